@@ -65,26 +65,50 @@ typedef struct {
   acq_dialog_widgets_t *w;
   gchar *cmd;
   gchar *extra;
+  VikTrwLayer *input; /* streamed to the command, or NULL */
 } w_and_interface_t;
 
 
+/* the layer filled as the data arrives */
+typedef struct {
+  acq_dialog_widgets_t *w;
+  VikTrwLayer *vtl;   /* what the user sees, NULL once deleted */
+  VikTrwLayer *stage; /* what is read goes here first, and is moved to vtl every so often */
+} acq_target_t;
+
+
 /*********************************************************
  * Definitions and routines for acquiring data from Data Sources in general
  *********************************************************/
 
-static void progress_func ( BabelProgressCode c, gpointer data, acq_dialog_widgets_t *w )
+/* the user has deleted it, wherever it was. called with the gdk lock held */
+static void acquire_layer_gone ( acq_target_t *t, GObject *vtl )
+{
+  t->vtl = NULL;
+}
+
+static void progress_func ( BabelProgressCode c, gpointer data, acq_target_t *t )
 {
+  acq_dialog_widgets_t *w = t->w;
+  gboolean ok;
+
   gdk_threads_enter ();
-  if (!w->ok) {
-    if ( w->source_interface->cleanup_func )
-      w->source_interface->cleanup_func( w->user_data );
-    g_free ( w );
-    gdk_threads_leave();
-    g_thread_exit ( NULL );
+  ok = w->ok;
+  if ( c == BABEL_PROGRESS ) {
+    BabelProgress *progress = data;
+    /* a cancelled dialog kills the program, not just us */
+    if ( ! ok || ! t->vtl )
+      progress->stop = TRUE;
+    else if ( progress->new_data ) {
+      /* at most once every BABEL_PROGRESS_MS, keeping the redraws down */
+      vik_trw_layer_steal_items ( t->vtl, t->stage );
+      vik_layer_emit_update ( VIK_LAYER(t->vtl) );
+    }
   }
   gdk_threads_leave ();
 
-  if ( w->source_interface->progress_func )
+  /* the dialog is gone once cancelled */
+  if ( ok && c != BABEL_PROGRESS && w->source_interface->progress_func )
     w->source_interface->progress_func ( (gpointer) c, data, w );
 }
 
@@ -94,8 +118,11 @@ static void get_from_anything ( w_and_interface_t *wi )
 {
   gchar *cmd = wi->cmd;
   gchar *extra = wi->extra;
+  VikTrwLayer *input = wi->input;
   gboolean result = TRUE;
   VikTrwLayer *vtl;
+  VikAggregateLayer *top;
+  acq_target_t target;
 
   gboolean creating_new_layer = TRUE;
 
@@ -105,6 +132,7 @@ static void get_from_anything ( w_and_interface_t *wi )
   wi = NULL;
 
   gdk_threads_enter();
+  top = vik_layers_panel_get_top_layer ( w->vlp );
   if (source_interface->mode == VIK_DATASOURCE_ADDTOLAYER) {
     VikLayer *current_selected = vik_layers_panel_get_selected ( w->vlp );
     if ( IS_VIK_TRW_LAYER(current_selected) ) {
@@ -115,19 +143,26 @@ static void get_from_anything ( w_and_interface_t *wi )
   if ( creating_new_layer ) {
     vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, w->vvp, NULL, FALSE ) );
     vik_layer_rename ( VIK_LAYER ( vtl ), _(source_interface->layer_title) );
+    /* there from the start, to fill up as the data comes */
+    vik_aggregate_layer_add_layer ( top, VIK_LAYER(vtl) );
     gtk_label_set_text ( GTK_LABEL(w->status), _("Working...") );
   }
+  target.w = w;
+  target.vtl = vtl;
+  /* told when it goes, whatever the user does with it */
+  g_object_weak_ref ( G_OBJECT ( vtl ), (GWeakNotify) acquire_layer_gone, &target );
+  target.stage = vik_trw_layer_new_detached ( vik_trw_layer_get_coord_mode ( vtl ) );
   gdk_threads_leave();
 
   switch ( source_interface->type ) {
   case VIK_DATASOURCE_GPSBABEL_DIRECT:
-    result = a_babel_convert_from (vtl, cmd, (BabelStatusFunc) progress_func, extra, w);
+    result = a_babel_convert_from (target.stage, cmd, (BabelStatusFunc) progress_func, extra, &target);
     break;
   case VIK_DATASOURCE_URL:
-    result = a_babel_convert_from_url (vtl, cmd, extra, (BabelStatusFunc) progress_func, w);
+    result = a_babel_convert_from_url (target.stage, cmd, extra, (BabelStatusFunc) progress_func, &target);
     break;
   case VIK_DATASOURCE_SHELL_CMD:
-    result = a_babel_convert_from_shellcommand ( vtl, cmd, extra, (BabelStatusFunc) progress_func, w);
+    result = a_babel_convert_from_filter ( target.stage, cmd, extra, input, (BabelStatusFunc) progress_func, &target);
     break;
   default:
     g_critical("Houston, we've had a problem.");
@@ -136,29 +171,34 @@ static void get_from_anything ( w_and_interface_t *wi )
   g_free ( cmd );
   g_free ( extra );
 
-  if (!result) {
-    gdk_threads_enter();
-    gtk_label_set_text ( GTK_LABEL(w->status), _("Error: acquisition failed.") );
-    if ( creating_new_layer )
-      g_object_unref ( G_OBJECT ( vtl ) );
-    gdk_threads_leave();
-  } 
-  else {
-    gdk_threads_enter();
-    if (w->ok) {
+  gdk_threads_enter();
+  if ( input )
+    g_object_unref ( G_OBJECT ( input ) );
+
+  /* what arrived last. what arrived before a cancel stays too */
+  if ( target.vtl ) {
+    g_object_weak_unref ( G_OBJECT ( vtl ), (GWeakNotify) acquire_layer_gone, &target );
+    vik_trw_layer_steal_items ( vtl, target.stage );
+    if ( creating_new_layer && ! g_hash_table_size ( vik_trw_layer_get_tracks ( vtl ) ) &&
+         ! g_hash_table_size ( vik_trw_layer_get_waypoints ( vtl ) ) &&
+         g_list_find ( (GList *) vik_aggregate_layer_get_children ( top ), vtl ) )
+      vik_aggregate_layer_delete ( top, &(VIK_LAYER(vtl)->iter) );
+    else
+      vik_layer_emit_update ( VIK_LAYER(vtl) );
+  }
+  g_object_unref ( G_OBJECT ( target.stage ) );
+
+  if (w->ok) {
+    if (!result)
+      gtk_label_set_text ( GTK_LABEL(w->status), _("Error: acquisition failed.") );
+    else {
       gtk_label_set_text ( GTK_LABEL(w->status), _("Done.") );
-      if ( creating_new_layer )
-	vik_aggregate_layer_add_layer( vik_layers_panel_get_top_layer(w->vlp), VIK_LAYER(vtl));
       if ( source_interface->keep_dialog_open ) {
         gtk_dialog_set_response_sensitive ( GTK_DIALOG(w->dialog), GTK_RESPONSE_ACCEPT, TRUE );
         gtk_dialog_set_response_sensitive ( GTK_DIALOG(w->dialog), GTK_RESPONSE_REJECT, FALSE );
       } else {
         gtk_dialog_response ( GTK_DIALOG(w->dialog), GTK_RESPONSE_ACCEPT );     
       }
-    } else {
-      /* canceled */
-      if ( creating_new_layer )
-	g_object_unref(vtl);
     }
   }
   if ( source_interface->cleanup_func )
@@ -222,6 +262,7 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
   VikLayerParamData *paramdatas = NULL;
 
   w_and_interface_t *wi;
+  VikTrwLayer *input = NULL;
 
   /*** INIT AND CHECK EXISTENCE ***/
   if ( source_interface->init_func )
@@ -270,13 +311,10 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
   /* CREATE INPUT DATA & GET COMMAND STRING */
 
   if ( source_interface->inputtype == VIK_DATASOURCE_INPUTTYPE_TRWLAYER ) {
-    gchar *name_src = write_tmp_trwlayer ( vtl );
-
+    /* the layer is piped to the command as it runs */
     ((VikDataSourceGetCmdStringFuncWithInput) source_interface->get_cmd_string_func)
-	( pass_along_data, &cmd, &extra, name_src );
-
-    g_free ( name_src );
-    /* TODO: delete the tmp file? or delete it only after we're done with it? */
+	( pass_along_data, &cmd, &extra, "-" );
+    input = vtl;
   } else if ( source_interface->inputtype == VIK_DATASOURCE_INPUTTYPE_TRWLAYER_TRACK ) {
     gchar *name_src = write_tmp_trwlayer ( vtl );
     gchar *name_src_track = write_tmp_track ( track );
@@ -315,6 +353,9 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
   wi->w->source_interface = source_interface;
   wi->cmd = cmd;
   wi->extra = extra; /* usually input data type (?) */
+  wi->input = input;
+  if ( input )
+    g_object_ref ( G_OBJECT ( input ) );
 
   dialog = gtk_dialog_new_with_buttons ( "", GTK_WINDOW(vw), 0, GTK_STOCK_OK, GTK_RESPONSE_ACCEPT, GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT, NULL );
   gtk_dialog_set_response_sensitive ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT, FALSE );
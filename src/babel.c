@@ -23,6 +23,12 @@
  * GPSBabel may not be necessary for everything -- for instance,
  *   use a_babel_convert_from_shellcommand with input_file_type == NULL
  *   for an external program that outputs GPX.
+ *
+ * Data goes to and from the programs through pipes: a file name of "-"
+ * after -f means our layer written as GPX to the standard input, after
+ * -F means the standard output read as GPX, while it is produced.
+ * What comes of filtering a layer is kept by babelcache.
+ * Stopping a program stops everything it started, as with a shell command.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -32,63 +38,73 @@
 #include "viking.h"
 #include "gpx.h"
 #include "babel.h"
+#include "babelcache.h"
 #include <stdio.h>
+#include <string.h>
 #ifdef HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifndef WINDOWS
+#include <poll.h>
+#include <errno.h>
+#endif
 #include <glib.h>
 #include <glib/gstdio.h>
 
 /* in the future we could have support for other shells (change command strings), or not use a shell at all */
 #define BASH_LOCATION "/bin/bash"
 
-gboolean a_babel_convert( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, gpointer user_data )
-{
-  int fd_src;
-  FILE *f;
-  gchar *name_src;
-  gboolean ret = FALSE;
-  gchar *bargs = g_strconcat(babelargs, " -i gpx", NULL);
+/* What goes to and comes from a program, all optional */
+typedef struct {
+  VikTrwLayer *in;      /* written to the standard input as GPX, */
+  GByteArray *in_data;  /* or these bytes */
+  VikTrwLayer *out;     /* the standard output read into it as GPX, */
+  GByteArray *out_data; /* and kept here too */
+  gboolean ok;          /* whether the program said it worked */
+} BabelPipes;
 
-  if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
-    f = fdopen(fd_src, "w");
-    a_gpx_write_file(vt, f);
-    fclose(f);
-    f = NULL;
-    ret = a_babel_convert_from ( vt, bargs, cb, name_src, user_data );
-  }
-
-  g_free(bargs);
-  g_remove(name_src);
-  g_free(name_src);
-  return ret;
-}
-
-/* Runs args[0] with the arguments and uses the GPX module
- * to import the GPX data into layer vt. Assumes that upon
- * running the command, the data will appear in the (usually
- * temporary) file name_dst.
+/* Runs args[0] with the arguments and pipes, see above.
  *
- * cb: callback that is run upon new data from STDOUT (?)
- *     (TODO: STDERR would be nice since we usually redirect STDOUT)
+ * cb: callback that is run upon each line of diagnostic output: the
+ *     standard output or, when that carries the data, the standard error
  * user_data: passed along to cb
  *
  * returns TRUE on success
  */
 #ifdef WINDOWS
-gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+/* the pipes are temporary files here, the arguments naming them */
+static gboolean babel_general_convert( gchar **args, BabelPipes *pipes, BabelStatusFunc cb, gpointer user_data )
 {
   gboolean ret;
-  FILE *f;
   gchar *cmd;
   gchar **args2;
+  gchar *name_src = NULL, *name_dst = NULL;
+  gchar *contents;
+  gsize len;
+  DWORD code;
+  gint i, fd;
   
   STARTUPINFO si;
   PROCESS_INFORMATION pi;
 
+  for (i = 1; args[i]; i++) {
+    if (strcmp(args[i], "-") || (strcmp(args[i-1], "-f") && strcmp(args[i-1], "-F")))
+      continue;
+    if ((fd = g_file_open_tmp("tmp-viking.XXXXXX", args[i-1][1] == 'f' ? &name_src : &name_dst, NULL)) < 0)
+      return FALSE;
+    close(fd);
+    args[i] = args[i-1][1] == 'f' ? name_src : name_dst;
+  }
+  if (name_src && ((pipes->in && !a_file_export(pipes->in, name_src, FILE_TYPE_GPX)) ||
+                   (pipes->in_data && !g_file_set_contents(name_src, (gchar *) pipes->in_data->data, pipes->in_data->len, NULL)))) {
+    g_warning("%s(): error exporting to %s", __FUNCTION__, name_src);
+    g_remove(name_src);
+    g_free(name_src);
+    return FALSE;
+  }
   
   ZeroMemory( &si, sizeof(si) );
   ZeroMemory( &pi, sizeof(pi) );
@@ -123,6 +139,7 @@ gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar
   else {
     WaitForSingleObject(pi.hProcess, INFINITE);
     WaitForSingleObject(pi.hThread, INFINITE);
+    pipes->ok = GetExitCodeProcess(pi.hProcess, &code) && code == 0;
     
     CloseHandle(pi.hThread);
     CloseHandle(pi.hProcess);
@@ -130,148 +147,414 @@ gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar
     if ( cb )
       cb(BABEL_DONE, NULL, user_data);
     
-    f = g_fopen(name_dst, "r");
-    a_gpx_read_file( vt, f );
-    fclose(f);
+    if (pipes->out && name_dst && g_file_get_contents(name_dst, &contents, &len, NULL)) {
+      GpxReader *reader = a_gpx_reader_new ( pipes->out );
+      a_gpx_reader_feed ( reader, contents, len );
+      a_gpx_reader_free ( reader );
+      if (pipes->out_data)
+        g_byte_array_append ( pipes->out_data, (guint8 *) contents, len );
+      g_free(contents);
+    }
     ret = TRUE;
   }
 
   g_strfreev( args2 );
   g_free( cmd );
+  if (name_src) {
+    g_remove(name_src);
+    g_free(name_src);
+  }
+  if (name_dst) {
+    g_remove(name_dst);
+    g_free(name_dst);
+  }
  
   return ret;
 }
+
+/* a layer's GPX */
+static GByteArray *babel_gpx ( VikTrwLayer *vtl )
+{
+  GByteArray *gpx = g_byte_array_new ();
+  gchar *name, *contents;
+  gsize len;
+  gint fd;
+
+  if ((fd = g_file_open_tmp("tmp-viking.XXXXXX", &name, NULL)) >= 0) {
+    close(fd);
+    gdk_threads_enter();
+    a_file_export(vtl, name, FILE_TYPE_GPX);
+    gdk_threads_leave();
+    if (g_file_get_contents(name, &contents, &len, NULL)) {
+      g_byte_array_append ( gpx, (guint8 *) contents, len );
+      g_free ( contents );
+    }
+    g_remove(name);
+    g_free(name);
+  }
+  return gpx;
+}
 /* Windows */
 #else
 /* Posix */
-gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+typedef struct {
+  VikTrwLayer *vtl;
+  GByteArray *data;
+  gint fd;
+  volatile gint done;
+} BabelWriter;
+
+/* The layer or bytes down a pipe, from a thread of its own so that what
+ * comes out of the program can be read meanwhile. The layer is the
+ * user's, so it is only looked at with the gdk lock held. */
+static gpointer babel_write ( BabelWriter *writer )
 {
-  gboolean ret = FALSE;
-  GPid pid;
-  GError *error = NULL;
-  gint babel_stdout;
-  FILE *f;
+  if ( writer->vtl ) {
+    FILE *f = fdopen ( writer->fd, "w" );
+    gdk_threads_enter();
+    a_gpx_write_file ( writer->vtl, f );
+    gdk_threads_leave();
+    fclose ( f );
+  } else {
+    guint done = 0;
+    while ( done < writer->data->len ) {
+      gssize len = write ( writer->fd, writer->data->data + done, writer->data->len - done );
+      if ( len < 0 && errno == EINTR )
+        continue;
+      if ( len <= 0 )
+        break; /* the program has stopped reading */
+      done += len;
+    }
+    close ( writer->fd );
+  }
+  g_atomic_int_set ( &(writer->done), TRUE );
+  return NULL;
+}
+
+static GThread *babel_write_start ( BabelWriter *writer, VikTrwLayer *vtl, GByteArray *data, gint fd )
+{
+  /* SIGPIPE is ignored from main(), a program going away early shows
+   * as a failed write */
+  writer->vtl = vtl;
+  writer->data = data;
+  writer->fd = fd;
+  writer->done = FALSE;
+  return g_thread_create ( (GThreadFunc) babel_write, writer, TRUE, NULL );
+}
+
+/* a layer's GPX */
+static GByteArray *babel_gpx ( VikTrwLayer *vtl )
+{
+  GByteArray *gpx = g_byte_array_new ();
+  BabelWriter writer;
+  GThread *writer_thread;
+  gint fds[2];
+  gchar buf[4096];
+  gssize len;
+
+  if ( pipe ( fds ) )
+    return gpx;
+  writer_thread = babel_write_start ( &writer, vtl, NULL, fds[1] );
+  while ( (len = read ( fds[0], buf, sizeof(buf) )) != 0 ) {
+    if ( len > 0 )
+      g_byte_array_append ( gpx, (guint8 *) buf, len );
+    else if ( errno != EINTR )
+      break;
+  }
+  close ( fds[0] );
+  g_thread_join ( writer_thread );
+  return gpx;
+}
+
+/* hands on the complete lines in diag, all of them at the end */
+static void babel_diag ( GString *diag, gboolean end, BabelStatusFunc cb, gpointer user_data )
+{
+  gchar *nl;
+
+  while ( (nl = strchr ( diag->str, '\n' )) || (end && diag->len) ) {
+    gsize len = nl ? nl - diag->str + 1 : diag->len;
+    gchar *line = g_strndup ( diag->str, len );
+    g_string_erase ( diag, 0, len );
+    if ( cb )
+      cb(BABEL_DIAG_OUTPUT, line, user_data);
+    g_free ( line );
+  }
+}
+
+/* its own process group, to be killed as a whole */
+static void babel_child_setup ( gpointer data )
+{
+  setpgid ( 0, 0 );
+}
 
+/* what has been read so far goes to the layer, then cb may stop the program */
+static gboolean babel_progress ( GpxReader *reader, gboolean new_data, GPid pid, BabelStatusFunc cb, gpointer user_data )
+{
+  BabelProgress progress = { new_data, FALSE };
 
-  if (!g_spawn_async_with_pipes (NULL, args, NULL, 0, NULL, NULL, &pid, NULL, &babel_stdout, NULL, &error)) {
+  if ( new_data ) {
+    gdk_threads_enter();
+    a_gpx_reader_flush ( reader );
+    gdk_threads_leave();
+  }
+  cb(BABEL_PROGRESS, &progress, user_data);
+  if ( progress.stop )
+    kill ( -pid, SIGTERM );
+  return progress.stop;
+}
+
+static gboolean babel_general_convert( gchar **args, BabelPipes *pipes, BabelStatusFunc cb, gpointer user_data )
+{
+  GPid pid;
+  GError *error = NULL;
+  gboolean in = pipes->in || pipes->in_data, out = pipes->out != NULL;
+  gint babel_stdin, babel_stdout, babel_stderr;
+  BabelWriter writer;
+  GThread *writer_thread = NULL;
+  GpxReader *reader = NULL;
+  GString *diag;
+  GTimer *since_progress;
+  gboolean new_data = FALSE, stopped = FALSE;
+  struct pollfd fds[2];
+  gint nfds, i, status;
+  gchar buf[4096];
+
+  if (!g_spawn_async_with_pipes (NULL, args, NULL, G_SPAWN_DO_NOT_REAP_CHILD, babel_child_setup, NULL, &pid,
+                                 in ? &babel_stdin : NULL, &babel_stdout, out ? &babel_stderr : NULL, &error)) {
     g_warning("Error : %s", error->message);
     g_error_free(error);
-    ret = FALSE;
-  } else {
-    gchar line[512];
-    FILE *diag;
-    diag = fdopen(babel_stdout, "r");
-    setvbuf(diag, NULL, _IONBF, 0);
-
-    while (fgets(line, sizeof(line), diag)) {
-      if ( cb )
-        cb(BABEL_DIAG_OUTPUT, line, user_data);
+    return FALSE;
+  }
+
+  if (in)
+    writer_thread = babel_write_start ( &writer, pipes->in, pipes->in_data, babel_stdin );
+  if (out)
+    reader = a_gpx_reader_new ( pipes->out );
+
+  /* fds[0] is the data if any, the last one the diagnostics */
+  nfds = 0;
+  if (out) {
+    fds[nfds].fd = babel_stdout;
+    fds[nfds++].events = POLLIN;
+  }
+  fds[nfds].fd = out ? babel_stderr : babel_stdout;
+  fds[nfds++].events = POLLIN;
+
+  diag = g_string_new ( NULL );
+  since_progress = g_timer_new ();
+  while ( fds[0].fd >= 0 || fds[nfds-1].fd >= 0 ) {
+    gint ready = poll ( fds, nfds, cb ? BABEL_PROGRESS_MS : -1 );
+    if ( ready < 0 && errno != EINTR )
+      break;
+    /* as with cb below, not while the writer may hold the gdk lock */
+    if ( cb && ! stopped && g_timer_elapsed ( since_progress, NULL ) * 1000 >= BABEL_PROGRESS_MS &&
+         ( ! writer_thread || g_atomic_int_get ( &(writer.done) ) ) ) {
+      stopped = babel_progress ( reader, new_data, pid, cb, user_data );
+      new_data = FALSE;
+      g_timer_start ( since_progress );
     }
-    if ( cb )
-      cb(BABEL_DONE, NULL, user_data);
-    fclose(diag);
-    diag = NULL;
-    waitpid(pid, NULL, 0);
-    g_spawn_close_pid(pid);
-
-    f = g_fopen(name_dst, "r");
-    if (f) {
-      a_gpx_read_file ( vt, f );
-      fclose(f);
-      f = NULL;
-      ret = TRUE;
+    if ( ready <= 0 )
+      continue;
+    for ( i = 0; i < nfds; i++ ) {
+      gssize len;
+      if ( fds[i].fd < 0 || ! fds[i].revents )
+        continue;
+      len = read ( fds[i].fd, buf, sizeof(buf) );
+      if ( len < 0 && errno == EINTR )
+        continue;
+      if ( len <= 0 ) {
+        close ( fds[i].fd );
+        fds[i].fd = -1; /* ignored by poll() from now on */
+      } else if ( out && i == 0 ) {
+        a_gpx_reader_feed ( reader, buf, len );
+        new_data = TRUE;
+        if ( pipes->out_data )
+          g_byte_array_append ( pipes->out_data, (guint8 *) buf, len );
+      } else {
+        g_string_append_len ( diag, buf, len );
+        /* cb takes the gdk lock, which the writer may hold a while */
+        if ( ! writer_thread || g_atomic_int_get ( &(writer.done) ) )
+          babel_diag ( diag, FALSE, cb, user_data );
+      }
     }
   }
-    
-  return ret;
+  for ( i = 0; i < nfds; i++ )
+    if ( fds[i].fd >= 0 )
+      close ( fds[i].fd );
+
+  if ( writer_thread )
+    g_thread_join ( writer_thread );
+  babel_diag ( diag, TRUE, cb, user_data );
+  g_string_free ( diag, TRUE );
+  g_timer_destroy ( since_progress );
+  if ( reader && cb ) {
+    /* the tracks handed on already get their last points */
+    gdk_threads_enter();
+    a_gpx_reader_free ( reader );
+    gdk_threads_leave();
+  } else if ( reader )
+    a_gpx_reader_free ( reader );
+
+  if ( cb )
+    cb(BABEL_DONE, NULL, user_data);
+  pipes->ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  g_spawn_close_pid(pid);
+
+  return ! stopped;
 }
 #endif /* Posix */
 
-gboolean a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, const char *from, gpointer user_data )
+/* A program filtering a layer gives the same each time it is run on the
+ * same GPX with the same arguments, so its output is kept in the cache. */
+static gboolean babel_convert_cached ( gchar **args, VikTrwLayer *in, VikTrwLayer *out, BabelStatusFunc cb, gpointer user_data )
 {
-  int i,j;
-  int fd_dst;
-  gchar *name_dst;
-  gboolean ret = FALSE;
-  gchar *args[64];
+  BabelPipes pipes = { NULL, NULL, out, NULL, FALSE };
+  gboolean ret = TRUE;
+  gchar *key, *fn;
+  FILE *f = NULL;
 
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    gchar *gpsbabel_loc;
-    close(fd_dst);
+  pipes.in_data = babel_gpx ( in );
+  key = a_babelcache_key ( pipes.in_data->data, pipes.in_data->len, args );
 
-    gpsbabel_loc = g_find_program_in_path("gpsbabel");
-
-    if (gpsbabel_loc ) {
-      gchar *unbuffer_loc = g_find_program_in_path("unbuffer");
-      gchar **sub_args = g_strsplit(babelargs, " ", 0);
-
-      i = 0;
-      if (unbuffer_loc)
-        args[i++] = unbuffer_loc;
-      args[i++] = gpsbabel_loc;
-      for (j = 0; sub_args[j]; j++) {
-        /* some version of gpsbabel can not take extra blank arg */
-        if (sub_args[j][0] != '\0')
-          args[i++] = sub_args[j];
+  if ( (fn = a_babelcache_lookup ( key )) ) {
+    f = g_fopen ( fn, "r" );
+    g_free ( fn );
+  }
+  if ( f ) {
+    /* into the layer as if the program were running, so the lock is taken alike */
+    GpxReader *reader = a_gpx_reader_new ( out );
+    GTimer *since_progress = g_timer_new ();
+    gchar buf[16384];
+    gsize len;
+
+    while ( (len = fread ( buf, 1, sizeof(buf), f )) > 0 ) {
+      a_gpx_reader_feed ( reader, buf, len );
+      if ( cb && g_timer_elapsed ( since_progress, NULL ) * 1000 >= BABEL_PROGRESS_MS ) {
+        BabelProgress progress = { TRUE, FALSE };
+        gdk_threads_enter();
+        a_gpx_reader_flush ( reader );
+        gdk_threads_leave();
+        cb(BABEL_PROGRESS, &progress, user_data);
+        if ( progress.stop ) {
+          ret = FALSE;
+          break;
+        }
+        g_timer_start ( since_progress );
       }
-      args[i++] = "-o";
-      args[i++] = "gpx";
-      args[i++] = "-f";
-      args[i++] = from;
-      args[i++] = "-F";
-      args[i++] = name_dst;
-      args[i] = NULL;
-
-      ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
-
-      g_free ( unbuffer_loc );
-      g_strfreev(sub_args);
+    }
+    fclose ( f );
+    g_timer_destroy ( since_progress );
+    if ( cb ) {
+      gdk_threads_enter();
+      a_gpx_reader_free ( reader );
+      gdk_threads_leave();
+      cb(BABEL_DONE, NULL, user_data);
     } else
-      g_warning("gpsbabel not found in PATH");
-    g_free(gpsbabel_loc);
+      a_gpx_reader_free ( reader );
+  } else {
+    pipes.out_data = g_byte_array_new ();
+    ret = babel_general_convert ( args, &pipes, cb, user_data );
+    if ( ret && pipes.ok )
+      a_babelcache_store ( key, pipes.out_data->data, pipes.out_data->len );
+    g_byte_array_free ( pipes.out_data, TRUE );
   }
 
-  g_remove(name_dst);
-  g_free(name_dst);
+  g_free ( key );
+  g_byte_array_free ( pipes.in_data, TRUE );
+  return ret;
+}
+
+static gboolean babel_convert ( gchar **args, VikTrwLayer *in, VikTrwLayer *out, BabelStatusFunc cb, gpointer user_data )
+{
+  BabelPipes pipes = { in, NULL, out, NULL, FALSE };
+
+  if ( in && out )
+    return babel_convert_cached ( args, in, out, cb, user_data );
+  return babel_general_convert ( args, &pipes, cb, user_data );
+}
+
+/* gpsbabel with the options in babelargs, the first arguments around them */
+static gboolean babel_convert_gpsbabel ( const char *babelargs, gchar **pre, gchar **post,
+                                         VikTrwLayer *in, VikTrwLayer *out, BabelStatusFunc cb, gpointer user_data )
+{
+  gboolean ret = FALSE;
+  gchar *args[64];
+  gchar *gpsbabel_loc = g_find_program_in_path("gpsbabel");
+  gint i, j;
+
+  if (gpsbabel_loc ) {
+    gchar **sub_args = g_strsplit(babelargs, " ", 0);
+
+    i = 0;
+    args[i++] = gpsbabel_loc;
+    for (j = 0; pre[j]; j++)
+      args[i++] = pre[j];
+    for (j = 0; sub_args[j]; j++)
+      /* some version of gpsbabel can not take extra blank arg */
+      if (sub_args[j][0] != '\0')
+        args[i++] = sub_args[j];
+    for (j = 0; post[j]; j++)
+      args[i++] = post[j];
+    args[i] = NULL;
+
+    ret = babel_convert ( args, in, out, cb, user_data );
+
+    g_strfreev(sub_args);
+  } else
+    g_warning("gpsbabel not found in PATH");
+  g_free(gpsbabel_loc);
+
   return ret;
 }
 
+gboolean a_babel_convert( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, gpointer user_data )
+{
+  gchar *pre[] = { NULL };
+  gchar *post[] = { "-i", "gpx", "-o", "gpx", "-f", "-", "-F", "-", NULL };
+
+  return babel_convert_gpsbabel ( babelargs, pre, post, vt, vt, cb, user_data );
+}
+
+gboolean a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, const char *from, gpointer user_data )
+{
+  gchar *pre[] = { NULL };
+  gchar *post[] = { "-o", "gpx", "-f", (gchar *) from, "-F", "-", NULL };
+
+  return babel_convert_gpsbabel ( babelargs, pre, post, NULL, vt, cb, user_data );
+}
+
 /* Runs the input command in a shell (bash) and optionally uses GPSBabel to convert from input_file_type.
  * If input_file_type is NULL, doesn't use GPSBabel. Input must be GPX (or Geocaching *.loc)
  *
- * Uses babel_general_convert_from to actually run the command. This function
- * prepares the command and temporary file, and sets up the arguments for bash.
+ * Uses babel_general_convert to actually run the command. This function
+ * prepares the command, and sets up the arguments for bash.
  */
 gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, BabelStatusFunc cb, gpointer user_data )
 {
-  int fd_dst;
-  gchar *name_dst;
-  gboolean ret = FALSE;
-  gchar **args;  
-
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    gchar *shell_command;
-    if ( input_file_type )
-      shell_command = g_strdup_printf("%s | gpsbabel -i %s -f - -o gpx -F %s", input_cmd, input_file_type, name_dst);
-    else
-      shell_command = g_strdup_printf("%s > %s", input_cmd, name_dst);
-
-    g_debug("%s: %s", __FUNCTION__, shell_command);
-    close(fd_dst);
-
-    args = g_malloc(sizeof(gchar *)*4);
-    args[0] = BASH_LOCATION;
-    args[1] = "-c";
-    args[2] = shell_command;
-    args[3] = NULL;
-
-    ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
-    g_free ( args );
-    g_free ( shell_command );
-  }
+  return a_babel_convert_from_filter ( vt, input_cmd, input_file_type, NULL, cb, user_data );
+}
+
+gboolean a_babel_convert_from_filter ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, VikTrwLayer *input,
+                                       BabelStatusFunc cb, gpointer user_data )
+{
+  gboolean ret;
+  gchar *args[4];
+  gchar *shell_command;
+
+  if ( input_file_type )
+    shell_command = g_strdup_printf("%s | gpsbabel -i %s -f - -o gpx -F -", input_cmd, input_file_type);
+  else
+    shell_command = g_strdup(input_cmd);
 
-  g_remove(name_dst);
-  g_free(name_dst);
+  g_debug("%s: %s", __FUNCTION__, shell_command);
+
+  args[0] = BASH_LOCATION;
+  args[1] = "-c";
+  args[2] = shell_command;
+  args[3] = NULL;
+
+  ret = babel_convert ( args, input, vt, cb, user_data );
+  g_free ( shell_command );
   return ret;
 }
 
@@ -294,7 +577,7 @@ gboolean a_babel_convert_from_url ( VikTrwLayer *vt, const char *url, const char
 
     fetch_ret = a_http_download_get_url(url, "", name_src, &options, NULL);
     if (fetch_ret == 0)
-      ret = a_babel_convert_from( vt, babelargs, NULL, name_src, NULL);
+      ret = a_babel_convert_from( vt, babelargs, cb, name_src, user_data);
  
     g_remove(name_src);
     g_free(babelargs);
@@ -304,157 +587,10 @@ gboolean a_babel_convert_from_url ( VikTrwLayer *vt, const char *url, const char
   return ret;
 }
 
-#ifdef WINDOWS
-gboolean babel_general_convert_to( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_src, gpointer user_data )
-{
-  gboolean ret;
-  gchar *cmd;
-  gchar **args2;
-  
-  if (!a_file_export(vt, name_src, FILE_TYPE_GPX)) {
-    g_warning("%s(): error exporting to %s", __FUNCTION__, name_src);
-    return(FALSE);
-  }
-       
-  STARTUPINFO si;
-  PROCESS_INFORMATION pi;
-
-  ZeroMemory( &si, sizeof(si) );
-  ZeroMemory( &pi, sizeof(pi) );
-  si.cb = sizeof(si);
-  si.dwFlags = STARTF_USESHOWWINDOW;
-  si.wShowWindow = SW_HIDE;
-  
-  
-  cmd = g_strjoinv( " ", args);
-  args2 = g_strsplit(cmd, "\\", 0);
-  cmd = g_strjoinv( "\\\\", args2);
-  g_free(args2);
-       args2 = g_strsplit(cmd, "/", 0);
-       g_free(cmd);
-       cmd = g_strjoinv( "\\\\", args2);
-       
-  if( !CreateProcess(
-             NULL,                   // No module name (use command line).
-        (LPTSTR)cmd,           // Command line.
-        NULL,                   // Process handle not inheritable.
-        NULL,                   // Thread handle not inheritable.
-        FALSE,                  // Set handle inheritance to FALSE.
-        0,                      // No creation flags.
-        NULL,                   // Use parent's environment block.
-        NULL,                   // Use parent's starting directory.
-        &si,                    // Pointer to STARTUPINFO structure.
-        &pi )                   // Pointer to PROCESS_INFORMATION structure.
-    ){
-    g_warning( "CreateProcess failed" );
-    ret = FALSE;
-  }
-  else {
-    
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    WaitForSingleObject(pi.hThread, INFINITE);
-    
-    CloseHandle(pi.hThread);
-    CloseHandle(pi.hProcess);
-
-    if ( cb )
-      cb(BABEL_DONE, NULL, user_data);
-    
-    ret = TRUE;
-  }
-  
-  g_strfreev(args2);
-  g_free( cmd );
-  
-  return ret;
-}
-/* Windows */
-#else
-/* Posix */
-gboolean babel_general_convert_to( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_src, gpointer user_data )
-{
-  gboolean ret = FALSE;
-  GPid pid;
-  GError *error = NULL;
-  gint babel_stdout;
-
-  if (!a_file_export(vt, name_src, FILE_TYPE_GPX)) {
-    g_warning("%s(): error exporting to %s", __FUNCTION__, name_src);
-    return(FALSE);
-  }
-
-  if (!g_spawn_async_with_pipes (NULL, args, NULL, 0, NULL, NULL, &pid, NULL, &babel_stdout, NULL, &error)) {
-    g_warning("Error : %s", error->message);
-    g_error_free(error);
-    ret = FALSE;
-  } else {
-    gchar line[512];
-    FILE *diag;
-    diag = fdopen(babel_stdout, "r");
-    setvbuf(diag, NULL, _IONBF, 0);
-
-    while (fgets(line, sizeof(line), diag)) {
-      if ( cb )
-        cb(BABEL_DIAG_OUTPUT, line, user_data);
-    }
-    if ( cb )
-      cb(BABEL_DONE, NULL, user_data);
-    fclose(diag);
-    diag = NULL;
-    waitpid(pid, NULL, 0);
-    g_spawn_close_pid(pid);
-
-    ret = TRUE;
-  }
-    
-  return ret;
-}
-#endif /* Posix */
-
 gboolean a_babel_convert_to( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, const char *to, gpointer user_data )
 {
-  int i,j;
-  int fd_src;
-  gchar *name_src;
-  gboolean ret = FALSE;
-  gchar *args[64];  
-
-  if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
-    gchar *gpsbabel_loc;
-    close(fd_src);
-
-    gpsbabel_loc = g_find_program_in_path("gpsbabel");
-
-    if (gpsbabel_loc ) {
-      gchar *unbuffer_loc = g_find_program_in_path("unbuffer");
-      gchar **sub_args = g_strsplit(babelargs, " ", 0);
-
-      i = 0;
-      if (unbuffer_loc)
-        args[i++] = unbuffer_loc;
-      args[i++] = gpsbabel_loc;
-      args[i++] = "-i";
-      args[i++] = "gpx";
-      for (j = 0; sub_args[j]; j++)
-        /* some version of gpsbabel can not take extra blank arg */
-        if (sub_args[j][0] != '\0')
-          args[i++] = sub_args[j];
-      args[i++] = "-f";
-      args[i++] = name_src;
-      args[i++] = "-F";
-      args[i++] = to;
-      args[i] = NULL;
-
-      ret = babel_general_convert_to ( vt, cb, args, name_src, user_data );
-
-      g_free ( unbuffer_loc );
-      g_strfreev(sub_args);
-    } else
-      g_warning("gpsbabel not found in PATH");
-    g_free(gpsbabel_loc);
-  }
+  gchar *pre[] = { "-i", "gpx", NULL };
+  gchar *post[] = { "-f", "-", "-F", (gchar *) to, NULL };
 
-  g_remove(name_src);
-  g_free(name_src);
-  return ret;
+  return babel_convert_gpsbabel ( babelargs, pre, post, vt, NULL, cb, user_data );
 }
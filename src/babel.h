@@ -30,10 +30,25 @@
 typedef enum {
   BABEL_DIAG_OUTPUT,
   BABEL_DONE,
+  BABEL_PROGRESS,
 } BabelProgressCode;
 
+/* passed with BABEL_PROGRESS */
+typedef struct {
+  gboolean new_data; /* more has been added to the layer since last time */
+  gboolean stop;     /* set by the callback to have the program killed */
+} BabelProgress;
+
 typedef void (*BabelStatusFunc)(BabelProgressCode, gpointer, gpointer);
 
+/*
+ * Giving a callback means being called from a worker thread without the gdk lock: what
+ * is read then goes into the layer as it arrives, long tracks included, a piece at a
+ * time with the gdk lock held, and cb gets BABEL_PROGRESS every BABEL_PROGRESS_MS
+ * to look at it or stop the program, in which case the call returns FALSE.
+ */
+#define BABEL_PROGRESS_MS 250
+
 /*
  * a_babel_convert modifies data in a trw layer using gpsbabel filters.  This routine is synchronous;
  * that is, it will block the calling program until the conversion is done.  To avoid blocking, call
@@ -44,9 +59,12 @@ typedef void (*BabelStatusFunc)(BabelProgressCode, gpointer, gpointer);
  * babelargs       A string containing gpsbabel command line filter options.  No file types or names should
  *                 be specified.
  * 
+ * The layer goes to gpsbabel through a pipe, so this must be called without the gdk lock held.
+ *
  * cb		   A callback function, called with the following status codes:
  *                   BABEL_DIAG_OUTPUT: a line of diagnostic output is available.  The pointer is to a 
  *                                      NUL-terminated line of diagnostic output from gpsbabel.
+ *                   BABEL_PROGRESS: gpsbabel is still running, the pointer is to a BabelProgress.
  *                   BABEL_DIAG_DONE: gpsbabel finished,
  *                 or NULL if no callback is needed.
  */
@@ -66,6 +84,13 @@ int a_babel_convert( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb,
  */
 int a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, const char *file, gpointer user_data );
 gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, BabelStatusFunc cb, gpointer user_data );
+/*
+ * as a_babel_convert_from_shellcommand, with input written as GPX to the command's standard input
+ * (a gpsbabel "-f -") while its output is read. Must be called without the gdk lock held, the
+ * input layer is only read with it.
+ */
+gboolean a_babel_convert_from_filter ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, VikTrwLayer *input,
+                                       BabelStatusFunc cb, gpointer user_data );
 gboolean a_babel_convert_from_url ( VikTrwLayer *vt, const char *url, const char *input_type, BabelStatusFunc cb, gpointer user_data );
 int a_babel_convert_to( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, const char *file, gpointer user_data );
 
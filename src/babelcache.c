@@ -0,0 +1,155 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef WINDOWS
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "file.h"
+#include "md5.h"
+#include "babelcache.h"
+
+typedef struct {
+  gchar *fn;
+  off_t size;
+  time_t used;
+} BabelCacheEntry;
+
+/* the counts, and the files while they are weeded */
+G_LOCK_DEFINE_STATIC(babelcache);
+static guint hits = 0, lookups = 0;
+
+static gchar *babelcache_dir ()
+{
+  gchar *dir = g_build_filename ( a_get_viking_dir(), "babelcache", NULL );
+  g_mkdir_with_parents ( dir, 0755 );
+  return dir;
+}
+
+gchar *a_babelcache_key ( const guint8 *input, gsize len, gchar **args )
+{
+  MD5Context ctx;
+
+  a_md5_init ( &ctx );
+  a_md5_update ( &ctx, input, len );
+  for ( ; *args; args++ )
+    a_md5_update ( &ctx, (const guint8 *) *args, strlen ( *args ) + 1 );
+  return a_md5_final ( &ctx );
+}
+
+gchar *a_babelcache_lookup ( const gchar *key )
+{
+  gchar *dir = babelcache_dir ();
+  gchar *fn = g_build_filename ( dir, key, NULL );
+  gboolean found = g_file_test ( fn, G_FILE_TEST_IS_REGULAR );
+  guint h, l;
+
+  g_free ( dir );
+  if ( found )
+    utime ( fn, NULL ); /* used now */
+
+  G_LOCK(babelcache);
+  lookups++;
+  if ( found )
+    hits++;
+  h = hits;
+  l = lookups;
+  G_UNLOCK(babelcache);
+  g_debug ( "%s: %s %s, %u of %u found", __FUNCTION__, key, found ? "hit" : "miss", h, l );
+
+  if ( ! found ) {
+    g_free ( fn );
+    return NULL;
+  }
+  return fn;
+}
+
+static gint babelcache_entry_compare ( gconstpointer a, gconstpointer b )
+{
+  time_t t1 = ((BabelCacheEntry *) a)->used, t2 = ((BabelCacheEntry *) b)->used;
+  return t1 < t2 ? -1 : t1 > t2;
+}
+
+/* the least recently used go until the rest fit */
+static void babelcache_evict ( const gchar *dir )
+{
+  GDir *d = g_dir_open ( dir, 0, NULL );
+  GArray *entries = g_array_new ( FALSE, FALSE, sizeof(BabelCacheEntry) );
+  const gchar *name;
+  guint64 total = 0;
+  guint i;
+
+  if ( ! d )
+    return;
+  while ( (name = g_dir_read_name ( d )) ) {
+    BabelCacheEntry e;
+    struct stat st;
+    e.fn = g_build_filename ( dir, name, NULL );
+    if ( g_stat ( e.fn, &st ) == 0 && S_ISREG(st.st_mode) ) {
+      e.size = st.st_size;
+      e.used = st.st_mtime;
+      total += e.size;
+      g_array_append_val ( entries, e );
+    } else
+      g_free ( e.fn );
+  }
+  g_dir_close ( d );
+
+  if ( total > BABELCACHE_MAX_SIZE )
+    g_array_sort ( entries, babelcache_entry_compare );
+  for ( i = 0; i < entries->len; i++ ) {
+    BabelCacheEntry *e = &g_array_index ( entries, BabelCacheEntry, i );
+    if ( total > BABELCACHE_MAX_SIZE && g_remove ( e->fn ) == 0 )
+      total -= e->size;
+    g_free ( e->fn );
+  }
+  g_array_free ( entries, TRUE );
+}
+
+void a_babelcache_store ( const gchar *key, const guint8 *output, gsize len )
+{
+  gchar *dir = babelcache_dir ();
+  gchar *fn = g_build_filename ( dir, key, NULL );
+  GError *error = NULL;
+
+  /* written aside and renamed, so never seen half done */
+  if ( ! g_file_set_contents ( fn, (const gchar *) output, len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  } else {
+    G_LOCK(babelcache);
+    babelcache_evict ( dir );
+    G_UNLOCK(babelcache);
+  }
+  g_free ( fn );
+  g_free ( dir );
+}
@@ -0,0 +1,41 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_BABELCACHE_H
+#define _VIKING_BABELCACHE_H
+
+#include <glib.h>
+
+/* What gpsbabel and the filters make of a layer, kept on disk under the
+ * viking directory and found again by the MD5 of the GPX they were given
+ * and of their arguments. The least recently used files go once all of
+ * them take more than this many bytes. */
+#define BABELCACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* to be freed */
+gchar *a_babelcache_key ( const guint8 *input, gsize len, gchar **args );
+
+/* the name of the file holding the output for key, to be freed, or NULL */
+gchar *a_babelcache_lookup ( const gchar *key );
+
+void a_babelcache_store ( const gchar *key, const guint8 *output, gsize len );
+
+#endif
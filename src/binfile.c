@@ -0,0 +1,618 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "viking.h"
+#include "binfile.h"
+#include "marshall.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#include <zlib.h>
+#define BINFILE_ZLIB 1
+#endif
+
+/*
+ * All integers and doubles are little endian, strings and coordinates as
+ * marshall.h has them.
+ *
+ * header:  magic[4] u16:version u16:flags u64:payload_len u64:stored_len
+ * payload: sections, each tag[4] u16:version u64:len body[len]
+ *          (the payload is zlib compressed when flags has BINFILE_FLAG_ZLIB)
+ *
+ * VIEW  viewport settings, first in the payload
+ * LAYR  starts a layer: type, name, visibility and parameters. It is followed
+ *       by the sections holding the layer's data and by its children, then ENDL.
+ * TRWD  waypoints and tracks of the enclosing TrackWaypoint layer, their
+ *       fields as the clipboard has them; trackpoints are records of a size
+ *       given up front, so a reader skips the fields it doesn't know.
+ * ENDL  closes the innermost LAYR
+ *
+ * Unknown sections are skipped, as are bytes after the fields a reader knows
+ * about, so new fields go at the end of a section without changing its version.
+ * A section only gets a new version when its existing fields change.
+ */
+
+#define BINFILE_VERSION 1
+#define BINFILE_FLAG_ZLIB 0x1
+#define BINFILE_HEADER_LEN 24
+#define SECTION_HEADER_LEN 14
+
+#define TAG_VIEW "VIEW"
+#define TAG_LAYER "LAYR"
+#define TAG_END_LAYER "ENDL"
+#define TAG_TRW_DATA "TRWD"
+
+#define VIEW_VERSION 1
+#define LAYER_VERSION 1
+#define TRW_DATA_VERSION 1
+
+/* returns where the length goes, for section_end() */
+static guint section_begin ( GByteArray *b, const gchar *tag, guint16 version )
+{
+  guint len_pos;
+  g_byte_array_append ( b, (const guint8 *) tag, 4 );
+  a_marshall_uint16 ( b, version );
+  len_pos = b->len;
+  a_marshall_uint64 ( b, 0 );
+  return len_pos;
+}
+
+static void section_end ( GByteArray *b, guint len_pos )
+{
+  a_marshall_set_uint64 ( b, len_pos, b->len - len_pos - 8 );
+}
+
+/* FALSE at the end of r. body is set to a reader covering only the section. */
+static gboolean get_section ( MarshallReader *r, gchar tag[4], guint16 *version, MarshallReader *body )
+{
+  if ( r->error || r->left == 0 )
+    return FALSE;
+  if ( r->left < SECTION_HEADER_LEN ) {
+    r->error = TRUE;
+    return FALSE;
+  }
+  memcpy ( tag, r->data, 4 );
+  r->data += 4;
+  r->left -= 4;
+  *version = a_unmarshall_uint16 ( r );
+  return a_unmarshall_part ( r, a_unmarshall_uint64 ( r ), body );
+}
+
+/* ---------------------------------------------------- */
+
+static gint layer_type_from_name ( const gchar *name )
+{
+  gint i;
+  if ( name )
+    for ( i = 0; i < VIK_LAYER_NUM_TYPES; i++ )
+      if ( strcasecmp ( name, vik_layer_get_interface(i)->name ) == 0 )
+        return i;
+  return -1;
+}
+
+static const gchar *drawmode_name ( VikViewportDrawMode mode )
+{
+  switch ( mode ) {
+    case VIK_VIEWPORT_DRAWMODE_UTM: return "utm";
+    case VIK_VIEWPORT_DRAWMODE_EXPEDIA: return "expedia";
+    case VIK_VIEWPORT_DRAWMODE_MERCATOR: return "mercator";
+    default:
+      g_critical("Houston, we've had a problem. mode=%d", mode);
+      return NULL;
+  }
+}
+
+static void write_viewport ( GByteArray *b, VikAggregateLayer *top, VikViewport *vp )
+{
+  struct LatLon ll;
+  guint len_pos = section_begin ( b, TAG_VIEW, VIEW_VERSION );
+
+  vik_coord_to_latlon ( vik_viewport_get_center ( vp ), &ll );
+  a_marshall_double ( b, vik_viewport_get_xmpp ( vp ) );
+  a_marshall_double ( b, vik_viewport_get_ympp ( vp ) );
+  a_marshall_double ( b, ll.lat );
+  a_marshall_double ( b, ll.lon );
+  a_marshall_string ( b, drawmode_name ( vik_viewport_get_drawmode ( vp ) ) );
+  a_marshall_string ( b, vik_viewport_get_background_color ( vp ) );
+  a_marshall_uint8 ( b, vik_viewport_get_draw_scale ( vp ) );
+  a_marshall_uint8 ( b, vik_viewport_get_draw_centermark ( vp ) );
+  a_marshall_uint8 ( b, VIK_LAYER(top)->visible );
+
+  section_end ( b, len_pos );
+}
+
+static void read_viewport ( MarshallReader *r, VikAggregateLayer *top, VikViewport *vp )
+{
+  struct LatLon ll;
+  gdouble xmpp, ympp;
+  gchar *mode, *color;
+  gboolean draw_scale, draw_centermark, visible;
+
+  xmpp = a_unmarshall_double ( r );
+  ympp = a_unmarshall_double ( r );
+  ll.lat = a_unmarshall_double ( r );
+  ll.lon = a_unmarshall_double ( r );
+  mode = a_unmarshall_string ( r );
+  color = a_unmarshall_string ( r );
+  draw_scale = a_unmarshall_uint8 ( r );
+  draw_centermark = a_unmarshall_uint8 ( r );
+  visible = a_unmarshall_uint8 ( r );
+
+  if ( r->error )
+    g_warning ( "%s: truncated viewport settings", __FUNCTION__ );
+  else
+  {
+    vik_viewport_set_xmpp ( vp, xmpp );
+    vik_viewport_set_ympp ( vp, ympp );
+    if ( mode && strcmp ( mode, "utm" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_UTM );
+    else if ( mode && strcmp ( mode, "expedia" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_EXPEDIA );
+    else if ( mode && strcmp ( mode, "mercator" ) == 0 )
+      vik_viewport_set_drawmode ( vp, VIK_VIEWPORT_DRAWMODE_MERCATOR );
+    else if ( mode )
+      g_warning ( _("Draw mode '%s' no more supported"), mode );
+    else
+      g_warning ( "%s: no draw mode, keeping the current one", __FUNCTION__ );
+    if ( color )
+      vik_viewport_set_background_color ( vp, color );
+    vik_viewport_set_draw_scale ( vp, draw_scale );
+    vik_viewport_set_draw_centermark ( vp, draw_centermark );
+    VIK_LAYER(top)->visible = visible;
+    if ( ll.lat != 0.0 || ll.lon != 0.0 )
+      vik_viewport_set_center_latlon ( vp, &ll );
+  }
+  g_free ( mode );
+  g_free ( color );
+}
+
+/* ---------------------------------------------------- */
+
+static void write_layer_params ( GByteArray *b, VikLayer *l )
+{
+  VikLayerInterface *layer_interface = vik_layer_get_interface ( l->type );
+  guint16 i, params_count = ( layer_interface->params && layer_interface->get_param ) ? layer_interface->params_count : 0;
+
+  a_marshall_string ( b, layer_interface->name );
+  a_marshall_string ( b, l->name ? l->name : "" );
+  a_marshall_uint8 ( b, l->visible );
+
+  a_marshall_uint16 ( b, params_count );
+  for ( i = 0; i < params_count; i++ )
+  {
+    VikLayerParamData data = layer_interface->get_param ( l, i );
+    a_marshall_string ( b, layer_interface->params[i].name );
+    a_marshall_uint8 ( b, layer_interface->params[i].type );
+    switch ( layer_interface->params[i].type )
+    {
+      case VIK_LAYER_PARAM_DOUBLE: a_marshall_double ( b, data.d ); break;
+      case VIK_LAYER_PARAM_UINT: a_marshall_uint32 ( b, data.u ); break;
+      case VIK_LAYER_PARAM_INT: a_marshall_uint32 ( b, (guint32) data.i ); break;
+      case VIK_LAYER_PARAM_BOOLEAN: a_marshall_uint8 ( b, data.b ? 1 : 0 ); break;
+      case VIK_LAYER_PARAM_STRING: a_marshall_string ( b, data.s ); break;
+      case VIK_LAYER_PARAM_COLOR:
+        a_marshall_uint16 ( b, data.c.red );
+        a_marshall_uint16 ( b, data.c.green );
+        a_marshall_uint16 ( b, data.c.blue );
+        break;
+      case VIK_LAYER_PARAM_STRING_LIST: {
+        const GList *iter;
+        a_marshall_uint32 ( b, g_list_length ( data.sl ) );
+        for ( iter = data.sl; iter; iter = iter->next )
+          a_marshall_string ( b, (const gchar *) iter->data );
+        break;
+      }
+    }
+  }
+}
+
+/* parameters are normally in the same order as when they were written */
+static gint find_param ( VikLayerInterface *layer_interface, guint16 hint, const gchar *name )
+{
+  guint16 i;
+  if ( ! name || ! layer_interface->params )
+    return -1;
+  if ( hint < layer_interface->params_count && strcmp ( layer_interface->params[hint].name, name ) == 0 )
+    return hint;
+  for ( i = 0; i < layer_interface->params_count; i++ )
+    if ( strcmp ( layer_interface->params[i].name, name ) == 0 )
+      return i;
+  return -1;
+}
+
+static void read_layer_params ( MarshallReader *r, VikLayer *l, VikViewport *vp )
+{
+  VikLayerInterface *layer_interface = vik_layer_get_interface ( l->type );
+  guint16 i, params_count = a_unmarshall_uint16 ( r );
+
+  for ( i = 0; i < params_count && ! r->error; i++ )
+  {
+    VikLayerParamData x;
+    gchar *name = a_unmarshall_string ( r );
+    guint8 type = a_unmarshall_uint8 ( r );
+    gchar *s = NULL;
+    GList *sl = NULL;
+    gint id;
+
+    switch ( type )
+    {
+      case VIK_LAYER_PARAM_DOUBLE: x.d = a_unmarshall_double ( r ); break;
+      case VIK_LAYER_PARAM_UINT: x.u = a_unmarshall_uint32 ( r ); break;
+      case VIK_LAYER_PARAM_INT: x.i = (gint32) a_unmarshall_uint32 ( r ); break;
+      case VIK_LAYER_PARAM_BOOLEAN: x.b = a_unmarshall_uint8 ( r ); break;
+      case VIK_LAYER_PARAM_STRING: s = a_unmarshall_string ( r ); x.s = s ? s : ""; break;
+      case VIK_LAYER_PARAM_COLOR:
+        memset ( &(x.c), 0, sizeof(x.c) );
+        x.c.red = a_unmarshall_uint16 ( r );
+        x.c.green = a_unmarshall_uint16 ( r );
+        x.c.blue = a_unmarshall_uint16 ( r );
+        break;
+      case VIK_LAYER_PARAM_STRING_LIST: {
+        guint32 j, count = a_unmarshall_uint32 ( r );
+        for ( j = 0; j < count && ! r->error; j++ )
+          sl = g_list_prepend ( sl, a_unmarshall_string ( r ) );
+        x.sl = sl = g_list_reverse ( sl );
+        break;
+      }
+      default:
+        /* can't know how long the value is, so can't find the next one either */
+        g_warning ( "%s: parameter %s has unknown type %d", __FUNCTION__, name, type );
+        g_free ( name );
+        return;
+    }
+
+    id = find_param ( layer_interface, i, name );
+    if ( r->error )
+      ;
+    else if ( id == -1 || layer_interface->params[id].type != type )
+      g_warning ( "%s: unknown parameter %s for layer type %s", __FUNCTION__, name, layer_interface->name );
+    else
+    {
+      vik_layer_set_param ( l, id, x, vp );
+      sl = NULL; /* string list is the layer's responsibility now */
+    }
+
+    if ( sl ) {
+      g_list_foreach ( sl, (GFunc) g_free, NULL );
+      g_list_free ( sl );
+    }
+    g_free ( s );
+    g_free ( name );
+  }
+}
+
+/* ---------------------------------------------------- */
+
+static void write_waypoint ( const gchar *name, VikWaypoint *wp, GByteArray *b )
+{
+  a_marshall_string ( b, name );
+  vik_waypoint_marshall_fields ( wp, b );
+}
+
+static void write_track ( const gchar *name, VikTrack *t, GByteArray *b )
+{
+  GList *iter;
+
+  a_marshall_string ( b, name );
+  a_marshall_uint8 ( b, t->visible );
+  a_marshall_string ( b, t->comment );
+  a_marshall_uint32 ( b, g_list_length ( t->trackpoints ) );
+  for ( iter = t->trackpoints; iter; iter = iter->next )
+    vik_trackpoint_marshall_fields ( VIK_TRACKPOINT(iter->data), b );
+}
+
+static void write_trw_data ( GByteArray *b, VikTrwLayer *vtl )
+{
+  GHashTable *waypoints = vik_trw_layer_get_waypoints ( vtl );
+  GHashTable *tracks = vik_trw_layer_get_tracks ( vtl );
+
+  a_marshall_uint16 ( b, VIK_TRACKPOINT_MARSHALL_SIZE );
+  a_marshall_uint32 ( b, g_hash_table_size ( waypoints ) );
+  g_hash_table_foreach ( waypoints, (GHFunc) write_waypoint, b );
+  a_marshall_uint32 ( b, g_hash_table_size ( tracks ) );
+  g_hash_table_foreach ( tracks, (GHFunc) write_track, b );
+}
+
+static void read_trw_data ( MarshallReader *r, VikTrwLayer *vtl )
+{
+  VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+  guint16 tp_len = a_unmarshall_uint16 ( r );
+  guint32 i, j, n;
+
+  if ( tp_len < VIK_TRACKPOINT_MARSHALL_SIZE ) {
+    g_warning ( "%s: bad trackpoint record length %d", __FUNCTION__, tp_len );
+    return;
+  }
+
+  n = a_unmarshall_uint32 ( r );
+  for ( i = 0; i < n && ! r->error; i++ )
+  {
+    gchar *name = a_unmarshall_string ( r );
+    VikWaypoint *wp = vik_waypoint_new ();
+
+    vik_waypoint_unmarshall_fields ( wp, r );
+    if ( r->error || ! name )
+      vik_waypoint_free ( wp );
+    else
+    {
+      if ( wp->coord.mode != mode )
+        vik_coord_convert ( &(wp->coord), mode );
+      vik_trw_layer_filein_add_waypoint ( vtl, name, wp );
+    }
+    g_free ( name );
+  }
+
+  n = a_unmarshall_uint32 ( r );
+  for ( i = 0; i < n && ! r->error; i++ )
+  {
+    gchar *name = a_unmarshall_string ( r );
+    gboolean visible = a_unmarshall_uint8 ( r );
+    gchar *comment = a_unmarshall_string ( r );
+    guint32 n_points = a_unmarshall_uint32 ( r );
+    MarshallReader points;
+    VikTrack *tr;
+
+    if ( ! name || ! a_unmarshall_part ( r, (guint64) n_points * tp_len, &points ) ) {
+      g_free ( name );
+      g_free ( comment );
+      break;
+    }
+
+    tr = vik_track_new ();
+    tr->visible = visible;
+    vik_track_set_comment_no_copy ( tr, comment );
+    for ( j = 0; j < n_points; j++ )
+    {
+      /* tp_len is longer when a newer version added fields: skip those */
+      MarshallReader record;
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      a_unmarshall_part ( &points, tp_len, &record );
+      vik_trackpoint_unmarshall_fields ( tp, &record );
+      if ( tp->coord.mode != mode )
+        vik_coord_convert ( &(tp->coord), mode );
+      tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+    }
+    tr->trackpoints = g_list_reverse ( tr->trackpoints );
+
+    vik_trw_layer_filein_add_track ( vtl, name, tr );
+    g_free ( name );
+  }
+}
+
+/* ---------------------------------------------------- */
+
+static void write_layer ( GByteArray *b, VikLayer *l )
+{
+  const GList *children = NULL;
+  guint len_pos;
+
+  len_pos = section_begin ( b, TAG_LAYER, LAYER_VERSION );
+  write_layer_params ( b, l );
+  section_end ( b, len_pos );
+
+  if ( l->type == VIK_LAYER_TRW )
+  {
+    len_pos = section_begin ( b, TAG_TRW_DATA, TRW_DATA_VERSION );
+    write_trw_data ( b, VIK_TRW_LAYER(l) );
+    section_end ( b, len_pos );
+  }
+
+  if ( l->type == VIK_LAYER_AGGREGATE )
+    children = vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(l) );
+  else if ( l->type == VIK_LAYER_GPS )
+    children = vik_gps_layer_get_children ( VIK_GPS_LAYER(l) );
+  for ( ; children; children = children->next )
+    write_layer ( b, VIK_LAYER(children->data) );
+
+  section_end ( b, section_begin ( b, TAG_END_LAYER, LAYER_VERSION ) );
+}
+
+/* NULL if the layer can't be used; its contents are then skipped */
+static VikLayer *read_layer ( MarshallReader *r, VikLayer *parent, VikViewport *vp )
+{
+  gchar *type_name = a_unmarshall_string ( r );
+  gchar *name = a_unmarshall_string ( r );
+  gboolean visible = a_unmarshall_uint8 ( r );
+  gint type = layer_type_from_name ( type_name );
+  VikLayer *l = NULL;
+
+  if ( ! parent )
+    ; /* inside a layer we are skipping */
+  else if ( parent->type != VIK_LAYER_AGGREGATE && parent->type != VIK_LAYER_GPS )
+    g_warning ( "%s: Layer inside non-Aggregate Layer (type %d)", __FUNCTION__, parent->type );
+  else if ( type == -1 )
+    g_warning ( "%s: Unknown type %s", __FUNCTION__, type_name );
+  else if ( parent->type == VIK_LAYER_GPS )
+    l = VIK_LAYER(vik_gps_layer_get_a_child ( VIK_GPS_LAYER(parent) ));
+  else
+    l = vik_layer_create ( type, vp, NULL, FALSE );
+
+  if ( l )
+  {
+    vik_layer_rename ( l, name ? name : "" );
+    l->visible = visible;
+    read_layer_params ( r, l, vp );
+  }
+
+  g_free ( type_name );
+  g_free ( name );
+  return l;
+}
+
+/* Reads sections up to the ENDL closing layer, or to the end of the payload */
+static void read_layer_contents ( MarshallReader *r, VikLayer *layer, VikViewport *vp )
+{
+  gchar tag[4];
+  guint16 version;
+  MarshallReader body;
+
+  while ( get_section ( r, tag, &version, &body ) )
+  {
+    if ( memcmp ( tag, TAG_END_LAYER, 4 ) == 0 )
+      return;
+    else if ( memcmp ( tag, TAG_LAYER, 4 ) == 0 )
+    {
+      VikLayer *child = version <= LAYER_VERSION ? read_layer ( &body, layer, vp ) : NULL;
+      read_layer_contents ( r, child, vp );
+      if ( child && layer->type == VIK_LAYER_AGGREGATE )
+      {
+        vik_aggregate_layer_add_layer ( VIK_AGGREGATE_LAYER(layer), child );
+        vik_layer_post_read ( child, vp, TRUE );
+      }
+    }
+    else if ( memcmp ( tag, TAG_TRW_DATA, 4 ) == 0 )
+    {
+      if ( layer && layer->type == VIK_LAYER_TRW && version <= TRW_DATA_VERSION )
+        read_trw_data ( &body, VIK_TRW_LAYER(layer) );
+    }
+    /* anything else is from a newer version: skip it */
+  }
+}
+
+/* ---------------------------------------------------- */
+
+gboolean a_binfile_read ( VikAggregateLayer *top, FILE *f, VikViewport *vp )
+{
+  guint8 header[BINFILE_HEADER_LEN];
+  guint16 version, flags;
+  guint64 payload_len, stored_len;
+  guint8 *payload;
+  MarshallReader r, body;
+  gchar tag[4];
+
+  if ( fread ( header, sizeof(header), 1, f ) != 1 || memcmp ( header, BINFILE_MAGIC, BINFILE_MAGIC_LEN ) != 0 )
+    return FALSE;
+
+  a_marshall_reader_init ( &r, header+BINFILE_MAGIC_LEN, sizeof(header)-BINFILE_MAGIC_LEN );
+  version = a_unmarshall_uint16 ( &r );
+  flags = a_unmarshall_uint16 ( &r );
+  payload_len = a_unmarshall_uint64 ( &r );
+  stored_len = a_unmarshall_uint64 ( &r );
+  if ( version > BINFILE_VERSION ) {
+    g_warning ( "%s: file format version %d is newer than this program's (%d)", __FUNCTION__, version, BINFILE_VERSION );
+    return FALSE;
+  }
+  if ( payload_len > G_MAXSIZE || stored_len > G_MAXSIZE )
+    return FALSE;
+
+  /* the whole payload in one go */
+  payload = g_try_malloc ( stored_len );
+  if ( ! payload || fread ( payload, 1, stored_len, f ) != stored_len ) {
+    g_warning ( "%s: could not read %" G_GUINT64_FORMAT " bytes", __FUNCTION__, stored_len );
+    g_free ( payload );
+    return FALSE;
+  }
+
+  if ( flags & BINFILE_FLAG_ZLIB )
+  {
+#ifdef BINFILE_ZLIB
+    uLongf len = payload_len;
+    guint8 *stored = payload;
+    payload = g_try_malloc ( payload_len );
+    if ( ! payload || uncompress ( payload, &len, stored, stored_len ) != Z_OK || len != payload_len ) {
+      g_warning ( "%s: corrupt compressed data", __FUNCTION__ );
+      g_free ( payload );
+      g_free ( stored );
+      return FALSE;
+    }
+    g_free ( stored );
+#else
+    g_warning ( "%s: file is compressed, but this program was built without zlib", __FUNCTION__ );
+    g_free ( payload );
+    return FALSE;
+#endif
+  }
+  else
+    payload_len = stored_len;
+
+  a_marshall_reader_init ( &r, payload, payload_len );
+
+  if ( get_section ( &r, tag, &version, &body ) && memcmp ( tag, TAG_VIEW, 4 ) == 0 ) {
+    if ( version <= VIEW_VERSION )
+      read_viewport ( &body, top, vp );
+  } else
+    a_marshall_reader_init ( &r, payload, payload_len );
+
+  /* only stops early on a mismatched ENDL */
+  while ( r.left > 0 && ! r.error )
+    read_layer_contents ( &r, VIK_LAYER(top), vp );
+
+  if ( r.error )
+    g_warning ( "%s: file is truncated", __FUNCTION__ );
+  g_free ( payload );
+
+  if ( ( ! VIK_LAYER(top)->visible ) && VIK_LAYER(top)->realized )
+    vik_treeview_item_set_visible ( VIK_LAYER(top)->vt, &(VIK_LAYER(top)->iter), FALSE );
+
+  return TRUE;
+}
+
+gboolean a_binfile_write ( VikAggregateLayer *top, FILE *f, VikViewport *vp )
+{
+  GByteArray *b = g_byte_array_new ();
+  GByteArray *header;
+  guint8 *compressed = NULL;
+  const guint8 *stored;
+  guint64 stored_len;
+  guint16 flags = 0;
+  const GList *children;
+  gboolean rv;
+
+  write_viewport ( b, top, vp );
+  for ( children = vik_aggregate_layer_get_children ( top ); children; children = children->next )
+    write_layer ( b, VIK_LAYER(children->data) );
+
+  stored = b->data;
+  stored_len = b->len;
+#ifdef BINFILE_ZLIB
+  {
+    /* favour load & save time over size */
+    uLongf len = compressBound ( b->len );
+    compressed = g_try_malloc ( len );
+    if ( compressed && compress2 ( compressed, &len, b->data, b->len, Z_BEST_SPEED ) == Z_OK && len < b->len ) {
+      stored = compressed;
+      stored_len = len;
+      flags |= BINFILE_FLAG_ZLIB;
+    }
+  }
+#endif
+
+  header = g_byte_array_sized_new ( BINFILE_HEADER_LEN );
+  g_byte_array_append ( header, (const guint8 *) BINFILE_MAGIC, BINFILE_MAGIC_LEN );
+  a_marshall_uint16 ( header, BINFILE_VERSION );
+  a_marshall_uint16 ( header, flags );
+  a_marshall_uint64 ( header, b->len );
+  a_marshall_uint64 ( header, stored_len );
+
+  rv = fwrite ( header->data, header->len, 1, f ) == 1 && fwrite ( stored, 1, stored_len, f ) == stored_len;
+
+  g_free ( compressed );
+  g_byte_array_free ( header, TRUE );
+  g_byte_array_free ( b, TRUE );
+  return rv;
+}
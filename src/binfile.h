@@ -0,0 +1,42 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_BINFILE_H
+#define _VIKING_BINFILE_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "vikaggregatelayer.h"
+#include "vikviewport.h"
+
+/* Binary counterpart of the text .vik project format: same layer tree,
+ * same parameters, but trackpoints are stored as packed arrays and the
+ * whole payload is read with a couple of freads. */
+
+#define BINFILE_MAGIC "\211VIK"
+#define BINFILE_MAGIC_LEN 4
+#define BINFILE_EXT ".vikb"
+
+gboolean a_binfile_read ( VikAggregateLayer *top, FILE *f, VikViewport *vp );
+gboolean a_binfile_write ( VikAggregateLayer *top, FILE *f, VikViewport *vp );
+
+#endif
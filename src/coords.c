@@ -85,9 +85,10 @@ int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 {
-  static struct LatLon tmp1, tmp2;
+  struct LatLon tmp1, tmp2;
   if ( utm1->zone == utm2->zone ) {
-    return sqrt ( pow ( utm1->easting - utm2->easting, 2 ) + pow ( utm1->northing - utm2->northing, 2 ) );
+    double de = utm1->easting - utm2->easting, dn = utm1->northing - utm2->northing;
+    return sqrt ( de * de + dn * dn );
   } else {
     a_coords_utm_to_latlon ( utm1, &tmp1 );
     a_coords_utm_to_latlon ( utm2, &tmp2 );
@@ -95,76 +96,187 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
   }
 }
 
+/* Haversine keeps its precision for close points, where the law of
+ * cosines loses most of it to the acos. Angles in radians. */
+static double coords_haversine ( double lat1, double cos1, double lat2, double cos2, double dlon )
+{
+  double sl = sin ( ( lat2 - lat1 ) / 2 ), sn = sin ( dlon / 2 );
+  double h = sl * sl + cos1 * cos2 * sn * sn;
+  return 2 * EquatorialRadius * asin ( sqrt ( MIN ( h, 1.0 ) ) );
+}
+
+/* Up to this separation (in degrees) the equirectangular approximation
+ * is within half a millimetre of haversine at any latitude, and it only
+ * needs one cos. Consecutive trackpoints are nearly always this close. */
+#define EQUIRECTANGULAR_MAX 0.05
+
+#define COORDS_CLOSE(ll1,ll2) ( fabs ( (ll2)->lat - (ll1)->lat ) < EQUIRECTANGULAR_MAX && \
+                                fabs ( (ll2)->lon - (ll1)->lon ) < EQUIRECTANGULAR_MAX )
+
+static double coords_equirectangular ( const struct LatLon *ll1, const struct LatLon *ll2 )
+{
+  double dlat = ll2->lat - ll1->lat;
+  double x = ( ll2->lon - ll1->lon ) * cos ( ( ll1->lat + ll2->lat ) * PIOVER180 / 2 );
+  return EquatorialRadius * PIOVER180 * sqrt ( x * x + dlat * dlat );
+}
+
+static double coords_latlon_haversine ( const struct LatLon *ll1, const struct LatLon *ll2 )
+{
+  double lat1 = ll1->lat * PIOVER180, lat2 = ll2->lat * PIOVER180;
+  return coords_haversine ( lat1, cos ( lat1 ), lat2, cos ( lat2 ), ( ll2->lon - ll1->lon ) * PIOVER180 );
+}
+
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
 {
-  static struct LatLon tmp1, tmp2;
-  gdouble tmp3;
-  tmp1.lat = ll1->lat * PIOVER180;
-  tmp1.lon = ll1->lon * PIOVER180;
-  tmp2.lat = ll2->lat * PIOVER180;
-  tmp2.lon = ll2->lon * PIOVER180;
-  tmp3 = EquatorialRadius * acos(sin(tmp1.lat)*sin(tmp2.lat)+cos(tmp1.lat)*cos(tmp2.lat)*cos(tmp1.lon-tmp2.lon));
-  // For very small differences we can sometimes get NaN returned
-  return isnan(tmp3)?0:tmp3;
+  if ( COORDS_CLOSE ( ll1, ll2 ) )
+    return coords_equirectangular ( ll1, ll2 );
+  return coords_latlon_haversine ( ll1, ll2 );
+}
+
+void a_coords_latlons_diff ( const struct LatLon *latlons, guint n, gdouble *dists )
+{
+  guint i;
+  /* The first loop has no branches and no state carried between
+   * iterations, so the compiler is free to vectorise it; the odd long
+   * hop is redone afterwards. */
+  for ( i = 0; i + 1 < n; i++ )
+    dists[i] = coords_equirectangular ( latlons + i, latlons + i + 1 );
+  for ( i = 0; i + 1 < n; i++ )
+    if ( ! COORDS_CLOSE ( latlons + i, latlons + i + 1 ) )
+      dists[i] = coords_latlon_haversine ( latlons + i, latlons + i + 1 );
+}
+
+/* The series below only depend on the ellipsoid: their coefficients are
+ * worked out once here, and the multiple angle sines come from a single
+ * sin and cos per point. */
+#define E2 EccentricitySquared
+#define E4 ( E2 * E2 )
+#define E6 ( E4 * E2 )
+#define ECC_PRIME_SQUARED ( E2 / ( 1.0 - E2 ) )
+
+/* meridional arc */
+static const double M0 = EquatorialRadius * ( 1.0 - E2 / 4 - 3 * E4 / 64 - 5 * E6 / 256 );
+static const double M2 = EquatorialRadius * ( 3 * E2 / 8 + 3 * E4 / 32 + 45 * E6 / 1024 );
+static const double M4 = EquatorialRadius * ( 15 * E4 / 256 + 45 * E6 / 1024 );
+static const double M6 = EquatorialRadius * ( 35 * E6 / 3072 );
+
+/* footpoint latitude, E1 = ( 1 - sqrt(1 - E2) ) / ( 1 + sqrt(1 - E2) ) */
+#define E1 0.0016792203888649744
+static const double P2 = 3 * E1 / 2 - 27 * E1 * E1 * E1 / 32;
+static const double P4 = 21 * E1 * E1 / 16 - 55 * E1 * E1 * E1 * E1 / 32;
+static const double P6 = 151 * E1 * E1 * E1 / 96;
+
+static void coords_latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm )
+{
+  double latitude = latlon->lat, longitude = latlon->lon;
+  double lat_rad, s, c, t, s2, c2, s4, c4, s6;
+  double N, T, C, A, A2, M;
+  int zone;
+
+  /* We want the longitude within -180..180. */
+  if ( longitude < -180.0 )
+    longitude += 360.0;
+  if ( longitude > 180.0 )
+    longitude -= 360.0;
+
+  zone = (int) ( ( longitude + 180 ) / 6 ) + 1;
+  if ( latitude >= 56.0 && latitude < 64.0 &&
+       longitude >= 3.0 && longitude < 12.0 )
+    zone = 32;
+  /* Special zones for Svalbard. */
+  if ( latitude >= 72.0 && latitude < 84.0 )
+  {
+    if      ( longitude >= 0.0  && longitude <  9.0 ) zone = 31;
+    else if ( longitude >= 9.0  && longitude < 21.0 ) zone = 33;
+    else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
+    else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
+  }
+
+  lat_rad = latitude * M_PI / 180.0;
+  s = sin ( lat_rad );
+  c = cos ( lat_rad );
+  t = s / c;
+  s2 = 2 * s * c;
+  c2 = c * c - s * s;
+  s4 = 2 * s2 * c2;
+  c4 = c2 * c2 - s2 * s2;
+  s6 = s4 * c2 + c4 * s2;
+
+  N = EquatorialRadius / sqrt ( 1.0 - E2 * s * s );
+  T = t * t;
+  C = ECC_PRIME_SQUARED * c * c;
+  /* +3 puts origin in middle of zone */
+  A = c * ( longitude - ( ( zone - 1 ) * 6 - 180 + 3 ) ) * M_PI / 180.0;
+  A2 = A * A;
+  M = M0 * lat_rad - M2 * s2 + M4 * s4 - M6 * s6;
+
+  utm->easting = K0 * N * A * ( 1 + A2 * ( ( 1 - T + C ) / 6 + A2 * ( 5 - 18 * T + T * T + 72 * C - 58 * ECC_PRIME_SQUARED ) / 120 ) ) + 500000.0;
+  utm->northing = K0 * ( M + N * t * A2 * ( 0.5 + A2 * ( ( 5 - T + 9 * C + 4 * C * C ) / 24 + A2 * ( 61 - 58 * T + T * T + 600 * C - 330 * ECC_PRIME_SQUARED ) / 720 ) ) );
+  if ( latitude < 0.0 )
+    utm->northing += 10000000.0;  /* 1e7 meter offset for southern hemisphere */
+  utm->zone = zone;
+  utm->letter = coords_utm_letter( latitude );
+}
+
+static void coords_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon )
+{
+  double x, y, mu, sm, cm, s2, c2, s4, c4, s6;
+  double phi1_rad, s, c, t, w;
+  double N1, T1, C1, D, D2;
+
+  x = utm->easting - 500000.0;  /* remove 500000 meter offset */
+  y = utm->northing;
+  if ( utm->letter < 'N' )
+    y -= 10000000.0;  /* remove 1e7 meter offset for southern hemisphere */
+
+  mu = y / K0 / M0;
+  sm = sin ( mu );
+  cm = cos ( mu );
+  s2 = 2 * sm * cm;
+  c2 = cm * cm - sm * sm;
+  s4 = 2 * s2 * c2;
+  c4 = c2 * c2 - s2 * s2;
+  s6 = s4 * c2 + c4 * s2;
+  phi1_rad = mu + P2 * s2 + P4 * s4 + P6 * s6;
+
+  s = sin ( phi1_rad );
+  c = cos ( phi1_rad );
+  t = s / c;
+  w = 1.0 - E2 * s * s;
+  N1 = EquatorialRadius / sqrt ( w );
+  T1 = t * t;
+  C1 = ECC_PRIME_SQUARED * c * c;
+  D = x / ( N1 * K0 );
+  D2 = D * D;
+
+  /* N1 / R1 = w / ( 1 - E2 ) */
+  latlon->lat = ( phi1_rad - t * w / ( 1.0 - E2 ) * D2 * ( 0.5 - D2 * ( ( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * ECC_PRIME_SQUARED ) / 24 - D2 * ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * ECC_PRIME_SQUARED - 3 * C1 * C1 ) / 720 ) ) ) * 180.0 / M_PI;
+  latlon->lon = ( ( utm->zone - 1 ) * 6 - 180 + 3 ) + D * ( 1 - D2 * ( ( 1 + 2 * T1 + C1 ) / 6 - D2 * ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * ECC_PRIME_SQUARED + 24 * T1 * T1 ) / 120 ) ) / c * 180.0 / M_PI;
 }
 
 void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
-    {
-    double latitude;
-    double longitude;
-    double lat_rad, long_rad;
-    double long_origin, long_origin_rad;
-    double eccPrimeSquared;
-    double N, T, C, A, M;
-    int zone;
-    double northing, easting;
-
-    longitude = latlon->lon;
-    latitude = latlon->lat;
-
-    /* We want the longitude within -180..180. */
-    if ( longitude < -180.0 )
-	longitude += 360.0;
-    if ( longitude > 180.0 )
-	longitude -= 360.0;
-
-    /* Now convert. */
-    lat_rad = latitude * M_PI / 180.0;
-    long_rad = longitude * M_PI / 180.0;
-    zone = (int) ( ( longitude + 180 ) / 6 ) + 1;
-    if ( latitude >= 56.0 && latitude < 64.0 &&
-	 longitude >= 3.0 && longitude < 12.0 )
-	zone = 32;
-    /* Special zones for Svalbard. */
-    if ( latitude >= 72.0 && latitude < 84.0 )
-	{
-	if      ( longitude >= 0.0  && longitude <  9.0 ) zone = 31;
-	else if ( longitude >= 9.0  && longitude < 21.0 ) zone = 33;
-	else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
-	else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
-	}
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    long_origin_rad = long_origin * M_PI / 180.0;
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( lat_rad ) * sin( lat_rad ) );
-    T = tan( lat_rad ) * tan( lat_rad );
-    C = eccPrimeSquared * cos( lat_rad ) * cos( lat_rad );
-    A = cos( lat_rad ) * ( long_rad - long_origin_rad );
-    M = EquatorialRadius * ( ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) * lat_rad - ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 2 * lat_rad ) + ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 4 * lat_rad ) - ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 ) * sin( 6 * lat_rad ) );
-    easting =
-	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * eccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
-    northing =
-	K0 * ( M + N * tan( lat_rad ) * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * eccPrimeSquared ) * A * A * A * A * A * A / 720 ) );
-    if ( latitude < 0.0 )
-	northing += 10000000.0;  /* 1e7 meter offset for southern hemisphere */
-
-    utm->northing = northing;
-    utm->easting = easting;
-    utm->zone = zone;
-    utm->letter = coords_utm_letter( latitude );
-
-    /* All done. */
-    }
+{
+  coords_latlon_to_utm ( latlon, utm );
+}
+
+void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+{
+  coords_utm_to_latlon ( utm, latlon );
+}
+
+void a_coords_latlons_to_utms ( const struct LatLon *latlons, struct UTM *utms, guint n )
+{
+  guint i;
+  for ( i = 0; i < n; i++ )
+    coords_latlon_to_utm ( latlons + i, utms + i );
+}
+
+void a_coords_utms_to_latlons ( const struct UTM *utms, struct LatLon *latlons, guint n )
+{
+  guint i;
+  for ( i = 0; i < n; i++ )
+    coords_utm_to_latlon ( utms + i, latlons + i );
+}
 
 
 static char coords_utm_letter( double latitude )
@@ -198,58 +310,6 @@ static char coords_utm_letter( double latitude )
 
 
 
-void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
-    {
-    double northing, easting;
-    int zone;
-    char letter[100];
-    double x, y;
-    double eccPrimeSquared;
-    double e1;
-    double N1, T1, C1, R1, D, M;
-    double long_origin;
-    double mu, phi1_rad;
-    int northernHemisphere;	/* 1 for northern hemisphere, 0 for southern */
-    double latitude, longitude;
-
-    northing = utm->northing;
-    easting = utm->easting;
-    zone = utm->zone;
-    letter[0] = utm->letter;
-
-    /* Now convert. */
-    x = easting - 500000.0;	/* remove 500000 meter offset */
-    y = northing;
-    if ( ( *letter - 'N' ) >= 0 )
-	northernHemisphere = 1;	/* northern hemisphere */
-    else
-	{
-	northernHemisphere = 0;	/* southern hemisphere */
-	y -= 10000000.0;	/* remove 1e7 meter offset */
-	}
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
-    M = y / K0;
-    mu = M / ( EquatorialRadius * ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) );
-    phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 )* sin( 2 * mu ) + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * sin( 4 * mu ) + ( 151 * e1 * e1 * e1 / 96 ) * sin( 6 *mu );
-    N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ) );
-    T1 = tan( phi1_rad ) * tan( phi1_rad );
-    C1 = eccPrimeSquared * cos( phi1_rad ) * cos( phi1_rad );
-    R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ), 1.5 );
-    D = x / ( N1 * K0 );
-    latitude = phi1_rad - ( N1 * tan( phi1_rad ) / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * eccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * eccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
-    latitude = latitude * 180.0 / M_PI;
-    longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * eccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos( phi1_rad );
-    longitude = long_origin + longitude * 180.0 / M_PI;
-
-    /* Show results. */
-
-    latlon->lat = latitude;
-    latlon->lon = longitude;
-
-    }
-
 void a_coords_latlon_to_string ( const struct LatLon *latlon,
 				 gchar **lat,
 				 gchar **lon )
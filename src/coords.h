@@ -52,8 +52,12 @@ struct LatLon {
 int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 );
 void a_coords_latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm );
 void a_coords_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon );
+void a_coords_latlons_to_utms ( const struct LatLon *latlons, struct UTM *utms, guint n );
+void a_coords_utms_to_latlons ( const struct UTM *utms, struct LatLon *latlons, guint n );
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 );
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 );
+/* dists[i] is the distance from latlons[i] to latlons[i+1], so n-1 values */
+void a_coords_latlons_diff ( const struct LatLon *latlons, guint n, gdouble *dists );
 
 /**
  * Convert a double to a string WITHOUT LOCALE.
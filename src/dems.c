@@ -10,6 +10,9 @@ typedef struct {
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+/* bumped whenever a DEM is loaded or unloaded, so cached elevations can tell */
+static guint dems_generation = 0;
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
   vik_dem_free ( ldem->dem );
@@ -45,6 +48,7 @@ VikDEM *a_dems_load(const gchar *filename)
     ldem->ref_count = 1;
     ldem->dem = dem;
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
+    dems_generation++;
     return dem;
   }
 }
@@ -54,8 +58,15 @@ void a_dems_unref(const gchar *filename)
   LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   g_assert ( ldem );
   ldem->ref_count --;
-  if ( ldem->ref_count == 0 )
+  if ( ldem->ref_count == 0 ) {
     g_hash_table_remove ( loaded_dems, filename );
+    dems_generation++;
+  }
+}
+
+guint a_dems_get_generation ()
+{
+  return dems_generation;
 }
 
 /* to get a DEM that was already loaded.
@@ -19,6 +19,7 @@ void a_dems_list_free ( GList *dems );
 GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
+guint a_dems_get_generation ();
 
 #endif
 #include <glib.h>
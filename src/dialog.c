@@ -656,6 +656,38 @@ gboolean a_dialog_time_threshold ( GtkWindow *parent, gchar *title_text, gchar *
   return FALSE;
 }
 
+gboolean a_dialog_spin_value ( GtkWindow *parent, const gchar *title_text, const gchar *label_text,
+                               gdouble *value, gdouble min, gdouble max, gdouble step, guint digits )
+{
+  GtkWidget *dialog = gtk_dialog_new_with_buttons (title_text, 
+                                                  parent,
+                                                  GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                  GTK_STOCK_CANCEL,
+                                                  GTK_RESPONSE_REJECT,
+                                                  GTK_STOCK_OK,
+                                                  GTK_RESPONSE_ACCEPT,
+                                                  NULL);
+  GtkWidget *label, *spin;
+
+  label = gtk_label_new ( label_text );
+  spin = gtk_spin_button_new ( (GtkAdjustment *) gtk_adjustment_new ( *value, min, max, step, step * 10, step * 10 ), step, digits );
+  gtk_entry_set_activates_default ( GTK_ENTRY(spin), TRUE );
+  gtk_dialog_set_default_response ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+
+  gtk_box_pack_start ( GTK_BOX(GTK_DIALOG(dialog)->vbox), label, FALSE, FALSE, 0 );
+  gtk_box_pack_start ( GTK_BOX(GTK_DIALOG(dialog)->vbox), spin, FALSE, FALSE, 0 );
+  gtk_widget_show_all ( GTK_DIALOG(dialog)->vbox );
+
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+  {
+    *value = gtk_spin_button_get_value ( GTK_SPIN_BUTTON(spin) );
+    gtk_widget_destroy ( dialog );
+    return TRUE;
+  }
+  gtk_widget_destroy ( dialog );
+  return FALSE;
+}
+
 static void about_url_hook (GtkAboutDialog *about,
                             const gchar    *link,
                             gpointer        data)
@@ -58,6 +58,8 @@ gchar *a_dialog_new_track ( GtkWindow *parent, GHashTable *tracks );
 gboolean a_dialog_overwrite ( GtkWindow *parent, const gchar *message, const gchar *extra );
 gboolean a_dialog_custom_zoom ( GtkWindow *parent, gdouble *xmpp, gdouble *ympp );
 gboolean a_dialog_time_threshold ( GtkWindow *parent, gchar *title_text, gchar *label_text, guint *thr );
+gboolean a_dialog_spin_value ( GtkWindow *parent, const gchar *title_text, const gchar *label_text,
+                               gdouble *value, gdouble min, gdouble max, gdouble step, guint digits );
 
 void a_dialog_choose_dir ( GtkWidget *entry );
 
@@ -25,6 +25,8 @@
 #include "viking.h"
 
 #include "gpx.h"
+#include "binfile.h"
+#include "background.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -565,7 +567,21 @@ gshort a_file_load ( VikAggregateLayer *top, VikViewport *vp, const gchar *filen
   if ( ! f )
     return 0;
 
-  if ( !is_gpx_file && check_magic ( f, VIK_MAGIC ) )
+  if ( !is_gpx_file && check_magic ( f, BINFILE_MAGIC ) )
+  {
+    gboolean success;
+    if ( f != stdin )
+    {
+      /* reopen without newline translation */
+      xfclose(f);
+      if ( ! (f = g_fopen ( filename, "rb" )) )
+        return 0;
+    }
+    success = a_binfile_read ( top, f, vp );
+    xfclose(f);
+    return success ? 1 : 0;
+  }
+  else if ( !is_gpx_file && check_magic ( f, VIK_MAGIC ) )
   {
     file_read ( top, f, vp );
     if ( f != stdin )
@@ -594,19 +610,156 @@ gshort a_file_load ( VikAggregateLayer *top, VikViewport *vp, const gchar *filen
   }
 }
 
+/* ---------------------------------------------------- */
+
+/* passed along to the import worker thread */
+typedef struct {
+  VikAggregateLayer *top;
+  VikViewport *vp;
+  gboolean top_alive;
+  GMutex *mutex;
+  gchar *filename;
+  gboolean is_gpx_file; /* else gpspoint */
+  VikTrwLayer *vtl; /* detached, until merged into a real layer */
+} FileImportInfo;
+
+/* imports queued but not yet merged or cancelled. Only touched with the GDK lock held. */
+static guint imports_pending = 0;
+
+static void fii_free ( FileImportInfo *fii )
+{
+  g_mutex_free ( fii->mutex );
+  g_free ( fii->filename );
+  if ( fii->vtl )
+    g_object_unref ( G_OBJECT(fii->vtl) );
+  g_free ( fii );
+}
+
+static void import_weak_ref_cb ( gpointer ptr, GObject *dead_top )
+{
+  FileImportInfo *fii = ptr;
+  g_mutex_lock ( fii->mutex );
+  fii->top_alive = FALSE;
+  g_mutex_unlock ( fii->mutex );
+}
+
+/* called with the GDK lock held */
+static void file_import_merge ( FileImportInfo *fii )
+{
+  VikCoord new_center;
+  VikLayer *vtl = vik_layer_create ( VIK_LAYER_TRW, fii->vp, NULL, FALSE );
+  vik_layer_rename ( vtl, a_file_basename ( fii->filename ) );
+  vik_trw_layer_steal_items ( VIK_TRW_LAYER(vtl), fii->vtl );
+
+  vik_layer_post_read ( vtl, fii->vp, TRUE );
+  vik_aggregate_layer_add_layer ( fii->top, vtl );
+
+  /* only move the view once the whole batch is in */
+  if ( imports_pending == 1 && vik_trw_layer_find_center ( VIK_TRW_LAYER(vtl), &new_center ) )
+    vik_viewport_set_center_coord ( fii->vp, &new_center );
+  vik_layer_emit_update ( VIK_LAYER(fii->top) );
+}
+
+static void file_import_thread ( FileImportInfo *fii, gpointer threaddata )
+{
+  FILE *f;
+  GMappedFile *mf;
+
+  /* jobs cancelled while still queued run too, so check before doing any work */
+  if ( a_background_testcancel ( threaddata ) != 0 )
+    ;
+  else if ( fii->is_gpx_file )
+  {
+    if ( (f = g_fopen ( fii->filename, "r" )) )
+    {
+      a_gpx_read_file ( fii->vtl, f );
+      fclose ( f );
+    }
+  }
+  else if ( (mf = g_mapped_file_new ( fii->filename, FALSE, NULL )) )
+  {
+    a_gpspoint_read_buffer ( fii->vtl, g_mapped_file_get_contents ( mf ), g_mapped_file_get_length ( mf ) );
+    g_mapped_file_free ( mf );
+  }
+
+  a_background_thread_progress ( threaddata, 1.0 );
+
+  gdk_threads_enter();
+  g_mutex_lock ( fii->mutex );
+  if ( fii->top_alive )
+  {
+    if ( a_background_testcancel ( threaddata ) == 0 )
+      file_import_merge ( fii );
+    g_object_weak_unref ( G_OBJECT(fii->top), import_weak_ref_cb, fii );
+  }
+  imports_pending--;
+  g_mutex_unlock ( fii->mutex );
+  gdk_threads_leave();
+}
+
+/*
+ * Reads a GPX or gpspoint file on the background thread pool into a new layer of top.
+ * Several calls parse concurrently; each file appears as soon as it is done.
+ * Returns FALSE, without doing anything, for files that need a_file_load().
+ */
+gboolean a_file_import_in_background ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename_or_uri )
+{
+  const gchar *filename = filename_or_uri;
+  FileImportInfo *fii;
+  gboolean is_gpx_file, is_project;
+  gchar *tmp;
+  FILE *f;
+
+  if (strncmp(filename, "file://", 7) == 0)
+    filename = filename + 7;
+
+  if ( strcmp ( filename, "-" ) == 0 || ! (f = g_fopen ( filename, "r" )) )
+    return FALSE;
+  is_gpx_file = check_file_ext ( filename, ".gpx" ) || check_magic ( f, GPX_MAGIC );
+  is_project = ! is_gpx_file && ( check_magic ( f, VIK_MAGIC ) || check_magic ( f, BINFILE_MAGIC ) );
+  fclose ( f );
+  if ( is_project )
+    return FALSE;
+
+  fii = g_malloc ( sizeof(FileImportInfo) );
+  fii->top = top;
+  fii->vp = vp;
+  fii->top_alive = TRUE;
+  fii->mutex = g_mutex_new();
+  fii->filename = g_strdup ( filename );
+  fii->is_gpx_file = is_gpx_file;
+  fii->vtl = vik_trw_layer_new_detached ( vik_viewport_get_coord_mode ( vp ) );
+
+  imports_pending++;
+  g_object_weak_ref ( G_OBJECT(top), import_weak_ref_cb, fii );
+
+  tmp = g_strdup_printf ( _("Importing %s..."), a_file_basename ( filename ) );
+  a_background_thread ( VIK_GTK_WINDOW_FROM_WIDGET(vp), tmp,
+                        (vik_thr_func) file_import_thread, fii,
+                        (vik_thr_free_func) fii_free, NULL, 1 );
+  g_free ( tmp );
+  return TRUE;
+}
+
+/* the binary format is used when filename ends in BINFILE_EXT */
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
 {
-  FILE *f = g_fopen(filename, "w");
+  gboolean binary = check_file_ext ( filename, BINFILE_EXT );
+  gboolean rv = TRUE;
+  FILE *f = g_fopen(filename, binary ? "wb" : "w");
 
   if ( ! f )
     return FALSE;
 
-  file_write ( top, f, vp );
+  if ( binary )
+    rv = a_binfile_write ( top, f, VIK_VIEWPORT(vp) );
+  else
+    file_write ( top, f, vp );
 
   fclose(f);
   f = NULL;
 
-  return TRUE;
+  return rv;
 }
 
 
@@ -37,6 +37,7 @@ gboolean check_file_ext ( const gchar *filename, const gchar *fileext );
 
 /* 0 on failure, 1 on success (vik file) 2 on success (other file) */
 gshort a_file_load ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename );
+gboolean a_file_import_in_background ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename );
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename );
 gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, gshort file_type );
 const gchar *a_get_viking_dir();
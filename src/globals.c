@@ -34,8 +34,14 @@ gboolean vik_use_small_wp_icons = FALSE;
 
 static gchar * params_degree_formats[] = {"DDD", "DMM", "DMS", NULL};
 
+static VikLayerParamScale params_redraw_rate[] = {
+  /* min, max, step, digits (decimal places) */
+ { 1, 60, 1, 0 },
+};
+
 static VikLayerParam prefs[] = {
   { VIKING_PREFERENCES_NAMESPACE "degree_format", VIK_LAYER_PARAM_UINT, VIK_DEGREE_FORMAT_DMS, N_("Degree format:"), VIK_LAYER_WIDGET_COMBOBOX, params_degree_formats, NULL },
+  { VIKING_PREFERENCES_NAMESPACE "redraw_rate", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map redraws per second while loading:"), VIK_LAYER_WIDGET_HSCALE, params_redraw_rate, NULL },
 };
 
 void a_vik_preferences_init ()
@@ -45,6 +51,9 @@ void a_vik_preferences_init ()
   VikLayerParamData tmp;
   tmp.u = VIK_DEGREE_FORMAT_DMS;
   a_preferences_register(prefs, tmp, VIKING_PREFERENCES_GROUP_KEY);
+
+  tmp.u = VIK_DEFAULT_REDRAW_RATE;
+  a_preferences_register(prefs+1, tmp, VIKING_PREFERENCES_GROUP_KEY);
 }
 
 vik_degree_format_t a_vik_get_degree_format ( )
@@ -55,3 +64,9 @@ vik_degree_format_t a_vik_get_degree_format ( )
   /* TODO use preferences */
   return VIK_DEGREE_FORMAT_DMS;
 }
+
+guint a_vik_get_redraw_rate ( )
+{
+  guint rate = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "redraw_rate")->u;
+  return rate ? rate : VIK_DEFAULT_REDRAW_RATE;
+}
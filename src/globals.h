@@ -63,6 +63,10 @@ typedef enum {
 
 vik_degree_format_t a_vik_get_degree_format ( );
 
+/* Cap on how often updates from background threads redraw the map */
+#define VIK_DEFAULT_REDRAW_RATE 25
+guint a_vik_get_redraw_rate ( );
+
 /* Group for global preferences */
 #define VIKING_PREFERENCES_GROUP_KEY "viking.globals"
 #define VIKING_PREFERENCES_NAMESPACE "viking.globals."
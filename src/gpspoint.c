@@ -56,8 +56,6 @@ if trackpoint, make trackpoint, store to current track (error / skip if none)
 
 /* Thanks to etrex-cache's gpsbabel's gpspoint.c for starting me off! */
 
-static char line_buffer[2048];
-
 #define GPSPOINT_TYPE_NONE 0
 #define GPSPOINT_TYPE_WAYPOINT 1
 #define GPSPOINT_TYPE_TRACKPOINT 2
@@ -66,35 +64,41 @@ static char line_buffer[2048];
 
 /* #define GPSPOINT_TYPE_ROUTE 5 */
 
-static VikTrack *current_track; /* pointer to pointer to first GList */
-
-static gint line_type = GPSPOINT_TYPE_NONE;
-static struct LatLon line_latlon;
-static gchar *line_name;
-static gchar *line_comment;
-static gchar *line_image;
-static gchar *line_symbol;
-static gboolean line_newsegment = FALSE;
-static gboolean line_has_timestamp = FALSE;
-static time_t line_timestamp = 0;
-static gdouble line_altitude = VIK_DEFAULT_ALTITUDE;
-static gboolean line_visible = TRUE;
-
-static gboolean line_extended = FALSE;
-static gdouble line_speed = NAN;
-static gdouble line_course = NAN;
-static gint line_sat = 0;
-static gint line_fix = 0;
-/* other possible properties go here */
-
-
-static void gpspoint_process_tag ( const gchar *tag, gint len );
-static void gpspoint_process_key_and_value ( const gchar *key, gint key_len, const gchar *value, gint value_len );
+/* everything one read needs, so several can run at once */
+typedef struct {
+  VikTrwLayer *trw;
+  VikCoordMode coord_mode;
+  VikTrack *current_track;
+  GList *current_tail; /* last trackpoint of current_track, appending is O(1) */
+
+  gint line_type;
+  struct LatLon line_latlon;
+  gchar *line_name;
+  gchar *line_comment;
+  gchar *line_image;
+  gchar *line_symbol;
+  gboolean line_newsegment;
+  gboolean line_has_timestamp;
+  time_t line_timestamp;
+  gdouble line_altitude;
+  gboolean line_visible;
+
+  gboolean line_extended;
+  gdouble line_speed;
+  gdouble line_course;
+  gint line_sat;
+  gint line_fix;
+  /* other possible properties go here */
+} GpspointReadingContext;
+
+
+static void gpspoint_process_tag ( GpspointReadingContext *ctx, const gchar *tag, gint len );
+static void gpspoint_process_key_and_value ( GpspointReadingContext *ctx, const gchar *key, gint key_len, const gchar *value, gint value_len );
 
 static gchar *slashdup(const gchar *str)
 {
-  guint16 len = strlen(str);
-  guint16 need_bs_count, i, j;
+  gsize len = strlen(str);
+  gsize need_bs_count, i, j;
   gchar *rv;
   for ( i = 0, need_bs_count = 0; i < len; i++ )
     if ( str[i] == '\\' || str[i] == '"' )
@@ -110,190 +114,241 @@ static gchar *slashdup(const gchar *str)
   return rv;
 }
 
-static gchar *deslashndup ( const gchar *str, guint16 len )
+/* a backslash escapes the next character; one at the very end is kept */
+static gchar *deslashndup ( const gchar *str, gsize len )
 {
-  guint16 i,j, bs_count, new_len;
-  gboolean backslash = FALSE;
+  gsize i, j;
   gchar *rv;
 
   if ( len < 1 )
     return NULL;
 
-  for ( i = 0, bs_count = 0; i < len; i++ )
-   if ( str[i] == '\\' )
-   {
-     bs_count++;
-     i++;
-   }
-
-  if ( str[i-1] == '\\' && (len == 1 || str[i-2] != '\\') )
-    bs_count--;
-
-  new_len = len - bs_count;
-  rv = g_malloc ( (new_len+1) * sizeof(gchar) );
-  for ( i = 0, j = 0; i < len && j < new_len; i++ )
-    if ( str[i] == '\\' && !backslash )
-      backslash = TRUE;
-    else
-    {
-      rv[j++] = str[i];
-      backslash = FALSE;
-    }
+  rv = g_malloc ( (len+1) * sizeof(gchar) );
+  for ( i = 0, j = 0; i < len; i++ )
+  {
+    if ( str[i] == '\\' && i+1 < len )
+      i++;
+    rv[j++] = str[i];
+  }
 
-  rv[new_len] = '\0';
+  rv[j] = '\0';
   return rv;
 }
 
-void a_gpspoint_read_file(VikTrwLayer *trw, FILE *f ) {
-  VikCoordMode coord_mode = vik_trw_layer_get_coord_mode ( trw );
-  gchar *tag_start, *tag_end;
-  g_assert ( f != NULL && trw != NULL );
-  line_type = 0;
-  line_timestamp = 0;
-  line_newsegment = FALSE;
-  line_image = NULL;
-  line_symbol = NULL;
-
-  current_track = NULL;
-  while (fgets(line_buffer, 2048, f))
-  {
-    gboolean inside_quote = 0;
-    gboolean backslash = 0;
+/* values are not nul-terminated, so make a short copy for the number parsers */
+static gdouble value_to_double ( const gchar *value, gint value_len )
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  if ( value_len >= sizeof(buf) )
+    value_len = sizeof(buf) - 1;
+  memcpy ( buf, value, value_len );
+  buf[value_len] = '\0';
+  return g_ascii_strtod(buf, NULL);
+}
 
-    line_buffer[strlen(line_buffer)-1] = '\0'; /* chop off newline */
+static void line_reset ( GpspointReadingContext *ctx )
+{
+  g_free ( ctx->line_name );
+  g_free ( ctx->line_comment );
+  g_free ( ctx->line_image );
+  g_free ( ctx->line_symbol );
+  ctx->line_name = NULL;
+  ctx->line_comment = NULL;
+  ctx->line_image = NULL;
+  ctx->line_symbol = NULL;
+  ctx->line_type = GPSPOINT_TYPE_NONE;
+  ctx->line_newsegment = FALSE;
+  ctx->line_has_timestamp = FALSE;
+  ctx->line_timestamp = 0;
+  ctx->line_altitude = VIK_DEFAULT_ALTITUDE;
+  ctx->line_visible = TRUE;
+
+  ctx->line_extended = FALSE;
+  ctx->line_speed = NAN;
+  ctx->line_course = NAN;
+  ctx->line_sat = 0;
+  ctx->line_fix = 0;
+}
 
-    /* for gpspoint files wrapped inside */
-    if ( strlen(line_buffer) >= 13 && strncmp ( line_buffer, "~EndLayerData", 13 ) == 0 )
-      break;
+static void gpspoint_context_init ( GpspointReadingContext *ctx, VikTrwLayer *trw )
+{
+  memset ( ctx, 0, sizeof(GpspointReadingContext) );
+  ctx->trw = trw;
+  ctx->coord_mode = vik_trw_layer_get_coord_mode ( trw );
+  line_reset ( ctx );
+}
+
+/* one line, without its newline. Returns FALSE at the end of data wrapped in a .vik file */
+static gboolean gpspoint_process_line ( GpspointReadingContext *ctx, const gchar *line, gsize len )
+{
+  const gchar *line_end = line + len;
+  const gchar *tag_start, *tag_end;
+  gboolean inside_quote = 0;
+  gboolean backslash = 0;
+
+  /* for gpspoint files wrapped inside */
+  if ( len >= 13 && strncmp ( line, "~EndLayerData", 13 ) == 0 )
+    return FALSE;
 
 /* each line: nullify stuff, make thing if nes, free name if ness */
-    tag_start = line_buffer;
-    for (;;)
-    {
-      /* my addition: find first non-whitespace character. if the null, skip line. */
-      while (*tag_start != '\0' && isspace(*tag_start))
-        tag_start++;
-      if (tag_start == '\0')
-        break;
+  tag_start = line;
+  for (;;)
+  {
+    /* my addition: find first non-whitespace character. if the null, skip line. */
+    while (tag_start < line_end && isspace((guchar) *tag_start))
+      tag_start++;
+    if (tag_start == line_end)
+      break;
 
-      if (*tag_start == '#')
-        break;
+    if (*tag_start == '#')
+      break;
 
-      tag_end = tag_start;
-        if (*tag_end == '"')
-          inside_quote = !inside_quote;
-      while (*tag_end != '\0' && (!isspace(*tag_end) || inside_quote)) {
-        tag_end++;
-        if (*tag_end == '\\' && !backslash)
-          backslash = TRUE;
-        else if (backslash)
-          backslash = FALSE;
-        else if (*tag_end == '"')
-          inside_quote = !inside_quote;
-      }
-
-      gpspoint_process_tag ( tag_start, tag_end - tag_start );
-
-      if (*tag_end == '\0' )
+    tag_end = tag_start;
+      if (*tag_end == '"')
+        inside_quote = !inside_quote;
+    while (tag_end < line_end && (!isspace((guchar) *tag_end) || inside_quote)) {
+      tag_end++;
+      if (tag_end == line_end)
         break;
-      else
-        tag_start = tag_end+1;
+      if (*tag_end == '\\' && !backslash)
+        backslash = TRUE;
+      else if (backslash)
+        backslash = FALSE;
+      else if (*tag_end == '"')
+        inside_quote = !inside_quote;
     }
-    if (line_type == GPSPOINT_TYPE_WAYPOINT && line_name)
+
+    gpspoint_process_tag ( ctx, tag_start, tag_end - tag_start );
+
+    if (tag_end == line_end)
+      break;
+    else
+      tag_start = tag_end+1;
+  }
+  if (ctx->line_type == GPSPOINT_TYPE_WAYPOINT && ctx->line_name)
+  {
+    VikWaypoint *wp = vik_waypoint_new();
+    wp->visible = ctx->line_visible;
+    wp->altitude = ctx->line_altitude;
+
+    vik_coord_load_from_latlon ( &(wp->coord), ctx->coord_mode, &(ctx->line_latlon) );
+
+    vik_trw_layer_filein_add_waypoint ( ctx->trw, ctx->line_name, wp );
+
+    if ( ctx->line_comment )
     {
-      VikWaypoint *wp = vik_waypoint_new();
-      wp->visible = line_visible;
-      wp->altitude = line_altitude;
-
-      vik_coord_load_from_latlon ( &(wp->coord), coord_mode, &line_latlon );
-
-      vik_trw_layer_filein_add_waypoint ( trw, line_name, wp );
-      g_free ( line_name );
-      line_name = NULL;
-
-      if ( line_comment )
-      {
-        vik_waypoint_set_comment ( wp, line_comment );
-        line_comment = NULL;
-      }
-
-      if ( line_image )
-      {
-        vik_waypoint_set_image ( wp, line_image );
-        line_image = NULL;
-      }
-
-      if ( line_symbol )
-      {
-        vik_waypoint_set_symbol ( wp, line_symbol );
-	line_symbol = NULL;
-      }
+      vik_waypoint_set_comment_no_copy ( wp, ctx->line_comment );
+      ctx->line_comment = NULL;
     }
-    else if (line_type == GPSPOINT_TYPE_TRACK && line_name)
-    {
-      VikTrack *pl = vik_track_new();
 
-      /* Thanks to Peter Jones for this Fix */
-      if (!line_name) line_name = g_strdup("UNK");
+    if ( ctx->line_image )
+      vik_waypoint_set_image ( wp, ctx->line_image );
 
-      pl->visible = line_visible;
+    if ( ctx->line_symbol )
+      vik_waypoint_set_symbol ( wp, ctx->line_symbol );
+  }
+  else if (ctx->line_type == GPSPOINT_TYPE_TRACK && ctx->line_name)
+  {
+    VikTrack *pl = vik_track_new();
 
-      if ( line_comment )
-      {
-        vik_track_set_comment ( pl, line_comment );
-        line_comment = NULL;
-      }
+    pl->visible = ctx->line_visible;
+
+    if ( ctx->line_comment )
+    {
+      vik_track_set_comment_no_copy ( pl, ctx->line_comment );
+      ctx->line_comment = NULL;
+    }
 
-      pl->trackpoints = NULL;
-      vik_trw_layer_filein_add_track ( trw, line_name, pl );
-      g_free ( line_name );
-      line_name = NULL;
+    pl->trackpoints = NULL;
+    vik_trw_layer_filein_add_track ( ctx->trw, ctx->line_name, pl );
 
-      current_track = pl;
+    ctx->current_track = pl;
+    ctx->current_tail = NULL;
+  }
+  else if (ctx->line_type == GPSPOINT_TYPE_TRACKPOINT && ctx->current_track)
+  {
+    VikTrackpoint *tp = vik_trackpoint_new();
+    vik_coord_load_from_latlon ( &(tp->coord), ctx->coord_mode, &(ctx->line_latlon) );
+    tp->newsegment = ctx->line_newsegment;
+    tp->has_timestamp = ctx->line_has_timestamp;
+    tp->timestamp = ctx->line_timestamp;
+    tp->altitude = ctx->line_altitude;
+    if (ctx->line_extended) {
+      tp->speed = ctx->line_speed;
+      tp->course = ctx->line_course;
+      tp->nsats = ctx->line_sat;
+      tp->fix_mode = ctx->line_fix;
     }
-    else if (line_type == GPSPOINT_TYPE_TRACKPOINT && current_track)
+    if ( ctx->current_tail )
+      ctx->current_tail = g_list_append ( ctx->current_tail, tp )->next;
+    else
+      ctx->current_tail = ctx->current_track->trackpoints = g_list_append ( NULL, tp );
+    /* the track is in the layer already */
+    vik_track_extend_bounds ( ctx->current_track, tp );
+  }
+
+  line_reset ( ctx );
+  return TRUE;
+}
+
+void a_gpspoint_read_file(VikTrwLayer *trw, FILE *f ) {
+  GpspointReadingContext ctx;
+  GString *line = g_string_sized_new ( 2048 );
+  gchar chunk[2048];
+  g_assert ( f != NULL && trw != NULL );
+
+  gpspoint_context_init ( &ctx, trw );
+  for (;;)
+  {
+    /* lines can be of any length */
+    g_string_truncate ( line, 0 );
+    while ( fgets ( chunk, sizeof(chunk), f ) )
     {
-      VikTrackpoint *tp = vik_trackpoint_new();
-      vik_coord_load_from_latlon ( &(tp->coord), coord_mode, &line_latlon );
-      tp->newsegment = line_newsegment;
-      tp->has_timestamp = line_has_timestamp;
-      tp->timestamp = line_timestamp;
-      tp->altitude = line_altitude;
-      if (line_extended) {
-        tp->speed = line_speed;
-        tp->course = line_course;
-        tp->nsats = line_sat;
-        tp->fix_mode = line_fix;
-      }
-      current_track->trackpoints = g_list_append ( current_track->trackpoints, tp );
+      g_string_append ( line, chunk );
+      if ( line->len > 0 && line->str[line->len-1] == '\n' )
+        break;
     }
+    if ( line->len == 0 )
+      break;
+
+    /* chop off newline */
+    while ( line->len > 0 && (line->str[line->len-1] == '\n' || line->str[line->len-1] == '\r') )
+      g_string_truncate ( line, line->len-1 );
 
-    if (line_name) 
-      g_free ( line_name );
-    line_name = NULL;
-    if (line_comment) 
-      g_free ( line_comment );
-    if (line_image)
-      g_free ( line_image );
-    if (line_symbol)
-      g_free ( line_symbol );
-    line_comment = NULL;
-    line_image = NULL;
-    line_symbol = NULL;
-    line_type = GPSPOINT_TYPE_NONE;
-    line_newsegment = FALSE;
-    line_has_timestamp = FALSE;
-    line_timestamp = 0;
-    line_altitude = VIK_DEFAULT_ALTITUDE;
-    line_visible = TRUE;
-    line_symbol = NULL;
-
-    line_extended = FALSE;
-    line_speed = NAN;
-    line_course = NAN;
-    line_sat = 0;
-    line_fix = 0;
+    if ( ! gpspoint_process_line ( &ctx, line->str, line->len ) )
+      break;
   }
+  line_reset ( &ctx );
+  g_string_free ( line, TRUE );
+}
+
+/* Same as a_gpspoint_read_file() on data already in memory (a mapped file,
+ * for instance). Returns how much of buf was used, which is less than len
+ * when the data ends with a ~EndLayerData line. */
+gsize a_gpspoint_read_buffer ( VikTrwLayer *trw, const gchar *buf, gsize len )
+{
+  GpspointReadingContext ctx;
+  const gchar *p = buf, *end = buf + len;
+  g_assert ( trw != NULL );
+
+  gpspoint_context_init ( &ctx, trw );
+  while ( p < end )
+  {
+    const gchar *eol = memchr ( p, '\n', end - p );
+    const gchar *next = eol ? eol + 1 : end;
+    gsize line_len = (eol ? eol : end) - p;
+
+    if ( line_len > 0 && p[line_len-1] == '\r' )
+      line_len--;
+    if ( ! gpspoint_process_line ( &ctx, p, line_len ) )
+    {
+      p = next;
+      break;
+    }
+    p = next;
+  }
+  line_reset ( &ctx );
+  return p - buf;
 }
 
 /* Tag will be of a few defined forms:
@@ -304,9 +359,10 @@ void a_gpspoint_read_file(VikTrwLayer *trw, FILE *f ) {
 
 So we must determine end of tag name, start of value, end of value.
 */
-static void gpspoint_process_tag ( const gchar *tag, gint len )
+static void gpspoint_process_tag ( GpspointReadingContext *ctx, const gchar *tag, gint len )
 {
   const gchar *key_end, *value_start, *value_end;
+  const gchar *tag_end = tag + len;
 
   /* Searching for key end */
   key_end = tag;
@@ -315,126 +371,122 @@ static void gpspoint_process_tag ( const gchar *tag, gint len )
     if (*key_end == '=')
       break;
 
-  if (key_end - tag == len)
+  if (key_end - tag >= len)
     return; /* no good */
 
-  if (key_end - tag == len + 1)
-    value_start = value_end = 0; /* size = 0 */
-  else
-  {
-    value_start = key_end + 1; /* equal_sign plus one */
+  value_start = key_end + 1; /* equal_sign plus one */
 
-    if (*value_start == '"')
+  if (value_start < tag_end && *value_start == '"')
+  {
+    value_start++;
+    if (value_start >= tag_end - 1 || *value_start == '"')
+      value_start = value_end = 0; /* size = 0 */
+    else
     {
-      value_start++;
-      if (*value_start == '"')
-        value_start = value_end = 0; /* size = 0 */
+      if (*(tag_end-1) == '"')
+        value_end = tag_end - 1;
       else
-      {
-        if (*(tag+len-1) == '"')
-        value_end = tag + len - 1;
-        else
-          return; /* bogus */
-      }
+        return; /* bogus */
     }
-    else
-      value_end = tag + len; /* value start really IS value start. */
-
-    gpspoint_process_key_and_value(tag, key_end - tag, value_start, value_end - value_start);
   }
+  else
+    value_end = tag_end; /* value start really IS value start. */
+
+  gpspoint_process_key_and_value(ctx, tag, key_end - tag, value_start, value_end - value_start);
 }
 
 /*
 value = NULL for none
 */
-static void gpspoint_process_key_and_value ( const gchar *key, gint key_len, const gchar *value, gint value_len )
+static void gpspoint_process_key_and_value ( GpspointReadingContext *ctx, const gchar *key, gint key_len, const gchar *value, gint value_len )
 {
   if (key_len == 4 && strncasecmp( key, "type", key_len ) == 0 )
   {
     if (value == NULL)
-      line_type = GPSPOINT_TYPE_NONE;
+      ctx->line_type = GPSPOINT_TYPE_NONE;
     else if (value_len == 5 && strncasecmp( value, "track", value_len ) == 0 )
-      line_type = GPSPOINT_TYPE_TRACK;
+      ctx->line_type = GPSPOINT_TYPE_TRACK;
     else if (value_len == 10 && strncasecmp( value, "trackpoint", value_len ) == 0 )
-      line_type = GPSPOINT_TYPE_TRACKPOINT;
+      ctx->line_type = GPSPOINT_TYPE_TRACKPOINT;
     else if (value_len == 8 && strncasecmp( value, "waypoint", value_len ) == 0 )
-      line_type = GPSPOINT_TYPE_WAYPOINT;
+      ctx->line_type = GPSPOINT_TYPE_WAYPOINT;
     else
       /* all others are ignored */
-      line_type = GPSPOINT_TYPE_NONE;
+      ctx->line_type = GPSPOINT_TYPE_NONE;
   }
   else if (key_len == 4 && strncasecmp( key, "name", key_len ) == 0 && value != NULL)
   {
-    if (line_name == NULL)
+    if (ctx->line_name == NULL)
     {
-      line_name = g_strndup ( value, value_len );
+      ctx->line_name = g_strndup ( value, value_len );
     }
   }
   else if (key_len == 7 && strncasecmp( key, "comment", key_len ) == 0 && value != NULL)
   {
-    if (line_comment == NULL)
-      line_comment = deslashndup ( value, value_len );
+    if (ctx->line_comment == NULL)
+      ctx->line_comment = deslashndup ( value, value_len );
   }
   else if (key_len == 5 && strncasecmp( key, "image", key_len ) == 0 && value != NULL)
   {
-    if (line_image == NULL)
-      line_image = deslashndup ( value, value_len );
+    if (ctx->line_image == NULL)
+      ctx->line_image = deslashndup ( value, value_len );
   }
   else if (key_len == 8 && strncasecmp( key, "latitude", key_len ) == 0 && value != NULL)
   {
-    line_latlon.lat = g_ascii_strtod(value, NULL);
+    ctx->line_latlon.lat = value_to_double(value, value_len);
   }
   else if (key_len == 9 && strncasecmp( key, "longitude", key_len ) == 0 && value != NULL)
   {
-    line_latlon.lon = g_ascii_strtod(value, NULL);
+    ctx->line_latlon.lon = value_to_double(value, value_len);
   }
   else if (key_len == 8 && strncasecmp( key, "altitude", key_len ) == 0 && value != NULL)
   {
-    line_altitude = g_ascii_strtod(value, NULL);
+    ctx->line_altitude = value_to_double(value, value_len);
   }
-  else if (key_len == 7 && strncasecmp( key, "visible", key_len ) == 0 && value[0] != 'y' && value[0] != 'Y' && value[0] != 't' && value[0] != 'T')
+  else if (key_len == 7 && strncasecmp( key, "visible", key_len ) == 0 && (value_len == 0 || (value[0] != 'y' && value[0] != 'Y' && value[0] != 't' && value[0] != 'T')))
   {
-    line_visible = FALSE;
+    ctx->line_visible = FALSE;
   }
   else if (key_len == 6 && strncasecmp( key, "symbol", key_len ) == 0 && value != NULL)
   {
-    line_symbol = g_strndup ( value, value_len );
+    if (ctx->line_symbol == NULL)
+      ctx->line_symbol = g_strndup ( value, value_len );
   }
   else if (key_len == 8 && strncasecmp( key, "unixtime", key_len ) == 0 && value != NULL)
   {
-    line_timestamp = g_ascii_strtod(value, NULL);
-    if ( line_timestamp != 0x80000000 )
-      line_has_timestamp = TRUE;
+    ctx->line_timestamp = value_to_double(value, value_len);
+    if ( ctx->line_timestamp != 0x80000000 )
+      ctx->line_has_timestamp = TRUE;
   }
   else if (key_len == 10 && strncasecmp( key, "newsegment", key_len ) == 0 && value != NULL)
   {
-    line_newsegment = TRUE;
+    ctx->line_newsegment = TRUE;
   }
   else if (key_len == 8 && strncasecmp( key, "extended", key_len ) == 0 && value != NULL)
   {
-    line_extended = TRUE;
+    ctx->line_extended = TRUE;
   }
   else if (key_len == 5 && strncasecmp( key, "speed", key_len ) == 0 && value != NULL)
   {
-    line_speed = g_ascii_strtod(value, NULL);
+    ctx->line_speed = value_to_double(value, value_len);
   }
   else if (key_len == 6 && strncasecmp( key, "course", key_len ) == 0 && value != NULL)
   {
-    line_course = g_ascii_strtod(value, NULL);
+    ctx->line_course = value_to_double(value, value_len);
   }
   else if (key_len == 3 && strncasecmp( key, "sat", key_len ) == 0 && value != NULL)
   {
-    line_sat = atoi(value);
+    ctx->line_sat = value_to_double(value, value_len);
   }
   else if (key_len == 3 && strncasecmp( key, "fix", key_len ) == 0 && value != NULL)
   {
-    line_fix = atoi(value);
+    ctx->line_fix = value_to_double(value, value_len);
   }
 }
 
 static void a_gpspoint_write_waypoint ( const gchar *name, VikWaypoint *wp, FILE *f )
 {
-  static struct LatLon ll;
+  struct LatLon ll;
   gchar *s_lat, *s_lon;
   vik_coord_to_latlon ( &(wp->coord), &ll );
   s_lat = a_coords_dtostr(ll.lat);
@@ -471,7 +523,7 @@ static void a_gpspoint_write_waypoint ( const gchar *name, VikWaypoint *wp, FILE
 
 static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, FILE *f )
 {
-  static struct LatLon ll;
+  struct LatLon ll;
   gchar *s_lat, *s_lon;
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
@@ -25,6 +25,7 @@
 #include "viktrwlayer.h"
 
 void a_gpspoint_read_file ( VikTrwLayer *trw, FILE *f );
+gsize a_gpspoint_read_buffer ( VikTrwLayer *trw, const gchar *buf, gsize len );
 void a_gpspoint_write_file ( VikTrwLayer *trw, FILE *f );
 
 #endif
@@ -138,26 +138,39 @@ static tag_type get_tag(const char *t)
 
 /******************************************/
 
-tag_type current_tag = tt_unknown;
-GString *xpath = NULL;
-GString *c_cdata = NULL;
-
-/* current ("c_") objects */
-VikTrackpoint *c_tp = NULL;
-VikWaypoint *c_wp = NULL;
-VikTrack *c_tr = NULL;
-
-gchar *c_wp_name = NULL;
-gchar *c_tr_name = NULL;
-
-/* temporary things so we don't have to create them lots of times */
-const gchar *c_slat, *c_slon;
-struct LatLon c_ll;
+/* a waypoint or track read whole, to go into the layer at the next flush */
+typedef struct {
+  gchar *name;
+  VikWaypoint *wp;
+  VikTrack *tr;
+} GpxEnded;
 
-/* specialty flags / etc */
-gboolean f_tr_newseg;
-guint unnamed_waypoints = 0;
-guint unnamed_tracks = 0;
+/* Parser state. There is one per a_gpx_read_file() call, so several files
+ * may be read at the same time from different threads. */
+typedef struct {
+  VikTrwLayer *vtl;
+  tag_type current_tag;
+  GString *xpath;
+  GString *c_cdata;
+
+  /* current ("c_") objects */
+  VikTrackpoint *c_tp;
+  VikWaypoint *c_wp;
+  VikTrack *c_tr;
+  GList *c_tps;        /* c_tr's points not handed on yet, newest first */
+  gboolean c_tr_shown; /* c_tr is in the layer already, see a_gpx_reader_flush() */
+  VikTrack *closed_tr; /* a shown track that has ended, */
+  GList *closed_tps;   /* and its last points */
+  GList *ended;        /* GpxEnded, newest first */
+
+  gchar *c_wp_name;
+  gchar *c_tr_name;
+
+  /* specialty flags / etc */
+  gboolean f_tr_newseg;
+  guint unnamed_waypoints;
+  guint unnamed_tracks;
+} GpxReadingContext;
 
 
 static const char *get_attr ( const char **attr, const char *key )
@@ -170,55 +183,60 @@ static const char *get_attr ( const char **attr, const char *key )
   return NULL;
 }
 
-static gboolean set_c_ll ( const char **attr )
+static gboolean get_ll ( const char **attr, struct LatLon *ll )
 {
-  if ( (c_slat = get_attr ( attr, "lat" )) && (c_slon = get_attr ( attr, "lon" )) ) {
-    c_ll.lat = g_ascii_strtod(c_slat, NULL);
-    c_ll.lon = g_ascii_strtod(c_slon, NULL);
+  const gchar *slat, *slon;
+  if ( (slat = get_attr ( attr, "lat" )) && (slon = get_attr ( attr, "lon" )) ) {
+    ll->lat = g_ascii_strtod(slat, NULL);
+    ll->lon = g_ascii_strtod(slon, NULL);
     return TRUE;
   }
   return FALSE;
 }
 
-static void gpx_start(VikTrwLayer *vtl, const char *el, const char **attr)
+static void gpx_start(GpxReadingContext *ctx, const char *el, const char **attr)
 {
-  static const gchar *tmp;
+  const gchar *tmp;
+  struct LatLon ll;
 
-  g_string_append_c ( xpath, '/' );
-  g_string_append ( xpath, el );
-  current_tag = get_tag ( xpath->str );
+  g_string_append_c ( ctx->xpath, '/' );
+  g_string_append ( ctx->xpath, el );
+  ctx->current_tag = get_tag ( ctx->xpath->str );
 
-  switch ( current_tag ) {
+  switch ( ctx->current_tag ) {
 
      case tt_wpt:
-       if ( set_c_ll( attr ) ) {
-         c_wp = vik_waypoint_new ();
+       if ( get_ll ( attr, &ll ) ) {
+         ctx->c_wp = vik_waypoint_new ();
          if ( ! get_attr ( attr, "hidden" ) )
-           c_wp->visible = TRUE;
+           ctx->c_wp->visible = TRUE;
 
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(ctx->c_wp->coord), vik_trw_layer_get_coord_mode ( ctx->vtl ), &ll );
        }
        break;
 
      case tt_trk:
-       c_tr = vik_track_new ();
+       ctx->c_tr = vik_track_new ();
+       ctx->c_tps = NULL;
+       ctx->c_tr_shown = FALSE;
        if ( ! get_attr ( attr, "hidden" ) )
-         c_tr->visible = TRUE;
+         ctx->c_tr->visible = TRUE;
        break;
 
      case tt_trk_trkseg:
-       f_tr_newseg = TRUE;
+       ctx->f_tr_newseg = TRUE;
        break;
 
      case tt_trk_trkseg_trkpt:
-       if ( set_c_ll( attr ) ) {
-         c_tp = vik_trackpoint_new ();
-         vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
-         if ( f_tr_newseg ) {
-           c_tp->newsegment = TRUE;
-           f_tr_newseg = FALSE;
+       if ( get_ll ( attr, &ll ) ) {
+         ctx->c_tp = vik_trackpoint_new ();
+         vik_coord_load_from_latlon ( &(ctx->c_tp->coord), vik_trw_layer_get_coord_mode ( ctx->vtl ), &ll );
+         if ( ctx->f_tr_newseg ) {
+           ctx->c_tp->newsegment = TRUE;
+           ctx->f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_append ( c_tr->trackpoints, c_tp );
+         /* kept in reverse until handed on, prepending is O(1) */
+         ctx->c_tps = g_list_prepend ( ctx->c_tps, ctx->c_tp );
        }
        break;
 
@@ -230,164 +248,181 @@ static void gpx_start(VikTrwLayer *vtl, const char *el, const char **attr)
      case tt_wpt_link:
      case tt_trk_desc:
      case tt_trk_name:
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer */
+       g_string_erase ( ctx->c_cdata, 0, -1 ); /* clear the cdata buffer */
        break;
 
      case tt_waypoint:
-       c_wp = vik_waypoint_new ();
-       c_wp->visible = TRUE;
+       ctx->c_wp = vik_waypoint_new ();
+       ctx->c_wp->visible = TRUE;
        break;
 
      case tt_waypoint_coord:
-       if ( set_c_ll( attr ) )
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+       if ( get_ll ( attr, &ll ) )
+         vik_coord_load_from_latlon ( &(ctx->c_wp->coord), vik_trw_layer_get_coord_mode ( ctx->vtl ), &ll );
        break;
 
      case tt_waypoint_name:
        if ( ( tmp = get_attr(attr, "id") ) ) {
-         if ( c_wp_name )
-           g_free ( c_wp_name );
-         c_wp_name = g_strdup ( tmp );
+         if ( ctx->c_wp_name )
+           g_free ( ctx->c_wp_name );
+         ctx->c_wp_name = g_strdup ( tmp );
        }
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer for description */
+       g_string_erase ( ctx->c_cdata, 0, -1 ); /* clear the cdata buffer for description */
        break;
         
      default: break;
   }
 }
 
-static void gpx_end(VikTrwLayer *vtl, const char *el)
+static void gpx_ended ( GpxReadingContext *ctx, gchar *name, VikWaypoint *wp, VikTrack *tr )
 {
-  static GTimeVal tp_time;
+  GpxEnded *e = g_malloc ( sizeof(GpxEnded) );
+  e->name = name;
+  e->wp = wp;
+  e->tr = tr;
+  ctx->ended = g_list_prepend ( ctx->ended, e );
+}
 
-  g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+static void gpx_end(GpxReadingContext *ctx, const char *el)
+{
+  GTimeVal tp_time;
 
-  switch ( current_tag ) {
+  g_string_truncate ( ctx->xpath, ctx->xpath->len - strlen(el) - 1 );
+
+  switch ( ctx->current_tag ) {
 
      case tt_waypoint:
      case tt_wpt:
-       if ( ! c_wp_name )
-         c_wp_name = g_strdup_printf("VIKING_WP%d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
-       g_free ( c_wp_name );
-       c_wp = NULL;
-       c_wp_name = NULL;
+       if ( ! ctx->c_wp_name )
+         ctx->c_wp_name = g_strdup_printf("VIKING_WP%d", ctx->unnamed_waypoints++);
+       gpx_ended ( ctx, ctx->c_wp_name, ctx->c_wp, NULL );
+       ctx->c_wp = NULL;
+       ctx->c_wp_name = NULL;
        break;
 
      case tt_trk:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_TR%d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
-       g_free ( c_tr_name );
-       c_tr = NULL;
-       c_tr_name = NULL;
+       if ( ctx->c_tr_shown ) {
+         /* may be on screen, so left for the next flush */
+         ctx->closed_tr = ctx->c_tr;
+         ctx->closed_tps = ctx->c_tps;
+       } else {
+         if ( ! ctx->c_tr_name )
+           ctx->c_tr_name = g_strdup_printf("VIKING_TR%d", ctx->unnamed_waypoints++);
+         ctx->c_tr->trackpoints = g_list_reverse ( ctx->c_tps );
+         gpx_ended ( ctx, ctx->c_tr_name, NULL, ctx->c_tr );
+         ctx->c_tr_name = NULL;
+       }
+       g_free ( ctx->c_tr_name );
+       ctx->c_tps = NULL;
+       ctx->c_tr = NULL;
+       ctx->c_tr_name = NULL;
        break;
 
      case tt_wpt_name:
-       if ( c_wp_name )
-         g_free ( c_wp_name );
-       c_wp_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ctx->c_wp_name )
+         g_free ( ctx->c_wp_name );
+       ctx->c_wp_name = g_strdup ( ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_name:
-       if ( c_tr_name )
-         g_free ( c_tr_name );
-       c_tr_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ctx->c_tr_name )
+         g_free ( ctx->c_tr_name );
+       ctx->c_tr_name = g_strdup ( ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ele:
-       c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_wp->altitude = g_ascii_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_ele:
-       c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->altitude = g_ascii_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint_name: /* .loc name is really description. */
      case tt_wpt_desc:
-       vik_waypoint_set_comment ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_comment ( ctx->c_wp, ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_link:
-       vik_waypoint_set_image ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_image ( ctx->c_wp, ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sym: {
-       gchar *tmp_lower = g_utf8_strdown(c_cdata->str, -1); /* for things like <type>Geocache</type> */
-       vik_waypoint_set_symbol ( c_wp, tmp_lower );
+       gchar *tmp_lower = g_utf8_strdown(ctx->c_cdata->str, -1); /* for things like <type>Geocache</type> */
+       vik_waypoint_set_symbol ( ctx->c_wp, tmp_lower );
        g_free ( tmp_lower );
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
        }
 
      case tt_trk_desc:
-       vik_track_set_comment ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_comment ( ctx->c_tr, ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
-         c_tp->timestamp = tp_time.tv_sec;
-         c_tp->has_timestamp = TRUE;
+       if ( g_time_val_from_iso8601(ctx->c_cdata->str, &tp_time) ) {
+         ctx->c_tp->timestamp = tp_time.tv_sec;
+         ctx->c_tp->has_timestamp = TRUE;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_course:
-       c_tp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->course = g_ascii_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_speed:
-       c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->speed = g_ascii_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_3D;
+       if (!strcmp("2d", ctx->c_cdata->str))
+         ctx->c_tp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ctx->c_cdata->str))
+         ctx->c_tp->fix_mode = VIK_GPS_MODE_3D;
        else  /* TODO: more fix modes here */
-         c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ctx->c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_sat:
-       c_tp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->nsats = atoi ( ctx->c_cdata->str );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_hdop:
-       c_tp->hdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->hdop = g_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_vdop:
-       c_tp->vdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->vdop = g_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_pdop:
-       c_tp->pdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ctx->c_tp->pdop = g_strtod ( ctx->c_cdata->str, NULL );
+       g_string_erase ( ctx->c_cdata, 0, -1 );
        break;
 
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
+  ctx->current_tag = get_tag ( ctx->xpath->str );
 }
 
-static void gpx_cdata(void *dta, const XML_Char *s, int len)
+static void gpx_cdata(GpxReadingContext *ctx, const XML_Char *s, int len)
 {
-  switch ( current_tag ) {
+  switch ( ctx->current_tag ) {
     case tt_wpt_name:
     case tt_trk_name:
     case tt_wpt_ele:
@@ -405,7 +440,7 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_trk_trkseg_trkpt_vdop:
     case tt_trk_trkseg_trkpt_pdop:
     case tt_waypoint_name: /* .loc name is really description. */
-      g_string_append_len ( c_cdata, s, len );
+      g_string_append_len ( ctx->c_cdata, s, len );
       break;
 
     default: break;  /* ignore cdata from other things */
@@ -415,33 +450,111 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
 // make like a "stack" of tag names
 // like gpspoint's separated like /gpx/wpt/whatever
 
-void a_gpx_read_file( VikTrwLayer *vtl, FILE *f ) {
-  XML_Parser parser = XML_ParserCreate(NULL);
-  int done=0, len;
+struct _GpxReader {
+  XML_Parser parser;
+  GpxReadingContext ctx;
+};
 
-  XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
-  XML_SetUserData(parser, vtl); /* in the future we could remove all global variables */
-  XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_cdata);
+GpxReader *a_gpx_reader_new ( VikTrwLayer *vtl )
+{
+  GpxReader *reader = g_malloc0 ( sizeof(GpxReader) );
 
-  gchar buf[4096];
+  g_assert ( vtl != NULL );
 
-  g_assert ( f != NULL && vtl != NULL );
+  reader->parser = XML_ParserCreate(NULL);
+  XML_SetElementHandler(reader->parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
+  XML_SetUserData(reader->parser, &(reader->ctx));
+  XML_SetCharacterDataHandler(reader->parser, (XML_CharacterDataHandler) gpx_cdata);
+
+  reader->ctx.vtl = vtl;
+  reader->ctx.current_tag = tt_unknown;
+  reader->ctx.xpath = g_string_new ( "" );
+  reader->ctx.c_cdata = g_string_new ( "" );
+  return reader;
+}
+
+void a_gpx_reader_feed ( GpxReader *reader, const gchar *buf, gsize len )
+{
+  XML_Parse(reader->parser, buf, len, FALSE);
+}
 
-  xpath = g_string_new ( "" );
-  c_cdata = g_string_new ( "" );
+static void gpx_append_points ( VikTrack *tr, GList *tps )
+{
+  tr->trackpoints = g_list_concat ( tr->trackpoints, g_list_reverse ( tps ) );
+  vik_track_calculate_bounds ( tr );
+}
+
+void a_gpx_reader_flush ( GpxReader *reader )
+{
+  GpxReadingContext *ctx = &(reader->ctx);
+  GList *iter;
+
+  ctx->ended = g_list_reverse ( ctx->ended );
+  for ( iter = ctx->ended; iter; iter = iter->next ) {
+    GpxEnded *e = iter->data;
+    if ( e->wp )
+      vik_trw_layer_filein_add_waypoint ( ctx->vtl, e->name, e->wp );
+    else
+      vik_trw_layer_filein_add_track ( ctx->vtl, e->name, e->tr );
+    g_free ( e->name );
+    g_free ( e );
+  }
+  g_list_free ( ctx->ended );
+  ctx->ended = NULL;
+
+  if ( ctx->closed_tr ) {
+    gpx_append_points ( ctx->closed_tr, ctx->closed_tps );
+    vik_track_free ( ctx->closed_tr );
+    ctx->closed_tr = NULL;
+    ctx->closed_tps = NULL;
+  }
+
+  if ( ! ctx->c_tr || ! ctx->c_tps )
+    return;
+  if ( ctx->c_tr_shown )
+    gpx_append_points ( ctx->c_tr, ctx->c_tps );
+  else {
+    if ( ! ctx->c_tr_name )
+      ctx->c_tr_name = g_strdup_printf("VIKING_TR%d", ctx->unnamed_waypoints++);
+    ctx->c_tr->trackpoints = g_list_reverse ( ctx->c_tps );
+    /* our reference stays valid should the track be deleted meanwhile */
+    vik_track_ref ( ctx->c_tr );
+    vik_trw_layer_filein_add_track ( ctx->vtl, ctx->c_tr_name, ctx->c_tr );
+    ctx->c_tr_shown = TRUE;
+  }
+  ctx->c_tps = NULL;
+}
 
-  unnamed_waypoints = 0;
-  unnamed_tracks = 0;
+void a_gpx_reader_free ( GpxReader *reader )
+{
+  GpxReadingContext *ctx = &(reader->ctx);
+
+  XML_Parse(reader->parser, NULL, 0, TRUE);
+  XML_ParserFree (reader->parser);
 
-  while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
-    done = feof(f) || !len;
-    XML_Parse(parser, buf, len, done);
+  a_gpx_reader_flush ( reader );
+  /* a track cut off by the end of the input */
+  if ( ctx->c_tr ) {
+    vik_track_free ( ctx->c_tr );
+    g_free ( ctx->c_tr_name );
   }
- 
-  XML_ParserFree (parser);
-  g_string_free ( xpath, TRUE );
-  g_string_free ( c_cdata, TRUE );
+
+  g_string_free ( reader->ctx.xpath, TRUE );
+  g_string_free ( reader->ctx.c_cdata, TRUE );
+  g_free ( reader );
+}
+
+void a_gpx_read_file( VikTrwLayer *vtl, FILE *f ) {
+  GpxReader *reader;
+  gchar buf[4096];
+  size_t len;
+
+  g_assert ( f != NULL && vtl != NULL );
+
+  reader = a_gpx_reader_new ( vtl );
+  while ( (len = fread(buf, 1, sizeof(buf), f)) > 0 )
+    a_gpx_reader_feed ( reader, buf, len );
+  a_gpx_reader_free ( reader );
 }
 
 /**** entitize from GPSBabel ****/
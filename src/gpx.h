@@ -33,6 +33,20 @@ typedef struct {
 } GpxWritingOptions;
 
 void a_gpx_read_file ( VikTrwLayer *trw, FILE *f );
+
+/* For GPX arriving a piece at a time, as from a pipe. Nothing is added
+ * to trw while feeding, only at a flush; freeing the reader ends the
+ * document and flushes. */
+typedef struct _GpxReader GpxReader;
+GpxReader *a_gpx_reader_new ( VikTrwLayer *trw );
+void a_gpx_reader_feed ( GpxReader *reader, const gchar *buf, gsize len );
+/* Adds what has been read of the current track too, so a long one can be
+ * shown as it arrives. Its points then go straight onto it, wherever it has
+ * been moved, at each flush or when the reader is freed: hold the gdk lock
+ * around those calls if trw's tracks may be on screen by then. */
+void a_gpx_reader_flush ( GpxReader *reader );
+void a_gpx_reader_free ( GpxReader *reader );
+
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f );
 void a_gpx_write_file_options ( GpxWritingOptions *options, VikTrwLayer *trw, FILE *f );
 void a_gpx_write_track_file ( const gchar *name, VikTrack *track, FILE *f );
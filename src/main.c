@@ -31,13 +31,18 @@
 #include "curl_download.h"
 #include "preferences.h"
 #include "globals.h"
+#include "render.h"
 
 #ifdef VIK_CONFIG_GEOCACHES
 void a_datasource_gc_init();
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WINDOWS
+#include <signal.h>
+#endif
 
 #include <glib/gprintf.h>
 #include <glib/gi18n.h>
@@ -110,6 +115,13 @@ static void open_window ( VikWindow *vw, const gchar **files )
     }
 }
 
+/* Rendering without a window */
+static gchar *render_file = NULL;
+static gchar *render_bbox = NULL;
+static gchar *render_size = NULL;
+static gdouble render_zoom = 0.0;
+static gchar *convert_file = NULL;
+
 /* Options */
 static GOptionEntry entries[] = 
 {
@@ -117,9 +129,149 @@ static GOptionEntry entries[] =
   { "debug", 'd', 0, G_OPTION_ARG_NONE, &vik_debug, N_("Enable debug output"), NULL },
   { "verbose", 'V', 0, G_OPTION_ARG_NONE, &vik_verbose, N_("Enable verbose output"), NULL },
   { "version", 'v', 0, G_OPTION_ARG_NONE, &vik_version, N_("Show version"), NULL },
+  { "render", 'r', 0, G_OPTION_ARG_FILENAME, &render_file, N_("Draw the files into a PNG or JPEG image and exit"), N_("IMAGE") },
+  { "bbox", 'b', 0, G_OPTION_ARG_STRING, &render_bbox, N_("Area to draw, in degrees (default: the view saved in the file)"), N_("SOUTH,WEST,NORTH,EAST") },
+  { "zoom", 'z', 0, G_OPTION_ARG_DOUBLE, &render_zoom, N_("Metres per pixel to draw at (default: fit the area, or the saved view)"), N_("MPP") },
+  { "size", 0, 0, G_OPTION_ARG_STRING, &render_size, N_("Size of the image (default: 1024x768)"), N_("WIDTHxHEIGHT") },
+  { "convert", 'c', 0, G_OPTION_ARG_FILENAME, &convert_file, N_("Save the files as one project (binary if it ends in .vikb) and exit"), N_("FILE") },
   { NULL }
 };
 
+static void render_corners_to_screen ( VikViewport *vvp, const struct LatLon *sw, const struct LatLon *ne,
+                                      gint *x1, gint *y1, gint *x2, gint *y2 )
+{
+  VikCoord c1, c2;
+
+  vik_coord_load_from_latlon ( &c1, vik_viewport_get_coord_mode ( vvp ), sw );
+  vik_coord_load_from_latlon ( &c2, vik_viewport_get_coord_mode ( vvp ), ne );
+  vik_viewport_coord_to_screen ( vvp, &c1, x1, y1 );
+  vik_viewport_coord_to_screen ( vvp, &c2, x2, y2 );
+}
+
+/* A UTM view only shows its own zone */
+static gboolean render_corners_in_zone ( VikViewport *vvp, const struct LatLon *sw, const struct LatLon *ne )
+{
+  gint x1, y1, x2, y2;
+
+  render_corners_to_screen ( vvp, sw, ne, &x1, &y1, &x2, &y2 );
+  return x1 != VIK_VIEWPORT_UTM_WRONG_ZONE && x2 != VIK_VIEWPORT_UTM_WRONG_ZONE;
+}
+
+/* Zoom at which the area between the corners fills the image */
+static gdouble render_fit_zoom ( VikViewport *vvp, const struct LatLon *sw, const struct LatLon *ne, guint width, guint height )
+{
+  gint x1, y1, x2, y2;
+  gdouble zoom = vik_viewport_get_zoom ( vvp );
+
+  render_corners_to_screen ( vvp, sw, ne, &x1, &y1, &x2, &y2 );
+  if ( x1 == x2 && y1 == y2 )
+    return zoom;
+  /* screen distances are inversely proportional to the zoom */
+  return zoom * MAX ( (gdouble) ABS(x2-x1) / width, (gdouble) ABS(y2-y1) / height );
+}
+
+/* The files given on the command line, into top and the view of vvp */
+static gboolean load_files ( VikAggregateLayer *top, VikViewport *vvp, int argc, char *argv[] )
+{
+  int i;
+
+  for ( i = 1; i < argc; i++ )
+    if ( strcmp ( argv[i], "--" ) != 0 && ! a_file_load ( top, vvp, argv[i] ) ) {
+      g_fprintf ( stderr, _("Unable to load %s\n"), argv[i] );
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Loads the files given on the command line and draws them into
+ * render_file, as "Generate Image File" would, without opening a window.
+ * Maps are drawn from what is already in the tile cache. */
+static int render_files ( int argc, char *argv[] )
+{
+  guint width = 1024, height = 768;
+  struct LatLon sw, ne;
+  VikAggregateLayer *top;
+  VikViewport *vvp;
+  GError *error = NULL;
+  gboolean save_as_png;
+
+  if ( render_size && ( sscanf ( render_size, "%ux%u", &width, &height ) != 2 || ! width || ! height ) ) {
+    g_fprintf ( stderr, _("Invalid image size: %s\n"), render_size );
+    return EXIT_FAILURE;
+  }
+  if ( render_bbox && sscanf ( render_bbox, "%lf,%lf,%lf,%lf", &sw.lat, &sw.lon, &ne.lat, &ne.lon ) != 4 ) {
+    g_fprintf ( stderr, _("Invalid area: %s\n"), render_bbox );
+    return EXIT_FAILURE;
+  }
+  save_as_png = ! ( g_str_has_suffix ( render_file, ".jpg" ) || g_str_has_suffix ( render_file, ".jpeg" )
+                    || g_str_has_suffix ( render_file, ".JPG" ) || g_str_has_suffix ( render_file, ".JPEG" ) );
+
+  gdk_threads_enter ();
+
+  /* holds the view the files set, the image is drawn elsewhere */
+  vvp = vik_viewport_new_offscreen ( NULL, width, MIN ( height, RENDER_STRIP_HEIGHT ) );
+  top = vik_aggregate_layer_new ();
+  if ( ! load_files ( top, vvp, argc, argv ) ) {
+    gdk_threads_leave ();
+    return EXIT_FAILURE;
+  }
+
+  if ( render_bbox ) {
+    struct LatLon center;
+    center.lat = (sw.lat + ne.lat) / 2;
+    center.lon = (sw.lon + ne.lon) / 2;
+    vik_viewport_set_center_latlon ( vvp, &center );
+    if ( ! render_corners_in_zone ( vvp, &sw, &ne ) ) {
+      /* the area spans UTM zones, draw it in a projection that takes it all */
+      vik_viewport_set_drawmode ( vvp, VIK_VIEWPORT_DRAWMODE_MERCATOR );
+      vik_layer_change_coord_mode ( VIK_LAYER(top), VIK_COORD_LATLON );
+      vik_viewport_set_center_latlon ( vvp, &center );
+    }
+    if ( render_zoom <= 0.0 )
+      render_zoom = render_fit_zoom ( vvp, &sw, &ne, width, height );
+  }
+  if ( render_zoom <= 0.0 )
+    render_zoom = vik_viewport_get_zoom ( vvp );
+
+  if ( ! a_render_file ( VIK_LAYER(top), vvp, render_zoom, width, height, render_file, save_as_png, &error ) ) {
+    g_fprintf ( stderr, _("Unable to write %s: %s\n"), render_file, error->message );
+    g_error_free ( error );
+    gdk_threads_leave ();
+    return EXIT_FAILURE;
+  }
+
+  g_object_unref ( G_OBJECT(top) );
+  vik_viewport_free_offscreen ( vvp );
+  gdk_threads_leave ();
+  return EXIT_SUCCESS;
+}
+
+/* Loads the files given on the command line and saves them as one
+ * project in convert_file, as "Save As" would, without opening a window */
+static int convert_files ( int argc, char *argv[] )
+{
+  VikAggregateLayer *top;
+  VikViewport *vvp;
+  int status = EXIT_SUCCESS;
+
+  gdk_threads_enter ();
+
+  /* only the view the files set is saved */
+  vvp = vik_viewport_new_offscreen ( NULL, 1024, 768 );
+  top = vik_aggregate_layer_new ();
+  if ( ! load_files ( top, vvp, argc, argv ) )
+    status = EXIT_FAILURE;
+  else if ( ! a_file_save ( top, vvp, convert_file ) ) {
+    g_fprintf ( stderr, _("Unable to write %s\n"), convert_file );
+    status = EXIT_FAILURE;
+  }
+
+  g_object_unref ( G_OBJECT(top) );
+  vik_viewport_free_offscreen ( vvp );
+  gdk_threads_leave ();
+  return status;
+}
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
@@ -136,6 +288,11 @@ int main( int argc, char *argv[] )
   g_thread_init ( NULL );
   gdk_threads_init ();
 
+#ifndef WINDOWS
+  /* set before any thread writes to a program which may go away early */
+  signal ( SIGPIPE, SIG_IGN );
+#endif
+
   gui_initialized = gtk_init_with_args (&argc, &argv, "files+", entries, NULL, &error);
   if (!gui_initialized)
   {
@@ -145,6 +302,8 @@ int main( int argc, char *argv[] )
       /* no error message, the GUI initialization failed */
       const gchar *display_name = gdk_get_display_arg_name ();
       g_fprintf (stderr, "Failed to open display: %s\n", (display_name != NULL) ? display_name : " ");
+      if (render_file || convert_file)
+        g_fprintf (stderr, "Loading files still needs an X server, try running under xvfb-run.\n");
     }
     else
     {
@@ -182,6 +341,18 @@ int main( int argc, char *argv[] )
   a_datasource_gc_init();
 #endif
 
+  if (render_file || convert_file)
+  {
+    int status = convert_file ? convert_files ( argc, argv ) : EXIT_SUCCESS;
+    if ( status == EXIT_SUCCESS && render_file )
+      status = render_files ( argc, argv );
+    a_background_uninit ();
+    a_mapcache_uninit ();
+    a_dems_uninit ();
+    a_preferences_uninit ();
+    return status;
+  }
+
   /* Set the icon */
   main_icon = gdk_pixbuf_from_pixdata(&viking_pixbuf, FALSE, NULL);
   gtk_window_set_default_icon(main_icon);
@@ -0,0 +1,192 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "marshall.h"
+
+void a_marshall_uint8 ( GByteArray *b, guint8 v )
+{
+  g_byte_array_append ( b, &v, sizeof(v) );
+}
+
+void a_marshall_uint16 ( GByteArray *b, guint16 v )
+{
+  v = GUINT16_TO_LE ( v );
+  g_byte_array_append ( b, (guint8 *) &v, sizeof(v) );
+}
+
+void a_marshall_uint32 ( GByteArray *b, guint32 v )
+{
+  v = GUINT32_TO_LE ( v );
+  g_byte_array_append ( b, (guint8 *) &v, sizeof(v) );
+}
+
+void a_marshall_uint64 ( GByteArray *b, guint64 v )
+{
+  v = GUINT64_TO_LE ( v );
+  g_byte_array_append ( b, (guint8 *) &v, sizeof(v) );
+}
+
+void a_marshall_int64 ( GByteArray *b, gint64 v )
+{
+  a_marshall_uint64 ( b, (guint64) v );
+}
+
+/* the bits, in the byte order of a 64 bit integer */
+void a_marshall_double ( GByteArray *b, gdouble v )
+{
+  guint64 bits;
+  memcpy ( &bits, &v, sizeof(bits) );
+  a_marshall_uint64 ( b, bits );
+}
+
+void a_marshall_string ( GByteArray *b, const gchar *s )
+{
+  guint32 len = s ? strlen(s) + 1 : 0;
+  a_marshall_uint32 ( b, len );
+  if ( s )
+    g_byte_array_append ( b, (guint8 *) s, len );
+}
+
+void a_marshall_coord ( GByteArray *b, const VikCoord *coord )
+{
+  a_marshall_double ( b, coord->north_south );
+  a_marshall_double ( b, coord->east_west );
+  a_marshall_uint8 ( b, coord->utm_zone );
+  a_marshall_uint8 ( b, coord->utm_letter );
+  a_marshall_uint8 ( b, coord->mode );
+}
+
+void a_marshall_set_uint64 ( GByteArray *b, guint pos, guint64 v )
+{
+  g_return_if_fail ( pos + sizeof(v) <= b->len );
+  v = GUINT64_TO_LE ( v );
+  memcpy ( b->data + pos, &v, sizeof(v) );
+}
+
+void a_marshall_reader_init ( MarshallReader *r, const guint8 *data, gsize len )
+{
+  r->data = data;
+  r->left = data ? len : 0;
+  r->error = FALSE;
+}
+
+/* the data has no alignment to speak of, hence the copies */
+static gboolean reader_take ( MarshallReader *r, gpointer dest, gsize len )
+{
+  if ( r->error || r->left < len ) {
+    r->error = TRUE;
+    memset ( dest, 0, len );
+    return FALSE;
+  }
+  memcpy ( dest, r->data, len );
+  r->data += len;
+  r->left -= len;
+  return TRUE;
+}
+
+guint8 a_unmarshall_uint8 ( MarshallReader *r )
+{
+  guint8 v;
+  reader_take ( r, &v, sizeof(v) );
+  return v;
+}
+
+guint16 a_unmarshall_uint16 ( MarshallReader *r )
+{
+  guint16 v;
+  reader_take ( r, &v, sizeof(v) );
+  return GUINT16_FROM_LE ( v );
+}
+
+guint32 a_unmarshall_uint32 ( MarshallReader *r )
+{
+  guint32 v;
+  reader_take ( r, &v, sizeof(v) );
+  return GUINT32_FROM_LE ( v );
+}
+
+guint64 a_unmarshall_uint64 ( MarshallReader *r )
+{
+  guint64 v;
+  reader_take ( r, &v, sizeof(v) );
+  return GUINT64_FROM_LE ( v );
+}
+
+gint64 a_unmarshall_int64 ( MarshallReader *r )
+{
+  return (gint64) a_unmarshall_uint64 ( r );
+}
+
+gdouble a_unmarshall_double ( MarshallReader *r )
+{
+  guint64 bits = a_unmarshall_uint64 ( r );
+  gdouble v;
+  memcpy ( &v, &bits, sizeof(v) );
+  return v;
+}
+
+gchar *a_unmarshall_string ( MarshallReader *r )
+{
+  guint32 len = a_unmarshall_uint32 ( r );
+  gchar *s;
+
+  if ( len == 0 || r->error )
+    return NULL;
+  if ( r->left < len || r->data[len-1] != '\0' ) {
+    r->error = TRUE;
+    return NULL;
+  }
+  s = g_memdup ( r->data, len );
+  r->data += len;
+  r->left -= len;
+  return s;
+}
+
+void a_unmarshall_coord ( MarshallReader *r, VikCoord *coord )
+{
+  coord->north_south = a_unmarshall_double ( r );
+  coord->east_west = a_unmarshall_double ( r );
+  coord->utm_zone = a_unmarshall_uint8 ( r );
+  coord->utm_letter = a_unmarshall_uint8 ( r );
+  coord->mode = a_unmarshall_uint8 ( r );
+}
+
+gboolean a_unmarshall_part ( MarshallReader *r, guint64 len, MarshallReader *sub )
+{
+  if ( r->error || r->left < len ) {
+    r->error = TRUE;
+    a_marshall_reader_init ( sub, NULL, 0 );
+    sub->error = TRUE;
+    return FALSE;
+  }
+  a_marshall_reader_init ( sub, r->data, len );
+  r->data += len;
+  r->left -= len;
+  return TRUE;
+}
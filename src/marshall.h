@@ -0,0 +1,68 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_MARSHALL_H
+#define _VIKING_MARSHALL_H
+
+#include <glib.h>
+
+#include "vikcoord.h"
+
+/* Packed data for the clipboard and the binary project files: every
+ * field is written on its own at a fixed width and little endian, so
+ * there are no pointers, no struct padding and no byte order in it.
+ * Strings go with their length (NUL included) in front, 0 for NULL. */
+
+void a_marshall_uint8 ( GByteArray *b, guint8 v );
+void a_marshall_uint16 ( GByteArray *b, guint16 v );
+void a_marshall_uint32 ( GByteArray *b, guint32 v );
+void a_marshall_uint64 ( GByteArray *b, guint64 v );
+void a_marshall_int64 ( GByteArray *b, gint64 v );
+void a_marshall_double ( GByteArray *b, gdouble v );
+void a_marshall_string ( GByteArray *b, const gchar *s );
+void a_marshall_coord ( GByteArray *b, const VikCoord *coord );
+#define A_MARSHALL_COORD_SIZE 19
+
+/* overwrites what a_marshall_uint64() put at pos, e.g. a length not known before */
+void a_marshall_set_uint64 ( GByteArray *b, guint pos, guint64 v );
+
+/* Reading past the end, or a malformed string, sets error and from
+ * then on everything reads as 0 or NULL: check it once at the end. */
+typedef struct {
+  const guint8 *data;
+  gsize left;
+  gboolean error;
+} MarshallReader;
+
+void a_marshall_reader_init ( MarshallReader *r, const guint8 *data, gsize len );
+guint8 a_unmarshall_uint8 ( MarshallReader *r );
+guint16 a_unmarshall_uint16 ( MarshallReader *r );
+guint32 a_unmarshall_uint32 ( MarshallReader *r );
+guint64 a_unmarshall_uint64 ( MarshallReader *r );
+gint64 a_unmarshall_int64 ( MarshallReader *r );
+gdouble a_unmarshall_double ( MarshallReader *r );
+gchar *a_unmarshall_string ( MarshallReader *r ); /* newly allocated */
+void a_unmarshall_coord ( MarshallReader *r, VikCoord *coord );
+
+/* sub covers the next len bytes, which r then skips; FALSE if there aren't as many */
+gboolean a_unmarshall_part ( MarshallReader *r, guint64 len, MarshallReader *sub );
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_MD5_H
+#define _VIKING_MD5_H
+
+#include <glib.h>
+
+typedef struct _MD5Context MD5Context;
+
+struct _MD5Context {
+	guint32 buf[4];
+	guint32 bytes[2];
+	guint32 in[16];
+};
+
+void a_md5_init ( MD5Context *ctx );
+void a_md5_update ( MD5Context *ctx, const guint8 *buf, guint len );
+/* the digest as 32 hex digits, to be freed */
+gchar *a_md5_final ( MD5Context *ctx );
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "globals.h"
+#include "coords.h"
+#include "realtime.h"
+
+/* m/s in a knot */
+#define REALTIME_KNOT 0.514444
+
+static void realtime_fix_init ( RealtimeFix *fix )
+{
+  memset ( fix, 0, sizeof(RealtimeFix) );
+  /* track alt/time graph uses VIK_DEFAULT_ALTITUDE (0.0) as invalid */
+  fix->altitude = VIK_DEFAULT_ALTITUDE;
+  fix->speed = NAN;
+}
+
+void a_realtime_recorder_init ( RealtimeRecorder *rec, VikTrack *track, VikCoordMode mode )
+{
+  rec->track = track;
+  if ( track )
+    vik_track_ref ( track );
+  rec->coord_mode = mode;
+  rec->tail = track ? g_list_last ( track->trackpoints ) : NULL;
+  rec->tail_stale = rec->tail_ours = FALSE;
+  realtime_fix_init ( &(rec->latest) );
+  realtime_fix_init ( &(rec->last) );
+  rec->dirty = FALSE;
+  rec->points = 0;
+  rec->length = rec->last_step = rec->max_speed = 0;
+  rec->start = 0;
+}
+
+void a_realtime_recorder_clear ( RealtimeRecorder *rec )
+{
+  if ( rec->track )
+    vik_track_free ( rec->track );
+  rec->track = NULL;
+  rec->tail = NULL;
+}
+
+void a_realtime_recorder_changed ( RealtimeRecorder *rec )
+{
+  rec->tail_stale = TRUE;
+}
+
+/* the same tests as always: a new point for a turn of more than 3 degrees
+ * or a change of height, in place of the last if that was a 2D fix */
+static VikTrackpoint *realtime_record ( RealtimeRecorder *rec, gboolean forced, gboolean *replaced )
+{
+  RealtimeFix *fix = &(rec->latest), *last = &(rec->last);
+  time_t cur_timestamp = fix->time, last_timestamp = last->time;
+  gint heading, last_heading, alt, last_alt;
+  gboolean replace = FALSE;
+  VikTrackpoint *tp;
+  struct LatLon ll;
+
+  if ( replaced )
+    *replaced = FALSE;
+  if ( cur_timestamp < last_timestamp || ! rec->track || ! rec->dirty )
+    return NULL;
+  /* edited from elsewhere, whatever is at the end is not ours now */
+  if ( rec->tail_stale ) {
+    rec->tail = g_list_last ( rec->track->trackpoints );
+    rec->tail_stale = rec->tail_ours = FALSE;
+  }
+  /* emptied from elsewhere */
+  if ( ! rec->track->trackpoints )
+    rec->tail = NULL;
+
+  heading = (gint) floor ( fix->track );
+  last_heading = (gint) floor ( last->track );
+  alt = isnan ( fix->altitude ) ? VIK_DEFAULT_ALTITUDE : floor ( fix->altitude );
+  last_alt = isnan ( last->altitude ) ? VIK_DEFAULT_ALTITUDE : floor ( last->altitude );
+
+  if ( rec->tail && rec->tail_ours && fix->mode > VIK_GPS_MODE_2D && last->mode <= VIK_GPS_MODE_2D &&
+       cur_timestamp - last_timestamp < 2 ) {
+    GList *prev = rec->tail->prev;
+    vik_trackpoint_free ( VIK_TRACKPOINT(rec->tail->data) );
+    rec->track->trackpoints = g_list_delete_link ( rec->track->trackpoints, rec->tail );
+    rec->tail = prev;
+    rec->points--;
+    rec->length -= rec->last_step;
+    replace = TRUE;
+  }
+  if ( ! replace &&
+       ( cur_timestamp == last_timestamp ||
+         ! ( forced || ABS ( heading - last_heading ) > 3 ||
+             ( alt != VIK_DEFAULT_ALTITUDE && alt != last_alt ) ) ) )
+    return NULL;
+
+  /* TODO: check for new segments */
+  tp = vik_trackpoint_new ();
+  tp->newsegment = FALSE;
+  tp->has_timestamp = TRUE;
+  tp->timestamp = fix->time;
+  tp->altitude = alt;
+  /* speed only available for 3D fix. Check for NAN when use this speed */
+  tp->speed = fix->speed;
+  tp->course = fix->track;
+  tp->nsats = fix->satellites_used;
+  tp->fix_mode = fix->mode;
+  ll.lat = fix->latitude;
+  ll.lon = fix->longitude;
+  vik_coord_load_from_latlon ( &(tp->coord), rec->coord_mode, &ll );
+
+  /* appending to the last link walks no list */
+  if ( rec->tail ) {
+    rec->last_step = vik_coord_diff ( &(VIK_TRACKPOINT(rec->tail->data)->coord), &(tp->coord) );
+    rec->tail = g_list_append ( rec->tail, tp )->next;
+  } else {
+    rec->last_step = 0;
+    rec->track->trackpoints = rec->tail = g_list_append ( NULL, tp );
+    rec->start = tp->timestamp;
+  }
+  rec->tail_ours = TRUE;
+  rec->points++;
+  rec->length += rec->last_step;
+  if ( ! isnan ( tp->speed ) && tp->speed > rec->max_speed )
+    rec->max_speed = tp->speed;
+
+  if ( replace )
+    vik_track_calculate_bounds ( rec->track );
+  else
+    vik_track_extend_bounds ( rec->track, tp );
+
+  rec->dirty = FALSE;
+  fix->satellites_used = 0;
+  *last = *fix;
+  if ( replaced )
+    *replaced = replace;
+  return tp;
+}
+
+VikTrackpoint *a_realtime_recorder_add ( RealtimeRecorder *rec, const RealtimeFix *fix, gboolean forced, gboolean *replaced )
+{
+  rec->latest = *fix;
+  rec->dirty = TRUE;
+  return realtime_record ( rec, forced, replaced );
+}
+
+VikTrackpoint *a_realtime_recorder_flush ( RealtimeRecorder *rec )
+{
+  return realtime_record ( rec, TRUE, NULL );
+}
+
+gchar *a_realtime_recorder_status ( RealtimeRecorder *rec )
+{
+  glong secs = rec->points ? (glong) rec->last.time - rec->start : 0;
+
+  return g_strdup_printf ( _("%lu points, %.2f km in %ld:%02ld:%02ld, max %.1f km/h"),
+                           rec->points, rec->length / 1000,
+                           secs / 3600, (secs / 60) % 60, secs % 60, rec->max_speed * 3.6 );
+}
+
+/* grows the rectangle x1,y1 x2,y2 to take in c */
+static gboolean realtime_area_add ( VikViewport *vvp, const VikCoord *c, gint *x1, gint *y1, gint *x2, gint *y2, gboolean first )
+{
+  VikCoord conv;
+  gint x, y;
+
+  vik_coord_copy_convert ( c, vik_viewport_get_coord_mode ( vvp ), &conv );
+  vik_viewport_coord_to_screen ( vvp, &conv, &x, &y );
+  if ( x == VIK_VIEWPORT_UTM_WRONG_ZONE )
+    return FALSE;
+  if ( first ) {
+    *x1 = *x2 = x;
+    *y1 = *y2 = y;
+  } else {
+    *x1 = MIN(*x1,x); *x2 = MAX(*x2,x);
+    *y1 = MIN(*y1,y); *y2 = MAX(*y2,y);
+  }
+  return TRUE;
+}
+
+gboolean a_realtime_redraw_area ( VikViewport *vvp, const VikCoord *old, const VikCoord *cur, const VikCoord *prev, GdkRectangle *area )
+{
+  gint x1, y1, x2, y2;
+
+  if ( ! realtime_area_add ( vvp, cur, &x1, &y1, &x2, &y2, TRUE ) ||
+       ( old && ! realtime_area_add ( vvp, old, &x1, &y1, &x2, &y2, FALSE ) ) ||
+       ( prev && ! realtime_area_add ( vvp, prev, &x1, &y1, &x2, &y2, FALSE ) ) )
+    return FALSE;
+  area->x = x1 - REALTIME_CURSOR_SIZE;
+  area->y = y1 - REALTIME_CURSOR_SIZE;
+  area->width = x2 - x1 + 2 * REALTIME_CURSOR_SIZE;
+  area->height = y2 - y1 + 2 * REALTIME_CURSOR_SIZE;
+  return TRUE;
+}
+
+/* ---------------------------------------------------- */
+
+/* ddmm.mmmm and a hemisphere */
+static gdouble realtime_nmea_angle ( const gchar *value, const gchar *hemisphere )
+{
+  gdouble v = g_ascii_strtod ( value, NULL );
+  gdouble deg = floor ( v / 100 );
+
+  deg += ( v - deg * 100 ) / 60;
+  return ( *hemisphere == 'S' || *hemisphere == 'W' ) ? -deg : deg;
+}
+
+/* the XOR of everything between the $ and the *, when given */
+static gboolean realtime_nmea_checksum ( const gchar *line )
+{
+  const gchar *star = strchr ( line, '*' ), *p;
+  guint sum = 0;
+
+  if ( ! star )
+    return TRUE;
+  for ( p = line + 1; p < star; p++ )
+    sum ^= (guchar) *p;
+  return strtoul ( star + 1, NULL, 16 ) == sum;
+}
+
+/* hhmmss.ss and ddmmyy */
+static gdouble realtime_nmea_time ( const gchar *hms, const gchar *dmy )
+{
+  GDate date;
+  gdouble secs = g_ascii_strtod ( hms, NULL );
+  gint d = atoi ( dmy );
+  gint y = d % 100;
+
+  if ( strlen ( hms ) < 6 || strlen ( dmy ) != 6 )
+    return 0;
+  g_date_clear ( &date, 1 );
+  g_date_set_dmy ( &date, d / 10000, (d / 100) % 100, y < 80 ? 2000 + y : 1900 + y );
+  if ( ! g_date_valid ( &date ) )
+    return 0;
+  /* days since 1970 */
+  return ( g_date_get_julian ( &date ) - 719163 ) * 86400.0 +
+         floor ( secs / 10000 ) * 3600 + fmod ( floor ( secs / 100 ), 100 ) * 60 + fmod ( secs, 100 );
+}
+
+static gboolean realtime_parse_nmea ( RealtimeFix *fix, const gchar *line )
+{
+  gchar *copy, *star, **f;
+  guint n;
+  gboolean complete = FALSE;
+
+  if ( ! realtime_nmea_checksum ( line ) )
+    return FALSE;
+  copy = g_strdup ( line );
+  if ( (star = strchr ( copy, '*' )) )
+    *star = '\0';
+  f = g_strsplit ( copy, ",", 0 );
+  n = g_strv_length ( f );
+
+  /* any talker, GP, GN... */
+  if ( strlen ( f[0] ) == 6 && strcmp ( f[0] + 3, "RMC" ) == 0 && n >= 10 ) {
+    if ( f[2][0] == 'A' && *f[3] && *f[5] ) {
+      fix->time = realtime_nmea_time ( f[1], f[9] );
+      fix->latitude = realtime_nmea_angle ( f[3], f[4] );
+      fix->longitude = realtime_nmea_angle ( f[5], f[6] );
+      fix->speed = *f[7] ? g_ascii_strtod ( f[7], NULL ) * REALTIME_KNOT : NAN;
+      fix->track = *f[8] ? g_ascii_strtod ( f[8], NULL ) : 0;
+      if ( fix->mode < VIK_GPS_MODE_2D )
+        fix->mode = VIK_GPS_MODE_2D;
+      complete = TRUE;
+    } else
+      fix->mode = VIK_GPS_MODE_NO_FIX;
+  } else if ( strlen ( f[0] ) == 6 && strcmp ( f[0] + 3, "GGA" ) == 0 && n >= 10 ) {
+    fix->satellites_used = atoi ( f[7] );
+    fix->altitude = *f[9] ? g_ascii_strtod ( f[9], NULL ) : NAN;
+  } else if ( strlen ( f[0] ) == 6 && strcmp ( f[0] + 3, "GSA" ) == 0 && n >= 3 ) {
+    fix->mode = atoi ( f[2] );
+  }
+
+  g_strfreev ( f );
+  g_free ( copy );
+  return complete;
+}
+
+/* "key":value in a line of JSON, enough for gpsd's flat reports */
+static gboolean realtime_json_value ( const gchar *line, const gchar *key, gdouble *value, const gchar **string )
+{
+  gchar *pattern = g_strdup_printf ( "\"%s\":", key );
+  const gchar *p = strstr ( line, pattern );
+
+  if ( p ) {
+    p += strlen ( pattern );
+    while ( *p == ' ' )
+      p++;
+    if ( string )
+      *string = p;
+    else
+      *value = g_ascii_strtod ( p, NULL );
+  }
+  g_free ( pattern );
+  return p != NULL;
+}
+
+static gboolean realtime_parse_json ( RealtimeFix *fix, const gchar *line )
+{
+  const gchar *s;
+  gdouble v;
+
+  if ( ! strstr ( line, "\"class\":\"TPV\"" ) )
+    return FALSE;
+
+  fix->mode = realtime_json_value ( line, "mode", &v, NULL ) ? (gint) v : VIK_GPS_MODE_NOT_SEEN;
+  if ( fix->mode < VIK_GPS_MODE_2D ||
+       ! realtime_json_value ( line, "lat", &(fix->latitude), NULL ) ||
+       ! realtime_json_value ( line, "lon", &(fix->longitude), NULL ) )
+    return FALSE;
+
+  /* ISO 8601 in newer gpsd, seconds before */
+  if ( realtime_json_value ( line, "time", NULL, &s ) ) {
+    GTimeVal tv;
+    gchar *iso = *s == '"' ? g_strndup ( s + 1, strcspn ( s + 1, "\"" ) ) : NULL;
+    if ( iso && g_time_val_from_iso8601 ( iso, &tv ) )
+      fix->time = tv.tv_sec + tv.tv_usec / 1e6;
+    else if ( ! iso )
+      fix->time = g_ascii_strtod ( s, NULL );
+    g_free ( iso );
+  }
+  fix->altitude = realtime_json_value ( line, "alt", &v, NULL ) ? v : NAN;
+  fix->speed = realtime_json_value ( line, "speed", &v, NULL ) ? v : NAN;
+  fix->track = realtime_json_value ( line, "track", &v, NULL ) ? v : 0;
+  return TRUE;
+}
+
+gboolean a_realtime_parse_line ( RealtimeFix *fix, const gchar *line )
+{
+  if ( *line == '$' )
+    return realtime_parse_nmea ( fix, line );
+  if ( *line == '{' )
+    return realtime_parse_json ( fix, line );
+  return FALSE;
+}
@@ -0,0 +1,100 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_REALTIME_H
+#define _VIKING_REALTIME_H
+
+#include <glib.h>
+#include <time.h>
+
+#include "vikcoord.h"
+#include "viktrack.h"
+#include "vikviewport.h"
+
+/* A position report, as gpsd gives them. Kept apart from libgps so that
+ * fixes can come from a log as well. */
+typedef struct {
+  gdouble time;      /* seconds since 1970 */
+  gdouble latitude;
+  gdouble longitude;
+  gdouble altitude;  /* NAN if not known */
+  gdouble track;     /* heading in degrees */
+  gdouble speed;     /* m/s, NAN if not known */
+  gint mode;         /* VIK_GPS_MODE_* */
+  gint satellites_used;
+} RealtimeFix;
+
+/* Turns fixes into the points of a track. The end of the track's list is
+ * kept, so recording costs the same after hours as at the start, and so
+ * are the totals below. Whoever changes the points other than through
+ * the recorder is to call a_realtime_recorder_changed() before the next
+ * fix. */
+typedef struct {
+  VikTrack *track;       /* referenced, or NULL to just follow the fixes */
+  VikCoordMode coord_mode;
+  GList *tail;           /* the track's last point */
+  gboolean tail_stale;   /* tail may have gone, to be looked for again */
+  gboolean tail_ours;    /* tail was recorded here, so may be replaced */
+  RealtimeFix latest;    /* the last fix given */
+  gboolean dirty;        /* latest is not in the track yet */
+  RealtimeFix last;      /* the fix last put in the track */
+
+  gulong points;
+  gdouble length;        /* metres */
+  gdouble last_step;     /* what the last point added to it */
+  gdouble max_speed;     /* m/s */
+  time_t start;          /* of the first point */
+} RealtimeRecorder;
+
+void a_realtime_recorder_init ( RealtimeRecorder *rec, VikTrack *track, VikCoordMode mode );
+void a_realtime_recorder_clear ( RealtimeRecorder *rec );
+
+/* The track's points have been edited: the end is found again at the
+ * next fix, and the totals stay those of what was recorded. */
+void a_realtime_recorder_changed ( RealtimeRecorder *rec );
+
+/* Takes a fix, recording it if it changes the course enough, or forced.
+ * Returns the point added, or NULL; *replaced is set if it took the place
+ * of the last one, a 2D fix soon improved on. */
+VikTrackpoint *a_realtime_recorder_add ( RealtimeRecorder *rec, const RealtimeFix *fix, gboolean forced, gboolean *replaced );
+
+/* the latest fix, if not in the track yet, as when recording stops */
+VikTrackpoint *a_realtime_recorder_flush ( RealtimeRecorder *rec );
+
+/* The totals as one line of text, to be freed */
+gchar *a_realtime_recorder_status ( RealtimeRecorder *rec );
+
+/* the cursor reaches this far from the position, in pixels */
+#define REALTIME_CURSOR_SIZE 30
+
+/* The part of the screen a fix changes, while the map stays put: the
+ * cursor where it was (old, may be NULL) and where it is, and the new
+ * segment from prev (may be NULL). FALSE if any of them is off this view,
+ * as in another UTM zone, when all of it is to be drawn again. */
+gboolean a_realtime_redraw_area ( VikViewport *vvp, const VikCoord *old, const VikCoord *cur, const VikCoord *prev, GdkRectangle *area );
+
+/* Reads a line of a log of fixes: NMEA 0183 sentences ($GPRMC, $GPGGA and
+ * $GPGSA) or the TPV reports of gpsd's JSON. Sentences fill in the parts
+ * they carry, so fix is to be kept from one line to the next.
+ * TRUE when a line completes a fix with a position. */
+gboolean a_realtime_parse_line ( RealtimeFix *fix, const gchar *line );
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#include "viking.h"
+#include "background.h"
+#include "render.h"
+
+/* threads compressing tiles of a directory export, and how many
+ * drawn tiles may wait for them before drawing stops for a while */
+#define RENDER_SAVE_THREADS 4
+#define RENDER_SAVE_QUEUE 8
+
+typedef struct {
+  VikLayer *layer;
+  VikViewport *vvp;
+  guint tiles_w, tiles_h;
+  gchar *dir;
+  gboolean save_as_png;
+
+  GThreadPool *savers;
+  GMutex *mutex;
+  GCond *cond;
+  guint queued;
+
+  /* the layers lose their tree with it, so closing it ends the job */
+  GtkWindow *window;
+  gulong destroy_handler;
+  gboolean window_gone;
+} RenderDirJob;
+
+typedef struct {
+  GdkPixbuf *pixbuf;
+  gchar *fn;
+} RenderTile;
+
+/* as the window draws its viewport; being offscreen, layers
+ * load what they show (waypoint images) before returning */
+static void render_draw ( VikLayer *layer, VikViewport *vvp, gboolean scale, gboolean centermark )
+{
+  vik_viewport_clear ( vvp );
+  vik_layer_draw ( layer, vvp );
+  if ( scale )
+    vik_viewport_draw_scale ( vvp );
+  if ( centermark )
+    vik_viewport_draw_centermark ( vvp );
+}
+
+/* The drawing buffer only ever holds a strip of the image, which keeps
+ * big images within what the X server will allocate. */
+GdkPixbuf *a_render_pixbuf ( VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height )
+{
+  gint strip_height = MIN ( height, RENDER_STRIP_HEIGHT );
+  gboolean strips = strip_height < height;
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, width, height );
+  VikViewport *vvp;
+  VikCoord center;
+  gint y, h;
+
+  if ( ! pixbuf )
+    return NULL;
+
+  vvp = vik_viewport_new_offscreen ( like, width, strip_height );
+  vik_viewport_set_zoom ( vvp, zoom );
+  center = *vik_viewport_get_center ( vvp );
+
+  for ( y = 0; y < height; y += h ) {
+    h = MIN ( strip_height, height - y );
+    if ( h != strip_height )
+      vik_viewport_configure_manually ( vvp, width, h );
+    /* centre on the middle row of this strip */
+    vik_viewport_set_center_coord ( vvp, &center );
+    vik_viewport_set_center_screen ( vvp, width/2, h/2 + y + h/2 - (gint) height/2 );
+    /* the scale belongs in the bottom corner, the centre mark in no strip */
+    render_draw ( layer, vvp, y + h == height, ! strips );
+    gdk_pixbuf_get_from_drawable ( pixbuf, GDK_DRAWABLE(vik_viewport_get_pixmap ( vvp )), NULL, 0, 0, 0, y, width, h );
+  }
+
+  vik_viewport_free_offscreen ( vvp );
+  return pixbuf;
+}
+
+gboolean a_render_file ( VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height,
+                         const gchar *fn, gboolean save_as_png, GError **error )
+{
+  GdkPixbuf *pixbuf = a_render_pixbuf ( layer, like, zoom, width, height );
+  gboolean ok;
+
+  if ( ! pixbuf ) {
+    g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                  _("Not enough memory for a %dx%d image"), width, height );
+    return FALSE;
+  }
+  ok = gdk_pixbuf_save ( pixbuf, fn, save_as_png ? "png" : "jpeg", error, NULL );
+  g_object_unref ( G_OBJECT(pixbuf) );
+  return ok;
+}
+
+static void render_dir_save ( RenderTile *tile, RenderDirJob *job )
+{
+  GError *error = NULL;
+
+  if ( ! gdk_pixbuf_save ( tile->pixbuf, tile->fn, job->save_as_png ? "png" : "jpeg", &error, NULL ) ) {
+    g_warning("Unable to write to file %s: %s", tile->fn, error->message );
+    g_error_free (error);
+  }
+  g_object_unref ( G_OBJECT(tile->pixbuf) );
+  g_free ( tile->fn );
+  g_free ( tile );
+
+  g_mutex_lock ( job->mutex );
+  job->queued--;
+  g_cond_signal ( job->cond );
+  g_mutex_unlock ( job->mutex );
+}
+
+static void render_dir_thread ( RenderDirJob *job, gpointer threaddata )
+{
+  guint total = job->tiles_w * job->tiles_h, done = 0;
+  guint x, y;
+  gint w, h;
+  VikCoord center;
+
+  gdk_threads_enter();
+  w = vik_viewport_get_width ( job->vvp );
+  h = vik_viewport_get_height ( job->vvp );
+  center = *vik_viewport_get_center ( job->vvp );
+  gdk_threads_leave();
+
+  for ( y = 1; y <= job->tiles_h; y++ )
+    for ( x = 1; x <= job->tiles_w; x++ )
+    {
+      RenderTile *tile = g_malloc ( sizeof(RenderTile) );
+
+      /* the grid is centred on the map centre, whole tiles apart */
+      gdk_threads_enter();
+      if ( job->window_gone ) {
+        gdk_threads_leave();
+        g_free ( tile );
+        return;
+      }
+      vik_viewport_set_center_coord ( job->vvp, &center );
+      vik_viewport_set_center_screen ( job->vvp,
+                                       w/2 + (gint) floor ( (2.0*x - job->tiles_w - 1) * w / 2 ),
+                                       h/2 + (gint) floor ( (2.0*y - job->tiles_h - 1) * h / 2 ) );
+      render_draw ( job->layer, job->vvp, TRUE, TRUE );
+      tile->pixbuf = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( job->vvp )), NULL, 0, 0, 0, 0, w, h );
+      gdk_threads_leave();
+      tile->fn = g_strdup_printf ( "%s%cy%d-x%d.%s", job->dir, G_DIR_SEPARATOR, y, x, job->save_as_png ? "png" : "jpg" );
+
+      g_mutex_lock ( job->mutex );
+      while ( job->queued >= RENDER_SAVE_QUEUE )
+        g_cond_wait ( job->cond, job->mutex );
+      job->queued++;
+      g_mutex_unlock ( job->mutex );
+      g_thread_pool_push ( job->savers, tile, NULL );
+
+      if ( a_background_thread_progress ( threaddata, ((gdouble) ++done) / total ) != 0 )
+        return; /* cancelled, tiles already drawn are still written */
+    }
+}
+
+static void render_dir_free ( RenderDirJob *job )
+{
+  /* waits for the last tiles to be written */
+  g_thread_pool_free ( job->savers, FALSE, TRUE );
+  g_mutex_free ( job->mutex );
+  g_cond_free ( job->cond );
+
+  gdk_threads_enter();
+  vik_viewport_free_offscreen ( job->vvp );
+  g_object_unref ( G_OBJECT(job->layer) );
+  /* destroying the window took its handlers already */
+  if ( ! job->window_gone )
+    g_signal_handler_disconnect ( G_OBJECT(job->window), job->destroy_handler );
+  g_object_unref ( G_OBJECT(job->window) );
+  gdk_threads_leave();
+
+  g_free ( job->dir );
+  g_free ( job );
+}
+
+static void render_dir_window_destroyed ( GtkWindow *window, RenderDirJob *job )
+{
+  job->window_gone = TRUE;
+}
+
+void a_render_dir ( GtkWindow *parent, VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height,
+                    guint tiles_w, guint tiles_h, const gchar *dir, gboolean save_as_png )
+{
+  RenderDirJob *job = g_malloc ( sizeof(RenderDirJob) );
+  gchar *msg;
+
+  g_mkdir ( dir, 0777 );
+
+  /* the layers are kept and the view copied, the user can carry on meanwhile */
+  job->layer = g_object_ref ( layer );
+  job->vvp = vik_viewport_new_offscreen ( like, width, height );
+  vik_viewport_set_zoom ( job->vvp, zoom );
+  job->tiles_w = tiles_w;
+  job->tiles_h = tiles_h;
+  job->dir = g_strdup ( dir );
+  job->save_as_png = save_as_png;
+
+  job->savers = g_thread_pool_new ( (GFunc) render_dir_save, job, RENDER_SAVE_THREADS, FALSE, NULL );
+  job->mutex = g_mutex_new ();
+  job->cond = g_cond_new ();
+  job->queued = 0;
+
+  job->window = g_object_ref ( parent );
+  job->window_gone = FALSE;
+  job->destroy_handler = g_signal_connect ( G_OBJECT(parent), "destroy", G_CALLBACK(render_dir_window_destroyed), job );
+
+  msg = g_strdup_printf ( _("Saving %d images to %s"), tiles_w * tiles_h, dir );
+  a_background_thread ( parent, msg, (vik_thr_func) render_dir_thread, job,
+                        (vik_thr_free_func) render_dir_free, NULL, tiles_w * tiles_h );
+  g_free ( msg );
+}
@@ -0,0 +1,49 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2003-2005, Evan Battaglia <gtoevan@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_RENDER_H
+#define _VIKING_RENDER_H
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "viklayer.h"
+#include "vikviewport.h"
+
+/* Drawing layers into image files on viewports of their own, so an
+ * export neither moves the map on screen nor has to wait for it.
+ * The view (centre, draw mode, background...) is taken from like,
+ * with zoom as the metres per pixel of the image. */
+
+/* taller images are drawn in strips of this many rows */
+#define RENDER_STRIP_HEIGHT 1024
+
+GdkPixbuf *a_render_pixbuf ( VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height );
+gboolean a_render_file ( VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height,
+                         const gchar *fn, gboolean save_as_png, GError **error );
+
+/* A grid of tiles_w by tiles_h images named y<row>-x<column> in dir,
+ * centred on like. Runs as a background job, drawing a tile at a time
+ * and compressing several at once, until done or parent is closed. */
+void a_render_dir ( GtkWindow *parent, VikLayer *layer, VikViewport *like, gdouble zoom, guint width, guint height,
+                    guint tiles_w, guint tiles_h, const gchar *dir, gboolean save_as_png );
+
+#endif
@@ -268,28 +268,27 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
 /* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
  * to draw the layers above and including the trigger layer.
  * To do this we don't draw any layers if in half drawn mode, unless we find the
- * trigger layer, in which case we pull up the saved pixmap, turn off half drawn mode and
+ * trigger layer, in which case we pull up its saved pixmap, turn off half drawn mode and
  * start drawing layers.
- * Also, if we were never in half drawn mode, we save a snapshot
- * of the pixmap before drawing the trigger layer so we can use it again
- * later.
+ * Otherwise we give the viewport the chance to save a snapshot of the pixmap
+ * before each layer, so we can use it again later.
  */
 void vik_aggregate_layer_draw ( VikAggregateLayer *val, gpointer data )
 {
   GList *iter = val->children;
   VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( VIK_VIEWPORT(data) ));
+  VikViewport *vp = VIK_VIEWPORT(data);
+  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
   while ( iter ) {
     vl = VIK_LAYER(iter->data);
-    if ( vl == trigger ) {
-      if ( vik_viewport_get_half_drawn ( VIK_VIEWPORT(data) ) ) {
-        vik_viewport_set_half_drawn ( VIK_VIEWPORT(data), FALSE );
-        vik_viewport_snapshot_load( VIK_VIEWPORT(data) );
-      } else {
-        vik_viewport_snapshot_save( VIK_VIEWPORT(data) );
+    if ( vik_viewport_get_half_drawn ( vp ) ) {
+      if ( vl == trigger ) {
+        vik_viewport_set_half_drawn ( vp, FALSE );
+        vik_viewport_snapshot_load( vp, vl );
       }
-    }
-    if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS || ! vik_viewport_get_half_drawn( VIK_VIEWPORT(data) ) )
+    } else
+      vik_viewport_snapshot_save( vp, vl );
+    if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS || ! vik_viewport_get_half_drawn( vp ) )
       vik_layer_draw ( vl, data );
     iter = iter->next;
   }
@@ -54,24 +54,16 @@ void vik_coord_copy_convert(const VikCoord *coord, VikCoordMode dest_mode, VikCo
   }
 }
 
-static gdouble vik_coord_diff_safe(const VikCoord *c1, const VikCoord *c2)
+gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2)
 {
-  static struct LatLon a, b;
+  struct LatLon a, b;
+  if ( c1->mode == VIK_COORD_LATLON && c2->mode == VIK_COORD_LATLON )
+    return a_coords_latlon_diff ( (const struct LatLon *) c1, (const struct LatLon *) c2 );
   vik_coord_to_latlon ( c1, &a );
   vik_coord_to_latlon ( c2, &b );
   return a_coords_latlon_diff ( &a, &b );
 }
 
-gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2)
-{
-  if ( c1->mode == c2->mode )
-    return vik_coord_diff_safe ( c1, c2 );
-  if ( c1->mode == VIK_COORD_UTM )
-    return a_coords_utm_diff ( (const struct UTM *) c1, (const struct UTM *) c2 );
-  else
-    return a_coords_latlon_diff ( (const struct LatLon *) c1, (const struct LatLon *) c2 );
-}
-
 void vik_coord_load_from_latlon ( VikCoord *coord, VikCoordMode mode, const struct LatLon *ll )
 {
   if ( mode == VIK_COORD_LATLON )
@@ -98,6 +90,30 @@ void vik_coord_to_latlon ( const VikCoord *coord, struct LatLon *dest )
     a_coords_utm_to_latlon ( (const struct UTM *) coord, dest );
 }
 
+void vik_coord_bounds_init ( struct LatLon bounds[2], const VikCoord *coord )
+{
+  vik_coord_to_latlon ( coord, &(bounds[0]) );
+  bounds[1] = bounds[0];
+}
+
+void vik_coord_bounds_extend ( struct LatLon bounds[2], const VikCoord *coord )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  bounds[0].lat = MAX ( bounds[0].lat, ll.lat );
+  bounds[0].lon = MAX ( bounds[0].lon, ll.lon );
+  bounds[1].lat = MIN ( bounds[1].lat, ll.lat );
+  bounds[1].lon = MIN ( bounds[1].lon, ll.lon );
+}
+
+void vik_coord_bounds_union ( struct LatLon bounds[2], const struct LatLon other[2] )
+{
+  bounds[0].lat = MAX ( bounds[0].lat, other[0].lat );
+  bounds[0].lon = MAX ( bounds[0].lon, other[0].lon );
+  bounds[1].lat = MIN ( bounds[1].lat, other[1].lat );
+  bounds[1].lon = MIN ( bounds[1].lon, other[1].lon );
+}
+
 void vik_coord_to_utm ( const VikCoord *coord, struct UTM *dest )
 {
   if ( coord->mode == VIK_COORD_UTM )
@@ -54,6 +54,11 @@ void vik_coord_to_utm ( const VikCoord *coord, struct UTM *dest );
 
 gboolean vik_coord_equals ( const VikCoord *coord1, const VikCoord *coord2 );
 
+/* Boxes as the north east and south west corners, bounds[0] and bounds[1] */
+void vik_coord_bounds_init ( struct LatLon bounds[2], const VikCoord *coord );
+void vik_coord_bounds_extend ( struct LatLon bounds[2], const VikCoord *coord );
+void vik_coord_bounds_union ( struct LatLon bounds[2], const struct LatLon other[2] );
+
 void vik_coord_set_area(const VikCoord *coord, const struct LatLon *wh, VikCoord *tl, VikCoord *br);
 gboolean vik_coord_inside(const VikCoord *coord, const VikCoord *tl, const VikCoord *br);
 /* all coord operations MUST BE ABSTRACTED!!! */
@@ -353,6 +353,28 @@ VikDEMLayer *vik_dem_layer_new ( )
 
 
 
+/* min, max lat/lon of DEM data */
+static void dem_get_bounds ( VikDEM *dem, struct LatLon *dem_northeast, struct LatLon *dem_southwest )
+{
+  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+    dem_northeast->lat = dem->max_north / 3600.0;
+    dem_northeast->lon = dem->max_east / 3600.0;
+    dem_southwest->lat = dem->min_north / 3600.0;
+    dem_southwest->lon = dem->min_east / 3600.0;
+  } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+    struct UTM dem_northeast_utm, dem_southwest_utm;
+    dem_northeast_utm.northing = dem->max_north;
+    dem_northeast_utm.easting = dem->max_east;
+    dem_southwest_utm.northing = dem->min_north;
+    dem_southwest_utm.easting = dem->min_east;
+    dem_northeast_utm.zone = dem_southwest_utm.zone = dem->utm_zone;
+    dem_northeast_utm.letter = dem_southwest_utm.letter = dem->utm_letter;
+
+    a_coords_utm_to_latlon(&dem_northeast_utm, dem_northeast);
+    a_coords_utm_to_latlon(&dem_southwest_utm, dem_southwest);
+  }
+}
+
 static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
 {
   VikDEMColumn *column;
@@ -366,24 +388,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
   /* get min, max lat/lon of viewport */
   vik_viewport_get_min_max_lat_lon ( vp, &min_lat, &max_lat, &min_lon, &max_lon );
 
-  /* get min, max lat/lon of DEM data */
-  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    dem_northeast.lat = dem->max_north / 3600.0;
-    dem_northeast.lon = dem->max_east / 3600.0;
-    dem_southwest.lat = dem->min_north / 3600.0;
-    dem_southwest.lon = dem->min_east / 3600.0;
-  } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
-    struct UTM dem_northeast_utm, dem_southwest_utm;
-    dem_northeast_utm.northing = dem->max_north;
-    dem_northeast_utm.easting = dem->max_east;
-    dem_southwest_utm.northing = dem->min_north;
-    dem_southwest_utm.easting = dem->min_east;
-    dem_northeast_utm.zone = dem_southwest_utm.zone = dem->utm_zone;
-    dem_northeast_utm.letter = dem_southwest_utm.letter = dem->utm_letter;
-
-    a_coords_utm_to_latlon(&dem_northeast_utm, &dem_northeast);
-    a_coords_utm_to_latlon(&dem_southwest_utm, &dem_southwest);
-  }
+  dem_get_bounds ( dem, &dem_northeast, &dem_southwest );
 
   if ( (max_lat > dem_northeast.lat && min_lat > dem_northeast.lat) ||
        (max_lat < dem_southwest.lat && min_lat < dem_southwest.lat) )
@@ -423,7 +428,9 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
   #endif
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
+    struct LatLon *column_lls;
+    gint *xs, *ys;
+    guint i, n, max_rows;
 
     gdouble max_lat_as, max_lon_as, min_lat_as, min_lon_as;  
     gdouble start_lat_as, end_lat_as, start_lon_as, end_lon_as;
@@ -462,6 +469,12 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
     if ( vdl->max_elev <= vdl->min_elev )
       vdl->max_elev = vdl->min_elev + 1;
 
+    /* each column is projected to the screen in one go */
+    max_rows = MAX ( 0, (end_lat - start_lat) / (nscale_deg * skip_factor) ) + 2;
+    column_lls = g_new ( struct LatLon, max_rows );
+    xs = g_new ( gint, max_rows );
+    ys = g_new ( gint, max_rows );
+
     for ( x=start_x, counter.lon = start_lon; counter.lon <= end_lon; counter.lon += escale_deg * skip_factor, x += skip_factor ) {
       if ( x > 0 && x < dem->n_columns ) {
         column = g_ptr_array_index ( dem->columns, x );
@@ -471,9 +484,12 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 	  nextcolumn = g_ptr_array_index ( dem->columns, x+1);
 	}
 
-        for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
-            break;
+        n = 0;
+        for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat && y <= column->n_points && n < max_rows; counter.lat += nscale_deg * skip_factor, y += skip_factor )
+          column_lls[n++] = counter;
+        vik_viewport_latlons_to_screen ( vp, column_lls, n, xs, ys );
+
+        for ( y=start_y, i = 0; i < n; y += skip_factor, i++ ) {
           elev = column->points[y];
 
 	  if(vdl->type == DEM_TYPE_HEIGHT) {
@@ -484,10 +500,8 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 	  }
 
           {
-            gint a, b;
+            gint a = xs[i], b = ys[i];
 
-            vik_coord_load_from_latlon(&tmp, vik_viewport_get_coord_mode(vp), &counter);
-            vik_viewport_coord_to_screen(vp, &tmp, &a, &b);
 	    if(vdl->type == DEM_TYPE_GRADIENT) {
 		    if( elev == VIK_DEM_INVALID_ELEVATION ) {
 			    /* don't draw it */
@@ -551,6 +565,9 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
         } /* for y= */
       }
     } /* for x= */
+    g_free ( column_lls );
+    g_free ( xs );
+    g_free ( ys );
   } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
     gdouble max_nor, max_eas, min_nor, min_eas;
     gdouble start_nor, start_eas, end_nor, end_eas;
@@ -559,7 +576,9 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     guint x, y, start_x, start_y;
 
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
+    VikCoord *column_coords;
+    gint *xs, *ys;
+    guint i, n, max_rows;
     struct UTM counter;
 
     guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 10 ); /* todo: smarter calculation. */
@@ -609,12 +628,22 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
     counter.zone = dem->utm_zone;
     counter.letter = dem->utm_letter;
 
+    /* each column is projected to the screen in one go */
+    max_rows = MAX ( 0, (end_nor - start_nor) / (dem->north_scale * skip_factor) ) + 2;
+    column_coords = g_new ( VikCoord, max_rows );
+    xs = g_new ( gint, max_rows );
+    ys = g_new ( gint, max_rows );
+
     for ( x=start_x, counter.easting = start_eas; counter.easting <= end_eas; counter.easting += dem->east_scale * skip_factor, x += skip_factor ) {
       if ( x > 0 && x < dem->n_columns ) {
         column = g_ptr_array_index ( dem->columns, x );
-        for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
-            continue;
+
+        n = 0;
+        for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor && y <= column->n_points && n < max_rows; counter.northing += dem->north_scale * skip_factor, y += skip_factor )
+          vik_coord_load_from_utm ( column_coords + n++, vik_viewport_get_coord_mode(vp), &counter );
+        vik_viewport_coords_to_screen ( vp, column_coords, n, xs, ys );
+
+        for ( y=start_y, i = 0; i < n; y += skip_factor, i++ ) {
           elev = column->points[y];
           if ( elev != VIK_DEM_INVALID_ELEVATION && elev < vdl->min_elev )
             elev=vdl->min_elev;
@@ -622,9 +651,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
             elev=vdl->max_elev;
 
           {
-            gint a, b;
-            vik_coord_load_from_utm(&tmp, vik_viewport_get_coord_mode(vp), &counter);
-	            vik_viewport_coord_to_screen(vp, &tmp, &a, &b);
+            gint a = xs[i], b = ys[i];
             if ( elev == VIK_DEM_INVALID_ELEVATION )
               ; /* don't draw it */
             else if ( elev <= 0 )
@@ -635,6 +662,9 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
         } /* for y= */
       }
     } /* for x= */
+    g_free ( column_coords );
+    g_free ( xs );
+    g_free ( ys );
   }
 }
 
@@ -954,10 +984,19 @@ static gboolean dem_layer_add_file ( VikDEMLayer *vdl, const gchar *full_path )
     stat (full_path, &sb);
     if ( sb.st_size ) {
       gchar *duped_path = g_strdup(full_path);
+      VikDEM *dem;
       vdl->files = g_list_prepend ( vdl->files, duped_path );
-      a_dems_load ( duped_path );
+      dem = a_dems_load ( duped_path );
       g_debug("%s: %s", __FUNCTION__, duped_path);
-      vik_layer_emit_update ( VIK_LAYER(vdl) );
+      if ( dem ) {
+        /* only what this DEM covers needs redrawing */
+        struct LatLon ne, sw;
+        VikCoord c1, c2;
+        dem_get_bounds ( dem, &ne, &sw );
+        vik_coord_load_from_latlon ( &c1, VIK_COORD_LATLON, &ne );
+        vik_coord_load_from_latlon ( &c2, VIK_COORD_LATLON, &sw );
+        vik_layer_emit_update_area ( VIK_LAYER(vdl), &c1, &c2 );
+      }
     }
     return TRUE;
   } else
@@ -978,8 +1017,7 @@ static void dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
   if ( p->vdl ) {
     g_object_weak_unref ( G_OBJECT(p->vdl), weak_ref_cb, p );
 
-    if ( dem_layer_add_file ( p->vdl, p->dest ) )
-      vik_layer_emit_update ( VIK_LAYER(p->vdl) );
+    dem_layer_add_file ( p->vdl, p->dest );
   }
   g_mutex_unlock ( p->mutex );
   gdk_threads_leave();
@@ -30,6 +30,7 @@
 #include "viking.h"
 #include "icons/icons.h"
 #include "babel.h"
+#include "realtime.h"
 
 #ifdef HAVE_STRING_H
 #include <string.h>
@@ -70,7 +71,10 @@ static void gps_empty_download_cb( gpointer layer_and_vlp[2] );
 static void gps_empty_all_cb( gpointer layer_and_vlp[2] );
 #ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
 static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2] );
+static void gps_replay_cb( gpointer layer_and_vlp[2] );
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp);
+static void rt_gpsd_disconnect(VikGpsLayer *vgl);
+static void realtime_layer_update(VikGpsLayer *vgl);
 #endif
 
 typedef enum {GARMIN_P = 0, MAGELLAN_P, NUM_PROTOCOLS} vik_gps_proto;
@@ -134,6 +138,11 @@ enum {
   VEHICLE_POSITION_ON_SCREEN,
   VEHICLE_POSITION_NONE,
 };
+
+static VikLayerParamScale params_scales[] = {
+ /* min  max    step digits */
+ {  1,   50,    1,   0 }, /* replay_rate */
+};
 #endif
 
 static VikLayerParam gps_layer_params[] = {
@@ -147,12 +156,13 @@ static VikLayerParam gps_layer_params[] = {
   { "gpsd_host", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Host:"), VIK_LAYER_WIDGET_ENTRY},
   { "gpsd_port", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Port:"), VIK_LAYER_WIDGET_ENTRY},
   { "gpsd_retry_interval", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Retry Interval (seconds):"), VIK_LAYER_WIDGET_ENTRY},
+  { "replay_rate", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Log Replay Rate (fixes/second):"), VIK_LAYER_WIDGET_SPINBUTTON, params_scales + 0 },
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 };
 enum {
   PARAM_PROTOCOL=0, PARAM_PORT,
 #ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
-  PARAM_REALTIME_REC, PARAM_REALTIME_CENTER_START, PARAM_VEHICLE_POSITION, PARAM_GPSD_HOST, PARAM_GPSD_PORT, PARAM_GPSD_RETRY_INTERVAL,
+  PARAM_REALTIME_REC, PARAM_REALTIME_CENTER_START, PARAM_VEHICLE_POSITION, PARAM_GPSD_HOST, PARAM_GPSD_PORT, PARAM_GPSD_RETRY_INTERVAL, PARAM_REPLAY_RATE,
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   NUM_PARAMS};
 
@@ -221,12 +231,6 @@ typedef struct {
   struct gps_data_t gpsd;
   VikGpsLayer *vgl;
 } VglGpsd;
-
-typedef struct {
-  struct gps_fix_t fix;
-  gint satellites_used;
-  gboolean dirty;   /* needs to be saved */
-} GpsFix;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 
 struct _VikGpsLayer {
@@ -238,8 +242,8 @@ struct _VikGpsLayer {
   VglGpsd *vgpsd;
   gboolean realtime_tracking;  /* set/reset only by the callback */
   gboolean first_realtime_trackpoint;
-  GpsFix realtime_fix;
-  GpsFix last_fix;
+  RealtimeRecorder realtime_rec; /* its latest fix is where we are */
+  gboolean realtime_updating;    /* the realtime layer's update is ours */
 
   VikTrack *realtime_track;
   gchar *realtime_track_name;
@@ -247,6 +251,9 @@ struct _VikGpsLayer {
   GIOChannel *realtime_io_channel;
   guint realtime_io_watch_id;
   guint realtime_retry_timer;
+  GIOChannel *replay_channel;  /* a log played back in place of gpsd */
+  guint replay_timer;
+  RealtimeFix replay_fix;
   GdkGC *realtime_track_gc;
   GdkGC *realtime_track_bg_gc;
   GdkGC *realtime_track_pt_gc;
@@ -260,6 +267,7 @@ struct _VikGpsLayer {
   gboolean realtime_record;
   gboolean realtime_jump_to_start;
   guint vehicle_position;
+  guint replay_rate;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   guint protocol_id;
   gchar *serial_port;
@@ -419,6 +427,10 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, guint16 id, VikLayerPara
     case PARAM_VEHICLE_POSITION:
       vgl->vehicle_position = data.u;
       break;
+    case PARAM_REPLAY_RATE:
+      if ( data.u >= 1 && data.u <= 50 )
+        vgl->replay_rate = data.u;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default:
       g_warning("gps_layer_set_param(): unknown parameter");
@@ -458,6 +470,9 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id )
     case PARAM_VEHICLE_POSITION:
       rv.u = vgl->vehicle_position;
       break;
+    case PARAM_REPLAY_RATE:
+      rv.u = vgl->replay_rate;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default:
       g_warning(_("%s: unknown parameter"), __FUNCTION__);
@@ -484,12 +499,16 @@ VikGpsLayer *vik_gps_layer_new (VikViewport *vp)
   vgl->realtime_io_channel = NULL;
   vgl->realtime_io_watch_id = 0;
   vgl->realtime_retry_timer = 0;
+  vgl->replay_channel = NULL;
+  vgl->replay_timer = 0;
   vgl->realtime_track_gc = vik_viewport_new_gc ( vp, "#203070", 2 );
   vgl->realtime_track_bg_gc = vik_viewport_new_gc ( vp, "grey", 2 );
   vgl->realtime_track_pt1_gc = vik_viewport_new_gc ( vp, "red", 2 );
   vgl->realtime_track_pt2_gc = vik_viewport_new_gc ( vp, "green", 2 );
   vgl->realtime_track_pt_gc = vgl->realtime_track_pt1_gc;
   vgl->realtime_track = NULL;
+  a_realtime_recorder_init ( &(vgl->realtime_rec), NULL, VIK_COORD_LATLON );
+  vgl->realtime_updating = FALSE;
 
   /* Setting params here */
   vgl->gpsd_host = g_strdup("localhost");
@@ -498,6 +517,7 @@ VikGpsLayer *vik_gps_layer_new (VikViewport *vp)
   vgl->realtime_jump_to_start = TRUE;
   vgl->vehicle_position = VEHICLE_POSITION_ON_SCREEN;
   vgl->gpsd_retry_interval = 10;
+  vgl->replay_rate = 10;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   vgl->protocol_id = 0;
   vgl->serial_port = NULL;
@@ -513,27 +533,25 @@ static void vik_gps_layer_draw ( VikGpsLayer *vgl, gpointer data )
 
   for (i = 0; i < NUM_TRW; i++) {
     vl = VIK_LAYER(vgl->trw_children[i]);
-    if (vl == trigger) {
-      if ( vik_viewport_get_half_drawn ( VIK_VIEWPORT(data) ) ) {
+    if ( vik_viewport_get_half_drawn ( VIK_VIEWPORT(data) ) ) {
+      if (vl == trigger) {
         vik_viewport_set_half_drawn ( VIK_VIEWPORT(data), FALSE );
-        vik_viewport_snapshot_load( VIK_VIEWPORT(data) );
-      } else {
-        vik_viewport_snapshot_save( VIK_VIEWPORT(data) );
+        vik_viewport_snapshot_load( VIK_VIEWPORT(data), vl );
       }
-    }
+    } else
+      vik_viewport_snapshot_save( VIK_VIEWPORT(data), vl );
     if (!vik_viewport_get_half_drawn( VIK_VIEWPORT(data)))
       vik_layer_draw ( vl, data );
   }
 #ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
   if (vgl->realtime_tracking) {
-    if (VIK_LAYER(vgl) == trigger) {
-      if ( vik_viewport_get_half_drawn ( VIK_VIEWPORT(data) ) ) {
+    if ( vik_viewport_get_half_drawn ( VIK_VIEWPORT(data) ) ) {
+      if (VIK_LAYER(vgl) == trigger) {
         vik_viewport_set_half_drawn ( VIK_VIEWPORT(data), FALSE );
-        vik_viewport_snapshot_load( VIK_VIEWPORT(data) );
-      } else {
-        vik_viewport_snapshot_save( VIK_VIEWPORT(data) );
+        vik_viewport_snapshot_load( VIK_VIEWPORT(data), vgl );
       }
-    }
+    } else
+      vik_viewport_snapshot_save( VIK_VIEWPORT(data), vgl );
     if (!vik_viewport_get_half_drawn( VIK_VIEWPORT(data)))
       realtime_tracking_draw(vgl, VIK_VIEWPORT(data));
   }
@@ -577,6 +595,13 @@ static void gps_layer_add_menu_items( VikGpsLayer *vgl, GtkMenu *menu, gpointer
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
   gtk_widget_show ( item );
 
+  if (!vgl->realtime_tracking) {
+    item = gtk_menu_item_new_with_label ( _("Replay GPS Log...") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(gps_replay_cb), pass_along );
+    gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+    gtk_widget_show ( item );
+  }
+
   item = gtk_menu_item_new();
   gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
   gtk_widget_show ( item );
@@ -607,6 +632,13 @@ static void disconnect_layer_signal ( VikLayer *vl, VikGpsLayer *vgl )
 static void vik_gps_layer_free ( VikGpsLayer *vgl )
 {
   gint i;
+#ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
+  /* nothing is to call back into a freed layer */
+  if (vgl->realtime_tracking)
+    rt_gpsd_disconnect(vgl);
+  if (vgl->vl.realized)
+    g_signal_handlers_disconnect_by_func ( vgl->trw_children[TRW_REALTIME], realtime_layer_update, vgl );
+#endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   for (i = 0; i < NUM_TRW; i++) {
     if (vgl->vl.realized)
       disconnect_layer_signal(VIK_LAYER(vgl->trw_children[i]), vgl);
@@ -656,6 +688,10 @@ static void vik_gps_layer_realize ( VikGpsLayer *vgl, VikTreeview *vt, GtkTreeIt
     vik_layer_realize ( trw, VIK_LAYER(vgl)->vt, &iter );
     g_signal_connect_swapped ( G_OBJECT(trw), "update", G_CALLBACK(vik_layer_emit_update_secondary), vgl );
   }
+#ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
+  /* edits of the track being recorded, the layer shown or not */
+  g_signal_connect_swapped ( G_OBJECT(vgl->trw_children[TRW_REALTIME]), "changed", G_CALLBACK(realtime_layer_update), vgl );
+#endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 }
 
 const GList *vik_gps_layer_get_children ( VikGpsLayer *vgl )
@@ -807,18 +843,21 @@ static void set_gps_info(const gchar *info, GpsSession *sess)
 static void gps_download_progress_func(BabelProgressCode c, gpointer data, GpsSession * sess )
 {
   gchar *line;
+  gboolean cancelled;
 
   gdk_threads_enter ();
   g_mutex_lock(sess->mutex);
-  if (!sess->ok) {
-    g_mutex_unlock(sess->mutex);
-    gps_session_delete(sess);
-    gdk_threads_leave();
-    g_thread_exit ( NULL );
-  }
+  cancelled = !sess->ok;
   g_mutex_unlock(sess->mutex);
   gdk_threads_leave ();
 
+  /* babel kills the program and returns, then the session goes */
+  if (cancelled) {
+    if (c == BABEL_PROGRESS)
+      ((BabelProgress *) data)->stop = TRUE;
+    return;
+  }
+
   switch(c) {
   case BABEL_DIAG_OUTPUT:
     line = (gchar *)data;
@@ -879,18 +918,21 @@ static void gps_upload_progress_func(BabelProgressCode c, gpointer data, GpsSess
 {
   gchar *line;
   static int cnt = 0;
+  gboolean cancelled;
 
   gdk_threads_enter ();
   g_mutex_lock(sess->mutex);
-  if (!sess->ok) {
-    g_mutex_unlock(sess->mutex);
-    gps_session_delete(sess);
-    gdk_threads_leave();
-    g_thread_exit ( NULL );
-  }
+  cancelled = !sess->ok;
   g_mutex_unlock(sess->mutex);
   gdk_threads_leave ();
 
+  /* babel kills the program and returns, then the session goes */
+  if (cancelled) {
+    if (c == BABEL_PROGRESS)
+      ((BabelProgress *) data)->stop = TRUE;
+    return;
+  }
+
   switch(c) {
   case BABEL_DIAG_OUTPUT:
     line = (gchar *)data;
@@ -965,27 +1007,21 @@ static void gps_comm_thread(GpsSession *sess)
         (BabelStatusFunc) gps_upload_progress_func, sess->port, sess);
 
   gdk_threads_enter();
-  if (!result) {
-    gtk_label_set_text ( GTK_LABEL(sess->status_label), _("Error: couldn't find gpsbabel.") );
-  } 
-  else {
-    g_mutex_lock(sess->mutex);
-    if (sess->ok) {
+  g_mutex_lock(sess->mutex);
+  if (sess->ok) {
+    if (!result) {
+      gtk_label_set_text ( GTK_LABEL(sess->status_label), _("Error: couldn't find gpsbabel.") );
+    }
+    else {
       gtk_label_set_text ( GTK_LABEL(sess->status_label), _("Done.") );
       gtk_dialog_set_response_sensitive ( GTK_DIALOG(sess->dialog), GTK_RESPONSE_ACCEPT, TRUE );
       gtk_dialog_set_response_sensitive ( GTK_DIALOG(sess->dialog), GTK_RESPONSE_REJECT, FALSE );
-    } else {
-      /* canceled */
     }
-    g_mutex_unlock(sess->mutex);
-  }
-
-  g_mutex_lock(sess->mutex);
-  if (sess->ok) {
-    sess->ok = FALSE;
+    sess->ok = FALSE;   /* the dialog frees the session */
     g_mutex_unlock(sess->mutex);
   }
   else {
+    /* canceled, the dialog is gone */
     g_mutex_unlock(sess->mutex);
     gps_session_delete(sess);
   }
@@ -1088,7 +1124,6 @@ static void gps_empty_all_cb( gpointer layer_and_vlp[2] )
 }
 
 #ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
-static void rt_gpsd_disconnect(VikGpsLayer *vgl);
 static gboolean rt_gpsd_connect(VikGpsLayer *vgl, gboolean ask_if_failed);
 
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
@@ -1096,14 +1131,15 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
   struct LatLon ll;
   VikCoord nw, se;
   struct LatLon lnw, lse;
+  RealtimeFix *fix = &(vgl->realtime_rec.latest);
   vik_viewport_screen_to_coord ( vp, -20, -20, &nw );
-  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp)+20, vik_viewport_get_width(vp)+20, &se );
+  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp)+20, vik_viewport_get_height(vp)+20, &se );
   vik_coord_to_latlon ( &nw, &lnw );
   vik_coord_to_latlon ( &se, &lse );
-  if ( vgl->realtime_fix.fix.latitude > lse.lat &&
-       vgl->realtime_fix.fix.latitude < lnw.lat &&
-       vgl->realtime_fix.fix.longitude > lnw.lon &&
-       vgl->realtime_fix.fix.longitude < lse.lon ) {
+  if ( fix->latitude > lse.lat &&
+       fix->latitude < lnw.lat &&
+       fix->longitude > lnw.lon &&
+       fix->longitude < lse.lon ) {
     VikCoord gps;
     gint x, y;
     gint half_back_x, half_back_y;
@@ -1113,13 +1149,13 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
     gint side1_x, side1_y, side2_x, side2_y;
     gint side1bg_x, side1bg_y, side2bg_x, side2bg_y;
 
-    ll.lat = vgl->realtime_fix.fix.latitude;
-    ll.lon = vgl->realtime_fix.fix.longitude;
+    ll.lat = fix->latitude;
+    ll.lon = fix->longitude;
     vik_coord_load_from_latlon ( &gps, vik_viewport_get_coord_mode(vp), &ll);
     vik_viewport_coord_to_screen ( vp, &gps, &x, &y );
 
-    gdouble heading_cos = cos(M_PI/180*vgl->realtime_fix.fix.track);
-    gdouble heading_sin = sin(M_PI/180*vgl->realtime_fix.fix.track);
+    gdouble heading_cos = cos(M_PI/180*fix->track);
+    gdouble heading_sin = sin(M_PI/180*fix->track);
 
     half_back_y = y+8*heading_cos;
     half_back_x = x-8*heading_sin;
@@ -1147,75 +1183,110 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_bg_gc, TRUE, trian_bg, 3 );
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_gc, TRUE, trian, 3 );
      vik_viewport_draw_rectangle ( vp,
-         (vgl->realtime_fix.fix.mode > MODE_2D) ? vgl->realtime_track_pt2_gc : vgl->realtime_track_pt1_gc,
+         (fix->mode > MODE_2D) ? vgl->realtime_track_pt2_gc : vgl->realtime_track_pt1_gc,
          TRUE, x-2, y-2, 4, 4 );
      //vgl->realtime_track_pt_gc = (vgl->realtime_track_pt_gc == vgl->realtime_track_pt1_gc) ? vgl->realtime_track_pt2_gc : vgl->realtime_track_pt1_gc;
   }
 }
 
-static void create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
+/* Only the part of the screen the cursor leaves, the new part of the track
+ * and the cursor's new place is repainted, as long as the map stays put. */
+static void realtime_tracking_update ( VikGpsLayer *vgl, VikViewport *vvp, const VikCoord *old, const VikCoord *cur,
+                                       VikTrackpoint *tp, gboolean replaced )
 {
-    struct LatLon ll;
-    GList *last_tp;
+  const VikCoord *prev = NULL;
+  GdkRectangle area;
+  VikCoord c1, c2;
 
-    /* Note that fix.time is a double, but it should not affect the precision
-       for most GPS */
-    time_t cur_timestamp = vgl->realtime_fix.fix.time;
-    time_t last_timestamp = vgl->last_fix.fix.time;
+  if ( tp && vgl->realtime_rec.tail->prev )
+    prev = &(VIK_TRACKPOINT(vgl->realtime_rec.tail->prev->data)->coord);
 
-    if (cur_timestamp < last_timestamp) {
-      return;
-    }
+  vgl->realtime_updating = TRUE;
+  /* the line was drawn to a point that has gone */
+  if ( replaced || ! a_realtime_redraw_area ( vvp, old, cur, prev, &area ) )
+    vik_layer_emit_update ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]) );
+  else {
+    vik_viewport_screen_to_coord ( vvp, area.x, area.y, &c1 );
+    vik_viewport_screen_to_coord ( vvp, area.x + area.width, area.y + area.height, &c2 );
+    vik_layer_emit_update_area ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]), &c1, &c2 );
+  }
+  vgl->realtime_updating = FALSE;
+}
 
-    if (vgl->realtime_record && vgl->realtime_fix.dirty) {
-      gboolean replace = FALSE;
-      int heading = (int)floor(vgl->realtime_fix.fix.track);
-      int last_heading = (int)floor(vgl->last_fix.fix.track);
-      int alt = isnan(vgl->realtime_fix.fix.altitude) ? VIK_DEFAULT_ALTITUDE : floor(vgl->realtime_fix.fix.altitude);
-      int last_alt = isnan(vgl->last_fix.fix.altitude) ? VIK_DEFAULT_ALTITUDE : floor(vgl->last_fix.fix.altitude);
-      if (((last_tp = g_list_last(vgl->realtime_track->trackpoints)) != NULL) &&
-          (vgl->realtime_fix.fix.mode > MODE_2D) &&
-          (vgl->last_fix.fix.mode <= MODE_2D) &&
-          ((cur_timestamp - last_timestamp) < 2)) {
-        g_free(last_tp->data);
-        vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
-        replace = TRUE;
-      }
-      if (replace ||
-          ((cur_timestamp != last_timestamp) &&
-          ((forced || 
-            ((heading < last_heading) && (heading < (last_heading - 3))) || 
-            ((heading > last_heading) && (heading > (last_heading + 3))) ||
-            ((alt != VIK_DEFAULT_ALTITUDE) && (alt != last_alt)))))) {
-        /* TODO: check for new segments */
-        VikTrackpoint *tp = vik_trackpoint_new();
-        tp->newsegment = FALSE;
-        tp->has_timestamp = TRUE;
-        tp->timestamp = vgl->realtime_fix.fix.time;
-        tp->altitude = alt;
-        /* speed only available for 3D fix. Check for NAN when use this speed */
-        tp->speed = vgl->realtime_fix.fix.speed;  
-        tp->course = vgl->realtime_fix.fix.track;
-        tp->nsats = vgl->realtime_fix.satellites_used;
-        tp->fix_mode = vgl->realtime_fix.fix.mode;
-
-        ll.lat = vgl->realtime_fix.fix.latitude;
-        ll.lon = vgl->realtime_fix.fix.longitude;
-        vik_coord_load_from_latlon(&tp->coord,
-             vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
-
-        vgl->realtime_track->trackpoints = g_list_append(vgl->realtime_track->trackpoints, tp);
-        vgl->realtime_fix.dirty = FALSE;
-        vgl->realtime_fix.satellites_used = 0;
-        vgl->last_fix = vgl->realtime_fix;
-      }
-    }
+/* Anything else updating the realtime layer may have edited the track
+ * being recorded, deleting its last point say. */
+static void realtime_layer_update ( VikGpsLayer *vgl )
+{
+  if ( ! vgl->realtime_updating )
+    a_realtime_recorder_changed ( &(vgl->realtime_rec) );
+}
+
+/* Where every fix goes, whether from gpsd or a log being replayed */
+static void realtime_tracking_fix ( VikGpsLayer *vgl, const RealtimeFix *fix )
+{
+  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vgl));
+  VikViewport *vvp = vik_window_viewport(vw);
+  VikCoordMode mode = vik_viewport_get_coord_mode ( vvp );
+  gboolean update_all = FALSE, had_fix, replaced = FALSE;
+  VikCoord vehicle_coord, old_coord;
+  VikTrackpoint *tp;
+  struct LatLon ll;
+
+  /* where the cursor was drawn last */
+  had_fix = vgl->realtime_rec.latest.mode >= VIK_GPS_MODE_2D;
+  ll.lat = vgl->realtime_rec.latest.latitude;
+  ll.lon = vgl->realtime_rec.latest.longitude;
+  vik_coord_load_from_latlon ( &old_coord, mode, &ll );
 
+  ll.lat = fix->latitude;
+  ll.lon = fix->longitude;
+  vik_coord_load_from_latlon ( &vehicle_coord, mode, &ll );
+
+  if ((vgl->vehicle_position == VEHICLE_POSITION_CENTERED) ||
+      (vgl->realtime_jump_to_start && vgl->first_realtime_trackpoint)) {
+    vik_viewport_set_center_coord(vvp, &vehicle_coord);
+    update_all = TRUE;
+  }
+  else if (vgl->vehicle_position == VEHICLE_POSITION_ON_SCREEN) {
+    const int hdiv = 6;
+    const int vdiv = 6;
+    const int px = 20; /* adjust ment in pixels to make sure vehicle is inside the box */
+    gint width = vik_viewport_get_width(vvp);
+    gint height = vik_viewport_get_height(vvp);
+    gint vx, vy;
+
+    vik_viewport_coord_to_screen(vvp, &vehicle_coord, &vx, &vy);
+    update_all = TRUE;
+    if (vx < (width/hdiv))
+      vik_viewport_set_center_screen(vvp, vx - width/2 + width/hdiv + px, vy);
+    else if (vx > (width - width/hdiv))
+      vik_viewport_set_center_screen(vvp, vx + width/2 - width/hdiv - px, vy);
+    else if (vy < (height/vdiv))
+      vik_viewport_set_center_screen(vvp, vx, vy - height/2 + height/vdiv + px);
+    else if (vy > (height - height/vdiv))
+      vik_viewport_set_center_screen(vvp, vx, vy + height/2 - height/vdiv - px);
+    else
+      update_all = FALSE;
+  }
+
+  vgl->first_realtime_trackpoint = FALSE;
+  tp = a_realtime_recorder_add ( &(vgl->realtime_rec), fix, FALSE, &replaced );
+
+  if ( tp ) {
+    gchar *msg = a_realtime_recorder_status ( &(vgl->realtime_rec) );
+    /* the field the ruler uses, nothing else measures while driving */
+    vik_statusbar_set_message ( vik_window_get_statusbar ( vw ), 3, msg );
+    g_free ( msg );
+  }
+
+  if ( update_all )
+    vik_layer_emit_update ( VIK_LAYER(vgl) );
+  else
+    realtime_tracking_update ( vgl, vvp, had_fix ? &old_coord : NULL, &vehicle_coord, tp, replaced );
 }
 
 static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
 {
-  gboolean update_all = FALSE;
   VikGpsLayer *vgl = vgpsd->vgl;
 
   if (!vgl->realtime_tracking) {
@@ -1227,52 +1298,17 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
       !isnan(vgpsd->gpsd.fix.latitude) &&
       !isnan(vgpsd->gpsd.fix.longitude) &&
       !isnan(vgpsd->gpsd.fix.track)) {
-
-    VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vgl));
-    VikViewport *vvp = vik_window_viewport(vw);
-    vgl->realtime_fix.fix = vgpsd->gpsd.fix;
-    vgl->realtime_fix.satellites_used = vgpsd->gpsd.satellites_used;
-    vgl->realtime_fix.dirty = TRUE;
-
-    struct LatLon ll;
-    VikCoord vehicle_coord;
-
-    ll.lat = vgl->realtime_fix.fix.latitude;
-    ll.lon = vgl->realtime_fix.fix.longitude;
-    vik_coord_load_from_latlon(&vehicle_coord,
-           vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
-
-    if ((vgl->vehicle_position == VEHICLE_POSITION_CENTERED) ||
-        (vgl->realtime_jump_to_start && vgl->first_realtime_trackpoint)) {
-      vik_viewport_set_center_coord(vvp, &vehicle_coord);
-      update_all = TRUE;
-    }
-    else if (vgl->vehicle_position == VEHICLE_POSITION_ON_SCREEN) {
-      const int hdiv = 6;
-      const int vdiv = 6;
-      const int px = 20; /* adjust ment in pixels to make sure vehicle is inside the box */
-      gint width = vik_viewport_get_width(vvp);
-      gint height = vik_viewport_get_height(vvp);
-      gint vx, vy;
-
-      vik_viewport_coord_to_screen(vvp, &vehicle_coord, &vx, &vy);
-      update_all = TRUE;
-      if (vx < (width/hdiv))
-        vik_viewport_set_center_screen(vvp, vx - width/2 + width/hdiv + px, vy);
-      else if (vx > (width - width/hdiv))
-        vik_viewport_set_center_screen(vvp, vx + width/2 - width/hdiv - px, vy);
-      else if (vy < (height/vdiv))
-        vik_viewport_set_center_screen(vvp, vx, vy - height/2 + height/vdiv + px);
-      else if (vy > (height - height/vdiv))
-        vik_viewport_set_center_screen(vvp, vx, vy + height/2 - height/vdiv - px);
-      else
-        update_all = FALSE;
-    }
-
-    vgl->first_realtime_trackpoint = FALSE;
-    create_realtime_trackpoint(vgl, FALSE);
-
-    vik_layer_emit_update ( update_all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]));
+    RealtimeFix fix;
+
+    fix.time = vgpsd->gpsd.fix.time;
+    fix.latitude = vgpsd->gpsd.fix.latitude;
+    fix.longitude = vgpsd->gpsd.fix.longitude;
+    fix.altitude = vgpsd->gpsd.fix.altitude;
+    fix.track = vgpsd->gpsd.fix.track;
+    fix.speed = vgpsd->gpsd.fix.speed;
+    fix.mode = vgpsd->gpsd.fix.mode;
+    fix.satellites_used = vgpsd->gpsd.satellites_used;
+    realtime_tracking_fix ( vgl, &fix );
   }
 }
 
@@ -1307,6 +1343,32 @@ static gchar *make_track_name(VikTrwLayer *vtl)
 
 }
 
+/* a new track for the fixes to come, from gpsd or a log */
+static void rt_recording_start(VikGpsLayer *vgl)
+{
+  if (vgl->realtime_record) {
+    VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
+    vgl->realtime_track = vik_track_new();
+    vgl->realtime_track->visible = TRUE;
+    vgl->realtime_track_name = make_track_name(vtl);
+    vik_trw_layer_add_track(vtl, vgl->realtime_track_name, vgl->realtime_track);
+  }
+  a_realtime_recorder_clear ( &(vgl->realtime_rec) );
+  a_realtime_recorder_init ( &(vgl->realtime_rec), vgl->realtime_track,
+                             vik_trw_layer_get_coord_mode ( vgl->trw_children[TRW_REALTIME] ) );
+}
+
+static void rt_recording_stop(VikGpsLayer *vgl)
+{
+  if (vgl->realtime_record && vgl->realtime_track) {
+    a_realtime_recorder_flush ( &(vgl->realtime_rec) );
+    if ((vgl->realtime_track->trackpoints == NULL) || (vgl->realtime_track->trackpoints->next == NULL))
+      vik_trw_layer_delete_track(vgl->trw_children[TRW_REALTIME], vgl->realtime_track_name);
+    vgl->realtime_track = NULL;
+  }
+  a_realtime_recorder_clear ( &(vgl->realtime_rec) );
+}
+
 static gboolean rt_gpsd_try_connect(gpointer *data)
 {
   VikGpsLayer *vgl = (VikGpsLayer *)data;
@@ -1329,18 +1391,7 @@ static gboolean rt_gpsd_try_connect(gpointer *data)
 #endif
   vgl->vgpsd->vgl = vgl;
 
-  vgl->realtime_fix.dirty = vgl->last_fix.dirty = FALSE;
-  /* track alt/time graph uses VIK_DEFAULT_ALTITUDE (0.0) as invalid */
-  vgl->realtime_fix.fix.altitude = vgl->last_fix.fix.altitude = VIK_DEFAULT_ALTITUDE;
-  vgl->realtime_fix.fix.speed = vgl->last_fix.fix.speed = NAN;
-
-  if (vgl->realtime_record) {
-    VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
-    vgl->realtime_track = vik_track_new();
-    vgl->realtime_track->visible = TRUE;
-    vgl->realtime_track_name = make_track_name(vtl);
-    vik_trw_layer_add_track(vtl, vgl->realtime_track_name, vgl->realtime_track);
-  }
+  rt_recording_start(vgl);
 
   gps_set_raw_hook(&vgl->vgpsd->gpsd, gpsd_raw_hook);
   vgl->realtime_io_channel = g_io_channel_unix_new(vgl->vgpsd->gpsd.gps_fd);
@@ -1411,13 +1462,102 @@ static void rt_gpsd_disconnect(VikGpsLayer *vgl)
 #endif
     vgl->vgpsd = NULL;
   }
+  if (vgl->replay_timer) {
+    g_source_remove(vgl->replay_timer);
+    vgl->replay_timer = 0;
+  }
+  if (vgl->replay_channel) {
+    g_io_channel_shutdown (vgl->replay_channel, FALSE, NULL);
+    g_io_channel_unref (vgl->replay_channel);
+    vgl->replay_channel = NULL;
+  }
 
-  if (vgl->realtime_record && vgl->realtime_track) {
-    create_realtime_trackpoint(vgl, TRUE);
-    if ((vgl->realtime_track->trackpoints == NULL) || (vgl->realtime_track->trackpoints->next == NULL))
-      vik_trw_layer_delete_track(vgl->trw_children[TRW_REALTIME], vgl->realtime_track_name);
-    vgl->realtime_track = NULL;
+  rt_recording_stop(vgl);
+}
+
+/* Feeds the next fix of the log through the same path as gpsd's */
+static gboolean rt_replay_next(VikGpsLayer *vgl)
+{
+  gchar *line;
+  gsize term;
+
+  gdk_threads_enter();
+  while (g_io_channel_read_line(vgl->replay_channel, &line, NULL, &term, NULL) == G_IO_STATUS_NORMAL) {
+    gboolean complete;
+    line[term] = '\0';
+    complete = a_realtime_parse_line(&vgl->replay_fix, line);
+    g_free(line);
+    if (complete) {
+      realtime_tracking_fix(vgl, &vgl->replay_fix);
+      gdk_threads_leave();
+      return TRUE;
+    }
   }
+
+  /* the end of the log: stop as if asked to */
+  vgl->replay_timer = 0;
+  vgl->realtime_tracking = FALSE;
+  vgl->first_realtime_trackpoint = FALSE;
+  rt_gpsd_disconnect(vgl);
+  vik_layer_emit_update ( VIK_LAYER(vgl) );
+  gdk_threads_leave();
+  return FALSE;
+}
+
+static void gps_replay_cb( gpointer layer_and_vlp[2] )
+{
+  VikGpsLayer *vgl = (VikGpsLayer *)layer_and_vlp[0];
+  GtkWidget *dialog;
+  GError *error = NULL;
+  gchar *fn;
+
+  if (vgl->realtime_tracking)
+    return;
+
+  dialog = gtk_file_chooser_dialog_new (_("Replay GPS Log"),
+                                        VIK_GTK_WINDOW_FROM_LAYER(vgl),
+                                        GTK_FILE_CHOOSER_ACTION_OPEN,
+                                        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+                                        NULL);
+  if (gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT) {
+    gtk_widget_destroy(dialog);
+    return;
+  }
+  fn = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+  gtk_widget_destroy(dialog);
+
+  if (!vik_gps_layer_replay(vgl, fn, &error)) {
+    a_dialog_error_msg(VIK_GTK_WINDOW_FROM_LAYER(vgl), error->message);
+    g_error_free(error);
+  }
+  g_free(fn);
+}
+
+gboolean vik_gps_layer_replay ( VikGpsLayer *vgl, const gchar *filename, GError **error )
+{
+  g_return_val_if_fail ( ! vgl->realtime_tracking, FALSE );
+
+  vgl->replay_channel = g_io_channel_new_file(filename, "r", error);
+  if (!vgl->replay_channel)
+    return FALSE;
+  /* NMEA is plain ASCII, but logs often carry a damaged line or two */
+  g_io_channel_set_encoding(vgl->replay_channel, NULL, NULL);
+
+  memset(&vgl->replay_fix, 0, sizeof(vgl->replay_fix));
+  vgl->replay_fix.altitude = vgl->replay_fix.speed = NAN;
+
+  vgl->realtime_tracking = TRUE;
+  vgl->first_realtime_trackpoint = TRUE;
+  rt_recording_start(vgl);
+  /* at the rate asked for, whatever the times in the log */
+  vgl->replay_timer = g_timeout_add(1000 / vgl->replay_rate, (GSourceFunc)rt_replay_next, vgl);
+  return TRUE;
+}
+
+gboolean vik_gps_layer_get_tracking ( VikGpsLayer *vgl )
+{
+  return vgl->realtime_tracking;
 }
 
 static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2])
@@ -46,4 +46,12 @@ gboolean vik_gps_layer_is_empty ( VikGpsLayer *vgl );
 const GList *vik_gps_layer_get_children ( VikGpsLayer *vgl );
 VikTrwLayer * vik_gps_layer_get_a_child(VikGpsLayer *vgl);
 
+#ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
+/* Plays a log of fixes (see a_realtime_parse_line()) back through the
+ * realtime tracking at the layer's replay rate, when not tracking already. */
+gboolean vik_gps_layer_replay ( VikGpsLayer *vgl, const gchar *filename, GError **error );
+/* from gpsd or a log, until it ends */
+gboolean vik_gps_layer_get_tracking ( VikGpsLayer *vgl );
+#endif
+
 #endif
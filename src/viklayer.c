@@ -41,6 +41,7 @@ extern VikLayerInterface vik_dem_layer_interface;
 
 enum {
   VL_UPDATE_SIGNAL,
+  VL_CHANGED_SIGNAL,
   VL_LAST_SIGNAL
 };
 static guint layer_signals[VL_LAST_SIGNAL] = { 0 };
@@ -92,13 +93,31 @@ static void layer_class_init (VikLayerClass *klass)
   layer_signals[VL_UPDATE_SIGNAL] = g_signal_new ( "update", G_TYPE_FROM_CLASS (klass),
       G_SIGNAL_RUN_FIRST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (VikLayerClass, update), NULL, NULL, 
       g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+  /* as "update", but hidden layers too: for those following what is in the layer */
+  layer_signals[VL_CHANGED_SIGNAL] = g_signal_new ( "changed", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_FIRST, 0, NULL, NULL,
+      g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
 }
 
 void vik_layer_emit_update ( VikLayer *vl )
 {
+  g_signal_emit ( G_OBJECT(vl), layer_signals[VL_CHANGED_SIGNAL], 0 );
+  if ( vl->visible ) {
+    vik_window_set_redraw_trigger(vl);
+    g_signal_emit ( G_OBJECT(vl), layer_signals[VL_UPDATE_SIGNAL], 0 );
+  }
+}
+
+/* The window repaints just that part of the screen, if it can. The area
+ * is only valid while the signal is being handled. */
+void vik_layer_emit_update_area ( VikLayer *vl, const VikCoord *c1, const VikCoord *c2 )
+{
+  g_signal_emit ( G_OBJECT(vl), layer_signals[VL_CHANGED_SIGNAL], 0 );
   if ( vl->visible ) {
     vik_window_set_redraw_trigger(vl);
+    vik_window_set_redraw_area(vl, c1, c2);
     g_signal_emit ( G_OBJECT(vl), layer_signals[VL_UPDATE_SIGNAL], 0 );
+    vik_window_set_redraw_area(vl, NULL, NULL);
   }
 }
 
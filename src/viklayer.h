@@ -252,7 +252,10 @@ const gchar *vik_layer_get_name ( VikLayer *l );
 
 gboolean vik_layer_set_param (VikLayer *layer, guint16 id, VikLayerParamData data, gpointer vp);
 
+/* both emit "changed" first, whether the layer is shown or not */
 void vik_layer_emit_update ( VikLayer *vl );
+/* only the area between the two corners changed */
+void vik_layer_emit_update_area ( VikLayer *vl, const VikCoord *c1, const VikCoord *c2 );
 
 /* GUI */
 void vik_layer_set_menu_items_selection(VikLayer *l, guint16 selection);
@@ -644,7 +644,9 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     guint max_path_len = strlen(vml->cache_dir) + 40;
     gchar *path_buf = g_malloc ( max_path_len * sizeof(char) );
 
-    if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
+    /* an export draws from the local cache only, and leaves last_center be */
+    if ( (!existence_only) && vml->autodownload && ! vik_viewport_get_offscreen ( vvp ) &&
+         should_start_autodownload(vml, vvp)) {
 #ifdef DEBUG
       fputs(stderr, "DEBUG: Starting autodownload\n");
 #endif
@@ -705,6 +707,12 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
           ulm.x = x;
           ulm.y = y;
 
+          /* during a partial repaint most tiles are not needed */
+          if ( ! vik_viewport_area_visible ( vvp, xx, yy, tilesize_x_ceil, tilesize_y_ceil ) ) {
+            yy += tilesize_y;
+            continue;
+          }
+
           if ( existence_only ) {
             g_snprintf ( path_buf, max_path_len, DIRSTRUCTURE,
                      vml->cache_dir, mode,
@@ -811,6 +819,25 @@ static void weak_ref_cb(gpointer ptr, GObject * dead_vml)
   g_mutex_unlock(mdi->mutex);
 }
 
+/* the area a tile covers: halfway to the centres of its diagonal neighbours */
+static void maps_layer_tile_area ( VikMapSource *map, MapCoord *mc, VikCoord *c1, VikCoord *c2 )
+{
+  MapCoord next = *mc;
+  VikCoord center, corner;
+
+  vik_map_source_mapcoord_to_center_coord ( map, mc, &center );
+  next.x = mc->x - 1; next.y = mc->y - 1;
+  vik_map_source_mapcoord_to_center_coord ( map, &next, &corner );
+  *c1 = center;
+  c1->east_west = ( center.east_west + corner.east_west ) / 2;
+  c1->north_south = ( center.north_south + corner.north_south ) / 2;
+  next.x = mc->x + 1; next.y = mc->y + 1;
+  vik_map_source_mapcoord_to_center_coord ( map, &next, &corner );
+  *c2 = center;
+  c2->east_west = ( center.east_west + corner.east_west ) / 2;
+  c2->north_south = ( center.north_south + corner.north_south ) / 2;
+}
+
 static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 {
   void *handle = vik_map_source_download_handle_init(MAPS_LAYER_NTH_TYPE(mdi->maptype));
@@ -875,8 +902,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
       if (remove_mem_cache)
           a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale );
       if (mdi->refresh_display && mdi->map_layer_alive) {
-        /* TODO: check if it's on visible area */
-        vik_layer_emit_update ( VIK_LAYER(mdi->vml) );
+        VikCoord c1, c2;
+        maps_layer_tile_area ( MAPS_LAYER_NTH_TYPE(mdi->maptype), &(mdi->mapcoord), &c1, &c2 );
+        vik_layer_emit_update_area ( VIK_LAYER(mdi->vml), &c1, &c2 );
       }
       g_mutex_unlock(mdi->mutex);
       gdk_threads_leave();
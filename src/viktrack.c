@@ -37,6 +37,7 @@
 #include "viktrack.h"
 #include "globals.h"
 #include "dems.h"
+#include "marshall.h"
 
 VikTrack *vik_track_new()
 {
@@ -105,9 +106,12 @@ VikTrack *vik_track_copy ( const VikTrack *tr )
   {
     new_tp = g_malloc ( sizeof ( VikTrackpoint ) );
     *new_tp = *((VikTrackpoint *)(tp_iter->data));
-    new_tr->trackpoints = g_list_append ( new_tr->trackpoints, new_tp );
+    new_tr->trackpoints = g_list_prepend ( new_tr->trackpoints, new_tp );
     tp_iter = tp_iter->next;
   }
+  new_tr->trackpoints = g_list_reverse ( new_tr->trackpoints );
+  new_tr->bounds[0] = tr->bounds[0];
+  new_tr->bounds[1] = tr->bounds[1];
   vik_track_set_comment(new_tr,tr->comment);
   return new_tr;
 }
@@ -136,19 +140,43 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
   return rv;
 }
 
+/* Distances between consecutive trackpoints, worked out in one batch:
+ * hops[i] runs from point i to point i+1. Returns NULL for fewer than
+ * two points; the caller frees the array. */
+static gdouble *track_get_hops ( const VikTrack *tr )
+{
+  guint n = g_list_length ( tr->trackpoints ), i = 0;
+  struct LatLon *lls;
+  gdouble *hops;
+  GList *iter;
+
+  if ( n < 2 )
+    return NULL;
+  lls = g_new ( struct LatLon, n );
+  for ( iter = tr->trackpoints; iter; iter = iter->next )
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), lls + i++ );
+  hops = g_new ( gdouble, n - 1 );
+  a_coords_latlons_diff ( lls, n, hops );
+  g_free ( lls );
+  return hops;
+}
+
 gdouble vik_track_get_length(const VikTrack *tr)
 {
   gdouble len = 0.0;
-  if ( tr->trackpoints )
+  gdouble *hops = track_get_hops ( tr );
+  if ( hops )
   {
     GList *iter = tr->trackpoints->next;
+    guint i = 0;
     while (iter)
     {
       if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+        len += hops[i];
       iter = iter->next;
+      i++;
     }
+    g_free ( hops );
   }
   return len;
 }
@@ -156,15 +184,13 @@ gdouble vik_track_get_length(const VikTrack *tr)
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
 {
   gdouble len = 0.0;
-  if ( tr->trackpoints )
+  gdouble *hops = track_get_hops ( tr );
+  if ( hops )
   {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                              &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
+    guint i, n = g_list_length ( tr->trackpoints );
+    for ( i = 0; i + 1 < n; i++ )
+      len += hops[i];
+    g_free ( hops );
   }
   return len;
 }
@@ -211,6 +237,255 @@ void vik_track_remove_dup_points ( VikTrack *tr )
   }
 }
 
+/* metres in a degree of latitude */
+#define SIMPLIFY_DEGREE 111319.49
+
+/* Flat positions in metres, good enough for judging which points of a
+ * track matter: a sinusoidal projection around the first point. */
+static void simplify_project ( GList *iter, gdouble *xs, gdouble *ys )
+{
+  struct LatLon ll, ll0;
+  guint i;
+
+  vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll0 );
+  for ( i = 0; iter; iter = iter->next, i++ ) {
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll );
+    xs[i] = (ll.lon - ll0.lon) * cos ( ll.lat * DEG2RAD ) * SIMPLIFY_DEGREE;
+    ys[i] = (ll.lat - ll0.lat) * SIMPLIFY_DEGREE;
+  }
+}
+
+/* from point i to the line from a to b, squared */
+static gdouble simplify_distance2 ( const gdouble *xs, const gdouble *ys, guint a, guint b, guint i )
+{
+  gdouble dx = xs[b] - xs[a], dy = ys[b] - ys[a];
+  gdouble len2 = dx * dx + dy * dy, t = 0;
+
+  if ( len2 > 0 ) {
+    t = ( (xs[i] - xs[a]) * dx + (ys[i] - ys[a]) * dy ) / len2;
+    t = CLAMP ( t, 0, 1 );
+  }
+  dx = xs[a] + t * dx - xs[i];
+  dy = ys[a] + t * dy - ys[i];
+  return dx * dx + dy * dy;
+}
+
+static gdouble simplify_area ( const gdouble *xs, const gdouble *ys, guint a, guint b, guint c )
+{
+  return fabs ( (xs[b] - xs[a]) * (ys[c] - ys[a]) - (xs[c] - xs[a]) * (ys[b] - ys[a]) ) / 2;
+}
+
+/* between each pair of kept points, the one furthest off the line
+ * between them is kept too if it is more than tolerance away */
+static void simplify_douglas_peucker ( const gdouble *xs, const gdouble *ys, gboolean *keep, guint n, gdouble tolerance )
+{
+  GArray *todo = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  guint a, b, i, far;
+  gdouble d, max;
+
+  /* the segment ends are kept already, each stretch between them is split */
+  for ( a = 0, b = 1; b < n; b++ )
+    if ( keep[b] ) {
+      if ( b > a + 1 ) {
+        g_array_append_val ( todo, a );
+        g_array_append_val ( todo, b );
+      }
+      a = b;
+    }
+
+  while ( todo->len ) {
+    b = g_array_index ( todo, guint, todo->len - 1 );
+    a = g_array_index ( todo, guint, todo->len - 2 );
+    g_array_set_size ( todo, todo->len - 2 );
+    max = -1;
+    far = a;
+    for ( i = a + 1; i < b; i++ )
+      if ( (d = simplify_distance2 ( xs, ys, a, b, i )) > max ) {
+        max = d;
+        far = i;
+      }
+    if ( max > tolerance * tolerance ) {
+      keep[far] = TRUE;
+      if ( far > a + 1 ) {
+        g_array_append_val ( todo, a );
+        g_array_append_val ( todo, far );
+      }
+      if ( b > far + 1 ) {
+        g_array_append_val ( todo, far );
+        g_array_append_val ( todo, b );
+      }
+    }
+  }
+  g_array_free ( todo, TRUE );
+}
+
+/* Visvalingam's points, in a heap by the area they add */
+typedef struct {
+  gdouble *area;
+  guint *heap;
+  guint *pos;  /* where each point is in heap, G_MAXUINT once out */
+  guint len;
+} SimplifyHeap;
+
+static void simplify_heap_swap ( SimplifyHeap *h, guint i, guint j )
+{
+  guint t = h->heap[i];
+  h->heap[i] = h->heap[j];
+  h->heap[j] = t;
+  h->pos[h->heap[i]] = i;
+  h->pos[h->heap[j]] = j;
+}
+
+static void simplify_heap_up ( SimplifyHeap *h, guint i )
+{
+  while ( i > 0 && h->area[h->heap[i]] < h->area[h->heap[(i-1)/2]] ) {
+    simplify_heap_swap ( h, i, (i-1)/2 );
+    i = (i-1)/2;
+  }
+}
+
+static void simplify_heap_down ( SimplifyHeap *h, guint i )
+{
+  for ( ;; ) {
+    guint least = i, c;
+    for ( c = 2*i + 1; c <= 2*i + 2 && c < h->len; c++ )
+      if ( h->area[h->heap[c]] < h->area[h->heap[least]] )
+        least = c;
+    if ( least == i )
+      return;
+    simplify_heap_swap ( h, i, least );
+    i = least;
+  }
+}
+
+/* Drops the point adding least area to the line until none adds less
+ * than min_area, or until max_points are left */
+static void simplify_visvalingam ( const gdouble *xs, const gdouble *ys, gboolean *keep, guint n, gdouble min_area, gulong max_points )
+{
+  SimplifyHeap h;
+  guint *prev = g_new ( guint, n ), *next = g_new ( guint, n );
+  gulong left = n;
+  guint i;
+
+  h.area = g_new ( gdouble, n );
+  h.heap = g_new ( guint, n );
+  h.pos = g_new ( guint, n );
+  h.len = 0;
+
+  /* the segment ends stay, so no point ever has neighbours across them */
+  for ( i = 0; i < n; i++ ) {
+    prev[i] = i - 1;
+    next[i] = i + 1;
+    h.pos[i] = G_MAXUINT;
+    if ( ! keep[i] ) {
+      h.area[i] = simplify_area ( xs, ys, i - 1, i, i + 1 );
+      h.heap[h.len] = i;
+      h.pos[i] = h.len++;
+      simplify_heap_up ( &h, h.pos[i] );
+    }
+  }
+
+  while ( h.len && ( max_points ? left > max_points : h.area[h.heap[0]] < min_area ) ) {
+    guint gone = h.heap[0], neighbours[2] = { prev[gone], next[gone] }, j;
+    gdouble area = h.area[gone];
+
+    simplify_heap_swap ( &h, 0, --h.len );
+    h.pos[gone] = G_MAXUINT;
+    simplify_heap_down ( &h, 0 );
+    next[neighbours[0]] = neighbours[1];
+    prev[neighbours[1]] = neighbours[0];
+    left--;
+
+    /* what's left of a triangle never counts for less than what went */
+    for ( j = 0; j < 2; j++ ) {
+      i = neighbours[j];
+      if ( h.pos[i] == G_MAXUINT )
+        continue;
+      h.area[i] = MAX ( simplify_area ( xs, ys, prev[i], i, next[i] ), area );
+      simplify_heap_up ( &h, h.pos[i] );
+      simplify_heap_down ( &h, h.pos[i] );
+    }
+  }
+
+  for ( i = 0; i < n; i++ )
+    if ( h.pos[i] != G_MAXUINT )
+      keep[i] = TRUE;
+
+  g_free ( h.area );
+  g_free ( h.heap );
+  g_free ( h.pos );
+  g_free ( prev );
+  g_free ( next );
+}
+
+gulong vik_track_simplify ( VikTrack *tr, VikTrackSimplify method, gdouble value )
+{
+  guint n = g_list_length ( tr->trackpoints ), i;
+  gboolean *keep;
+  gdouble *xs, *ys;
+  GList *iter, *next;
+  VikTrackpoint *last = NULL;
+  gdouble travelled = 0;
+  gulong removed = 0;
+
+  if ( n < 3 )
+    return 0;
+
+  /* each segment keeps its ends */
+  keep = g_new0 ( gboolean, n );
+  for ( iter = tr->trackpoints, i = 0; iter; iter = iter->next, i++ )
+    if ( i == 0 || ! iter->next || VIK_TRACKPOINT(iter->data)->newsegment || VIK_TRACKPOINT(iter->next->data)->newsegment )
+      keep[i] = TRUE;
+
+  switch ( method ) {
+    case VIK_TRACK_SIMPLIFY_DOUGLAS_PEUCKER:
+    case VIK_TRACK_SIMPLIFY_VISVALINGAM:
+    case VIK_TRACK_SIMPLIFY_POINTS:
+      xs = g_new ( gdouble, n );
+      ys = g_new ( gdouble, n );
+      simplify_project ( tr->trackpoints, xs, ys );
+      if ( method == VIK_TRACK_SIMPLIFY_DOUGLAS_PEUCKER )
+        simplify_douglas_peucker ( xs, ys, keep, n, value );
+      else if ( method == VIK_TRACK_SIMPLIFY_VISVALINGAM )
+        simplify_visvalingam ( xs, ys, keep, n, value, 0 );
+      else
+        simplify_visvalingam ( xs, ys, keep, n, 0, MAX ( value, 2 ) );
+      g_free ( xs );
+      g_free ( ys );
+      break;
+    case VIK_TRACK_SIMPLIFY_TIME:
+    case VIK_TRACK_SIMPLIFY_DISTANCE:
+      for ( iter = tr->trackpoints, i = 0; iter; iter = iter->next, i++ ) {
+        VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+        if ( i > 0 && ! tp->newsegment )
+          travelled += vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(tp->coord) );
+        if ( ! keep[i] ) {
+          if ( method == VIK_TRACK_SIMPLIFY_TIME )
+            /* points without a time can't be judged, they stay */
+            keep[i] = ! tp->has_timestamp || ! last->has_timestamp || tp->timestamp - last->timestamp >= value;
+          else
+            keep[i] = travelled >= value;
+        }
+        if ( keep[i] ) {
+          last = tp;
+          travelled = 0;
+        }
+      }
+      break;
+  }
+
+  for ( iter = tr->trackpoints, i = 0; iter; iter = next, i++ ) {
+    next = iter->next;
+    if ( ! keep[i] ) {
+      vik_trackpoint_free ( VIK_TRACKPOINT(iter->data) );
+      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter );
+      removed++;
+    }
+  }
+  g_free ( keep );
+  return removed;
+}
+
 guint vik_track_get_segment_count(const VikTrack *tr)
 {
   guint num = 1;
@@ -263,6 +538,107 @@ VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
   return rv;
 }
 
+/* the local day t falls in, as [start,end), FALSE if t is no date */
+static gboolean day_limits ( time_t t, time_t *start, time_t *end )
+{
+  struct tm tm;
+#ifdef WINDOWS
+  /* per thread there already */
+  struct tm *tmp = localtime ( &t );
+  if ( ! tmp )
+    return FALSE;
+  tm = *tmp;
+#else /* WINDOWS */
+  if ( ! localtime_r ( &t, &tm ) )
+    return FALSE;
+#endif /* WINDOWS */
+  tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+  tm.tm_isdst = -1;
+  *start = mktime ( &tm );
+  tm.tm_mday++;
+  tm.tm_isdst = -1;
+  *end = mktime ( &tm );
+  return TRUE;
+}
+
+VikTrack **vik_track_split(VikTrack *tr, VikTrackSplit criterion, gdouble value, guint *ret_len)
+{
+  GPtrArray *cuts = g_ptr_array_new ();
+  VikTrack **rv;
+  GList *iter;
+  VikTrackpoint *prev;
+  time_t day_start = 0, day_end = 0;
+  gboolean day_known = FALSE;
+  gulong run = 0;
+  guint i;
+
+  *ret_len = 0;
+  if ( ! tr->trackpoints ) {
+    g_ptr_array_free ( cuts, TRUE );
+    return NULL;
+  }
+
+  /* first find where the pieces start, in one walk */
+  prev = VIK_TRACKPOINT(tr->trackpoints->data);
+  for ( iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gboolean cut = FALSE;
+
+    switch ( criterion ) {
+      case VIK_TRACK_SPLIT_TIME:
+        cut = tp->has_timestamp && prev->has_timestamp && tp->timestamp - prev->timestamp > value;
+        break;
+      case VIK_TRACK_SPLIT_DISTANCE:
+        cut = iter != tr->trackpoints && vik_coord_diff ( &(prev->coord), &(tp->coord) ) > value;
+        break;
+      case VIK_TRACK_SPLIT_POINTS:
+        cut = run >= value;
+        break;
+      case VIK_TRACK_SPLIT_DAY:
+        /* the day's limits are only worked out again on leaving it */
+        if ( tp->has_timestamp ) {
+          if ( day_known && ( tp->timestamp < day_start || tp->timestamp >= day_end ) )
+            cut = TRUE;
+          if ( ! day_known || cut )
+            day_known = day_limits ( tp->timestamp, &day_start, &day_end );
+        }
+        break;
+    }
+    if ( cut && iter != tr->trackpoints ) {
+      g_ptr_array_add ( cuts, iter );
+      run = 0;
+    }
+    run++;
+    prev = tp;
+  }
+
+  if ( cuts->len == 0 ) {
+    g_ptr_array_free ( cuts, TRUE );
+    return NULL;
+  }
+
+  /* then unlink the runs there, the first staying in tr until the end */
+  *ret_len = cuts->len + 1;
+  rv = g_malloc ( *ret_len * sizeof(VikTrack *) );
+  for ( i = 0; i < *ret_len; i++ ) {
+    rv[i] = vik_track_new();
+    if ( tr->comment )
+      vik_track_set_comment ( rv[i], tr->comment );
+    rv[i]->visible = tr->visible;
+    if ( i == 0 )
+      rv[i]->trackpoints = tr->trackpoints;
+    else {
+      iter = g_ptr_array_index ( cuts, i - 1 );
+      iter->prev->next = NULL;
+      iter->prev = NULL;
+      rv[i]->trackpoints = iter;
+    }
+  }
+  tr->trackpoints = NULL;
+  g_ptr_array_free ( cuts, TRUE );
+  return rv;
+}
+
 void vik_track_reverse ( VikTrack *tr )
 {
   GList *iter;
@@ -289,21 +665,24 @@ gdouble vik_track_get_average_speed(const VikTrack *tr)
 {
   gdouble len = 0.0;
   guint32 time = 0;
-  if ( tr->trackpoints )
+  gdouble *hops = track_get_hops ( tr );
+  if ( hops )
   {
     GList *iter = tr->trackpoints->next;
+    guint i = 0;
     while (iter)
     {
       if ( VIK_TRACKPOINT(iter->data)->has_timestamp && 
           VIK_TRACKPOINT(iter->prev->data)->has_timestamp &&
           (! VIK_TRACKPOINT(iter->data)->newsegment) )
       {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+        len += hops[i];
         time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
       }
       iter = iter->next;
+      i++;
     }
+    g_free ( hops );
   }
   return (time == 0) ? 0 : ABS(len/time);
 }
@@ -311,22 +690,25 @@ gdouble vik_track_get_average_speed(const VikTrack *tr)
 gdouble vik_track_get_max_speed(const VikTrack *tr)
 {
   gdouble maxspeed = 0.0, speed = 0.0;
-  if ( tr->trackpoints )
+  gdouble *hops = track_get_hops ( tr );
+  if ( hops )
   {
     GList *iter = tr->trackpoints->next;
+    guint i = 0;
     while (iter)
     {
       if ( VIK_TRACKPOINT(iter->data)->has_timestamp && 
           VIK_TRACKPOINT(iter->prev->data)->has_timestamp &&
           (! VIK_TRACKPOINT(iter->data)->newsegment) )
       {
-        speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
-                 / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
+        speed = hops[i] / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
         if ( speed > maxspeed )
           maxspeed = speed;
       }
       iter = iter->next;
+      i++;
     }
+    g_free ( hops );
   }
   return maxspeed;
 }
@@ -491,7 +873,7 @@ void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble
 /* by Alex Foobarian */
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s, *t, *hops;
   gdouble duration, chunk_dur;
   time_t t1, t2;
   int i, pt_count, numpts, index;
@@ -521,17 +903,20 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
   s = g_malloc(sizeof(double) * pt_count);
   t = g_malloc(sizeof(double) * pt_count);
 
+  /* at least two points, otherwise the duration would be zero */
+  hops = track_get_hops ( tr );
   iter = tr->trackpoints->next;
   numpts = 0;
   s[0] = 0;
   t[0] = VIK_TRACKPOINT(iter->prev->data)->timestamp;
   numpts++;
   while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
+    s[numpts] = s[numpts-1] + hops[numpts-1];
     t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
     numpts++;
     iter = iter->next;
   }
+  g_free ( hops );
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -671,67 +1056,115 @@ gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdoubl
   return FALSE;
 }
 
-void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
+/* bump when the layout below changes: old data is then refused */
+#define TRACK_MARSHALL_VERSION 1
+
+/* the fields as the clipboard and the binary files both have them */
+void vik_trackpoint_marshall_fields ( const VikTrackpoint *tp, GByteArray *b )
 {
-  GList *tps;
-  GByteArray *b = g_byte_array_new();
-  guint len;
-  guint intp, ntp;
+  a_marshall_coord ( b, &(tp->coord) );
+  a_marshall_uint8 ( b, tp->newsegment );
+  a_marshall_uint8 ( b, tp->has_timestamp );
+  a_marshall_int64 ( b, tp->timestamp );
+  a_marshall_double ( b, tp->altitude );
+  a_marshall_double ( b, tp->speed );
+  a_marshall_double ( b, tp->course );
+  a_marshall_uint32 ( b, tp->nsats );
+  a_marshall_uint8 ( b, tp->fix_mode );
+  a_marshall_double ( b, tp->hdop );
+  a_marshall_double ( b, tp->vdop );
+  a_marshall_double ( b, tp->pdop );
+}
 
-  g_byte_array_append(b, (guint8 *)tr, sizeof(*tr));
+void vik_trackpoint_unmarshall_fields ( VikTrackpoint *tp, MarshallReader *r )
+{
+  a_unmarshall_coord ( r, &(tp->coord) );
+  tp->newsegment = a_unmarshall_uint8 ( r );
+  tp->has_timestamp = a_unmarshall_uint8 ( r );
+  tp->timestamp = a_unmarshall_int64 ( r );
+  tp->altitude = a_unmarshall_double ( r );
+  tp->speed = a_unmarshall_double ( r );
+  tp->course = a_unmarshall_double ( r );
+  tp->nsats = a_unmarshall_uint32 ( r );
+  tp->fix_mode = a_unmarshall_uint8 ( r );
+  tp->hdop = a_unmarshall_double ( r );
+  tp->vdop = a_unmarshall_double ( r );
+  tp->pdop = a_unmarshall_double ( r );
+}
 
-  /* we'll fill out number of trackpoints later */
-  intp = b->len;
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len));
+void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
+{
+  guint ntp = g_list_length ( tr->trackpoints );
+  GByteArray *b = g_byte_array_sized_new ( 16 + ntp * VIK_TRACKPOINT_MARSHALL_SIZE
+                                           + (tr->comment ? strlen(tr->comment) + 1 : 0) );
+  GList *tps;
 
-  tps = tr->trackpoints;
-  ntp = 0;
-  while (tps) {
-    g_byte_array_append(b, (guint8 *)tps->data, sizeof(VikTrackpoint));
-    tps = tps->next;
-    ntp++;
-  }
-  *(guint *)(b->data + intp) = ntp;
+  a_marshall_uint8 ( b, TRACK_MARSHALL_VERSION );
+  a_marshall_uint8 ( b, tr->visible );
+  a_marshall_string ( b, tr->comment );
+  a_marshall_uint32 ( b, ntp );
 
-  len = (tr->comment) ? strlen(tr->comment)+1 : 0; 
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len)); 
-  if (tr->comment) g_byte_array_append(b, (guint8 *)tr->comment, len);
+  for ( tps = tr->trackpoints; tps; tps = tps->next )
+    vik_trackpoint_marshall_fields ( VIK_TRACKPOINT(tps->data), b );
 
   *data = b->data;
   *datalen = b->len;
   g_byte_array_free(b, FALSE);
 }
 
+/* NULL if the data is cut short or from another version */
 VikTrack *vik_track_unmarshall (guint8 *data, guint datalen)
 {
-  guint len;
-  VikTrack *new_tr = vik_track_new();
-  VikTrackpoint *new_tp;
-  guint ntp;
-  gint i;
+  MarshallReader r;
+  VikTrack *new_tr;
+  guint ntp, i;
 
-  /* only the visibility is needed */
-  new_tr->visible = ((VikTrack *)data)->visible;
-  data += sizeof(*new_tr);
-
-  ntp = *(guint *)data;
-  data += sizeof(ntp);
+  a_marshall_reader_init ( &r, data, datalen );
+  if ( a_unmarshall_uint8 ( &r ) != TRACK_MARSHALL_VERSION )
+    return NULL;
 
-  for (i=0; i<ntp; i++) {
-    new_tp = vik_trackpoint_new();
-    memcpy(new_tp, data, sizeof(*new_tp));
-    data += sizeof(*new_tp);
-    new_tr->trackpoints = g_list_append(new_tr->trackpoints, new_tp);
+  new_tr = vik_track_new();
+  new_tr->visible = a_unmarshall_uint8 ( &r );
+  new_tr->comment = a_unmarshall_string ( &r );
+  ntp = a_unmarshall_uint32 ( &r );
+  /* don't trust the count with a huge loop */
+  if ( ntp > r.left / VIK_TRACKPOINT_MARSHALL_SIZE )
+    r.error = TRUE;
+
+  for ( i = 0; i < ntp && ! r.error; i++ ) {
+    VikTrackpoint *new_tp = vik_trackpoint_new();
+    vik_trackpoint_unmarshall_fields ( new_tp, &r );
+    /* appending would walk the whole list every time */
+    new_tr->trackpoints = g_list_prepend ( new_tr->trackpoints, new_tp );
   }
+  new_tr->trackpoints = g_list_reverse ( new_tr->trackpoints );
 
-  len = *(guint *)data;
-  data += sizeof(len);
-  if (len) {
-    new_tr->comment = g_strdup((gchar *)data);
+  if ( r.error ) {
+    vik_track_free ( new_tr );
+    return NULL;
   }
   return new_tr;
 }
 
+void vik_track_calculate_bounds ( VikTrack *tr )
+{
+  GList *iter = tr->trackpoints;
+
+  if ( ! iter )
+    return;
+  vik_coord_bounds_init ( tr->bounds, &(VIK_TRACKPOINT(iter->data)->coord) );
+  for ( iter = iter->next; iter; iter = iter->next )
+    vik_coord_bounds_extend ( tr->bounds, &(VIK_TRACKPOINT(iter->data)->coord) );
+}
+
+void vik_track_extend_bounds ( VikTrack *tr, const VikTrackpoint *tp )
+{
+  if ( tr->trackpoints && tr->trackpoints->next )
+    vik_coord_bounds_extend ( tr->bounds, &(tp->coord) );
+  else
+    vik_coord_bounds_init ( tr->bounds, &(tp->coord) );
+}
+
 void vik_track_apply_dem_data ( VikTrack *tr )
 {
   GList *tp_iter;
@@ -27,6 +27,7 @@
 #include <gtk/gtk.h>
 
 #include "vikcoord.h"
+#include "marshall.h"
 
 /* todo important: put these in their own header file, maybe.probably also rename */
 
@@ -60,6 +61,9 @@ struct _VikTrack {
   gchar *comment;
   guint8 ref_count;
   GtkWidget *property_dialog;
+  /* around the trackpoints, as for vik_coord_bounds_init(); kept by
+   * whoever changes them, meaningless while there are none */
+  struct LatLon bounds[2];
 };
 
 VikTrack *vik_track_new();
@@ -76,11 +80,35 @@ gdouble vik_track_get_length_including_gaps(const VikTrack *tr);
 gulong vik_track_get_tp_count(const VikTrack *tr);
 guint vik_track_get_segment_count(const VikTrack *tr);
 VikTrack **vik_track_split_into_segments(VikTrack *tr, guint *ret_len);
+
+typedef enum {
+  VIK_TRACK_SPLIT_TIME,     /* where points are more than value seconds apart */
+  VIK_TRACK_SPLIT_DISTANCE, /* where points are more than value metres apart */
+  VIK_TRACK_SPLIT_POINTS,   /* into pieces of value points */
+  VIK_TRACK_SPLIT_DAY,      /* where the local date changes */
+} VikTrackSplit;
+
+/* moves the points of tr, in order and without copying, into new tracks
+ * cut where criterion says, leaving it with none. returns NULL and leaves
+ * tr alone when there is nowhere to cut. */
+VikTrack **vik_track_split(VikTrack *tr, VikTrackSplit criterion, gdouble value, guint *ret_len);
 void vik_track_reverse(VikTrack *tr);
 
 gulong vik_track_get_dup_point_count ( const VikTrack *vt );
 void vik_track_remove_dup_points ( VikTrack *vt );
 
+typedef enum {
+  VIK_TRACK_SIMPLIFY_DOUGLAS_PEUCKER, /* keeps points more than value metres off the line */
+  VIK_TRACK_SIMPLIFY_VISVALINGAM,     /* drops points adding less than value square metres */
+  VIK_TRACK_SIMPLIFY_POINTS,          /* keeps the value points adding the most (Visvalingam) */
+  VIK_TRACK_SIMPLIFY_TIME,            /* keeps a point every value seconds */
+  VIK_TRACK_SIMPLIFY_DISTANCE,        /* keeps a point every value metres */
+} VikTrackSimplify;
+
+/* thins out the trackpoints in place, each segment keeping its ends.
+ * returns how many went. the bounds are left to the caller. */
+gulong vik_track_simplify ( VikTrack *tr, VikTrackSimplify method, gdouble value );
+
 gdouble vik_track_get_max_speed(const VikTrack *tr);
 gdouble vik_track_get_average_speed(const VikTrack *tr);
 
@@ -91,8 +119,14 @@ VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdoub
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reldist, time_t *seconds_from_start );
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks );
 gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt );
+void vik_track_calculate_bounds ( VikTrack *tr );
+void vik_track_extend_bounds ( VikTrack *tr, const VikTrackpoint *tp ); /* for tp just appended */
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (guint8 *data, guint datalen);
+/* a trackpoint on its own, always this many bytes */
+void vik_trackpoint_marshall_fields ( const VikTrackpoint *tp, GByteArray *b );
+void vik_trackpoint_unmarshall_fields ( VikTrackpoint *tp, MarshallReader *r );
+#define VIK_TRACKPOINT_MARSHALL_SIZE (A_MARSHALL_COORD_SIZE + 2 + 8 + 3*8 + 4 + 1 + 3*8)
 
 void vik_track_apply_dem_data ( VikTrack *tr);
 
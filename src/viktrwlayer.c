@@ -45,6 +45,7 @@
 #endif
 #include "acquire.h"
 #include "util.h"
+#include "marshall.h"
 
 #include "icons/icons.h"
 
@@ -169,7 +170,11 @@ struct _VikTrwLayer {
   gboolean drawlabels;
   gboolean drawimages;
   guint8 image_alpha;
-  GQueue *image_cache;
+  GHashTable *image_cache; /* filename -> CachedPixbuf */
+  GQueue *image_lru; /* loaded CachedPixbufs, most recently drawn first */
+  gsize image_cache_bytes;
+  GSList *image_load_queue; /* filenames missed during this draw */
+  GdkPixbuf *image_placeholder; /* drawn until an image is loaded */
   guint8 image_size;
   guint16 image_cache_size;
 
@@ -178,6 +183,13 @@ struct _VikTrwLayer {
 
   gboolean has_verified_thumbnails;
 
+  GHashTable *track_projections; /* VikTrack * -> TrackProjection */
+  guint draw_serial;
+
+  /* tracks keep their own bounds, waypoints share these */
+  struct LatLon waypoints_bounds[2];
+  gboolean waypoints_bounds_dirty;
+
   GtkMenu *wp_right_click_menu;
 
   /* menu */
@@ -186,12 +198,42 @@ struct _VikTrwLayer {
   gint highest_wp_number;
 };
 
-/* A caached waypoint image. */
+/* A cached waypoint image, or one still being loaded (pixbuf is NULL). */
 typedef struct {
   GdkPixbuf *pixbuf;
-  gchar *image; /* filename */
+  gchar *image; /* filename, also the key in image_cache */
+  guint8 size; /* image_size it was scaled to */
+  gboolean cancelled; /* not loaded again until asked to */
+  gsize bytes;
+  GList *lru; /* link in image_lru once loaded */
 } CachedPixbuf;
 
+/* A batch of waypoint images loaded off the main thread */
+typedef struct {
+  VikTrwLayer *vtl;
+  gboolean layer_alive;
+  GMutex *mutex;
+  GSList *images;
+  guint8 size;
+} ImageLoadInfo;
+
+/* Screen positions of every point of a track */
+typedef struct {
+  gint *x, *y;
+  guint allocated;
+} TrackScreenPoints;
+
+/* A track's points projected to the viewport's pan independent plane,
+ * kept between redraws: panning only offsets them and only points that
+ * moved are projected again, until the zoom or draw mode changes. */
+typedef struct {
+  VikViewportPlane plane;
+  VikCoord *coords; /* as projected */
+  gdouble *px, *py;
+  guint n, allocated;
+  guint used; /* draw_serial of the last draw using it */
+} TrackProjection;
+
 struct DrawingParams {
   VikViewport *vp;
   VikTrwLayer *vtl;
@@ -201,6 +243,11 @@ struct DrawingParams {
   gint track_gc_iter;
   gboolean one_zone, lat_lon;
   gdouble ce1, ce2, cn1, cn2;
+  TrackScreenPoints points; /* reused from track to track */
+  const VikTrack *projected_track;
+  GArray *line; /* GdkPoint, the polyline not drawn yet */
+  GdkGC *line_gc;
+  gboolean sync_images; /* load missing images now, not in the background */
 };
 
 static void vik_trw_layer_set_menu_selection(VikTrwLayer *vtl, guint16);
@@ -210,9 +257,7 @@ static void trw_layer_delete_item ( gpointer *pass_along );
 static void trw_layer_copy_item_cb( gpointer *pass_along);
 static void trw_layer_cut_item_cb( gpointer *pass_along);
 
-static void trw_layer_find_maxmin_waypoints ( const gchar *name, const VikWaypoint *w, struct LatLon maxmin[2] );
-static void trw_layer_find_maxmin_tracks ( const gchar *name, GList **t, struct LatLon maxmin[2] );	
-static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2]);
+static gboolean trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2]);
 
 static void trw_layer_new_track_gcs ( VikTrwLayer *vtl, VikViewport *vp );
 static void trw_layer_free_track_gcs ( VikTrwLayer *vtl );
@@ -226,14 +271,20 @@ static void trw_layer_goto_track_startpoint ( gpointer pass_along[5] );
 static void trw_layer_goto_track_endpoint ( gpointer pass_along[6] );
 static void trw_layer_merge_by_timestamp ( gpointer pass_along[6] );
 static void trw_layer_split_by_timestamp ( gpointer pass_along[6] );
+static void trw_layer_split_by_distance ( gpointer pass_along[6] );
+static void trw_layer_split_by_n_points ( gpointer pass_along[6] );
+static void trw_layer_split_by_day ( gpointer pass_along[6] );
+static void trw_layer_simplify ( gpointer pass_along[6] );
 static void trw_layer_download_map_along_track_cb(gpointer pass_along[6]);
 static void trw_layer_centerize ( gpointer layer_and_vlp[2] );
 static void trw_layer_export ( gpointer layer_and_vlp[2], guint file_type );
 static void trw_layer_goto_wp ( gpointer layer_and_vlp[2] );
+static void trw_layer_reload_images ( gpointer layer_and_vlp[2] );
 static void trw_layer_new_wp ( gpointer lav[2] );
 static void trw_layer_new_wikipedia_wp_viewport ( gpointer lav[2] );
 static void trw_layer_new_wikipedia_wp_layer ( gpointer lav[2] );
 static void trw_layer_merge_with_other ( gpointer pass_along[6] );
+static void trw_layer_merge_all_by_timestamp ( gpointer lav[2] );
 
 /* pop-up items */
 static void trw_layer_properties_item ( gpointer pass_along[5] );
@@ -285,7 +336,9 @@ static gboolean tool_magic_scissors_click ( VikTrwLayer *vtl, GdkEventButton *ev
 
 
 static void cached_pixbuf_free ( CachedPixbuf *cp );
-static gint cached_pixbuf_cmp ( CachedPixbuf *cp, const gchar *name );
+static void track_projection_free ( TrackProjection *proj );
+static void trw_layer_image_cache_clear ( VikTrwLayer *vtl );
+static void trw_layer_image_cache_trim ( VikTrwLayer *vtl );
 static void trw_layer_verify_thumbnails ( VikTrwLayer *vtl, GtkWidget *vp );
 
 static VikTrackpoint *closest_tp_in_five_pixel_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y );
@@ -554,8 +607,10 @@ static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *i
     VikWaypoint *w;
     gchar *name;
 
-    name = get_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, (gchar *)fi->data);
     w = vik_waypoint_unmarshall(fi->data + fi->len, len - sizeof(*fi) - fi->len);
+    if ( ! w )
+      return FALSE;
+    name = get_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, (gchar *)fi->data);
     vik_trw_layer_add_waypoint ( vtl, name, w );
     waypoint_convert(name, w, &vtl->coord_mode);
     return TRUE;
@@ -564,8 +619,10 @@ static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *i
   {
     VikTrack *t;
     gchar *name;
-    name = get_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, (gchar *)fi->data);
     t = vik_track_unmarshall(fi->data + fi->len, len - sizeof(*fi) - fi->len);
+    if ( ! t )
+      return FALSE;
+    name = get_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, (gchar *)fi->data);
     vik_trw_layer_add_track ( vtl, name, t );
     track_convert(name, t, &vtl->coord_mode);
     return TRUE;
@@ -617,15 +674,12 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, guint16 id, VikLayerPara
     case PARAM_IS: if ( data.u != vtl->image_size )
       {
         vtl->image_size = data.u;
-        g_list_foreach ( vtl->image_cache->head, (GFunc) cached_pixbuf_free, NULL );
-        g_queue_free ( vtl->image_cache );
-        vtl->image_cache = g_queue_new ();
+        trw_layer_image_cache_clear ( vtl );
       }
       break;
     case PARAM_IA: vtl->image_alpha = data.u; break;
     case PARAM_ICS: vtl->image_cache_size = data.u;
-      while ( vtl->image_cache->length > vtl->image_cache_size ) /* if shrinking cache_size, free pixbuf ASAP */
-          cached_pixbuf_free ( g_queue_pop_tail ( vtl->image_cache ) );
+      trw_layer_image_cache_trim ( vtl ); /* if shrinking cache_size, free pixbuf ASAP */
       break;
     case PARAM_WPC: gdk_gc_set_rgb_fg_color(vtl->waypoint_gc, &(data.c)); break;
     case PARAM_WPTC: gdk_gc_set_rgb_fg_color(vtl->waypoint_text_gc, &(data.c)); break;
@@ -673,58 +727,119 @@ static VikLayerParamData trw_layer_get_param ( VikTrwLayer *vtl, guint16 id )
   return rv;
 }
 
+/* bump when the layout below changes: old data is then refused */
+#define TRW_LAYER_MARSHALL_VERSION 1
+
+static void trw_layer_marshall_waypoint ( const gchar *name, VikWaypoint *wp, GByteArray *b )
+{
+  guint8 *id;
+  guint il;
+
+  vik_waypoint_marshall ( wp, &id, &il );
+  a_marshall_string ( b, name );
+  a_marshall_uint32 ( b, il );
+  g_byte_array_append ( b, id, il );
+  g_free ( id );
+}
+
+static void trw_layer_marshall_track ( const gchar *name, VikTrack *tr, GByteArray *b )
+{
+  guint8 *id;
+  guint il;
+
+  vik_track_marshall ( tr, &id, &il );
+  a_marshall_string ( b, name );
+  a_marshall_uint32 ( b, il );
+  g_byte_array_append ( b, id, il );
+  g_free ( id );
+}
+
+/* The parameters, then every waypoint and track packed as on the
+ * clipboard: no round trip through a GPX file. */
 static void trw_layer_marshall( VikTrwLayer *vtl, guint8 **data, gint *len )
 {
-  guint8 *pd, *dd;
-  gint pl, dl;
-  gchar *tmpname;
-  FILE *f;
-
-  *data = NULL;
-
-  if ((f = fdopen(g_file_open_tmp (NULL, &tmpname, NULL), "r+"))) {
-    a_gpx_write_file(vtl, f);
-    vik_layer_marshall_params(VIK_LAYER(vtl), &pd, &pl);
-    fclose(f);
-    f = NULL;
-    g_file_get_contents(tmpname, (void *)&dd, (void *)&dl, NULL);
-    *len = sizeof(pl) + pl + dl;
-    *data = g_malloc(*len);
-    memcpy(*data, &pl, sizeof(pl));
-    memcpy(*data + sizeof(pl), pd, pl);
-    memcpy(*data + sizeof(pl) + pl, dd, dl);
-    
-    g_free(pd);
-    g_free(dd);
-    g_remove(tmpname);
-    g_free(tmpname);
+  GByteArray *b = g_byte_array_new ();
+  guint8 *pd;
+  gint pl;
+
+  vik_layer_marshall_params ( VIK_LAYER(vtl), &pd, &pl );
+  a_marshall_uint32 ( b, pl );
+  g_byte_array_append ( b, pd, pl );
+  g_free ( pd );
+
+  a_marshall_uint8 ( b, TRW_LAYER_MARSHALL_VERSION );
+  a_marshall_uint32 ( b, g_hash_table_size ( vtl->waypoints ) );
+  g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_marshall_waypoint, b );
+  a_marshall_uint32 ( b, g_hash_table_size ( vtl->tracks ) );
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_marshall_track, b );
+
+  *len = b->len;
+  *data = g_byte_array_free ( b, FALSE );
+}
+
+/* an item as trw_layer_marshall_waypoint/track wrote it */
+static guint8 *trw_layer_unmarshall_item ( MarshallReader *r, gchar **name, guint *il )
+{
+  guint8 *id;
+
+  *name = a_unmarshall_string ( r );
+  *il = a_unmarshall_uint32 ( r );
+  if ( r->error || ! *name || *il > r->left ) {
+    r->error = TRUE;
+    g_free ( *name );
+    return NULL;
   }
+  id = (guint8 *) r->data;
+  r->data += *il;
+  r->left -= *il;
+  return id;
 }
 
 static VikTrwLayer *trw_layer_unmarshall( gpointer data, gint len, VikViewport *vvp )
 {
   VikTrwLayer *rv = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, NULL, FALSE ));
-  guint pl;
-  gchar *tmpname;
-  FILE *f;
+  MarshallReader r;
+  guint pl, n, i, il;
+  guint8 *id;
+  gchar *name;
 
+  a_marshall_reader_init ( &r, data, len );
+  pl = a_unmarshall_uint32 ( &r );
+  if ( r.error || pl > r.left ) {
+    g_warning ( "%s: truncated layer data", __FUNCTION__ );
+    return rv;
+  }
+  vik_layer_unmarshall_params ( VIK_LAYER(rv), (guint8 *) r.data, pl, vvp );
+  r.data += pl;
+  r.left -= pl;
 
-  memcpy(&pl, data, sizeof(pl));
-  data += sizeof(pl);
-  vik_layer_unmarshall_params ( VIK_LAYER(rv), data, pl, vvp );
-  data += pl;
+  if ( a_unmarshall_uint8 ( &r ) != TRW_LAYER_MARSHALL_VERSION ) {
+    g_warning ( "%s: layer data of an unknown version", __FUNCTION__ );
+    return rv;
+  }
 
-  if (!(f = fdopen(g_file_open_tmp (NULL, &tmpname, NULL), "r+"))) {
-    g_critical("couldn't open temp file");
-    exit(1);
+  n = a_unmarshall_uint32 ( &r );
+  for ( i = 0; i < n && ( id = trw_layer_unmarshall_item ( &r, &name, &il ) ); i++ ) {
+    VikWaypoint *wp = vik_waypoint_unmarshall ( id, il );
+    if ( wp ) {
+      waypoint_convert ( name, wp, &rv->coord_mode );
+      vik_trw_layer_add_waypoint ( rv, name, wp );
+    } else
+      g_free ( name );
   }
-  fwrite(data, len - pl - sizeof(pl), 1, f);
-  rewind(f);
-  a_gpx_read_file(rv, f);
-  fclose(f);
-  f = NULL;
-  g_remove(tmpname);
-  g_free(tmpname);
+
+  n = a_unmarshall_uint32 ( &r );
+  for ( i = 0; i < n && ( id = trw_layer_unmarshall_item ( &r, &name, &il ) ); i++ ) {
+    VikTrack *tr = vik_track_unmarshall ( id, il );
+    if ( tr ) {
+      track_convert ( name, tr, &rv->coord_mode );
+      vik_trw_layer_add_track ( rv, name, tr );
+    } else
+      g_free ( name );
+  }
+
+  if ( r.error )
+    g_warning ( "%s: truncated layer data", __FUNCTION__ );
   return rv;
 }
 
@@ -818,7 +933,14 @@ VikTrwLayer *vik_trw_layer_new ( gint drawmode )
   rv->last_tpl = NULL;
   rv->last_tp_track_name = NULL;
   rv->tpwin = NULL;
-  rv->image_cache = g_queue_new();
+  rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) cached_pixbuf_free );
+  rv->image_lru = g_queue_new();
+  rv->image_cache_bytes = 0;
+  rv->image_load_queue = NULL;
+  rv->image_placeholder = NULL;
+  rv->track_projections = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) track_projection_free );
+  rv->draw_serial = 0;
+  rv->waypoints_bounds_dirty = TRUE;
   rv->image_size = 64;
   rv->image_alpha = 255;
   rv->image_cache_size = 300;
@@ -857,13 +979,17 @@ void vik_trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->tpwin != NULL )
     gtk_widget_destroy ( GTK_WIDGET(trwlayer->tpwin) );
 
-  g_list_foreach ( trwlayer->image_cache->head, (GFunc) cached_pixbuf_free, NULL );
-  g_queue_free ( trwlayer->image_cache );
+  g_hash_table_destroy ( trwlayer->track_projections );
+
+  trw_layer_image_cache_clear ( trwlayer );
+  g_hash_table_destroy ( trwlayer->image_cache );
+  g_queue_free ( trwlayer->image_lru );
 }
 
 static void init_drawing_params ( struct DrawingParams *dp, VikViewport *vp )
 {
   dp->vp = vp;
+  dp->sync_images = vik_viewport_get_offscreen ( vp );
   dp->xmpp = vik_viewport_get_xmpp ( vp );
   dp->ympp = vik_viewport_get_ympp ( vp );
   dp->width = vik_viewport_get_width ( vp );
@@ -896,6 +1022,85 @@ static void init_drawing_params ( struct DrawingParams *dp, VikViewport *vp )
   }
 
   dp->track_gc_iter = 0;
+  dp->projected_track = NULL;
+  if ( ! dp->line )
+    dp->line = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+  g_array_set_size ( dp->line, 0 );
+  dp->line_gc = NULL;
+}
+
+static void track_projection_free ( TrackProjection *proj )
+{
+  g_free ( proj->coords );
+  g_free ( proj->px );
+  g_free ( proj->py );
+  g_free ( proj );
+}
+
+static gboolean track_projection_unused ( gpointer tr, TrackProjection *proj, gpointer draw_serial )
+{
+  return proj->used != GPOINTER_TO_UINT(draw_serial);
+}
+
+static TrackProjection *trw_layer_project_track ( VikTrwLayer *vtl, VikViewport *vvp, const VikTrack *tr )
+{
+  TrackProjection *proj = g_hash_table_lookup ( vtl->track_projections, tr );
+  VikViewportPlane plane;
+  gboolean all = FALSE;
+  GList *iter;
+  guint i, n = g_list_length ( tr->trackpoints );
+
+  vik_viewport_get_plane ( vvp, &plane );
+  if ( ! proj ) {
+    proj = g_malloc0 ( sizeof(TrackProjection) );
+    g_hash_table_insert ( vtl->track_projections, (gpointer) tr, proj );
+    all = TRUE;
+  } else if ( ! vik_viewport_plane_equal ( &plane, &(proj->plane) ) )
+    all = TRUE;
+  proj->plane = plane;
+
+  if ( n > proj->allocated ) {
+    proj->allocated = MAX ( n, 2 * proj->allocated );
+    proj->coords = g_renew ( VikCoord, proj->coords, proj->allocated );
+    proj->px = g_renew ( gdouble, proj->px, proj->allocated );
+    proj->py = g_renew ( gdouble, proj->py, proj->allocated );
+  }
+
+  if ( all ) {
+    for ( iter = tr->trackpoints, i = 0; iter; iter = iter->next, i++ )
+      proj->coords[i] = VIK_TRACKPOINT(iter->data)->coord;
+    vik_viewport_coords_to_plane ( vvp, proj->coords, n, proj->px, proj->py );
+  } else {
+    /* the track may have been edited since */
+    for ( iter = tr->trackpoints, i = 0; iter; iter = iter->next, i++ ) {
+      const VikCoord *coord = &(VIK_TRACKPOINT(iter->data)->coord);
+      if ( i >= proj->n || ! vik_coord_equals ( coord, proj->coords + i ) ) {
+        proj->coords[i] = *coord;
+        vik_viewport_coords_to_plane ( vvp, coord, 1, proj->px + i, proj->py + i );
+      }
+    }
+  }
+  proj->n = n;
+  proj->used = vtl->draw_serial;
+  return proj;
+}
+
+static void track_screen_points_project ( TrackScreenPoints *sp, VikTrwLayer *vtl, VikViewport *vvp, const VikTrack *tr )
+{
+  TrackProjection *proj = trw_layer_project_track ( vtl, vvp, tr );
+
+  if ( proj->n > sp->allocated ) {
+    sp->allocated = MAX ( proj->n, 2 * sp->allocated );
+    sp->x = g_renew ( gint, sp->x, sp->allocated );
+    sp->y = g_renew ( gint, sp->y, sp->allocated );
+  }
+  vik_viewport_plane_to_screen ( vvp, proj->coords, proj->px, proj->py, proj->n, sp->x, sp->y );
+}
+
+static void track_screen_points_free ( TrackScreenPoints *sp )
+{
+  g_free ( sp->x );
+  g_free ( sp->y );
 }
 
 static gint calculate_velocity ( VikTrwLayer *vtl, VikTrackpoint *tp1, VikTrackpoint *tp2 )
@@ -921,6 +1126,32 @@ static gint calculate_velocity ( VikTrwLayer *vtl, VikTrackpoint *tp1, VikTrackp
    return VIK_TRW_LAYER_TRACK_GC_BLACK;
 }
 
+/* Segments joining up are gathered into one polyline, drawn when the
+ * track breaks off or the style changes. */
+static void trw_layer_draw_line_flush ( struct DrawingParams *dp )
+{
+  if ( dp->line->len > 1 )
+    vik_viewport_draw_lines ( dp->vp, dp->line_gc, (GdkPoint *) dp->line->data, dp->line->len );
+  g_array_set_size ( dp->line, 0 );
+}
+
+static void trw_layer_draw_line ( struct DrawingParams *dp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 )
+{
+  GdkPoint pt;
+  GdkPoint *last = dp->line->len ? &g_array_index ( dp->line, GdkPoint, dp->line->len - 1 ) : NULL;
+
+  if ( gc != dp->line_gc || ! last || last->x != x1 || last->y != y1 ) {
+    trw_layer_draw_line_flush ( dp );
+    dp->line_gc = gc;
+    pt.x = x1;
+    pt.y = y1;
+    g_array_append_val ( dp->line, pt );
+  }
+  pt.x = x2;
+  pt.y = y2;
+  g_array_append_val ( dp->line, pt );
+}
+
 void draw_utm_skip_insignia ( VikViewport *vvp, GdkGC *gc, gint x, gint y )
 {
   vik_viewport_draw_line ( vvp, gc, x+5, y, x-5, y );
@@ -955,6 +1186,12 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
   if ( ! track->visible )
     return;
 
+  if ( dp->projected_track != track ) /* else done for the background pass already */
+  {
+    track_screen_points_project ( &(dp->points), dp->vtl, dp->vp, track );
+    dp->projected_track = track;
+  }
+
   /* admittedly this is not an efficient way to do it because we go through the whole GC thing all over... */
   if ( dp->vtl->bg_line_thickness && !drawing_white_background )
     trw_layer_draw_track ( name, track, dp, TRUE );
@@ -973,11 +1210,13 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
 
   if (list) {
     int x, y, oldx, oldy;
+    guint i = 0;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
   
     tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
-    vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+    x = dp->points.x[0];
+    y = dp->points.y[0];
 
     if ( (drawpoints) && dp->track_gc_iter < VIK_TRW_LAYER_TRACK_GC )
     {
@@ -993,6 +1232,7 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
 
     while ((list = g_list_next(list)))
     {
+      i++;
       tp = VIK_TRACKPOINT(list->data);
       tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
@@ -1002,7 +1242,8 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
              tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&  /* both UTM and lat lon */
              tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2 ) )
       {
-        vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+        x = dp->points.x[i];
+        y = dp->points.y[i];
 
         if ( drawpoints && ! drawing_white_background )
         {
@@ -1030,17 +1271,21 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
           if ( dp->vtl->drawmode == DRAWMODE_BY_VELOCITY )
             dp->track_gc_iter = calculate_velocity ( dp->vtl, tp, tp2 );
 
-          if (!useoldvals)
-            vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
+          if (!useoldvals) {
+            oldx = dp->points.x[i-1];
+            oldy = dp->points.y[i-1];
+          }
 
           if ( drawing_white_background ) {
-            vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
+            trw_layer_draw_line ( dp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
           }
           else {
 
-            vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
+            trw_layer_draw_line ( dp, main_gc, oldx, oldy, x, y);
             if ( dp->vtl->drawelevation && list && list->next && VIK_TRACKPOINT(list->next->data)->altitude != VIK_DEFAULT_ALTITUDE ) {
               GdkPoint tmp[4];
+              /* the shading goes over the track, as it always has */
+              trw_layer_draw_line_flush ( dp );
               #define FIXALTITUDE(what) ((VIK_TRACKPOINT((what))->altitude-min_alt)/alt_diff*DRAW_ELEVATION_FACTOR*dp->vtl->elevation_factor/dp->xmpp)
               if ( list && list->next && VIK_TRACKPOINT(list->next->data)->altitude != VIK_DEFAULT_ALTITUDE ) {
                 tmp[0].x = oldx;
@@ -1074,24 +1319,27 @@ static void trw_layer_draw_track ( const gchar *name, VikTrack *track, struct Dr
           VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
           if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
-            vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+            x = dp->points.x[i];
+            y = dp->points.y[i];
             if ( dp->vtl->drawmode == DRAWMODE_BY_VELOCITY )
               dp->track_gc_iter = calculate_velocity ( dp->vtl, tp, tp2 );
 
             if ( drawing_white_background )
-              vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
+              trw_layer_draw_line ( dp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
             else
-              vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
+              trw_layer_draw_line ( dp, main_gc, oldx, oldy, x, y);
           }
           else 
           {
-            vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &x, &y );
+            x = dp->points.x[i-1];
+            y = dp->points.y[i-1];
             draw_utm_skip_insignia ( dp->vp, main_gc, x, y );
           }
         }
         useoldvals = FALSE;
       }
     }
+    trw_layer_draw_line_flush ( dp );
   }
   if ( dp->vtl->drawmode == DRAWMODE_BY_TRACK )
     if ( ++(dp->track_gc_iter) >= VIK_TRW_LAYER_TRACK_GC )
@@ -1106,13 +1354,184 @@ static void trw_layer_draw_track_cb ( const gchar *name, VikTrack *track, struct
 
 static void cached_pixbuf_free ( CachedPixbuf *cp )
 {
-  g_object_unref ( G_OBJECT(cp->pixbuf) );
+  if ( cp->pixbuf )
+    g_object_unref ( G_OBJECT(cp->pixbuf) );
   g_free ( cp->image );
+  g_free ( cp );
+}
+
+static void trw_layer_image_cache_remove ( VikTrwLayer *vtl, CachedPixbuf *cp )
+{
+  if ( cp->lru ) {
+    g_queue_delete_link ( vtl->image_lru, cp->lru );
+    vtl->image_cache_bytes -= cp->bytes;
+  }
+  g_hash_table_remove ( vtl->image_cache, cp->image ); /* frees cp */
+}
+
+/* image_cache_size is counted in full size images, but as memory:
+ * images scaled down to less than image_size square take less room. */
+static void trw_layer_image_cache_trim ( VikTrwLayer *vtl )
+{
+  gsize budget = (gsize) vtl->image_cache_size * vtl->image_size * vtl->image_size * 4;
+  while ( vtl->image_cache_bytes > budget && vtl->image_lru->length > 1 )
+    trw_layer_image_cache_remove ( vtl, g_queue_peek_tail ( vtl->image_lru ) );
+}
+
+/* loads still running find their entries gone and drop what they load */
+static void trw_layer_image_cache_clear ( VikTrwLayer *vtl )
+{
+  g_hash_table_remove_all ( vtl->image_cache );
+  while ( g_queue_pop_head ( vtl->image_lru ) )
+    ;
+  vtl->image_cache_bytes = 0;
+  g_slist_foreach ( vtl->image_load_queue, (GFunc) g_free, NULL );
+  g_slist_free ( vtl->image_load_queue );
+  vtl->image_load_queue = NULL;
+  if ( vtl->image_placeholder ) {
+    g_object_unref ( G_OBJECT(vtl->image_placeholder) );
+    vtl->image_placeholder = NULL;
+  }
+}
+
+/* called with the gdk lock held. takes the pixbuf, NULL if loading was cancelled */
+static void trw_layer_image_loaded ( VikTrwLayer *vtl, const gchar *image, guint8 size, GdkPixbuf *pixbuf )
+{
+  CachedPixbuf *cp = g_hash_table_lookup ( vtl->image_cache, image );
+  if ( ! cp || cp->pixbuf || cp->size != size ) {
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    return;
+  }
+  if ( ! pixbuf ) {
+    cp->cancelled = TRUE;
+    return;
+  }
+  cp->cancelled = FALSE;
+  cp->pixbuf = pixbuf;
+  cp->bytes = gdk_pixbuf_get_rowstride ( pixbuf ) * gdk_pixbuf_get_height ( pixbuf );
+  g_queue_push_head ( vtl->image_lru, cp );
+  cp->lru = vtl->image_lru->head;
+  vtl->image_cache_bytes += cp->bytes;
+  trw_layer_image_cache_trim ( vtl );
+}
+
+static GdkPixbuf *image_load ( const gchar *image, guint8 size )
+{
+  GdkPixbuf *regularthumb = a_thumbnails_get ( image ), *pixbuf;
+  if ( ! regularthumb ) {
+    a_thumbnails_create ( image );
+    regularthumb = a_thumbnails_get ( image );
+  }
+  if ( ! regularthumb )
+    regularthumb = a_thumbnails_get_default (); /* can't be read, remember that */
+  if ( size == 128 )
+    return regularthumb;
+  pixbuf = a_thumbnails_scale_pixbuf ( regularthumb, size, size );
+  g_object_unref ( G_OBJECT(regularthumb) );
+  return pixbuf;
+}
+
+static void image_load_weak_ref_cb ( ImageLoadInfo *ili, GObject *dead_vtl )
+{
+  g_mutex_lock ( ili->mutex );
+  ili->layer_alive = FALSE;
+  g_mutex_unlock ( ili->mutex );
+}
+
+#define IMAGE_LOAD_UPDATE_EVERY 16
+
+static void image_load_thread ( ImageLoadInfo *ili, gpointer threaddata )
+{
+  guint total = g_slist_length ( ili->images ), done = 0;
+  gboolean cancelled = FALSE;
+  GSList *iter;
+
+  for ( iter = ili->images; iter; iter = iter->next )
+  {
+    GdkPixbuf *pixbuf = NULL;
+    if ( ! cancelled )
+      cancelled = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total ) != 0;
+    if ( ! cancelled )
+      pixbuf = image_load ( (gchar *) iter->data, ili->size );
+
+    gdk_threads_enter();
+    g_mutex_lock ( ili->mutex );
+    if ( ili->layer_alive ) {
+      trw_layer_image_loaded ( ili->vtl, (gchar *) iter->data, ili->size, pixbuf );
+      if ( ! cancelled && ( done % IMAGE_LOAD_UPDATE_EVERY == 0 || ! iter->next ) )
+        vik_layer_emit_update ( VIK_LAYER(ili->vtl) );
+    } else if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    g_mutex_unlock ( ili->mutex );
+    gdk_threads_leave();
+  }
+
+  /* the layer is finalised with the gdk lock held */
+  gdk_threads_enter();
+  g_mutex_lock ( ili->mutex );
+  if ( ili->layer_alive )
+    g_object_weak_unref ( G_OBJECT(ili->vtl), (GWeakNotify) image_load_weak_ref_cb, ili );
+  g_mutex_unlock ( ili->mutex );
+  gdk_threads_leave();
+}
+
+static void image_load_info_free ( ImageLoadInfo *ili )
+{
+  g_slist_foreach ( ili->images, (GFunc) g_free, NULL );
+  g_slist_free ( ili->images );
+  g_mutex_free ( ili->mutex );
+  g_free ( ili );
+}
+
+static gboolean cached_pixbuf_cancelled ( const gchar *image, CachedPixbuf *cp, gpointer data )
+{
+  return cp->cancelled; /* never loaded, so not in image_lru */
+}
+
+/* images whose loading was cancelled are loaded on the next draw */
+static void trw_layer_reload_images ( gpointer layer_and_vlp[2] )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(layer_and_vlp[0]);
+  g_hash_table_foreach_remove ( vtl->image_cache, (GHRFunc) cached_pixbuf_cancelled, NULL );
+  vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
 
-static gint cached_pixbuf_cmp ( CachedPixbuf *cp, const gchar *name )
+/* hand the images missed while drawing to a worker */
+static void trw_layer_start_image_load ( VikTrwLayer *vtl )
 {
-  return strcmp ( cp->image, name );
+  ImageLoadInfo *ili;
+  gint len;
+  gchar *tmp;
+
+  if ( ! vtl->image_load_queue )
+    return;
+
+  /* no window to run the job in; missed again on a draw once there is one */
+  if ( ! VIK_LAYER(vtl)->vt ) {
+    GSList *iter;
+    for ( iter = vtl->image_load_queue; iter; iter = iter->next ) {
+      g_hash_table_remove ( vtl->image_cache, iter->data ); /* not loaded, so not in image_lru */
+      g_free ( iter->data );
+    }
+    g_slist_free ( vtl->image_load_queue );
+    vtl->image_load_queue = NULL;
+    return;
+  }
+
+  ili = g_malloc ( sizeof(ImageLoadInfo) );
+  ili->vtl = vtl;
+  ili->layer_alive = TRUE;
+  ili->mutex = g_mutex_new();
+  ili->images = g_slist_reverse ( vtl->image_load_queue );
+  ili->size = vtl->image_size;
+  vtl->image_load_queue = NULL;
+  g_object_weak_ref ( G_OBJECT(vtl), (GWeakNotify) image_load_weak_ref_cb, ili );
+
+  len = g_slist_length ( ili->images );
+  tmp = g_strdup_printf ( _("Loading %d Waypoint Images..."), len );
+  a_background_thread ( VIK_GTK_WINDOW_FROM_LAYER(vtl), tmp, (vik_thr_func) image_load_thread, ili, (vik_thr_free_func) image_load_info_free, NULL, len );
+  g_free ( tmp );
 }
 
 static void trw_layer_draw_waypoint ( const gchar *name, VikWaypoint *wp, struct DrawingParams *dp )
@@ -1131,52 +1550,47 @@ static void trw_layer_draw_waypoint ( const gchar *name, VikWaypoint *wp, struct
     if ( wp->image && dp->vtl->drawimages )
     {
       GdkPixbuf *pixbuf = NULL;
-      GList *l;
+      CachedPixbuf *cp;
 
       if ( dp->vtl->image_alpha == 0)
         return;
 
-      l = g_list_find_custom ( dp->vtl->image_cache->head, wp->image, (GCompareFunc) cached_pixbuf_cmp );
-      if ( l )
-        pixbuf = ((CachedPixbuf *) l->data)->pixbuf;
-      else
+      cp = g_hash_table_lookup ( dp->vtl->image_cache, wp->image );
+      if ( ! cp )
       {
-        gchar *image = wp->image;
-        GdkPixbuf *regularthumb = a_thumbnails_get ( wp->image );
-        if ( ! regularthumb )
-        {
-          regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
-          image = "\x12\x00"; /* this shouldn't occur naturally. */
-        }
-        if ( regularthumb )
-        {
-          CachedPixbuf *cp = NULL;
-          cp = g_malloc ( sizeof ( CachedPixbuf ) );
-          if ( dp->vtl->image_size == 128 )
-            cp->pixbuf = regularthumb;
-          else
-          {
-            cp->pixbuf = a_thumbnails_scale_pixbuf(regularthumb, dp->vtl->image_size, dp->vtl->image_size);
-            g_assert ( cp->pixbuf );
-            g_object_unref ( G_OBJECT(regularthumb) );
-          }
-          cp->image = g_strdup ( image );
-
-          /* needed so 'click picture' tool knows how big the pic is; we don't
-           * store it in cp because they may have been freed already. */
-          wp->image_width = gdk_pixbuf_get_width ( cp->pixbuf );
-          wp->image_height = gdk_pixbuf_get_height ( cp->pixbuf );
-
-          g_queue_push_head ( dp->vtl->image_cache, cp );
-          if ( dp->vtl->image_cache->length > dp->vtl->image_cache_size )
-            cached_pixbuf_free ( g_queue_pop_tail ( dp->vtl->image_cache ) );
+        cp = g_malloc0 ( sizeof ( CachedPixbuf ) );
+        cp->image = g_strdup ( wp->image );
+        cp->size = dp->vtl->image_size;
+        g_hash_table_insert ( dp->vtl->image_cache, cp->image, cp );
+        if ( ! dp->sync_images )
+          dp->vtl->image_load_queue = g_slist_prepend ( dp->vtl->image_load_queue, g_strdup ( wp->image ) );
+      }
+      /* an image file gets the pictures themselves */
+      if ( ! cp->pixbuf && dp->sync_images )
+        trw_layer_image_loaded ( dp->vtl, wp->image, cp->size, image_load ( wp->image, cp->size ) );
 
-          pixbuf = cp->pixbuf;
+      if ( cp->pixbuf )
+      {
+        pixbuf = cp->pixbuf;
+        if ( cp->lru != dp->vtl->image_lru->head )
+        {
+          g_queue_unlink ( dp->vtl->image_lru, cp->lru );
+          g_queue_push_head_link ( dp->vtl->image_lru, cp->lru );
         }
-        else
+        /* needed so 'click picture' tool knows how big the pic is; we don't
+         * store it in cp because they may have been freed already. */
+        wp->image_width = gdk_pixbuf_get_width ( pixbuf );
+        wp->image_height = gdk_pixbuf_get_height ( pixbuf );
+      }
+      else
+      {
+        if ( ! dp->vtl->image_placeholder )
         {
-          pixbuf = a_thumbnails_get_default (); /* thumbnail not yet loaded */
+          GdkPixbuf *regularthumb = a_thumbnails_get_default ();
+          dp->vtl->image_placeholder = a_thumbnails_scale_pixbuf ( regularthumb, dp->vtl->image_size, dp->vtl->image_size );
+          g_object_unref ( G_OBJECT(regularthumb) );
         }
+        pixbuf = dp->vtl->image_placeholder; /* thumbnail not yet loaded */
       }
       if ( pixbuf )
       {
@@ -1244,12 +1658,17 @@ void vik_trw_layer_draw ( VikTrwLayer *l, gpointer data )
 
   init_drawing_params ( &dp, VIK_VIEWPORT(data) );
   dp.vtl = l;
+  l->draw_serial++;
 
   if ( l->tracks_visible )
     g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
+  /* forget tracks which are gone or hidden */
+  g_hash_table_foreach_remove ( l->track_projections, (GHRFunc) track_projection_unused, GUINT_TO_POINTER(l->draw_serial) );
 
-  if (l->waypoints_visible)
+  if (l->waypoints_visible) {
     g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint, &dp );
+    trw_layer_start_image_load ( l );
+  }
 }
 
 static void trw_layer_free_track_gcs ( VikTrwLayer *vtl )
@@ -1447,79 +1866,64 @@ GHashTable *vik_trw_layer_get_waypoints ( VikTrwLayer *l )
   return l->waypoints;
 }
 
-static void trw_layer_find_maxmin_waypoints ( const gchar *name, const VikWaypoint *w, struct LatLon maxmin[2] )
+typedef struct {
+  struct LatLon maxmin[2];
+  gboolean found;
+} LayerBounds;
+
+static void trw_layer_bounds_add_waypoint ( const gchar *name, const VikWaypoint *wp, LayerBounds *b )
 {
-  static VikCoord fixme;
-  vik_coord_copy_convert ( &(w->coord), VIK_COORD_LATLON, &fixme );
-  if ( VIK_LATLON(&fixme)->lat > maxmin[0].lat || maxmin[0].lat == 0.0 )
-    maxmin[0].lat = VIK_LATLON(&fixme)->lat;
-  if ( VIK_LATLON(&fixme)->lat < maxmin[1].lat || maxmin[1].lat == 0.0 )
-    maxmin[1].lat = VIK_LATLON(&fixme)->lat;
-  if ( VIK_LATLON(&fixme)->lon > maxmin[0].lon || maxmin[0].lon == 0.0 )
-    maxmin[0].lon = VIK_LATLON(&fixme)->lon;
-  if ( VIK_LATLON(&fixme)->lon < maxmin[1].lon || maxmin[1].lon == 0.0 )
-    maxmin[1].lon = VIK_LATLON(&fixme)->lon;
+  if ( b->found )
+    vik_coord_bounds_extend ( b->maxmin, &(wp->coord) );
+  else
+    vik_coord_bounds_init ( b->maxmin, &(wp->coord) );
+  b->found = TRUE;
 }
 
-static void trw_layer_find_maxmin_tracks ( const gchar *name, GList **t, struct LatLon maxmin[2] )
+static void trw_layer_bounds_add_track ( const gchar *name, const VikTrack *tr, LayerBounds *b )
 {
-  GList *tr = *t;
-  static VikCoord fixme;
-
-  while ( tr )
-  {
-    vik_coord_copy_convert ( &(VIK_TRACKPOINT(tr->data)->coord), VIK_COORD_LATLON, &fixme );
-    if ( VIK_LATLON(&fixme)->lat > maxmin[0].lat || maxmin[0].lat == 0.0 )
-      maxmin[0].lat = VIK_LATLON(&fixme)->lat;
-    if ( VIK_LATLON(&fixme)->lat < maxmin[1].lat || maxmin[1].lat == 0.0 )
-      maxmin[1].lat = VIK_LATLON(&fixme)->lat;
-    if ( VIK_LATLON(&fixme)->lon > maxmin[0].lon || maxmin[0].lon == 0.0 )
-      maxmin[0].lon = VIK_LATLON(&fixme)->lon;
-    if ( VIK_LATLON(&fixme)->lon < maxmin[1].lon || maxmin[1].lon == 0.0 )
-      maxmin[1].lon = VIK_LATLON(&fixme)->lon;
-    tr = tr->next;
+  if ( ! tr->trackpoints )
+    return;
+  if ( b->found )
+    vik_coord_bounds_union ( b->maxmin, tr->bounds );
+  else {
+    b->maxmin[0] = tr->bounds[0];
+    b->maxmin[1] = tr->bounds[1];
   }
+  b->found = TRUE;
 }
 
-static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
+/* Made of the bounds kept up to date as things change, so it takes a look
+ * at each track but not at any of their points. FALSE if the layer has
+ * nothing in it. */
+static gboolean trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
 {
-  struct LatLon wpt_maxmin[2] = { {0.0,0.0}, {0.0,0.0} };
-  struct LatLon trk_maxmin[2] = { {0.0,0.0}, {0.0,0.0} };
-  
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_find_maxmin_waypoints, wpt_maxmin );
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_find_maxmin_tracks, trk_maxmin );
-  if ((wpt_maxmin[0].lat != 0.0 && wpt_maxmin[0].lat > trk_maxmin[0].lat) || trk_maxmin[0].lat == 0.0) {
-    maxmin[0].lat = wpt_maxmin[0].lat;
-  }
-  else {
-    maxmin[0].lat = trk_maxmin[0].lat;
-  }
-  if ((wpt_maxmin[0].lon != 0.0 && wpt_maxmin[0].lon > trk_maxmin[0].lon) || trk_maxmin[0].lon == 0.0) {
-    maxmin[0].lon = wpt_maxmin[0].lon;
-  }
-  else {
-    maxmin[0].lon = trk_maxmin[0].lon;
-  }
-  if ((wpt_maxmin[1].lat != 0.0 && wpt_maxmin[1].lat < trk_maxmin[1].lat) || trk_maxmin[1].lat == 0.0) {
-    maxmin[1].lat = wpt_maxmin[1].lat;
-  }
-  else {
-    maxmin[1].lat = trk_maxmin[1].lat;
-  }
-  if ((wpt_maxmin[1].lon != 0.0 && wpt_maxmin[1].lon < trk_maxmin[1].lon) || trk_maxmin[1].lon == 0.0) {
-    maxmin[1].lon = wpt_maxmin[1].lon;
+  LayerBounds b;
+
+  if ( vtl->waypoints_bounds_dirty ) {
+    b.found = FALSE;
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_bounds_add_waypoint, &b );
+    vtl->waypoints_bounds[0] = b.maxmin[0];
+    vtl->waypoints_bounds[1] = b.maxmin[1];
+    vtl->waypoints_bounds_dirty = FALSE;
   }
-  else {
-    maxmin[1].lon = trk_maxmin[1].lon;
+
+  b.found = g_hash_table_size ( vtl->waypoints ) > 0;
+  b.maxmin[0] = vtl->waypoints_bounds[0];
+  b.maxmin[1] = vtl->waypoints_bounds[1];
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_bounds_add_track, &b );
+
+  if ( b.found ) {
+    maxmin[0] = b.maxmin[0];
+    maxmin[1] = b.maxmin[1];
   }
+  return b.found;
 }
 
 gboolean vik_trw_layer_find_center ( VikTrwLayer *vtl, VikCoord *dest )
 {
-  /* TODO: what if there's only one waypoint @ 0,0, it will think nothing found. like I don't have more important things to worry about... */
-  struct LatLon maxmin[2] = { {0.0,0.0}, {0.0,0.0} };
-  trw_layer_find_maxmin (vtl, maxmin);
-  if (maxmin[0].lat == 0.0 && maxmin[0].lon == 0.0 && maxmin[1].lat == 0.0 && maxmin[1].lon == 0.0)
+  struct LatLon maxmin[2];
+  if ( ! trw_layer_find_maxmin (vtl, maxmin) )
     return FALSE;
   else
   {
@@ -1730,6 +2134,11 @@ void vik_trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer vl
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
   gtk_widget_show ( item );
 
+  item = gtk_menu_item_new_with_label ( _("Reload Waypoint Images") );
+  g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_reload_images), pass_along );
+  gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+  gtk_widget_show ( item );
+
   export_submenu = gtk_menu_new ();
   item = gtk_menu_item_new_with_label ( _("Export layer") );
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
@@ -1756,6 +2165,11 @@ void vik_trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer vl
   gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
   gtk_widget_show ( item );
 
+  item = gtk_menu_item_new_with_label ( _("Merge All By Time") );
+  g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_merge_all_by_timestamp), pass_along );
+  gtk_menu_shell_append (GTK_MENU_SHELL (menu), item);
+  gtk_widget_show ( item );
+
 #ifdef VIK_CONFIG_GEONAMES
   wikipedia_submenu = gtk_menu_new();
   item = gtk_menu_item_new_with_label ( _("Add Wikipedia Waypoints") );
@@ -1819,12 +2233,23 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
   else
     wp->visible = TRUE;
 
+  /* replacing one could shrink the bounds, adding one only grows them */
+  if ( g_hash_table_lookup ( vtl->waypoints, name ) )
+    vtl->waypoints_bounds_dirty = TRUE;
+  else if ( ! vtl->waypoints_bounds_dirty ) {
+    if ( g_hash_table_size ( vtl->waypoints ) )
+      vik_coord_bounds_extend ( vtl->waypoints_bounds, &(wp->coord) );
+    else
+      vik_coord_bounds_init ( vtl->waypoints_bounds, &(wp->coord) );
+  }
+
   highest_wp_number_add_wp(vtl, name);
   g_hash_table_insert ( vtl->waypoints, name, wp );
  
 }
 
-void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+/* select is FALSE for all but one of many tracks added at once */
+static void trw_layer_insert_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t, gboolean select )
 {
   if ( VIK_LAYER(vtl)->realized )
   {
@@ -1839,7 +2264,8 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 #else
       vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, name, vtl, name, VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, t->visible, TRUE );
 #endif
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, iter );
+      if ( select )
+        vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, iter );
       g_hash_table_insert ( vtl->tracks_iters, name, iter );
       /* t->visible = TRUE; */
     }
@@ -1847,10 +2273,16 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
   else
     ; /* t->visible = TRUE; // this is now used by file input functions */
 
+  vik_track_calculate_bounds ( t );
   g_hash_table_insert ( vtl->tracks, name, t );
  
 }
 
+void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+{
+  trw_layer_insert_track ( vtl, name, t, TRUE );
+}
+
 /* to be called whenever a track has been deleted or may have been changed. */
 void trw_layer_cancel_tps_of_track ( VikTrwLayer *vtl, const gchar *trk_name )
 {
@@ -1885,6 +2317,7 @@ void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t
   if ( vtl->magic_scissors_append && vtl->magic_scissors_current_track ) {
     vik_track_remove_dup_points ( tr ); /* make "double point" track work to undo */
     vik_track_steal_and_append_trackpoints ( vtl->magic_scissors_current_track, tr );
+    vik_track_calculate_bounds ( vtl->magic_scissors_current_track );
     vik_track_free ( tr );
     vtl->magic_scissors_append = FALSE; /* this means we have added it */
   } else {
@@ -1900,6 +2333,38 @@ void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t
   }
 }
 
+/* A layer with only the data tables, no GCs or pango layout: safe to create on
+ * the GTK thread and fill from a file loader running in a worker thread. */
+VikTrwLayer *vik_trw_layer_new_detached ( VikCoordMode mode )
+{
+  VikTrwLayer *rv = vik_trw_layer_new ( 0 );
+  rv->coord_mode = mode;
+  return rv;
+}
+
+static gboolean trw_layer_steal_waypoint ( gchar *name, VikWaypoint *wp, VikTrwLayer *vtl )
+{
+  waypoint_convert ( name, wp, &vtl->coord_mode );
+  vik_trw_layer_filein_add_waypoint ( vtl, name, wp );
+  g_free ( name );
+  return TRUE;
+}
+
+static gboolean trw_layer_steal_track ( gchar *name, VikTrack *tr, VikTrwLayer *vtl )
+{
+  track_convert ( name, tr, &vtl->coord_mode );
+  vik_trw_layer_filein_add_track ( vtl, name, tr );
+  g_free ( name );
+  return TRUE;
+}
+
+void vik_trw_layer_steal_items ( VikTrwLayer *vtl, VikTrwLayer *vtl_src )
+{
+  g_hash_table_foreach_steal ( vtl_src->waypoints, (GHRFunc) trw_layer_steal_waypoint, vtl );
+  vtl_src->waypoints_bounds_dirty = TRUE;
+  g_hash_table_foreach_steal ( vtl_src->tracks, (GHRFunc) trw_layer_steal_track, vtl );
+}
+
 static void trw_layer_enum_item ( const gchar *name, GList **tr, GList **l )
 {
   *l = g_list_append(*l, (gpointer)name);
@@ -2004,6 +2469,7 @@ gboolean vik_trw_layer_delete_waypoint ( VikTrwLayer *vtl, const gchar *wp_name
 
     highest_wp_number_remove_wp(vtl, wp_name);
     g_hash_table_remove ( vtl->waypoints, wp_name ); /* last because this frees name */
+    vtl->waypoints_bounds_dirty = TRUE;
   }
 
   return was_visible;
@@ -2043,6 +2509,7 @@ void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
   g_hash_table_foreach(vtl->waypoints_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->waypoints_iters);
   g_hash_table_remove_all(vtl->waypoints);
+  vtl->waypoints_bounds_dirty = TRUE;
 
   /* TODO: only update if the layer is visible (ticked) */
   vik_layer_emit_update ( VIK_LAYER(vtl) );
@@ -2074,9 +2541,11 @@ static void trw_layer_properties_item ( gpointer pass_along[5] )
     if ( wp )
     {
       if ( a_dialog_new_waypoint ( VIK_GTK_WINDOW_FROM_LAYER(vtl), NULL, wp, NULL, vtl->coord_mode ) )
-
-      if ( VIK_LAYER(vtl)->visible )
-        vik_layer_emit_update ( VIK_LAYER(vtl) );
+      {
+        vtl->waypoints_bounds_dirty = TRUE; /* it may have been moved */
+        if ( VIK_LAYER(vtl)->visible )
+          vik_layer_emit_update ( VIK_LAYER(vtl) );
+      }
     }
   }
   else
@@ -2107,15 +2576,13 @@ static void trw_layer_goto_track_startpoint ( gpointer pass_along[5] )
 
 static void trw_layer_goto_track_center ( gpointer pass_along[5] )
 {
-  /* FIXME: get this into viktrack.c, and should be ->trackpoints right? */
-  GList **trps = g_hash_table_lookup ( VIK_TRW_LAYER(pass_along[0])->tracks, pass_along[3] );
-  if ( trps && *trps )
+  VikTrack *tr = g_hash_table_lookup ( VIK_TRW_LAYER(pass_along[0])->tracks, pass_along[3] );
+  if ( tr && tr->trackpoints )
   {
-    struct LatLon average, maxmin[2] = { {0,0}, {0,0} };
+    struct LatLon average;
     VikCoord coord;
-    trw_layer_find_maxmin_tracks ( NULL, trps, maxmin );
-    average.lat = (maxmin[0].lat+maxmin[1].lat)/2;
-    average.lon = (maxmin[0].lon+maxmin[1].lon)/2;
+    average.lat = (tr->bounds[0].lat+tr->bounds[1].lat)/2;
+    average.lon = (tr->bounds[0].lon+tr->bounds[1].lon)/2;
     vik_coord_load_from_latlon ( &coord, VIK_TRW_LAYER(pass_along[0])->coord_mode, &average );
     goto_coord ( VIK_LAYERS_PANEL(pass_along[1]), &coord);
   }
@@ -2197,74 +2664,105 @@ static void find_tracks_with_timestamp(gpointer key, gpointer value, gpointer ud
     p1 = VIK_TRACKPOINT(VIK_TRACK(value)->trackpoints->data);
     p2 = VIK_TRACKPOINT(g_list_last(VIK_TRACK(value)->trackpoints)->data);
 
-    if (!p1->has_timestamp || !p2->has_timestamp) {
-      g_print("no timestamp\n");
+    if (!p1->has_timestamp || !p2->has_timestamp)
       return;
-    }
-
   }
 
   *(user_data->result) = g_list_prepend(*(user_data->result), key);
 }
 
-/* called for each key in track hash table. if original track user_data[1] is close enough
- * to the passed one, add it to list in user_data[0] 
- */
-static void find_nearby_track(gpointer key, gpointer value, gpointer user_data)
-{
-  time_t t1, t2;
-  VikTrackpoint *p1, *p2;
+/* What merging by time needs to know of a track, found in one walk along it */
+typedef struct {
+  gchar *name;
+  VikTrack *track;
+  GList *tail;
+  time_t start, end;  /* of the first and last points, which are compared */
+  time_t min, max;    /* over all the points, where the merged track will end up */
+  gboolean merged;
+} MergeCandidate;
 
-  GList **nearby_tracks = ((gpointer *)user_data)[0];
-  GList *orig_track = ((gpointer *)user_data)[1];
-  guint thr = GPOINTER_TO_UINT (((gpointer *)user_data)[2]);
+typedef struct {
+  GArray *candidates;
+  VikTrack *exclude;
+} MergeIndexBuild;
 
-  /* outline: 
-   * detect reasons for not merging, and return
-   * if no reason is found not to merge, then do it.
-   */
+static void merge_index_add ( gchar *name, VikTrack *tr, MergeIndexBuild *build )
+{
+  MergeCandidate c;
+  GList *iter;
 
-  if (VIK_TRACK(value)->trackpoints == orig_track) {
+  if ( tr == build->exclude )
     return;
-  }
 
-  t1 = VIK_TRACKPOINT(orig_track->data)->timestamp;
-  t2 = VIK_TRACKPOINT(g_list_last(orig_track)->data)->timestamp;
-
-  if (VIK_TRACK(value)->trackpoints) {
-    p1 = VIK_TRACKPOINT(VIK_TRACK(value)->trackpoints->data);
-    p2 = VIK_TRACKPOINT(g_list_last(VIK_TRACK(value)->trackpoints)->data);
-
-    if (!p1->has_timestamp || !p2->has_timestamp) {
-      g_print("no timestamp\n");
+  c.name = name;
+  c.track = tr;
+  c.tail = NULL;
+  c.merged = FALSE;
+  c.start = c.end = c.min = c.max = 0;
+  if ( tr->trackpoints ) {
+    if ( ! VIK_TRACKPOINT(tr->trackpoints->data)->has_timestamp )
       return;
+    c.start = c.min = c.max = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
+    for ( iter = tr->trackpoints; iter; iter = iter->next ) {
+      time_t t = VIK_TRACKPOINT(iter->data)->timestamp;
+      c.min = MIN ( c.min, t );
+      c.max = MAX ( c.max, t );
+      c.tail = iter;
     }
-
-    /*  g_print("Got track named %s, times %d, %d\n", (gchar *)key, p1->timestamp, p2->timestamp); */
-    if (! (abs(t1 - p2->timestamp) < thr*60 ||
-	/*  p1 p2      t1 t2 */
-	   abs(p1->timestamp - t2) < thr*60)
-	/*  t1 t2      p1 p2 */
-	) {
+    if ( ! VIK_TRACKPOINT(c.tail->data)->has_timestamp )
       return;
-    }
+    c.end = VIK_TRACKPOINT(c.tail->data)->timestamp;
   }
+  g_array_append_val ( build->candidates, c );
+}
 
-  *nearby_tracks = g_list_prepend(*nearby_tracks, key);
+static gint merge_compare_start ( gconstpointer a, gconstpointer b )
+{
+  time_t t1 = (*(MergeCandidate **) a)->start, t2 = (*(MergeCandidate **) b)->start;
+  return t1 < t2 ? -1 : t1 > t2;
 }
 
-/* comparison function used to sort tracks; a and b are hash table keys */
-static gint track_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+static gint merge_compare_end ( gconstpointer a, gconstpointer b )
 {
-  GHashTable *tracks = user_data;
-  time_t t1, t2;
+  time_t t1 = (*(MergeCandidate **) a)->end, t2 = (*(MergeCandidate **) b)->end;
+  return t1 < t2 ? -1 : t1 > t2;
+}
 
-  t1 = VIK_TRACKPOINT(VIK_TRACK(g_hash_table_lookup(tracks, a))->trackpoints->data)->timestamp;
-  t2 = VIK_TRACKPOINT(VIK_TRACK(g_hash_table_lookup(tracks, b))->trackpoints->data)->timestamp;
-  
-  if (t1 < t2) return -1;
-  if (t1 > t2) return 1;
-  return 0;
+#define MERGE_KEY(c,by_start) ( (by_start) ? (c)->start : (c)->end )
+
+/* Those not merged yet of the candidates sorted in index whose start
+ * (or end) is strictly between from and to, onto group */
+static void merge_index_find ( GPtrArray *index, gboolean by_start, time_t from, time_t to, GPtrArray *group )
+{
+  guint lo = 0, hi = index->len;
+
+  while ( lo < hi ) {
+    guint mid = (lo + hi) / 2;
+    if ( MERGE_KEY((MergeCandidate *) g_ptr_array_index ( index, mid ), by_start) <= from )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for ( ; lo < index->len; lo++ ) {
+    MergeCandidate *c = g_ptr_array_index ( index, lo );
+    if ( MERGE_KEY(c, by_start) >= to )
+      break;
+    if ( ! c->merged ) {
+      c->merged = TRUE;
+      g_ptr_array_add ( group, c );
+    }
+  }
+}
+
+/* the points of other go after those of a track ending at tail: the new tail */
+static GList *merge_splice ( GList *tail, VikTrack *other, GList *other_tail )
+{
+  if ( ! other->trackpoints )
+    return tail;
+  tail->next = other->trackpoints;
+  other->trackpoints->prev = tail;
+  other->trackpoints = NULL;
+  return other_tail;
 }
 
 /* comparison function used to sort trackpoints */
@@ -2284,7 +2782,8 @@ static void trw_layer_merge_with_other ( gpointer pass_along[6] )
   GList *tracks_with_timestamp = NULL;
   VikTrack *track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, orig_track_name );
 
-  if (track->trackpoints &&
+  /* an empty track has no timestamp either */
+  if (!track->trackpoints ||
       !VIK_TRACKPOINT(track->trackpoints->data)->has_timestamp) {
     a_dialog_error_msg(VIK_GTK_WINDOW_FROM_LAYER(vtl), _("Failed. This track does not have timestamp"));
     return;
@@ -2311,17 +2810,16 @@ static void trw_layer_merge_with_other ( gpointer pass_along[6] )
 
   if (merge_list)
   {
-    GList *l;
+    GList *l, *tail = g_list_last(track->trackpoints);
     for (l = merge_list; l != NULL; l = g_list_next(l)) {
       VikTrack *merge_track = (VikTrack *) g_hash_table_lookup (vtl->tracks, l->data );
       if (merge_track) {
-        track->trackpoints = g_list_concat(track->trackpoints, merge_track->trackpoints);
-        merge_track->trackpoints = NULL;
+        tail = merge_splice(tail, merge_track, g_list_last(merge_track->trackpoints));
         vik_trw_layer_delete_track(vtl, l->data);
-        track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
       }
     }
-    /* TODO: free data before free merge_list */
+    track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+    vik_track_calculate_bounds ( track );
     for (l = merge_list; l != NULL; l = g_list_next(l))
       g_free(l->data);
     g_list_free(merge_list);
@@ -2329,169 +2827,257 @@ static void trw_layer_merge_with_other ( gpointer pass_along[6] )
   }
 }
 
+/* minutes, asked for again by both merges by time */
+static guint merge_threshold = 1;
+
 /* merge by time routine */
 static void trw_layer_merge_by_timestamp ( gpointer pass_along[6] )
 {
   VikTrwLayer *vtl = (VikTrwLayer *)pass_along[0];
-  gchar *orig_track_name = strdup(pass_along[3]);
-
-  time_t t1, t2;
-  GList *nearby_tracks;
-  VikTrack *track;
-  GList *trps;
-  static  guint thr = 1;
-  guint track_count = 0;
+  VikTrack *track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, pass_along[3] );
+  MergeIndexBuild build;
+  GPtrArray *by_start, *by_end, *group;
+  time_t t1, t2, w;
+  GList *tail;
+  guint i, round_start;
 
   if (!a_dialog_time_threshold(VIK_GTK_WINDOW_FROM_LAYER(vtl), 
 			       _("Merge Threshold..."), 
 			       _("Merge when time between tracks less than:"), 
-			       &thr)) {
-    free(orig_track_name);
+			       &merge_threshold))
     return;
-  }
 
-  /* merge tracks until we can't */
-  nearby_tracks = NULL;
+  if ( !track || !track->trackpoints )
+    return;
+
+  /* the start and end times of every other track, looked up once */
+  build.candidates = g_array_new ( FALSE, FALSE, sizeof(MergeCandidate) );
+  build.exclude = track;
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) merge_index_add, &build );
+  by_start = g_ptr_array_sized_new ( build.candidates->len );
+  by_end = g_ptr_array_sized_new ( build.candidates->len );
+  group = g_ptr_array_new ();
+  for ( i = 0; i < build.candidates->len; i++ ) {
+    MergeCandidate *c = &g_array_index ( build.candidates, MergeCandidate, i );
+    if ( c->track->trackpoints ) {
+      g_ptr_array_add ( by_start, c );
+      g_ptr_array_add ( by_end, c );
+    } else {
+      c->merged = TRUE; /* nothing to keep apart */
+      g_ptr_array_add ( group, c );
+    }
+  }
+  g_ptr_array_sort ( by_start, merge_compare_start );
+  g_ptr_array_sort ( by_end, merge_compare_end );
+
+  /* Tracks ending just before the merged track starts or starting just
+   * after it ends join it, until none do. */
+  w = merge_threshold * 60;
+  t1 = VIK_TRACKPOINT(track->trackpoints->data)->timestamp;
+  t2 = VIK_TRACKPOINT(g_list_last(track->trackpoints)->data)->timestamp;
   do {
-    gpointer params[3];
+    round_start = group->len;
+    merge_index_find ( by_end, FALSE, t1 - w, t1 + w, group );
+    merge_index_find ( by_start, TRUE, t2 - w, t2 + w, group );
+    for ( i = round_start; i < group->len; i++ ) {
+      MergeCandidate *c = g_ptr_array_index ( group, i );
+      t1 = MIN ( t1, c->min );
+      t2 = MAX ( t2, c->max );
+    }
+  } while ( group->len > round_start );
+
+  if ( group->len ) {
+    /* all the lists joined end to end, then sorted once */
+    tail = g_list_last ( track->trackpoints );
+    for ( i = 0; i < group->len; i++ ) {
+      MergeCandidate *c = g_ptr_array_index ( group, i );
+      tail = merge_splice ( tail, c->track, c->tail );
+      vik_trw_layer_delete_track ( vtl, c->name );
+    }
+    track->trackpoints = g_list_sort ( track->trackpoints, trackpoint_compare );
+    vik_track_calculate_bounds ( track );
+    vik_layer_emit_update( VIK_LAYER(vtl) );
+  }
 
-    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, orig_track_name );
-    trps = track->trackpoints;
-    if ( !trps )
-      return;
+  g_ptr_array_free ( group, TRUE );
+  g_ptr_array_free ( by_start, TRUE );
+  g_ptr_array_free ( by_end, TRUE );
+  g_array_free ( build.candidates, TRUE );
+}
 
+/* Every track with times joins the one before it in time when it starts
+ * less than the threshold after that ends, or overlaps it. One walk
+ * along the tracks sorted by start does it all, each group keeping the
+ * name of its first track. */
+static void trw_layer_merge_all_by_timestamp ( gpointer lav[2] )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(lav[0]);
+  MergeIndexBuild build;
+  GPtrArray *by_start;
+  gboolean merged = FALSE;
+  time_t t2, w;
+  GList *tail;
+  guint i, j;
+
+  if (!a_dialog_time_threshold(VIK_GTK_WINDOW_FROM_LAYER(vtl),
+			       _("Merge Threshold..."),
+			       _("Merge when time between tracks less than:"),
+			       &merge_threshold))
+    return;
 
-    if (nearby_tracks) {
-      g_list_free(nearby_tracks);
-      nearby_tracks = NULL;
+  build.candidates = g_array_new ( FALSE, FALSE, sizeof(MergeCandidate) );
+  build.exclude = NULL;
+  g_hash_table_foreach ( vtl->tracks, (GHFunc) merge_index_add, &build );
+  by_start = g_ptr_array_sized_new ( build.candidates->len );
+  for ( i = 0; i < build.candidates->len; i++ ) {
+    MergeCandidate *c = &g_array_index ( build.candidates, MergeCandidate, i );
+    if ( c->track->trackpoints )
+      g_ptr_array_add ( by_start, c );
+  }
+  g_ptr_array_sort ( by_start, merge_compare_start );
+
+  w = merge_threshold * 60;
+  for ( i = 0; i < by_start->len; i = j ) {
+    MergeCandidate *first = g_ptr_array_index ( by_start, i );
+    t2 = first->max;
+    tail = first->tail;
+    for ( j = i + 1; j < by_start->len; j++ ) {
+      MergeCandidate *c = g_ptr_array_index ( by_start, j );
+      if ( c->start >= t2 + w )
+        break;
+      t2 = MAX ( t2, c->max );
+      tail = merge_splice ( tail, c->track, c->tail );
+      vik_trw_layer_delete_track ( vtl, c->name );
+    }
+    if ( j > i + 1 ) {
+      first->track->trackpoints = g_list_sort ( first->track->trackpoints, trackpoint_compare );
+      vik_track_calculate_bounds ( first->track );
+      merged = TRUE;
     }
+  }
+  if ( merged )
+    vik_layer_emit_update( VIK_LAYER(vtl) );
 
-    t1 = ((VikTrackpoint *)trps->data)->timestamp;
-    t2 = ((VikTrackpoint *)g_list_last(trps)->data)->timestamp;
-    
-    /*    g_print("Original track times: %d and %d\n", t1, t2);  */
-    params[0] = &nearby_tracks;
-    params[1] = trps;
-    params[2] = GUINT_TO_POINTER (thr);
+  g_ptr_array_free ( by_start, TRUE );
+  g_array_free ( build.candidates, TRUE );
+}
+
+/* The points are moved into the new tracks, named after the old one,
+ * which then goes. Only the first new track gets selected. */
+static void trw_layer_split_track ( gpointer pass_along[6], VikTrackSplit criterion, gdouble value )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(pass_along[0]);
+  VikTrack *track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, pass_along[3] );
+  VikTrack **tracks;
+  guint ntracks, i;
 
-    /* get a list of adjacent-in-time tracks */
-    g_hash_table_foreach(vtl->tracks, find_nearby_track, (gpointer)params);
+  if ( !track )
+    return;
 
-    /* add original track */
-    nearby_tracks = g_list_prepend(nearby_tracks, orig_track_name);
+  tracks = vik_track_split ( track, criterion, value, &ntracks );
+  if ( !tracks )
+    return;
 
-    /* merge them */
-    { 
-#define get_track(x) VIK_TRACK(g_hash_table_lookup(vtl->tracks, (gchar *)((x)->data)))
-#define get_first_trackpoint(x) VIK_TRACKPOINT(get_track(x)->trackpoints->data)
-#define get_last_trackpoint(x) VIK_TRACKPOINT(g_list_last(get_track(x)->trackpoints)->data)
-      GList *l = nearby_tracks;
-      VikTrack *tr = vik_track_new();
-      tr->visible = track->visible;
-      track_count = 0;
-      while (l) {
-	/*
-	time_t t1, t2;
-	t1 = get_first_trackpoint(l)->timestamp;
-	t2 = get_last_trackpoint(l)->timestamp;
-	g_print("     %20s: track %d - %d\n", (char *)l->data, (int)t1, (int)t2);
-	*/
-
-
-	/* remove trackpoints from merged track, delete track */
-	tr->trackpoints = g_list_concat(tr->trackpoints, get_track(l)->trackpoints);
-	get_track(l)->trackpoints = NULL;
-	vik_trw_layer_delete_track(vtl, l->data);
-
-	track_count ++;
-	l = g_list_next(l);
-      }
-      tr->trackpoints = g_list_sort(tr->trackpoints, trackpoint_compare);
-      vik_trw_layer_add_track(vtl, strdup(orig_track_name), tr);
+  for ( i = 0; i < ntracks; i++ )
+    trw_layer_insert_track ( vtl, g_strdup_printf("%s #%d", (gchar *) pass_along[3], i+1), tracks[i], i == 0 );
+  g_free ( tracks );
 
-#undef get_first_trackpoint
-#undef get_last_trackpoint
-#undef get_track
-    }
-  } while (track_count > 1);
-  g_list_free(nearby_tracks);
-  free(orig_track_name);
-  vik_layer_emit_update( VIK_LAYER(vtl) );
+  vik_trw_layer_delete_track ( vtl, (gchar *) pass_along[3] );
+  vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
 
 /* split by time routine */
 static void trw_layer_split_by_timestamp ( gpointer pass_along[6] )
 {
-  VikTrack *track = (VikTrack *) g_hash_table_lookup ( VIK_TRW_LAYER(pass_along[0])->tracks, pass_along[3] );
-  GList *trps = track->trackpoints;
-  GList *iter;
-  GList *newlists = NULL;
-  GList *newtps = NULL;
-  guint i;
   static guint thr = 1;
 
-  time_t ts, prev_ts;
-
-  if ( !trps )
-    return;
-
   if (!a_dialog_time_threshold(VIK_GTK_WINDOW_FROM_LAYER(pass_along[0]), 
 			       _("Split Threshold..."), 
 			       _("Split when time between trackpoints exceeds:"), 
 			       &thr)) {
     return;
   }
+  trw_layer_split_track ( pass_along, VIK_TRACK_SPLIT_TIME, thr * 60 );
+}
 
-  /* iterate through trackpoints, and copy them into new lists without touching original list */
-  prev_ts = VIK_TRACKPOINT(trps->data)->timestamp;
-  iter = trps;
+static void trw_layer_split_by_distance ( gpointer pass_along[6] )
+{
+  static gdouble thr = 1000.0;
 
-  while (iter) {
-    ts = VIK_TRACKPOINT(iter->data)->timestamp;
-    if (ts < prev_ts) {
-      g_print("panic: ts < prev_ts: this should never happen!\n");
-      return;
-    }
-    if (ts - prev_ts > thr*60) {
-      /* flush accumulated trackpoints into new list */
-      newlists = g_list_prepend(newlists, g_list_reverse(newtps));
-      newtps = NULL;
-    }
+  if ( a_dialog_spin_value ( VIK_GTK_WINDOW_FROM_LAYER(pass_along[0]), _("Split Threshold..."),
+                             _("Split when distance between trackpoints exceeds (in meters):"),
+                             &thr, 1, 1000000, 100, 0 ) )
+    trw_layer_split_track ( pass_along, VIK_TRACK_SPLIT_DISTANCE, thr );
+}
 
-    /* accumulate trackpoint copies in newtps, in reverse order */
-    newtps = g_list_prepend(newtps, vik_trackpoint_copy(VIK_TRACKPOINT(iter->data)));
-    prev_ts = ts;
-    iter = g_list_next(iter);
-  }
-  if (newtps) {
-      newlists = g_list_prepend(newlists, g_list_reverse(newtps));
-  }
+static void trw_layer_split_by_n_points ( gpointer pass_along[6] )
+{
+  static gdouble n = 500;
 
-  /* put lists of trackpoints into tracks */
-  iter = newlists;
-  i = 1;
-  while (iter) {
-    gchar *new_tr_name;
-    VikTrack *tr;
+  if ( a_dialog_spin_value ( VIK_GTK_WINDOW_FROM_LAYER(pass_along[0]), _("Split Every..."),
+                             _("Number of trackpoints in each track:"),
+                             &n, 2, 1000000, 100, 0 ) )
+    trw_layer_split_track ( pass_along, VIK_TRACK_SPLIT_POINTS, n );
+}
 
-    tr = vik_track_new();
-    tr->visible = track->visible;
-    tr->trackpoints = (GList *)(iter->data);
+static void trw_layer_split_by_day ( gpointer pass_along[6] )
+{
+  trw_layer_split_track ( pass_along, VIK_TRACK_SPLIT_DAY, 0 );
+}
 
-    new_tr_name = g_strdup_printf("%s #%d", (gchar *) pass_along[3], i++);
-    vik_trw_layer_add_track(VIK_TRW_LAYER(pass_along[0]), new_tr_name, tr);
-    /*    g_print("adding track %s, times %d - %d\n", new_tr_name, VIK_TRACKPOINT(tr->trackpoints->data)->timestamp,
-	  VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp);*/
+/* end of split/merge routines */
+
+/* in the order of VikTrackSimplify */
+static gchar *params_simplify_methods[] = {
+  N_("Distance off the line (m)"),
+  N_("Area of the line (square meters)"),
+  N_("Number of points"),
+  N_("Every so many seconds"),
+  N_("Every so many meters"),
+  NULL };
+
+static VikLayerParamScale params_simplify_scales[] = {
+  { 0, 1000000, 1, 1 },
+};
+
+static VikLayerParam params_simplify[] = {
+  { "method", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Keep points by:"), VIK_LAYER_WIDGET_COMBOBOX, params_simplify_methods },
+  { "value", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Value:"), VIK_LAYER_WIDGET_SPINBUTTON, params_simplify_scales + 0 },
+};
 
-    iter = g_list_next(iter);
+/* done here rather than by gpsbabel, which would mean writing out and
+ * reading back the whole layer */
+static void trw_layer_simplify ( gpointer pass_along[6] )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(pass_along[0]);
+  VikTrack *track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, pass_along[3] );
+  /* the last choice is offered again */
+  static guint method = VIK_TRACK_SIMPLIFY_DOUGLAS_PEUCKER;
+  static gdouble value = 5;
+  VikLayerParamData defaults[2], *paramdatas;
+
+  if ( !track )
+    return;
+
+  defaults[0].u = method;
+  defaults[1].d = value;
+  paramdatas = a_uibuilder_run_dialog ( VIK_GTK_WINDOW_FROM_LAYER(vtl), params_simplify,
+                                        G_N_ELEMENTS(params_simplify), NULL, 0, defaults );
+  if ( !paramdatas )
+    return;
+  method = paramdatas[0].u;
+  value = paramdatas[1].d;
+  a_uibuilder_free_paramdatas ( paramdatas, params_simplify, G_N_ELEMENTS(params_simplify) );
+
+  /* the selected point may be one of those going */
+  trw_layer_cancel_tps_of_track ( vtl, pass_along[3] );
+
+  if ( vik_track_simplify ( track, method, value ) ) {
+    vik_track_calculate_bounds ( track );
+    vik_layer_emit_update ( VIK_LAYER(vtl) );
   }
-  g_list_free(newlists);
-  vik_trw_layer_delete_track(VIK_TRW_LAYER(pass_along[0]), (gchar *)pass_along[3]);
-  vik_layer_emit_update(VIK_LAYER(pass_along[0]));
 }
 
-/* end of split/merge routines */
-
 
 static void trw_layer_goto_waypoint ( gpointer pass_along[5] )
 {
@@ -2736,6 +3322,26 @@ gboolean vik_trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *menu,
     gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
     gtk_widget_show ( item );
 
+    item = gtk_menu_item_new_with_label ( _("Split By Distance...") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_split_by_distance), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+
+    item = gtk_menu_item_new_with_label ( _("Split By Number of Points...") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_split_by_n_points), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+
+    item = gtk_menu_item_new_with_label ( _("Split By Day") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_split_by_day), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+
+    item = gtk_menu_item_new_with_label ( _("Simplify...") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_simplify), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+
     item = gtk_menu_item_new_with_label ( _("Download maps along track...") );
     g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_download_map_along_track_cb), pass_along );
     gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
@@ -2849,6 +3455,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
 
       vtl->current_tpl->next->prev = newglist; /* end old track here */
       vtl->current_tpl->next = NULL;
+      vik_track_calculate_bounds ( g_hash_table_lookup ( vtl->tracks, vtl->current_tp_track_name ) );
 
       vtl->current_tpl = newglist; /* change tp to first of new track. */
       vtl->current_tp_track_name = name;
@@ -2877,6 +3484,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
         VIK_TRACKPOINT(vtl->current_tpl->next->data)->newsegment = TRUE; /* don't concat segments on del */
 
       tr->trackpoints = g_list_remove_link ( tr->trackpoints, vtl->current_tpl ); /* this nulls current_tpl->prev and next */
+      vik_track_calculate_bounds ( tr );
 
       /* at this point the old trackpoint exists, but the list links are correct (new), so it is safe to do this. */
       vik_trw_layer_tpwin_set_tp ( vtl->tpwin, new_tpl, vtl->current_tp_track_name );
@@ -2891,6 +3499,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     else
     {
       tr->trackpoints = g_list_remove_link ( tr->trackpoints, vtl->current_tpl );
+      vik_track_calculate_bounds ( tr );
       g_free ( vtl->current_tpl->data ); /* TODO longone: vik_trackpoint_new() and vik_trackpoint_free() */
       g_list_free_1 ( vtl->current_tpl );
       trw_layer_cancel_current_tp ( vtl, FALSE );
@@ -2932,6 +3541,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
       VIK_TRACKPOINT(tr_last->trackpoints->data)->newsegment = FALSE;
     tr1->trackpoints = g_list_concat ( tr_first->trackpoints, tr_last->trackpoints );
     tr2->trackpoints = NULL;
+    vik_track_calculate_bounds ( tr1 );
 
     tmp = vtl->current_tp_track_name;
 
@@ -2946,7 +3556,10 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     vik_layer_emit_update(VIK_LAYER(vtl));
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED )
+  {
+    vik_track_calculate_bounds ( g_hash_table_lookup ( vtl->tracks, vtl->current_tp_track_name ) );
     vik_layer_emit_update (VIK_LAYER(vtl));
+  }
 }
 
 static void trw_layer_tpwin_init ( VikTrwLayer *vtl )
@@ -2984,7 +3597,9 @@ typedef struct {
   gchar *closest_track_name;
   VikTrackpoint *closest_tp;
   VikViewport *vvp;
+  VikTrwLayer *vtl;
   GList *closest_tpl;
+  TrackScreenPoints points;
 } TPSearchParams;
 
 static void waypoint_search_closest_tp ( gchar *name, VikWaypoint *wp, WPSearchParams *params )
@@ -3010,16 +3625,17 @@ static void track_search_closest_tp ( gchar *name, VikTrack *t, TPSearchParams *
 {
   GList *tpl = t->trackpoints;
   VikTrackpoint *tp;
+  guint i = 0;
 
   if ( !t->visible )
     return;
 
+  track_screen_points_project ( &(params->points), params->vtl, params->vvp, t );
+
   while (tpl)
   {
-    gint x, y;
+    gint x = params->points.x[i], y = params->points.y[i];
     tp = VIK_TRACKPOINT(tpl->data);
-
-    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
  
     if ( abs (x - params->x) <= TRACKPOINT_SIZE_APPROX && abs (y - params->y) <= TRACKPOINT_SIZE_APPROX &&
         ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
@@ -3032,6 +3648,7 @@ static void track_search_closest_tp ( gchar *name, VikTrack *t, TPSearchParams *
       params->closest_y = y;
     }
     tpl = tpl->next;
+    i++;
   }
 }
 
@@ -3041,9 +3658,12 @@ static VikTrackpoint *closest_tp_in_five_pixel_interval ( VikTrwLayer *vtl, VikV
   params.x = x;
   params.y = y;
   params.vvp = vvp;
+  params.vtl = vtl;
   params.closest_track_name = NULL;
   params.closest_tp = NULL;
+  memset ( &(params.points), 0, sizeof(params.points) );
   g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+  track_screen_points_free ( &(params.points) );
   return params.closest_tp;
 }
 
@@ -3262,6 +3882,7 @@ static gboolean tool_edit_waypoint_release ( VikTrwLayer *vtl, GdkEventButton *e
     marker_end_move ( t );
 
     vtl->current_wp->coord = new_coord;
+    vtl->waypoints_bounds_dirty = TRUE;
     vik_layer_emit_update ( VIK_LAYER(vtl) );
     return TRUE;
   }
@@ -3360,6 +3981,7 @@ static gboolean tool_new_track_key_press ( VikTrwLayer *vtl, GdkEventKey *event,
       GList *last = g_list_last(vtl->current_track->trackpoints);
       g_free ( last->data );
       vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
+      vik_track_calculate_bounds ( vtl->current_track );
     }
     vik_layer_emit_update ( VIK_LAYER(vtl) );
     return TRUE;
@@ -3382,6 +4004,7 @@ static gboolean tool_new_track_click ( VikTrwLayer *vtl, GdkEventButton *event,
       GList *last = g_list_last(vtl->current_track->trackpoints);
       g_free ( last->data );
       vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
+      vik_track_calculate_bounds ( vtl->current_track );
     }
     vik_layer_emit_update ( VIK_LAYER(vtl) );
     return TRUE;
@@ -3432,6 +4055,7 @@ static gboolean tool_new_track_click ( VikTrwLayer *vtl, GdkEventButton *event,
   tp->has_timestamp = FALSE;
   tp->timestamp = 0;
   vtl->current_track->trackpoints = g_list_append ( vtl->current_track->trackpoints, tp );
+  vik_track_extend_bounds ( vtl->current_track, tp );
 
   vtl->ct_x1 = vtl->ct_x2;
   vtl->ct_y1 = vtl->ct_y2;
@@ -3484,11 +4108,13 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
    this along, do a foreach on the tracks which will do a foreach on the 
    trackpoints. */
   params.vvp = vvp;
+  params.vtl = vtl;
   params.x = event->x;
   params.y = event->y;
   params.closest_track_name = NULL;
   /* TODO: should get track listitem so we can break it up, make a new track, mess it up, all that. */
   params.closest_tp = NULL;
+  memset ( &(params.points), 0, sizeof(params.points) );
 
   if ( event->button != 1 ) 
     return FALSE;
@@ -3518,6 +4144,7 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
   }
 
   g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+  track_screen_points_free ( &(params.points) );
 
   if ( params.closest_tp )
   {
@@ -3588,6 +4215,7 @@ static gboolean tool_edit_trackpoint_release ( VikTrwLayer *vtl, GdkEventButton
     }
 
     VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
+    vik_track_calculate_bounds ( g_hash_table_lookup ( vtl->tracks, vtl->current_tp_track_name ) );
 
     marker_end_move ( t );
 
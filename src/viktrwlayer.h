@@ -49,6 +49,11 @@ typedef struct _VikTrwLayer VikTrwLayer;
 void vik_trw_layer_filein_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp );
 void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *tr );
 
+/* For loaders running outside the GTK thread: fill a detached layer, then
+ * move everything into a real one with the GDK lock held. */
+VikTrwLayer *vik_trw_layer_new_detached ( VikCoordMode mode );
+void vik_trw_layer_steal_items ( VikTrwLayer *vtl, VikTrwLayer *vtl_src );
+
 
 /* TODO 0.0.8: _none_ of this should be here... interfaces, remember... */
 VikTrwLayer *vik_trw_layer_new ( gint drawmode );
@@ -122,6 +122,126 @@ static void minmax_alt(const gdouble *altitudes, gdouble *min, gdouble *max)
   }
 }
 
+/* Profile data of the last few tracks shown, so reopening the dialog or
+ * redrawing a graph doesn't walk the track and query the DEMs again.
+ * An entry is only reused while the track's points are unchanged. */
+#define PROFILE_CACHE_SIZE 4
+
+typedef struct {
+  const VikTrack *tr;
+  guint n_points;
+  guint32 fingerprint;
+  gint width;
+  gdouble *altitudes;     /* vik_track_make_elevation_map(), NULL if no data */
+  gdouble *speeds;        /* vik_track_make_speed_map(), NULL if no data */
+  gdouble *dist_fraction; /* per trackpoint after the first: distance along the track / length */
+  gint16 *dem_elev;       /* per trackpoint after the first, VIK_DEM_INVALID_ELEVATION if none */
+  guint dems_generation;
+} ProfileCache;
+
+static GList *profile_cache = NULL;
+
+static void profile_cache_free ( ProfileCache *pc )
+{
+  g_free ( pc->altitudes );
+  g_free ( pc->speeds );
+  g_free ( pc->dist_fraction );
+  g_free ( pc->dem_elev );
+  g_free ( pc );
+}
+
+static guint32 hash_bits ( guint32 h, gconstpointer data, gsize len )
+{
+  const guchar *p = data;
+  while ( len-- )
+    h = (h << 5) + h + *p++;
+  return h;
+}
+
+/* cheap check of everything the profiles depend on, no trigonometry */
+static guint32 track_fingerprint ( const VikTrack *tr, guint *n_points )
+{
+  guint32 h = 5381;
+  GList *iter;
+  *n_points = 0;
+  for ( iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    h = hash_bits ( h, &(tp->coord.north_south), sizeof(tp->coord.north_south) );
+    h = hash_bits ( h, &(tp->coord.east_west), sizeof(tp->coord.east_west) );
+    h = hash_bits ( h, &(tp->coord.utm_zone), sizeof(tp->coord.utm_zone) );
+    h = hash_bits ( h, &(tp->altitude), sizeof(tp->altitude) );
+    h = hash_bits ( h, &(tp->speed), sizeof(tp->speed) );
+    h = hash_bits ( h, &(tp->timestamp), sizeof(tp->timestamp) );
+    h = hash_bits ( h, &(tp->newsegment), sizeof(tp->newsegment) );
+    (*n_points)++;
+  }
+  return h;
+}
+
+static ProfileCache *profile_cache_get ( const VikTrack *tr, gint width )
+{
+  ProfileCache *pc;
+  GList *iter, *last;
+  guint n_points;
+  guint32 fingerprint = track_fingerprint ( tr, &n_points );
+
+  for ( iter = profile_cache; iter; iter = iter->next ) {
+    pc = iter->data;
+    if ( pc->tr == tr && pc->width == width ) {
+      profile_cache = g_list_delete_link ( profile_cache, iter );
+      if ( pc->n_points == n_points && pc->fingerprint == fingerprint ) {
+        profile_cache = g_list_prepend ( profile_cache, pc );
+        return pc;
+      }
+      profile_cache_free ( pc );
+      break;
+    }
+  }
+
+  if ( g_list_length ( profile_cache ) >= PROFILE_CACHE_SIZE ) {
+    last = g_list_last ( profile_cache );
+    profile_cache_free ( last->data );
+    profile_cache = g_list_delete_link ( profile_cache, last );
+  }
+
+  pc = g_malloc0 ( sizeof(ProfileCache) );
+  pc->tr = tr;
+  pc->n_points = n_points;
+  pc->fingerprint = fingerprint;
+  pc->width = width;
+  pc->altitudes = vik_track_make_elevation_map ( (VikTrack *) tr, width );
+  pc->speeds = vik_track_make_speed_map ( (VikTrack *) tr, width );
+  profile_cache = g_list_prepend ( profile_cache, pc );
+  return pc;
+}
+
+/* the DEM series is filled in on first use and again when DEMs come or go */
+static void profile_cache_update_dem ( ProfileCache *pc )
+{
+  GList *iter;
+  gdouble dist = 0, total_length;
+  guint i;
+
+  if ( pc->dem_elev && pc->dems_generation == a_dems_get_generation () )
+    return;
+
+  if ( ! pc->dist_fraction ) {
+    total_length = vik_track_get_length_including_gaps ( (VikTrack *) pc->tr );
+    pc->dist_fraction = g_new ( gdouble, pc->n_points );
+    for ( iter = pc->tr->trackpoints->next, i = 0; iter; iter = iter->next, i++ ) {
+      dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+        &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+      pc->dist_fraction[i] = total_length > 0 ? dist / total_length : 0;
+    }
+  }
+
+  g_free ( pc->dem_elev );
+  pc->dem_elev = g_new ( gint16, pc->n_points );
+  for ( iter = pc->tr->trackpoints->next, i = 0; iter; iter = iter->next, i++ )
+    pc->dem_elev[i] = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST );
+  pc->dems_generation = a_dems_get_generation ();
+}
+
 #define MARGIN 70
 #define LINES 5
 static VikTrackpoint *set_center_at_graph_position(gdouble event_x, gint img_width, VikLayersPanel *vlp, VikTrack *tr, gboolean time_base)
@@ -307,28 +427,25 @@ void track_vt_move( GtkWidget *image, GdkEventMotion *event, gpointer *pass_alon
   }
 }
 
-static void draw_dem_alt_speed_dist(VikTrack *tr, GdkDrawable *pix, GdkGC *alt_gc, GdkGC *speed_gc, gdouble alt_offset, gdouble alt_diff, gint width, gint height, gint margin)
+static void draw_dem_alt_speed_dist(ProfileCache *pc, GdkDrawable *pix, GdkGC *alt_gc, GdkGC *speed_gc, gdouble alt_offset, gdouble alt_diff, gint width, gint height, gint margin)
 {
   GList *iter;
-  gdouble dist = 0;
   gdouble max_speed = 0;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
+  guint i;
+
+  profile_cache_update_dem ( pc );
 
-  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
+  for (iter = pc->tr->trackpoints->next; iter; iter = iter->next) {
     if (!isnan(VIK_TRACKPOINT(iter->data)->speed))
       max_speed = MAX(max_speed, VIK_TRACKPOINT(iter->data)->speed);
   }
   max_speed = max_speed * 110 / 100;
 
-  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
+  for (iter = pc->tr->trackpoints->next, i = 0; iter; iter = iter->next, i++) {
     int x, y_alt, y_speed;
-    gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
-    elev -= alt_offset;
-    dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-    x = (width * dist)/total_length + margin;
-    if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-      y_alt = height - ((height * elev)/alt_diff);
+    x = width * pc->dist_fraction[i] + margin;
+    if ( pc->dem_elev[i] != VIK_DEM_INVALID_ELEVATION ) {
+      y_alt = height - ((height * (pc->dem_elev[i] - alt_offset))/alt_diff);
       gdk_draw_rectangle(GDK_DRAWABLE(pix), alt_gc, TRUE, x-2, y_alt-2, 4, 4);
     }
     if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
@@ -342,7 +459,8 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, VikTrack *tr, gpoin
 {
   GdkPixmap *pix;
   GtkWidget *image;
-  gdouble *altitudes = vik_track_make_elevation_map ( tr, PROFILE_WIDTH );
+  ProfileCache *pc = profile_cache_get ( tr, PROFILE_WIDTH );
+  const gdouble *altitudes = pc->altitudes;
   gdouble mina, maxa;
   GtkWidget *eventbox;
   gpointer *pass_along;
@@ -412,7 +530,7 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, VikTrack *tr, gpoin
       gdk_draw_line ( GDK_DRAWABLE(pix), window->style->dark_gc[3], 
 		      i + MARGIN, PROFILE_HEIGHT, i + MARGIN, PROFILE_HEIGHT-PROFILE_HEIGHT*(altitudes[i]-mina)/(maxa-mina) );
 
-  draw_dem_alt_speed_dist(tr, GDK_DRAWABLE(pix), dem_alt_gc, gps_speed_gc, mina, maxa - mina, PROFILE_WIDTH, PROFILE_HEIGHT, MARGIN);
+  draw_dem_alt_speed_dist(pc, GDK_DRAWABLE(pix), dem_alt_gc, gps_speed_gc, mina, maxa - mina, PROFILE_WIDTH, PROFILE_HEIGHT, MARGIN);
 
   /* draw border */
   gdk_draw_rectangle(GDK_DRAWABLE(pix), window->style->black_gc, FALSE, MARGIN, 0, PROFILE_WIDTH-1, PROFILE_HEIGHT-1);
@@ -420,7 +538,6 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, VikTrack *tr, gpoin
 
 
   g_object_unref ( G_OBJECT(pix) );
-  g_free ( altitudes );
   g_object_unref ( G_OBJECT(no_alt_info) );
   g_object_unref ( G_OBJECT(dem_alt_gc) );
   g_object_unref ( G_OBJECT(gps_speed_gc) );
@@ -463,11 +580,14 @@ GtkWidget *vik_trw_layer_create_vtdiag ( GtkWidget *window, VikTrack *tr, gpoint
   pass_along[1] = vlp;
   pass_along[2] = widgets;
 
-  gdouble *speeds = vik_track_make_speed_map ( tr, PROFILE_WIDTH );
-  if ( speeds == NULL ) {
+  ProfileCache *pc = profile_cache_get ( tr, PROFILE_WIDTH );
+  gdouble *speeds;
+  if ( pc->speeds == NULL ) {
     g_free(pass_along);
     return NULL;
   }
+  /* converted below, the cached copy stays in m/s */
+  speeds = g_memdup ( pc->speeds, sizeof(gdouble) * PROFILE_WIDTH );
 
   pix = gdk_pixmap_new( window->window, PROFILE_WIDTH + MARGIN, PROFILE_HEIGHT, -1 );
   image = gtk_image_new_from_pixmap ( pix, NULL );
@@ -682,6 +802,7 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
         }
         iter->prev->next = NULL;
         iter->prev = NULL;
+        vik_track_calculate_bounds ( tr ); /* the right part gets its own when added */
         VikTrack *tr_right = vik_track_new();
         if ( tr->comment )
           vik_track_set_comment ( tr_right, tr->comment );
@@ -33,6 +33,9 @@
 #ifdef HAVE_MATH_H
 #include <math.h>
 #endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
 
 #include "coords.h"
 #include "vikcoord.h"
@@ -50,6 +53,7 @@ static void viewport_class_init ( VikViewportClass *klass );
 static void viewport_init ( VikViewport *vvp );
 static void viewport_finalize ( GObject *gob );
 static void viewport_utm_zone_check ( VikViewport *vvp );
+static void viewport_get_view ( VikViewport *vvp, VikViewportPlane *view );
 
 static gboolean calcxy(double *x, double *y, double lg, double lt, double zero_long, double zero_lat, double pixelfact_x, double pixelfact_y, gint mapSizeX2, gint mapSizeY2 );
 static gboolean calcxy_rev(double *lg, double *lt, gint x, gint y, double zero_long, double zero_lat, double pixelfact_x, double pixelfact_y, gint mapSizeX2, gint mapSizeY2 );
@@ -91,10 +95,24 @@ struct _VikViewport {
   gdouble google_calcx_rev_fact;
   gdouble google_calcy_rev_fact;
 
+  gboolean offscreen;             /* drawn once into an image */
+
   /* trigger stuff */
   gpointer trigger;
-  GdkPixmap *snapshot_buffer;
+  GList *snapshots;              /* ViewportSnapshot, latest trigger first */
   gboolean half_drawn;
+
+  /* partial repaints */
+  VikViewportPlane frame;        /* view held by scr_buffer */
+  gboolean frame_valid;
+  GdkPixmap *partial_buffer;
+  GdkRectangle partial_area;
+  guint full_frames, partial_frames; /* put on screen so far */
+  GdkRectangle clip;             /* primitives entirely outside are skipped */
+
+  /* polylines being batched by vik_viewport_draw_lines() */
+  GArray *line_run;              /* GdkPoint */
+  GArray *line_segments;         /* GdkSegment */
 };
 
 static gdouble
@@ -181,10 +199,20 @@ static void viewport_init ( VikViewport *vvp )
   vvp->draw_scale = TRUE;
   vvp->draw_centermark = TRUE;
 
+  vvp->offscreen = FALSE;
+
   vvp->trigger = NULL;
-  vvp->snapshot_buffer = NULL;
+  vvp->snapshots = NULL;
   vvp->half_drawn = FALSE;
 
+  vvp->frame_valid = FALSE;
+  vvp->partial_buffer = NULL;
+  vvp->partial_area.width = vvp->partial_area.height = 0;
+  vvp->full_frames = vvp->partial_frames = 0;
+
+  vvp->line_run = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+  vvp->line_segments = g_array_new ( FALSE, FALSE, sizeof(GdkSegment) );
+
   g_signal_connect (G_OBJECT(vvp), "configure_event", G_CALLBACK(vik_viewport_configure), NULL);
 
   GTK_WIDGET_SET_FLAGS(vvp, GTK_CAN_FOCUS); /* allow VVP to have focus -- enabling key events, etc */
@@ -242,6 +270,59 @@ GdkGC *vik_viewport_new_gc_from_color ( VikViewport *vvp, GdkColor *color, gint
   return rv;
 }
 
+/* Snapshots of everything drawn below a layer, for the few layers that
+ * changed last. When one of them changes again, drawing can start from
+ * its snapshot instead of going through all the layers below. */
+typedef struct {
+  gpointer layer;
+  GdkPixmap *pixmap;             /* allocated on first save */
+  gboolean valid;
+} ViewportSnapshot;
+
+#define VIEWPORT_MAX_SNAPSHOTS 4
+
+static void viewport_snapshot_free ( ViewportSnapshot *snap )
+{
+  if ( snap->pixmap )
+    g_object_unref ( G_OBJECT ( snap->pixmap ) );
+  g_free ( snap );
+}
+
+static ViewportSnapshot *viewport_find_snapshot ( VikViewport *vvp, gpointer layer )
+{
+  GList *iter;
+  for ( iter = vvp->snapshots; iter; iter = iter->next )
+    if ( ((ViewportSnapshot *) iter->data)->layer == layer )
+      return iter->data;
+  return NULL;
+}
+
+/* the screen size changed */
+static void viewport_drop_snapshot_buffers ( VikViewport *vvp )
+{
+  GList *iter;
+  for ( iter = vvp->snapshots; iter; iter = iter->next ) {
+    ViewportSnapshot *snap = iter->data;
+    if ( snap->pixmap )
+      g_object_unref ( G_OBJECT ( snap->pixmap ) );
+    snap->pixmap = NULL;
+    snap->valid = FALSE;
+  }
+}
+
+/* the buffers are reallocated: nothing on them can be reused */
+static void viewport_reset_partial ( VikViewport *vvp )
+{
+  if ( vvp->partial_buffer )
+    g_object_unref ( G_OBJECT ( vvp->partial_buffer ) );
+  vvp->partial_buffer = NULL;
+  vvp->partial_area.width = vvp->partial_area.height = 0;
+  vvp->frame_valid = FALSE;
+  vvp->clip.x = vvp->clip.y = 0;
+  vvp->clip.width = vvp->width;
+  vvp->clip.height = vvp->height;
+}
+
 void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint height )
 {
   vvp->width = width;
@@ -250,12 +331,52 @@ void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint heigh
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
   vvp->scr_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
 
-  /* TODO trigger: only if this is enabled !!! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
-  vvp->snapshot_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
+  viewport_drop_snapshot_buffers ( vvp );
+
+  viewport_reset_partial ( vvp );
 }
 
+/* A viewport that is never put on screen, for drawing layers into images
+ * without disturbing the one the user is looking at. It starts with the
+ * view and settings of like, if given. */
+VikViewport *vik_viewport_new_offscreen ( VikViewport *like, gint width, gint height )
+{
+  GtkWidget *window = gtk_window_new ( GTK_WINDOW_POPUP );
+  VikViewport *vvp = vik_viewport_new ();
+
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_realize ( GTK_WIDGET(vvp) );
+
+  vvp->offscreen = TRUE;
+  vvp->background_gc = vik_viewport_new_gc ( vvp, "", 1 );
+  vvp->scale_bg_gc = vik_viewport_new_gc ( vvp, "grey", 3 );
+  if ( like ) {
+    vvp->drawmode = like->drawmode;
+    vvp->coord_mode = like->coord_mode;
+    vvp->center = like->center;
+    vvp->xmpp = like->xmpp;
+    vvp->ympp = like->ympp;
+    vvp->draw_scale = like->draw_scale;
+    vvp->draw_centermark = like->draw_centermark;
+    vik_viewport_set_background_gdkcolor ( vvp, &(like->background_color) );
+  } else
+    vik_viewport_set_background_color ( vvp, DEFAULT_BACKGROUND_COLOR );
+
+  vik_viewport_configure_manually ( vvp, width, height );
+  if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_UTM )
+    viewport_utm_zone_check ( vvp );
+  return vvp;
+}
+
+void vik_viewport_free_offscreen ( VikViewport *vvp )
+{
+  gtk_widget_destroy ( gtk_widget_get_toplevel ( GTK_WIDGET(vvp) ) );
+}
+
+gboolean vik_viewport_get_offscreen ( VikViewport *vvp )
+{
+  return vvp->offscreen;
+}
 
 GdkPixmap *vik_viewport_get_pixmap ( VikViewport *vvp )
 {
@@ -274,12 +395,9 @@ gboolean vik_viewport_configure ( VikViewport *vvp )
 
   vvp->scr_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
 
-  /* TODO trigger: only if enabled! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
+  viewport_drop_snapshot_buffers ( vvp );
 
-  vvp->snapshot_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
-  /* TODO trigger */
+  viewport_reset_partial ( vvp );
 
   /* this is down here so it can get a GC (necessary?) */
   if ( ! vvp->background_gc )
@@ -303,8 +421,14 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
 
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
+  g_list_foreach ( vvp->snapshots, (GFunc) viewport_snapshot_free, NULL );
+  g_list_free ( vvp->snapshots );
+
+  if ( vvp->partial_buffer )
+    g_object_unref ( G_OBJECT ( vvp->partial_buffer ) );
+
+  g_array_free ( vvp->line_run, TRUE );
+  g_array_free ( vvp->line_segments, TRUE );
 
   if ( vvp->alpha_pixbuf )
     g_object_unref ( G_OBJECT ( vvp->alpha_pixbuf ) );
@@ -324,6 +448,77 @@ void vik_viewport_clear ( VikViewport *vvp )
 {
   g_return_if_fail ( vvp != NULL );
   gdk_draw_rectangle(GDK_DRAWABLE(vvp->scr_buffer), vvp->background_gc, TRUE, 0, 0, vvp->width, vvp->height);
+  /* a full frame of this view follows; unless we are starting from a
+   * snapshot, every snapshot will be taken again on the way */
+  viewport_get_view ( vvp, &(vvp->frame) );
+  vvp->frame_valid = TRUE;
+  if ( ! vvp->half_drawn ) {
+    GList *iter;
+    for ( iter = vvp->snapshots; iter; iter = iter->next )
+      ((ViewportSnapshot *) iter->data)->valid = FALSE;
+  }
+}
+
+/* Drawing outside the area still lands in partial_buffer, but only the
+ * area is copied back; the margin keeps thick lines and symbols whose
+ * centre is just outside from being skipped. */
+#define PARTIAL_MARGIN 32
+
+gboolean vik_viewport_partial_begin ( VikViewport *vvp, GdkRectangle *area )
+{
+  VikViewportPlane view;
+  GdkRectangle screen = { 0, 0, vvp->width, vvp->height };
+  GdkPixmap *tmp;
+
+  g_return_val_if_fail ( vvp != NULL, FALSE );
+
+  viewport_get_view ( vvp, &view );
+  if ( ! vvp->frame_valid || ! vik_viewport_plane_equal ( &view, &(vvp->frame) ) )
+    return FALSE;
+
+  if ( ! gdk_rectangle_intersect ( area, &screen, area ) )
+    area->width = area->height = 0;
+  vvp->partial_area = *area;
+  if ( area->width == 0 || area->height == 0 )
+    return TRUE;
+
+  if ( ! vvp->partial_buffer )
+    vvp->partial_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
+  tmp = vvp->scr_buffer;
+  vvp->scr_buffer = vvp->partial_buffer;
+  vvp->partial_buffer = tmp;
+  gdk_draw_rectangle ( vvp->scr_buffer, vvp->background_gc, TRUE, area->x, area->y, area->width, area->height );
+
+  vvp->clip.x = area->x - PARTIAL_MARGIN;
+  vvp->clip.y = area->y - PARTIAL_MARGIN;
+  vvp->clip.width = area->width + 2 * PARTIAL_MARGIN;
+  vvp->clip.height = area->height + 2 * PARTIAL_MARGIN;
+  return TRUE;
+}
+
+void vik_viewport_partial_end ( VikViewport *vvp )
+{
+  GdkRectangle *a = &(vvp->partial_area);
+  g_return_if_fail ( vvp != NULL );
+
+  if ( a->width > 0 && a->height > 0 ) {
+    GdkPixmap *tmp = vvp->scr_buffer;
+    vvp->scr_buffer = vvp->partial_buffer;
+    vvp->partial_buffer = tmp;
+    gdk_draw_drawable ( vvp->scr_buffer, vvp->background_gc, vvp->partial_buffer, a->x, a->y, a->x, a->y, a->width, a->height );
+    gdk_draw_drawable ( GTK_WIDGET(vvp)->window, GTK_WIDGET(vvp)->style->bg_gc[0], vvp->scr_buffer, a->x, a->y, a->x, a->y, a->width, a->height );
+    vvp->partial_frames++;
+  }
+  a->width = a->height = 0;
+  vvp->clip.x = vvp->clip.y = 0;
+  vvp->clip.width = vvp->width;
+  vvp->clip.height = vvp->height;
+}
+
+gboolean vik_viewport_area_visible ( VikViewport *vvp, gint x, gint y, gint width, gint height )
+{
+  return x < vvp->clip.x + vvp->clip.width && x + width > vvp->clip.x &&
+         y < vvp->clip.y + vvp->clip.height && y + height > vvp->clip.y;
 }
 
 void vik_viewport_set_draw_scale ( VikViewport *vvp, gboolean draw_scale )
@@ -456,6 +651,13 @@ void vik_viewport_sync ( VikViewport *vvp )
 {
   g_return_if_fail ( vvp != NULL );
   gdk_draw_drawable(GTK_WIDGET(vvp)->window, GTK_WIDGET(vvp)->style->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer), 0, 0, 0, 0, vvp->width, vvp->height);
+  vvp->full_frames++;
+}
+
+void vik_viewport_get_frames ( VikViewport *vvp, guint *full, guint *partial )
+{
+  *full = vvp->full_frames;
+  *partial = vvp->partial_frames;
 }
 
 void vik_viewport_pan_sync ( VikViewport *vvp, gint x_off, gint y_off )
@@ -748,6 +950,193 @@ void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int
   }
 }
 
+/* Batch form of vik_viewport_coord_to_screen(): the mode dispatch and the
+ * per-frame factors are worked out once, and each loop is plain arithmetic
+ * over the arrays so the compiler can vectorize it. */
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, guint n, gint *xs, gint *ys )
+{
+  guint i;
+  g_return_if_fail ( vvp != NULL );
+
+  for ( i = 0; i < n; i++ )
+    if ( coords[i].mode != vvp->coord_mode )
+      break;
+  if ( i < n ) {
+    /* slow path, warns like the single point version */
+    for ( i = 0; i < n; i++ )
+      vik_viewport_coord_to_screen ( vvp, coords + i, xs + i, ys + i );
+    return;
+  }
+
+  if ( vvp->coord_mode == VIK_COORD_UTM ) {
+    const gdouble xf = 1.0 / vvp->xmpp, yf = 1.0 / vvp->ympp;
+    const gdouble x0 = (vvp->width / 2) - vvp->center.east_west * xf;
+    const gdouble y0 = (vvp->height / 2) + vvp->center.north_south * yf;
+    const gdouble zw = vvp->utm_zone_width * xf;
+    const gint center_zone = vvp->center.utm_zone;
+
+    for ( i = 0; i < n; i++ ) {
+      xs[i] = coords[i].east_west * xf + x0 - (center_zone - coords[i].utm_zone) * zw;
+      ys[i] = y0 - coords[i].north_south * yf;
+    }
+    if ( vvp->one_utm_zone )
+      for ( i = 0; i < n; i++ )
+        if ( coords[i].utm_zone != center_zone )
+          xs[i] = ys[i] = VIK_VIEWPORT_UTM_WRONG_ZONE;
+  } else if ( vvp->coord_mode == VIK_COORD_LATLON ) {
+    if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ) {
+      const gdouble center_lon = vvp->center.east_west, center_lat = vvp->center.north_south;
+      const gdouble pixelfact_x = vvp->xmpp * ALTI_TO_MPP, pixelfact_y = vvp->ympp * ALTI_TO_MPP;
+      const gint w2 = vvp->width / 2, h2 = vvp->height / 2;
+      double xx, yy;
+      for ( i = 0; i < n; i++ ) {
+        calcxy ( &xx, &yy, center_lon, center_lat, coords[i].east_west, coords[i].north_south, pixelfact_x, pixelfact_y, w2, h2 );
+        xs[i] = xx; ys[i] = yy;
+      }
+    } else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+      const gdouble xf = 65536.0 / 180 / vvp->xmpp * 256.0, yf = 65536.0 / 180 / vvp->ympp * 256.0;
+      const gdouble x0 = (vvp->width / 2) - vvp->center.east_west * xf;
+      const gdouble y0 = (vvp->height / 2) + MERCLAT(vvp->center.north_south) * yf;
+      for ( i = 0; i < n; i++ ) {
+        xs[i] = coords[i].east_west * xf + x0;
+        ys[i] = y0 - MERCLAT(coords[i].north_south) * yf;
+      }
+    }
+  }
+}
+
+/* Same for raw latitude/longitude pairs, whatever the viewport's coord mode */
+void vik_viewport_latlons_to_screen ( VikViewport *vvp, const struct LatLon *lls, guint n, gint *xs, gint *ys )
+{
+  VikCoord *coords;
+  guint i;
+  g_return_if_fail ( vvp != NULL );
+
+  if ( vvp->coord_mode == VIK_COORD_LATLON && vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    const gdouble xf = 65536.0 / 180 / vvp->xmpp * 256.0, yf = 65536.0 / 180 / vvp->ympp * 256.0;
+    const gdouble x0 = (vvp->width / 2) - vvp->center.east_west * xf;
+    const gdouble y0 = (vvp->height / 2) + MERCLAT(vvp->center.north_south) * yf;
+    for ( i = 0; i < n; i++ ) {
+      xs[i] = lls[i].lon * xf + x0;
+      ys[i] = y0 - MERCLAT(lls[i].lat) * yf;
+    }
+    return;
+  }
+
+  coords = g_new ( VikCoord, n );
+  for ( i = 0; i < n; i++ )
+    vik_coord_load_from_latlon ( coords + i, vvp->coord_mode, lls + i );
+  vik_viewport_coords_to_screen ( vvp, coords, n, xs, ys );
+  g_free ( coords );
+}
+
+/* everything that decides where things land on the screen */
+static void viewport_get_view ( VikViewport *vvp, VikViewportPlane *view )
+{
+  view->drawmode = vvp->drawmode;
+  view->xmpp = vvp->xmpp;
+  view->ympp = vvp->ympp;
+  view->center = vvp->center;
+  view->width = vvp->width;
+  view->height = vvp->height;
+}
+
+void vik_viewport_get_plane ( VikViewport *vvp, VikViewportPlane *plane )
+{
+  memset ( plane, 0, sizeof(VikViewportPlane) );
+  plane->drawmode = vvp->drawmode;
+  plane->xmpp = vvp->xmpp;
+  plane->ympp = vvp->ympp;
+  if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ) {
+    plane->center = vvp->center;
+    plane->width = vvp->width;
+    plane->height = vvp->height;
+  }
+}
+
+gboolean vik_viewport_plane_equal ( const VikViewportPlane *p1, const VikViewportPlane *p2 )
+{
+  return p1->drawmode == p2->drawmode && p1->xmpp == p2->xmpp && p1->ympp == p2->ympp
+    && vik_coord_equals ( &(p1->center), &(p2->center) )
+    && p1->width == p2->width && p1->height == p2->height;
+}
+
+/* UTM: metres scaled to pixels, the zone is applied in plane_to_screen.
+ * Mercator: scaled Mercator metres. Expedia is not linear, so its plane
+ * is the screen itself and depends on the centre. */
+void vik_viewport_coords_to_plane ( VikViewport *vvp, const VikCoord *coords, guint n, gdouble *px, gdouble *py )
+{
+  guint i;
+  g_return_if_fail ( vvp != NULL );
+
+  for ( i = 0; i < n; i++ )
+    if ( coords[i].mode != vvp->coord_mode )
+      break;
+  if ( i < n ) {
+    VikCoord tmp;
+    g_warning ( "Have to convert in vik_viewport_coords_to_plane! This should never happen!");
+    for ( i = 0; i < n; i++ ) {
+      vik_coord_copy_convert ( coords + i, vvp->coord_mode, &tmp );
+      vik_viewport_coords_to_plane ( vvp, &tmp, 1, px + i, py + i );
+    }
+    return;
+  }
+
+  if ( vvp->coord_mode == VIK_COORD_UTM ) {
+    const gdouble xf = 1.0 / vvp->xmpp, yf = 1.0 / vvp->ympp;
+    for ( i = 0; i < n; i++ ) {
+      px[i] = coords[i].east_west * xf;
+      py[i] = - coords[i].north_south * yf;
+    }
+  } else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ) {
+    const gdouble center_lon = vvp->center.east_west, center_lat = vvp->center.north_south;
+    const gdouble pixelfact_x = vvp->xmpp * ALTI_TO_MPP, pixelfact_y = vvp->ympp * ALTI_TO_MPP;
+    for ( i = 0; i < n; i++ )
+      calcxy ( px + i, py + i, center_lon, center_lat, coords[i].east_west, coords[i].north_south, pixelfact_x, pixelfact_y, vvp->width / 2, vvp->height / 2 );
+  } else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    const gdouble xf = 65536.0 / 180 / vvp->xmpp * 256.0, yf = 65536.0 / 180 / vvp->ympp * 256.0;
+    for ( i = 0; i < n; i++ ) {
+      px[i] = coords[i].east_west * xf;
+      py[i] = - MERCLAT(coords[i].north_south) * yf;
+    }
+  }
+}
+
+/* Plane positions from vik_viewport_coords_to_plane() to the screen, for
+ * the current centre and size; only additions, whatever the draw mode.
+ * The coords are needed for their UTM zone. */
+void vik_viewport_plane_to_screen ( VikViewport *vvp, const VikCoord *coords, const gdouble *px, const gdouble *py, guint n, gint *xs, gint *ys )
+{
+  gdouble ox = 0, oy = 0;
+  guint i;
+  g_return_if_fail ( vvp != NULL );
+
+  if ( vvp->coord_mode == VIK_COORD_UTM ) {
+    const gdouble zw = vvp->utm_zone_width / vvp->xmpp;
+    const gint center_zone = vvp->center.utm_zone;
+    ox = (vvp->width / 2) - vvp->center.east_west / vvp->xmpp;
+    oy = (vvp->height / 2) + vvp->center.north_south / vvp->ympp;
+    for ( i = 0; i < n; i++ ) {
+      xs[i] = px[i] + ox - (center_zone - coords[i].utm_zone) * zw;
+      ys[i] = py[i] + oy;
+    }
+    if ( vvp->one_utm_zone )
+      for ( i = 0; i < n; i++ )
+        if ( coords[i].utm_zone != center_zone )
+          xs[i] = ys[i] = VIK_VIEWPORT_UTM_WRONG_ZONE;
+    return;
+  }
+
+  if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    ox = (vvp->width / 2) - vvp->center.east_west * (65536.0 / 180 / vvp->xmpp * 256.0);
+    oy = (vvp->height / 2) + MERCLAT(vvp->center.north_south) * (65536.0 / 180 / vvp->ympp * 256.0);
+  }
+  for ( i = 0; i < n; i++ ) {
+    xs[i] = px[i] + ox;
+    ys[i] = py[i] + oy;
+  }
+}
+
 void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 )
 {
   if ( *x1 > 20000 || *x1 < -20000 ) {
@@ -770,25 +1159,157 @@ void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 )
   }
 }
 
-void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 )
+/* Liang-Barsky: cuts the segment down to the part inside the rectangle,
+ * FALSE when there is none */
+static gboolean viewport_clip_segment ( gdouble xmin, gdouble ymin, gdouble xmax, gdouble ymax,
+                                        gdouble *x1, gdouble *y1, gdouble *x2, gdouble *y2 )
 {
-  if ( ! ( ( x1 < 0 && x2 < 0 ) || ( y1 < 0 && y2 < 0 ) ||
-       ( x1 > vvp->width && x2 > vvp->width ) || ( y1 > vvp->height && y2 > vvp->height ) ) ) {
-    /*** clipping, yeah! ***/
-    a_viewport_clip_line ( &x1, &y1, &x2, &y2 );
-    gdk_draw_line ( vvp->scr_buffer, gc, x1, y1, x2, y2);
+  gdouble dx = *x2 - *x1, dy = *y2 - *y1;
+  gdouble p[4] = { -dx, dx, -dy, dy };
+  gdouble q[4] = { *x1 - xmin, xmax - *x1, *y1 - ymin, ymax - *y1 };
+  gdouble t0 = 0.0, t1 = 1.0;
+  gint i;
+
+  for ( i = 0; i < 4; i++ ) {
+    if ( p[i] == 0.0 ) {
+      if ( q[i] < 0.0 )
+        return FALSE; /* parallel to this edge and outside it */
+    } else {
+      gdouble t = q[i] / p[i];
+      if ( p[i] < 0.0 ) {
+        if ( t > t1 )
+          return FALSE;
+        if ( t > t0 )
+          t0 = t;
+      } else {
+        if ( t < t0 )
+          return FALSE;
+        if ( t < t1 )
+          t1 = t;
+      }
+    }
   }
+  if ( t1 < 1.0 ) {
+    *x2 = *x1 + t1 * dx;
+    *y2 = *y1 + t1 * dy;
+  }
+  if ( t0 > 0.0 ) {
+    *x1 = *x1 + t0 * dx;
+    *y1 = *y1 + t0 * dy;
+  }
+  return TRUE;
+}
+
+/* Xlib splits longer requests itself, but then no longer as one polyline */
+#define VIEWPORT_MAX_LINE_POINTS 4096
+
+static void viewport_lines_flush_segments ( VikViewport *vvp, GdkGC *gc )
+{
+  if ( vvp->line_segments->len )
+    gdk_draw_segments ( vvp->scr_buffer, gc, (GdkSegment *) vvp->line_segments->data, vvp->line_segments->len );
+  g_array_set_size ( vvp->line_segments, 0 );
+}
+
+/* runs of a single segment are gathered up and drawn together */
+static void viewport_lines_flush_run ( VikViewport *vvp, GdkGC *gc )
+{
+  GArray *run = vvp->line_run;
+
+  /* a run all on one pixel still marks that pixel */
+  if ( run->len == 1 || run->len == 2 ) {
+    GdkSegment seg;
+    seg.x1 = g_array_index ( run, GdkPoint, 0 ).x;
+    seg.y1 = g_array_index ( run, GdkPoint, 0 ).y;
+    seg.x2 = g_array_index ( run, GdkPoint, run->len - 1 ).x;
+    seg.y2 = g_array_index ( run, GdkPoint, run->len - 1 ).y;
+    g_array_append_val ( vvp->line_segments, seg );
+    if ( vvp->line_segments->len >= VIEWPORT_MAX_LINE_POINTS )
+      viewport_lines_flush_segments ( vvp, gc );
+  } else if ( run->len > 2 )
+    gdk_draw_lines ( vvp->scr_buffer, gc, (GdkPoint *) run->data, run->len );
+  g_array_set_size ( run, 0 );
+}
+
+static void viewport_lines_add ( VikViewport *vvp, gdouble x, gdouble y )
+{
+  GArray *run = vvp->line_run;
+  GdkPoint pt;
+
+  pt.x = (gint) floor ( x + 0.5 );
+  pt.y = (gint) floor ( y + 0.5 );
+  /* dense tracks seen from afar put many points on the same pixel */
+  if ( run->len && g_array_index ( run, GdkPoint, run->len - 1 ).x == pt.x
+                && g_array_index ( run, GdkPoint, run->len - 1 ).y == pt.y )
+    return;
+  g_array_append_val ( run, pt );
+}
+
+/* The points are clipped a segment at a time and every unbroken run of
+ * what is left goes to the X server as one polyline, so a long track is
+ * a handful of requests instead of one per segment. */
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, const GdkPoint *points, gint npoints )
+{
+  GdkGCValues values;
+  gdouble xmin, ymin, xmax, ymax;
+  gint margin, i;
+
+  if ( npoints < 2 )
+    return;
+
+  /* far enough outside that the cut ends of wide lines don't show */
+  gdk_gc_get_values ( gc, &values );
+  margin = values.line_width + 2;
+  xmin = vvp->clip.x - margin;
+  ymin = vvp->clip.y - margin;
+  xmax = vvp->clip.x + vvp->clip.width + margin;
+  ymax = vvp->clip.y + vvp->clip.height + margin;
+
+  for ( i = 1; i < npoints; i++ ) {
+    gdouble x1 = points[i-1].x, y1 = points[i-1].y;
+    gdouble x2 = points[i].x, y2 = points[i].y;
+
+    if ( ! viewport_clip_segment ( xmin, ymin, xmax, ymax, &x1, &y1, &x2, &y2 ) ) {
+      viewport_lines_flush_run ( vvp, gc );
+      continue;
+    }
+    /* coming back in: the run is broken */
+    if ( x1 != points[i-1].x || y1 != points[i-1].y )
+      viewport_lines_flush_run ( vvp, gc );
+    if ( vvp->line_run->len == 0 )
+      viewport_lines_add ( vvp, x1, y1 );
+    viewport_lines_add ( vvp, x2, y2 );
+
+    if ( x2 != points[i].x || y2 != points[i].y )
+      viewport_lines_flush_run ( vvp, gc );
+    else if ( vvp->line_run->len >= VIEWPORT_MAX_LINE_POINTS ) {
+      GdkPoint last = g_array_index ( vvp->line_run, GdkPoint, vvp->line_run->len - 1 );
+      viewport_lines_flush_run ( vvp, gc );
+      g_array_append_val ( vvp->line_run, last );
+    }
+  }
+  viewport_lines_flush_run ( vvp, gc );
+  viewport_lines_flush_segments ( vvp, gc );
+}
+
+void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 )
+{
+  GdkPoint points[2];
+  points[0].x = x1; points[0].y = y1;
+  points[1].x = x2; points[1].y = y2;
+  vik_viewport_draw_lines ( vvp, gc, points, 2 );
 }
 
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 )
 {
-  if ( x1 > -10 && x1 < vvp->width + 10 && y1 > -10 && y1 < vvp->height + 10 )
+  if ( x1 > -10 && x1 < vvp->width + 10 && y1 > -10 && y1 < vvp->height + 10 &&
+       vik_viewport_area_visible ( vvp, x1 - 10, y1 - 10, x2 + 20, y2 + 20 ) )
     gdk_draw_rectangle ( vvp->scr_buffer, gc, filled, x1, y1, x2, y2);
 }
 
 void vik_viewport_draw_string ( VikViewport *vvp, GdkFont *font, GdkGC *gc, gint x1, gint y1, const gchar *string )
 {
-  if ( x1 > -100 && x1 < vvp->width + 100 && y1 > -100 && y1 < vvp->height + 100 )
+  if ( x1 > -100 && x1 < vvp->width + 100 && y1 > -100 && y1 < vvp->height + 100 &&
+       vik_viewport_area_visible ( vvp, x1, y1 - gdk_string_height ( font, string ), gdk_string_width ( font, string ), gdk_string_height ( font, string ) ) )
     gdk_draw_string ( vvp->scr_buffer, font, gc, x1, y1, string );
 }
 
@@ -799,7 +1320,7 @@ void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf,
   gint real_dest_x = MAX(dest_x,0);
   gint real_dest_y = MAX(dest_y,0);
 
-  if ( alpha == 0 )
+  if ( alpha == 0 || ! vik_viewport_area_visible ( vvp, dest_x, dest_y, w, h ) )
     return; /* don't waste your time */
 
   if ( w > vvp->alpha_pixbuf_width || h > vvp->alpha_pixbuf_height )
@@ -833,6 +1354,10 @@ void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf,
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h )
 {
+  if ( ! vik_viewport_area_visible ( vvp, dest_x, dest_y,
+                                     w < 0 ? gdk_pixbuf_get_width ( pixbuf ) : w,
+                                     h < 0 ? gdk_pixbuf_get_height ( pixbuf ) : h ) )
+    return;
   gdk_draw_pixbuf ( vvp->scr_buffer,
 // GTK_WIDGET(vvp)->style->black_gc,
 NULL,
@@ -843,13 +1368,24 @@ NULL,
 
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 )
 {
-  gdk_draw_arc ( vvp->scr_buffer, gc, filled, x, y, width, height, angle1, angle2 );
+  if ( vik_viewport_area_visible ( vvp, x - 10, y - 10, width + 20, height + 20 ) )
+    gdk_draw_arc ( vvp->scr_buffer, gc, filled, x, y, width, height, angle1, angle2 );
 }
 
 
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints )
 {
-  gdk_draw_polygon ( vvp->scr_buffer, gc, filled, points, npoints );
+  gint i, x1, y1, x2, y2;
+  if ( npoints < 1 )
+    return;
+  x1 = x2 = points[0].x;
+  y1 = y2 = points[0].y;
+  for ( i = 1; i < npoints; i++ ) {
+    x1 = MIN ( x1, points[i].x ); x2 = MAX ( x2, points[i].x );
+    y1 = MIN ( y1, points[i].y ); y2 = MAX ( y2, points[i].y );
+  }
+  if ( vik_viewport_area_visible ( vvp, x1 - 10, y1 - 10, x2 - x1 + 20, y2 - y1 + 20 ) )
+    gdk_draw_polygon ( vvp->scr_buffer, gc, filled, points, npoints );
 }
 
 VikCoordMode vik_viewport_get_coord_mode ( const VikViewport *vvp )
@@ -968,8 +1504,12 @@ gboolean vik_viewport_is_one_zone ( VikViewport *vvp )
 
 void vik_viewport_draw_layout ( VikViewport *vvp, GdkGC *gc, gint x, gint y, PangoLayout *layout )
 {
-  if ( x > -100 && x < vvp->width + 100 && y > -100 && y < vvp->height + 100 )
-    gdk_draw_layout ( vvp->scr_buffer, gc, x, y, layout );
+  gint width, height;
+  if ( x > -100 && x < vvp->width + 100 && y > -100 && y < vvp->height + 100 ) {
+    pango_layout_get_pixel_size ( layout, &width, &height );
+    if ( vik_viewport_area_visible ( vvp, x, y, width, height ) )
+      gdk_draw_layout ( vvp->scr_buffer, gc, x, y, layout );
+  }
 }
 
 void vik_gc_get_fg_color ( GdkGC *gc, GdkColor *dest )
@@ -1002,9 +1542,28 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp )
 }
 
 /******** triggering *******/
+/* Also makes the trigger one of the layers a snapshot is kept for. */
 void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger )
 {
+  ViewportSnapshot *snap;
+
   vp->trigger = trigger;
+  if ( ! trigger )
+    return;
+
+  snap = viewport_find_snapshot ( vp, trigger );
+  if ( snap )
+    vp->snapshots = g_list_remove ( vp->snapshots, snap );
+  else {
+    snap = g_new0 ( ViewportSnapshot, 1 );
+    snap->layer = trigger;
+    if ( g_list_length ( vp->snapshots ) >= VIEWPORT_MAX_SNAPSHOTS ) {
+      GList *last = g_list_last ( vp->snapshots );
+      viewport_snapshot_free ( last->data );
+      vp->snapshots = g_list_delete_link ( vp->snapshots, last );
+    }
+  }
+  vp->snapshots = g_list_prepend ( vp->snapshots, snap );
 }
 
 gpointer vik_viewport_get_trigger ( VikViewport *vp )
@@ -1012,14 +1571,44 @@ gpointer vik_viewport_get_trigger ( VikViewport *vp )
   return vp->trigger;
 }
 
-void vik_viewport_snapshot_save ( VikViewport *vp )
+/* To be called just before drawing layer; does nothing unless a
+ * snapshot is kept for it. */
+void vik_viewport_snapshot_save ( VikViewport *vp, gpointer layer )
+{
+  ViewportSnapshot *snap = viewport_find_snapshot ( vp, layer );
+  GdkRectangle *a = &(vp->partial_area);
+
+  if ( ! snap )
+    return;
+  if ( a->width > 0 && a->height > 0 ) {
+    /* partial repaint: only the area has changed */
+    if ( snap->valid )
+      gdk_draw_drawable ( snap->pixmap, vp->background_gc, vp->scr_buffer, a->x, a->y, a->x, a->y, a->width, a->height );
+    return;
+  }
+  if ( ! snap->pixmap )
+    snap->pixmap = gdk_pixmap_new ( GTK_WIDGET(vp)->window, vp->width, vp->height, -1 );
+  gdk_draw_drawable ( snap->pixmap, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  snap->valid = TRUE;
+}
+
+void vik_viewport_snapshot_load ( VikViewport *vp, gpointer layer )
 {
-  gdk_draw_drawable ( vp->snapshot_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  ViewportSnapshot *snap = viewport_find_snapshot ( vp, layer );
+  if ( snap && snap->valid )
+    gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, snap->pixmap, 0, 0, 0, 0, -1, -1 );
 }
 
-void vik_viewport_snapshot_load ( VikViewport *vp )
+/* whether the layers below layer are on a snapshot for the current view */
+gboolean vik_viewport_snapshot_valid ( VikViewport *vp, gpointer layer )
 {
-  gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->snapshot_buffer, 0, 0, 0, 0, -1, -1 );
+  ViewportSnapshot *snap = viewport_find_snapshot ( vp, layer );
+  VikViewportPlane view;
+
+  if ( ! snap || ! snap->valid || ! vp->frame_valid )
+    return FALSE;
+  viewport_get_view ( vp, &view );
+  return vik_viewport_plane_equal ( &view, &(vp->frame) );
 }
 
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
@@ -62,11 +62,18 @@ GType vik_viewport_get_type ();
 VikViewport *vik_viewport_new ();
 void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint height ); /* for off-screen viewports */
 gboolean vik_viewport_configure ( VikViewport *vp ); 
+VikViewport *vik_viewport_new_offscreen ( VikViewport *like, gint width, gint height ); /* never shown, for drawing into images */
+void vik_viewport_free_offscreen ( VikViewport *vvp );
+/* Drawn once, nothing loaded later will show: layers are to
+ * have everything ready before they return from drawing. */
+gboolean vik_viewport_get_offscreen ( VikViewport *vvp );
 
 
 /* coordinate transformations */
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord );
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y );
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, guint n, gint *xs, gint *ys );
+void vik_viewport_latlons_to_screen ( VikViewport *vvp, const struct LatLon *lls, guint n, gint *xs, gint *ys );
 
 
 /* viewport scale */
@@ -108,12 +115,38 @@ void vik_viewport_set_drawmode ( VikViewport *vvp, VikViewportDrawMode drawmode
 VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp );
    /* Do not forget to update vik_viewport_get_drawmode_name() if you modify VikViewportDrawMode */
 
+/* A pan independent projection, for layers keeping projected points
+ * between redraws: positions in the plane only change with the zoom and
+ * the draw mode (and the centre and size for Expedia), panning the map
+ * only changes how vik_viewport_plane_to_screen() offsets them. */
+typedef struct {
+  VikViewportDrawMode drawmode;
+  gdouble xmpp, ympp;
+  VikCoord center;
+  gint width, height;
+} VikViewportPlane;
+
+void vik_viewport_get_plane ( VikViewport *vvp, VikViewportPlane *plane );
+gboolean vik_viewport_plane_equal ( const VikViewportPlane *p1, const VikViewportPlane *p2 );
+void vik_viewport_coords_to_plane ( VikViewport *vvp, const VikCoord *coords, guint n, gdouble *px, gdouble *py );
+void vik_viewport_plane_to_screen ( VikViewport *vvp, const VikCoord *coords, const gdouble *px, const gdouble *py, guint n, gint *xs, gint *ys );
+
+
+/* Partial repaints: between these, only the part of the screen inside
+ * area is redrawn. partial_begin() clips area to the screen and returns
+ * FALSE if the buffer does not hold a full frame of the current view;
+ * partial_end() puts the area on screen. */
+gboolean vik_viewport_partial_begin ( VikViewport *vvp, GdkRectangle *area );
+void vik_viewport_partial_end ( VikViewport *vvp );
+/* whether anything drawn in this screen rectangle would show */
+gboolean vik_viewport_area_visible ( VikViewport *vvp, gint x, gint y, gint width, gint height );
 
 /* Triggers */
 void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger );
 gpointer vik_viewport_get_trigger ( VikViewport *vp );
-void vik_viewport_snapshot_save ( VikViewport *vp );
-void vik_viewport_snapshot_load ( VikViewport *vp );
+void vik_viewport_snapshot_save ( VikViewport *vp, gpointer layer );
+void vik_viewport_snapshot_load ( VikViewport *vp, gpointer layer );
+gboolean vik_viewport_snapshot_valid ( VikViewport *vp, gpointer layer );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 
@@ -126,6 +159,8 @@ gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 GdkPixmap *vik_viewport_get_pixmap ( VikViewport *vvp ); /* get pointer to drawing buffer */
 void vik_viewport_sync ( VikViewport *vvp );             /* draw buffer to window */
 void vik_viewport_pan_sync ( VikViewport *vvp, gint x_off, gint y_off );
+/* how many times the buffer went to the window, whole or in part */
+void vik_viewport_get_frames ( VikViewport *vvp, guint *full, guint *partial );
 void vik_viewport_clear ( VikViewport *vvp );
 void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf, gint alpha,
                                            gint src_x, gint src_y, gint dest_x, gint dest_y, gint w, gint h );
@@ -153,8 +188,10 @@ GdkGC *vik_viewport_new_gc_from_color ( VikViewport *vvp, GdkColor *color, gint
 GdkFunction vik_gc_get_function ( GdkGC *gc );
 
 /* Drawing primitives */
-void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run this before drawing a line. vik_viewport_draw_line runs it for you */
+void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run this before drawing a line outside of a viewport */
 void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 );
+/* a polyline, clipped to what is visible; use it rather than a line per segment */
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, const GdkPoint *points, gint npoints );
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 );
 void vik_viewport_draw_string ( VikViewport *vvp, GdkFont *font, GdkGC *gc, gint x1, gint y1, const gchar *string );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 );
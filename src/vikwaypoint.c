@@ -25,6 +25,7 @@
 #include "vikcoord.h"
 #include "vikwaypoint.h"
 #include "globals.h"
+#include "marshall.h"
 
 
 VikWaypoint *vik_waypoint_new()
@@ -101,50 +102,65 @@ VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp)
   return new_wp;
 }
 
-void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *datalen)
+/* bump when the layout below changes: old data is then refused */
+#define WAYPOINT_MARSHALL_VERSION 1
+
+/* the fields as the clipboard and the binary files both have them */
+void vik_waypoint_marshall_fields ( const VikWaypoint *wp, GByteArray *b )
 {
-  GByteArray *b = g_byte_array_new();
-  guint len;
+  a_marshall_coord ( b, &(wp->coord) );
+  a_marshall_uint8 ( b, wp->visible );
+  a_marshall_double ( b, wp->altitude );
+  a_marshall_uint8 ( b, wp->image_width );
+  a_marshall_uint8 ( b, wp->image_height );
+  a_marshall_string ( b, wp->comment );
+  a_marshall_string ( b, wp->image );
+  a_marshall_string ( b, wp->symbol );
+}
 
-  g_byte_array_append(b, (guint8 *)wp, sizeof(*wp));
+void vik_waypoint_unmarshall_fields ( VikWaypoint *wp, MarshallReader *r )
+{
+  a_unmarshall_coord ( r, &(wp->coord) );
+  wp->visible = a_unmarshall_uint8 ( r );
+  wp->altitude = a_unmarshall_double ( r );
+  wp->image_width = a_unmarshall_uint8 ( r );
+  wp->image_height = a_unmarshall_uint8 ( r );
+  vik_waypoint_set_comment_no_copy ( wp, a_unmarshall_string ( r ) );
+  g_free ( wp->image );
+  wp->image = a_unmarshall_string ( r );
+  g_free ( wp->symbol );
+  wp->symbol = a_unmarshall_string ( r );
+}
 
-#define vwm_append(s) \
-  len = (s) ? strlen(s)+1 : 0; \
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len)); \
-  if (s) g_byte_array_append(b, (guint8 *)s, len);
+void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *datalen)
+{
+  GByteArray *b = g_byte_array_new();
 
-  vwm_append(wp->comment);
-  vwm_append(wp->image);
-  vwm_append(wp->symbol);
+  a_marshall_uint8 ( b, WAYPOINT_MARSHALL_VERSION );
+  vik_waypoint_marshall_fields ( wp, b );
 
   *data = b->data;
   *datalen = b->len;
   g_byte_array_free(b, FALSE);
-#undef vwm_append
 }
 
+/* NULL if the data is cut short or from another version */
 VikWaypoint *vik_waypoint_unmarshall (guint8 *data, guint datalen)
 {
-  guint len;
-  VikWaypoint *new_wp = vik_waypoint_new();
-  memcpy(new_wp, data, sizeof(*new_wp));
-  data += sizeof(*new_wp);
-
-#define vwu_get(s) \
-  len = *(guint *)data; \
-  data += sizeof(len); \
-  if (len) { \
-    (s) = g_strdup((gchar *)data); \
-  } else { \
-    (s) = NULL; \
-  } \
-  data += len;
-
-  vwu_get(new_wp->comment);
-  vwu_get(new_wp->image); 
-  vwu_get(new_wp->symbol);
-  
+  MarshallReader r;
+  VikWaypoint *new_wp;
+
+  a_marshall_reader_init ( &r, data, datalen );
+  if ( a_unmarshall_uint8 ( &r ) != WAYPOINT_MARSHALL_VERSION )
+    return NULL;
+
+  new_wp = vik_waypoint_new();
+  vik_waypoint_unmarshall_fields ( new_wp, &r );
+
+  if ( r.error ) {
+    vik_waypoint_free ( new_wp );
+    return NULL;
+  }
   return new_wp;
-#undef vwu_get
 }
 
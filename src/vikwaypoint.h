@@ -23,6 +23,7 @@
 #define _VIKING_WAYPOINT_H
 
 #include "vikcoord.h"
+#include "marshall.h"
 
 /* todo important: put these in their own header file, maybe.probably also rename */
 
@@ -53,5 +54,8 @@ VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp);
 void vik_waypoint_set_comment_no_copy(VikWaypoint *wp, gchar *comment);
 void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *len);
 VikWaypoint *vik_waypoint_unmarshall (guint8 *data, guint datalen);
+/* just the fields, for whatever holds waypoints to put its own framing around */
+void vik_waypoint_marshall_fields ( const VikWaypoint *wp, GByteArray *b );
+void vik_waypoint_unmarshall_fields ( VikWaypoint *wp, MarshallReader *r );
 
 #endif
@@ -31,6 +31,7 @@
 #include "dems.h"
 #include "mapcache.h"
 #include "print.h"
+#include "render.h"
 #include "preferences.h"
 #include "icons/icons.h"
 #include "vikexttools.h"
@@ -65,6 +66,7 @@ static void window_class_init ( VikWindowClass *klass );
 static void window_set_filename ( VikWindow *vw, const gchar *filename );
 
 static void draw_update ( VikWindow *vw );
+static void draw_update_request ( VikWindow *vw );
 
 static void newwindow_cb ( GtkAction *a, VikWindow *vw );
 
@@ -163,7 +165,17 @@ struct _VikWindow {
 
   /* half-drawn update */
   VikLayer *trigger;
-  VikCoord trigger_center;
+
+  /* set while a layer reports a change to part of the map */
+  gboolean damage;
+  VikCoord damage_c1, damage_c2;
+
+  /* layer updates waiting for the next frame */
+  guint pending_source;
+  gboolean pending_full;
+  VikLayer *pending_trigger;
+  GdkRectangle pending_area;
+  GTimer *last_frame;
 };
 
 enum {
@@ -213,6 +225,16 @@ VikViewport * vik_window_viewport(VikWindow *vw)
   return(vw->viking_vvp);
 }
 
+VikLayersPanel * vik_window_layers_panel(VikWindow *vw)
+{
+  return(vw->viking_vlp);
+}
+
+VikStatusbar * vik_window_get_statusbar(VikWindow *vw)
+{
+  return(vw->viking_vs);
+}
+
 void vik_window_selected_layer(VikWindow *vw, VikLayer *vl)
 {
   int i, j, tool_count;
@@ -240,6 +262,10 @@ static void window_finalize ( GObject *gob )
 
   a_background_remove_status ( vw->viking_vs );
 
+  if ( vw->pending_source )
+    g_source_remove ( vw->pending_source );
+  g_timer_destroy ( vw->last_frame );
+
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
 
@@ -283,6 +309,12 @@ static void window_init ( VikWindow *vw )
 
   vw->modified = FALSE;
   vw->only_updating_coord_mode_ui = FALSE;
+  vw->damage = FALSE;
+  vw->pending_source = 0;
+  vw->pending_full = FALSE;
+  vw->pending_trigger = NULL;
+  vw->pending_area.width = vw->pending_area.height = 0;
+  vw->last_frame = g_timer_new ();
   
   vw->pan_x = vw->pan_y = -1;
   vw->draw_image_width = DRAW_IMAGE_DEFAULT_WIDTH;
@@ -308,7 +340,7 @@ static void window_init ( VikWindow *vw )
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "button_press_event", G_CALLBACK(draw_click), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "button_release_event", G_CALLBACK(draw_release), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "motion_notify_event", G_CALLBACK(draw_mouse_motion), vw);
-  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update), vw);
+  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update_request), vw);
 
   g_signal_connect_swapped (G_OBJECT (vw->viking_vvp), "key_press_event", G_CALLBACK (key_press_event), vw);
 
@@ -378,12 +410,121 @@ static void newwindow_cb ( GtkAction *a, VikWindow *vw )
   g_signal_emit ( G_OBJECT(vw), window_signals[VW_NEWWINDOW_SIGNAL], 0 );
 }
 
+/* Screen area of the change a layer is reporting.
+ * FALSE if it cannot be placed on the screen. */
+static gboolean window_damage_area ( VikWindow *vw, GdkRectangle *area )
+{
+  VikViewport *vvp = vw->viking_vvp;
+  VikCoordMode mode = vik_viewport_get_coord_mode ( vvp );
+  VikCoord c1, c2;
+  gint x1, y1, x2, y2;
+
+  vik_coord_copy_convert ( &(vw->damage_c1), mode, &c1 );
+  vik_coord_copy_convert ( &(vw->damage_c2), mode, &c2 );
+  vik_viewport_coord_to_screen ( vvp, &c1, &x1, &y1 );
+  vik_viewport_coord_to_screen ( vvp, &c2, &x2, &y2 );
+  if ( x1 == VIK_VIEWPORT_UTM_WRONG_ZONE || x2 == VIK_VIEWPORT_UTM_WRONG_ZONE )
+    return FALSE;
+  /* a pixel either way for rounding */
+  area->x = MIN(x1,x2) - 1;
+  area->y = MIN(y1,y2) - 1;
+  area->width = ABS(x2-x1) + 3;
+  area->height = ABS(y2-y1) + 3;
+  return TRUE;
+}
+
+/* Repaints just this screen area.
+ * FALSE if everything has to be redrawn instead. */
+static gboolean draw_redraw_area ( VikWindow *vw, GdkRectangle *area )
+{
+  VikViewport *vvp = vw->viking_vvp;
+
+  if ( ! vik_viewport_partial_begin ( vvp, area ) )
+    return FALSE;
+
+  /* the snapshots only take the area from this partial frame */
+  vw->trigger = NULL;
+
+  if ( area->width > 0 && area->height > 0 ) {
+    vik_layers_panel_draw_all ( vw->viking_vlp );
+    vik_viewport_draw_scale ( vvp );
+    vik_viewport_draw_centermark ( vvp );
+  }
+  vik_viewport_partial_end ( vvp );
+  g_timer_start ( vw->last_frame );
+  return TRUE;
+}
+
 static void draw_update ( VikWindow *vw )
 {
   draw_redraw (vw);
   draw_sync (vw);
 }
 
+/* Draws whatever layer updates have been merged since the last frame */
+static void draw_pending ( VikWindow *vw )
+{
+  GdkRectangle area = vw->pending_area;
+
+  if ( vw->pending_full ) {
+    vw->trigger = vw->pending_trigger;
+    draw_update ( vw );
+  } else if ( area.width > 0 ) {
+    vw->pending_area.width = vw->pending_area.height = 0;
+    if ( ! draw_redraw_area ( vw, &area ) )
+      draw_update ( vw );
+  }
+}
+
+static gboolean draw_pending_cb ( VikWindow *vw )
+{
+  gdk_threads_enter();
+  vw->pending_source = 0;
+  draw_pending ( vw );
+  gdk_threads_leave();
+  return FALSE;
+}
+
+/* Layers report their changes here, from the main loop or from background
+ * threads holding the gdk lock. Changes are merged and drawn at most
+ * a_vik_get_redraw_rate() times a second, and changes off the screen are
+ * dropped. A change that comes after a quiet spell is drawn straight away. */
+static void draw_update_request ( VikWindow *vw )
+{
+  VikLayer *trigger = vw->trigger;
+  gdouble interval, since;
+  GdkRectangle area, screen = { 0, 0, 0, 0 };
+
+  vw->trigger = NULL;
+
+  if ( vw->damage && window_damage_area ( vw, &area ) ) {
+    screen.width = vik_viewport_get_width ( vw->viking_vvp );
+    screen.height = vik_viewport_get_height ( vw->viking_vvp );
+    if ( ! gdk_rectangle_intersect ( &area, &screen, &area ) )
+      return;
+    if ( vw->pending_area.width > 0 )
+      gdk_rectangle_union ( &area, &(vw->pending_area), &(vw->pending_area) );
+    else
+      vw->pending_area = area;
+  } else {
+    /* only keep the half drawn update if one layer asked for all of it */
+    if ( ! vw->pending_full )
+      vw->pending_trigger = trigger;
+    else if ( vw->pending_trigger != trigger )
+      vw->pending_trigger = NULL;
+    vw->pending_full = TRUE;
+  }
+
+  if ( vw->pending_source )
+    return;
+  interval = 1.0 / a_vik_get_redraw_rate ();
+  since = g_timer_elapsed ( vw->last_frame, NULL );
+  if ( since >= interval )
+    draw_pending ( vw );
+  else
+    vw->pending_source = g_timeout_add ( (guint) ceil ( (interval - since) * 1000 ), (GSourceFunc) draw_pending_cb, vw );
+}
+
 static void draw_sync ( VikWindow *vw )
 {
   vik_viewport_sync(vw->viking_vvp);
@@ -410,6 +551,18 @@ void vik_window_set_redraw_trigger(VikLayer *vl)
     vw->trigger = vl;
 }
 
+void vik_window_set_redraw_area(VikLayer *vl, const VikCoord *c1, const VikCoord *c2)
+{
+  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl));
+  if (NULL != vw) {
+    vw->damage = ( c1 && c2 );
+    if ( vw->damage ) {
+      vw->damage_c1 = *c1;
+      vw->damage_c2 = *c2;
+    }
+  }
+}
+
 static void window_configure_event ( VikWindow *vw )
 {
   static int first = 1;
@@ -427,22 +580,35 @@ static void window_configure_event ( VikWindow *vw )
 
 static void draw_redraw ( VikWindow *vw )
 {
-  VikCoord old_center = vw->trigger_center;
-  vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
   VikLayer *new_trigger = vw->trigger;
   vw->trigger = NULL;
-  VikLayer *old_trigger = VIK_LAYER(vik_viewport_get_trigger(vw->viking_vvp));
 
-  if ( ! new_trigger )
-    ; /* do nothing -- have to redraw everything. */
-  else if ( (old_trigger != new_trigger) || !vik_coord_equals(&old_center, &vw->trigger_center) )
-    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger ); /* todo: set to half_drawn mode if new trigger is above old */
-  else
-    vik_viewport_set_half_drawn ( vw->viking_vvp, TRUE );
+  /* everything gets drawn, so nothing is left waiting */
+  if ( vw->pending_source ) {
+    g_source_remove ( vw->pending_source );
+    vw->pending_source = 0;
+  }
+  vw->pending_full = FALSE;
+  vw->pending_trigger = NULL;
+  vw->pending_area.width = vw->pending_area.height = 0;
+  g_timer_start ( vw->last_frame );
+
+  /* start from what is below the layer that changed, if it's still there */
+  if ( new_trigger ) {
+    gboolean reuse = vik_viewport_snapshot_valid ( vw->viking_vvp, new_trigger );
+    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger );
+    vik_viewport_set_half_drawn ( vw->viking_vvp, reuse );
+  }
 
   /* actually draw */
   vik_viewport_clear ( vw->viking_vvp);
   vik_layers_panel_draw_all ( vw->viking_vlp );
+  if ( vik_viewport_get_half_drawn ( vw->viking_vvp ) ) {
+    /* the trigger was not drawn after all */
+    vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE );
+    vik_viewport_clear ( vw->viking_vvp);
+    vik_layers_panel_draw_all ( vw->viking_vlp );
+  }
   vik_viewport_draw_scale ( vw->viking_vvp );
   vik_viewport_draw_centermark ( vw->viking_vvp );
 
@@ -1488,12 +1654,17 @@ static void load_file ( GtkAction *a, VikWindow *vw )
       g_signal_emit ( G_OBJECT(vw), window_signals[VW_OPENWINDOW_SIGNAL], 0, gtk_file_chooser_get_filenames (GTK_FILE_CHOOSER(vw->open_dia) ) );
     else {
       files = gtk_file_chooser_get_filenames (GTK_FILE_CHOOSER(vw->open_dia) );
-      gboolean change_fn = newwindow && (g_slist_length(files)==1); /* only change fn if one file */
+      gboolean single_file = (g_slist_length(files)==1);
+      gboolean change_fn = newwindow && single_file; /* only change fn if one file */
       
       cur_file = files;
       while ( cur_file ) {
         gchar *file_name = cur_file->data;
-        vik_window_open_file ( vw, file_name, change_fn );
+        /* several files: parse the GPX ones concurrently, in the background */
+        if ( !single_file && a_file_import_in_background ( vik_layers_panel_get_top_layer(vw->viking_vlp), vw->viking_vvp, file_name ) )
+          update_recently_used_document ( file_name );
+        else
+          vik_window_open_file ( vw, file_name, change_fn );
         g_free (file_name);
         cur_file = g_slist_next (cur_file);
       }
@@ -1628,106 +1799,21 @@ static void zoom_to_cb ( GtkAction *a, VikWindow *vw )
 
 static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png )
 {
-  /* more efficient way: stuff draws directly to pixbuf (fork viewport) */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
   GError *error = NULL;
+  VikLayer *top = VIK_LAYER(vik_layers_panel_get_top_layer ( vw->viking_vlp ));
 
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
-
-  /* reset width and height: */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-
-  /* draw all layers */
-  draw_redraw ( vw );
-
-  /* save buffer as file. */
-  pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-  gdk_pixbuf_save ( pixbuf_to_save, fn, save_as_png ? "png" : "jpeg", &error, NULL );
-  if (error)
+  if ( ! a_render_file ( top, vw->viking_vvp, zoom, w, h, fn, save_as_png, &error ) )
   {
     g_warning("Unable to write to file %s: %s", fn, error->message );
     g_error_free (error);
   }
-  g_object_unref ( G_OBJECT(pixbuf_to_save) );
-
-  /* pretend like nothing happened ;) */
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
 }
 
 static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
 {
-  gulong size = sizeof(gchar) * (strlen(fn) + 15);
-  gchar *name_of_file = g_malloc ( size );
-  guint x = 1, y = 1;
-  struct UTM utm_orig, utm;
-
-  /* *** copied from above *** */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
-
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
-
-  /* reset width and height: do this only once for all images (same size) */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-  /* *** end copy from above *** */
-
-  g_assert ( vik_viewport_get_coord_mode ( vw->viking_vvp ) == VIK_COORD_UTM );
-
-  g_mkdir(fn,0777);
-
-  utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
-
-  for ( y = 1; y <= tiles_h; y++ )
-  {
-    for ( x = 1; x <= tiles_w; x++ )
-    {
-      g_snprintf ( name_of_file, size, "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
-      utm = utm_orig;
-      if ( tiles_w & 0x1 )
-        utm.easting += ((gdouble)x - ceil(((gdouble)tiles_w)/2)) * (w*zoom);
-      else
-        utm.easting += ((gdouble)x - (((gdouble)tiles_w)+1)/2) * (w*zoom);
-      if ( tiles_h & 0x1 ) /* odd */
-        utm.northing -= ((gdouble)y - ceil(((gdouble)tiles_h)/2)) * (h*zoom);
-      else /* even */
-        utm.northing -= ((gdouble)y - (((gdouble)tiles_h)+1)/2) * (h*zoom);
-
-      /* move to correct place. */
-      vik_viewport_set_center_utm ( vw->viking_vvp, &utm );
-
-      draw_redraw ( vw );
-
-      /* save buffer as file. */
-      pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-      gdk_pixbuf_save ( pixbuf_to_save, name_of_file, save_as_png ? "png" : "jpeg", &error, NULL );
-      if (error)
-      {
-        g_warning("Unable to write to file %s: %s", name_of_file, error->message );
-        g_error_free (error);
-      }
-
-      g_object_unref ( G_OBJECT(pixbuf_to_save) );
-    }
-  }
-
-  vik_viewport_set_center_utm ( vw->viking_vvp, &utm_orig );
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
+  VikLayer *top = VIK_LAYER(vik_layers_panel_get_top_layer ( vw->viking_vlp ));
 
-  g_free ( name_of_file );
+  a_render_dir ( GTK_WINDOW(vw), top, vw->viking_vvp, zoom, w, h, tiles_w, tiles_h, fn, save_as_png );
 }
 
 static void draw_to_image_file_current_window_cb(GtkWidget* widget,GdkEventButton *event,gpointer *pass_along)
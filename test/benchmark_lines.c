@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <viking.h>
+
+/* Times drawing a long track with one gdk_draw_line() per segment
+ * against one vik_viewport_draw_lines() call, and checks that both
+ * leave the same pixels. */
+
+#define N_POINTS 100000
+#define ROUNDS 5
+
+static gdouble time_drawing ( VikViewport *vvp, GdkGC *gc, const GdkPoint *points, gboolean polyline )
+{
+  GdkDrawable *buffer = GDK_DRAWABLE(vik_viewport_get_pixmap ( vvp ));
+  GTimer *timer;
+  gdouble ms;
+  gint r, i;
+
+  vik_viewport_clear ( vvp );
+  gdk_flush ();
+  timer = g_timer_new ();
+  for ( r = 0; r < ROUNDS; r++ )
+    if ( polyline )
+      vik_viewport_draw_lines ( vvp, gc, points, N_POINTS );
+    else
+      for ( i = 1; i < N_POINTS; i++ )
+        gdk_draw_line ( buffer, gc, points[i-1].x, points[i-1].y, points[i].x, points[i].y );
+  gdk_flush (); /* until the server is done with it */
+
+  ms = g_timer_elapsed ( timer, NULL ) * 1e3 / ROUNDS;
+  g_timer_destroy ( timer );
+  return ms;
+}
+
+static GdkPixbuf *grab ( VikViewport *vvp )
+{
+  return gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vvp )), NULL, 0, 0, 0, 0,
+                                        vik_viewport_get_width ( vvp ), vik_viewport_get_height ( vvp ) );
+}
+
+int main(int argc, char *argv[])
+{
+  GtkWidget *window;
+  VikViewport *vvp;
+  GdkGC *gc;
+  GdkPixbuf *single_pixels, *batch_pixels;
+  GdkPoint *points = g_new ( GdkPoint, N_POINTS );
+  GRand *r = g_rand_new_with_seed ( 1 );
+  gdouble single, batch;
+  gint i, n, drawn = 0, differ = 0;
+
+  gtk_init ( &argc, &argv );
+
+  window = gtk_window_new ( GTK_WINDOW_TOPLEVEL );
+  vvp = vik_viewport_new ();
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_realize ( GTK_WIDGET(vvp) );
+  vik_viewport_configure_manually ( vvp, 1024, 768 );
+  gc = vik_viewport_new_gc ( vvp, "#000000", 1 );
+
+  /* a random walk kept on screen, so clipping doesn't move any end */
+  points[0].x = 512;
+  points[0].y = 384;
+  for ( i = 1; i < N_POINTS; i++ ) {
+    points[i].x = CLAMP ( points[i-1].x + g_rand_int_range ( r, -6, 7 ), 10, 1013 );
+    points[i].y = CLAMP ( points[i-1].y + g_rand_int_range ( r, -6, 7 ), 10, 757 );
+  }
+
+  single = time_drawing ( vvp, gc, points, FALSE );
+  single_pixels = grab ( vvp );
+  batch = time_drawing ( vvp, gc, points, TRUE );
+  batch_pixels = grab ( vvp );
+
+  n = gdk_pixbuf_get_height ( single_pixels ) * gdk_pixbuf_get_rowstride ( single_pixels );
+  for ( i = 0; i < n; i++ ) {
+    guchar a = gdk_pixbuf_get_pixels ( single_pixels )[i], b = gdk_pixbuf_get_pixels ( batch_pixels )[i];
+    if ( a != b )
+      differ++;
+    if ( a == 0 )
+      drawn++;
+  }
+
+  printf ( "%d segments  per segment %8.2f ms  polyline %8.2f ms  (%.1fx)\n", N_POINTS - 1, single, batch, single / batch );
+
+  g_object_unref ( G_OBJECT(single_pixels) );
+  g_object_unref ( G_OBJECT(batch_pixels) );
+  g_object_unref ( G_OBJECT(gc) );
+  g_rand_free ( r );
+  g_free ( points );
+  /* joins may be drawn a little differently, not whole segments */
+  if ( differ > drawn / 100 ) {
+    fprintf ( stderr, "%d of %d drawn bytes differ\n", differ, drawn );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <viking.h>
+
+/* Times projecting points one at a time with vik_viewport_coord_to_screen()
+ * against one vik_viewport_coords_to_screen() call, in each draw mode,
+ * and checks that both agree. */
+
+#define N_POINTS 100000
+#define ROUNDS 20
+
+static gdouble time_projection ( VikViewport *vvp, const VikCoord *coords, gint *xs, gint *ys, gboolean batch )
+{
+  GTimer *timer = g_timer_new ();
+  gdouble ns;
+  gint r, i;
+
+  for ( r = 0; r < ROUNDS; r++ )
+    if ( batch )
+      vik_viewport_coords_to_screen ( vvp, coords, N_POINTS, xs, ys );
+    else
+      for ( i = 0; i < N_POINTS; i++ )
+        vik_viewport_coord_to_screen ( vvp, coords + i, xs + i, ys + i );
+
+  ns = g_timer_elapsed ( timer, NULL ) * 1e9 / ( (gdouble) N_POINTS * ROUNDS );
+  g_timer_destroy ( timer );
+  return ns;
+}
+
+int main(int argc, char *argv[])
+{
+  static const gchar *mode_names[] = { "UTM", "Expedia", "Mercator" };
+  GtkWidget *window;
+  VikViewport *vvp;
+  VikCoord *coords = g_new ( VikCoord, N_POINTS );
+  gint *xs1 = g_new ( gint, N_POINTS ), *ys1 = g_new ( gint, N_POINTS );
+  gint *xs2 = g_new ( gint, N_POINTS ), *ys2 = g_new ( gint, N_POINTS );
+  GRand *r = g_rand_new_with_seed ( 1 );
+  gint mode, i, mismatches = 0;
+
+  gtk_init ( &argc, &argv );
+
+  window = gtk_window_new ( GTK_WINDOW_TOPLEVEL );
+  vvp = vik_viewport_new ();
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_realize ( GTK_WIDGET(vvp) );
+  vik_viewport_configure_manually ( vvp, 1024, 768 );
+
+  for ( mode = VIK_VIEWPORT_DRAWMODE_UTM; mode < VIK_VIEWPORT_NUM_DRAWMODES; mode++ )
+  {
+    struct LatLon center = { 47.0, 8.0 };
+    gdouble single, batch;
+
+    vik_viewport_set_drawmode ( vvp, mode );
+    vik_viewport_set_center_latlon ( vvp, &center );
+    vik_viewport_set_zoom ( vvp, 8.0 );
+
+    /* a few km around the center, as a dense track would be */
+    for ( i = 0; i < N_POINTS; i++ ) {
+      struct LatLon ll;
+      ll.lat = center.lat + g_rand_double_range ( r, -0.05, 0.05 );
+      ll.lon = center.lon + g_rand_double_range ( r, -0.05, 0.05 );
+      vik_coord_load_from_latlon ( coords + i, vik_viewport_get_coord_mode ( vvp ), &ll );
+    }
+
+    single = time_projection ( vvp, coords, xs1, ys1, FALSE );
+    batch = time_projection ( vvp, coords, xs2, ys2, TRUE );
+
+    /* the batch form reassociates the arithmetic, allow a pixel of rounding */
+    for ( i = 0; i < N_POINTS; i++ )
+      if ( ABS ( xs1[i] - xs2[i] ) > 1 || ABS ( ys1[i] - ys2[i] ) > 1 )
+        mismatches++;
+
+    printf ( "%-8s  per point %6.1f ns  batch %6.1f ns  (%.1fx)\n", mode_names[mode], single, batch, single / batch );
+  }
+
+  g_rand_free ( r );
+  g_free ( coords );
+  g_free ( xs1 ); g_free ( ys1 );
+  g_free ( xs2 ); g_free ( ys2 );
+  if ( mismatches )
+    fprintf ( stderr, "%d points projected differently\n", mismatches );
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
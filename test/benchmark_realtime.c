@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <viking.h>
+#include "globals.h"
+#include "preferences.h"
+#include "background.h"
+#include "mapcache.h"
+#include "realtime.h"
+
+/* Replays a drive logged as NMEA through a GPS layer in a window, as
+ * "Replay GPS Log" does: fixes are read at the replay rate, recorded,
+ * the cursor is moved, the map recentred and the window repaints what
+ * changed as often as it repaints anything. Reports the CPU time per fix
+ * at the start and the end of the drive against the time between fixes,
+ * how often the window put a frame on screen, whole or in part, and how
+ * much the process grew.
+ *
+ *   benchmark_realtime [fixes per second [minutes | log]]
+ *
+ * A log is NMEA or gpsd's JSON, one report a line; without one a drive
+ * round and round is written to a temporary file first. It runs in real
+ * time, as the layer replays at most 50 fixes a second. */
+
+#define START 1272621600 /* 2010-04-30 10:00 UTC */
+#define RADIUS 3000.0    /* metres, round and round */
+#define SPEED 15.0       /* m/s */
+
+#ifdef VIK_CONFIG_REALTIME_GPS_TRACKING
+
+typedef struct {
+  VikGpsLayer *vgl;
+  GArray *cpu;       /* CPU seconds used, one a second */
+  gdouble wall;
+  GTimer *timer;
+} Session;
+
+static glong rss_kb ( void )
+{
+  gchar *statm = NULL;
+  glong size = -1, resident = -1;
+
+  if ( g_file_get_contents ( "/proc/self/statm", &statm, NULL, NULL ) ) {
+    sscanf ( statm, "%ld %ld", &size, &resident );
+    g_free ( statm );
+  }
+  return resident < 0 ? -1 : resident * ( sysconf ( _SC_PAGESIZE ) / 1024 );
+}
+
+/* $body*checksum */
+static void nmea ( FILE *f, const gchar *body )
+{
+  guint sum = 0;
+  const gchar *p;
+
+  for ( p = body; *p; p++ )
+    sum ^= (guchar) *p;
+  fprintf ( f, "$%s*%02X\r\n", body, sum );
+}
+
+/* ddmm.mmmm or dddmm.mmmm, whatever the locale */
+static void nmea_angle ( gchar *buf, gsize size, gdouble deg, gint digits )
+{
+  gchar minutes[G_ASCII_DTOSTR_BUF_SIZE];
+  gdouble a = fabs ( deg );
+  gint d = (gint) floor ( a );
+
+  g_ascii_formatd ( minutes, sizeof(minutes), "%07.4f", ( a - d ) * 60 );
+  g_snprintf ( buf, size, "%0*d%s", digits, d, minutes );
+}
+
+/* the GGA and RMC sentences of fix i */
+static void write_fix ( FILE *f, gulong i, guint hz, GRand *r )
+{
+  gdouble t = (gdouble) i / hz;
+  gdouble a = t * SPEED / RADIUS;
+  gdouble lat = 47.0 + RADIUS * cos ( a ) / 111320;
+  gdouble lon = 8.0 + RADIUS * sin ( a ) / ( 111320 * cos ( lat * M_PI / 180 ) );
+  /* a driver weaving a little, so the course keeps changing */
+  gdouble course = fmod ( a * 180 / M_PI + 90 + g_rand_double_range ( r, -6, 6 ), 360 );
+  time_t secs = START + (time_t) floor ( t );
+  struct tm *tm = gmtime ( &secs );
+  gchar body[200], la[32], lo[32], hs[G_ASCII_DTOSTR_BUF_SIZE], cs[G_ASCII_DTOSTR_BUF_SIZE], ks[G_ASCII_DTOSTR_BUF_SIZE];
+
+  nmea_angle ( la, sizeof(la), lat, 2 );
+  nmea_angle ( lo, sizeof(lo), lon, 3 );
+  g_ascii_formatd ( hs, sizeof(hs), "%05.2f", tm->tm_sec + ( t - floor ( t ) ) );
+  g_ascii_formatd ( cs, sizeof(cs), "%.1f", course );
+  g_ascii_formatd ( ks, sizeof(ks), "%.1f", SPEED / 0.514444 );
+
+  g_snprintf ( body, sizeof(body), "GPGGA,%02d%02d%s,%s,N,%s,E,1,08,0.9,420.0,M,48.0,M,,",
+               tm->tm_hour, tm->tm_min, hs, la, lo );
+  nmea ( f, body );
+  g_snprintf ( body, sizeof(body), "GPRMC,%02d%02d%s,A,%s,N,%s,E,%s,%s,%02d%02d%02d,,",
+               tm->tm_hour, tm->tm_min, hs, la, lo, ks, cs, tm->tm_mday, tm->tm_mon + 1, tm->tm_year % 100 );
+  nmea ( f, body );
+}
+
+static gchar *write_log ( guint hz, guint minutes )
+{
+  GRand *r = g_rand_new_with_seed ( 1 );
+  gulong total = (gulong) hz * 60 * minutes, i;
+  gchar *fn;
+  gint fd = g_file_open_tmp ( "viking-drive-XXXXXX.nmea", &fn, NULL );
+  FILE *f;
+
+  if ( fd < 0 || ! (f = fdopen ( fd, "w" )) ) {
+    fprintf ( stderr, "cannot write the log\n" );
+    exit ( EXIT_FAILURE );
+  }
+  for ( i = 0; i < total; i++ )
+    write_fix ( f, i, hz, r );
+  fclose ( f );
+  g_rand_free ( r );
+  return fn;
+}
+
+/* as the layer counts them */
+static gulong count_fixes ( const gchar *fn )
+{
+  gchar *contents, **lines, **l;
+  RealtimeFix fix;
+  gulong n = 0;
+
+  if ( ! g_file_get_contents ( fn, &contents, NULL, NULL ) ) {
+    fprintf ( stderr, "cannot read %s\n", fn );
+    exit ( EXIT_FAILURE );
+  }
+  memset ( &fix, 0, sizeof(fix) );
+  lines = g_strsplit ( contents, "\n", -1 );
+  for ( l = lines; *l; l++ ) {
+    g_strchomp ( *l );
+    if ( a_realtime_parse_line ( &fix, *l ) )
+      n++;
+  }
+  g_strfreev ( lines );
+  g_free ( contents );
+  return n;
+}
+
+static void set_replay_rate ( VikGpsLayer *vgl, guint hz, VikViewport *vvp )
+{
+  VikLayerInterface *iface = vik_layer_get_interface ( VIK_LAYER_GPS );
+  VikLayerParamData data;
+  guint16 i;
+
+  data.u = hz;
+  for ( i = 0; i < iface->params_count; i++ )
+    if ( ! strcmp ( iface->params[i].name, "replay_rate" ) )
+      vik_layer_set_param ( VIK_LAYER(vgl), i, data, vvp );
+}
+
+/* once a second, until the log has been played through */
+static gboolean sample ( Session *s )
+{
+  gdouble cpu = (gdouble) clock () / CLOCKS_PER_SEC;
+  gboolean tracking;
+
+  g_array_append_val ( s->cpu, cpu );
+  gdk_threads_enter ();
+  tracking = vik_gps_layer_get_tracking ( s->vgl );
+  if ( ! tracking ) {
+    s->wall = g_timer_elapsed ( s->timer, NULL );
+    gtk_main_quit ();
+  }
+  gdk_threads_leave ();
+  return tracking;
+}
+
+static void count_points ( gpointer key, VikTrack *tr, gulong *points )
+{
+  *points += g_list_length ( tr->trackpoints );
+}
+
+int main ( int argc, char *argv[] )
+{
+  VikWindow *vw;
+  VikViewport *vvp;
+  struct LatLon center = { 47.0, 8.0 };
+  guint hz, minutes = 5, full, partial;
+  gchar *log;
+  gboolean own_log;
+  gulong fixes, points = 0, n;
+  glong rss;
+  gdouble first, last;
+  const GList *children;
+  Session s;
+  GError *error = NULL;
+
+  g_thread_init ( NULL );
+  gdk_threads_init ();
+  gtk_init ( &argc, &argv );
+  hz = argc > 1 ? CLAMP ( atoi ( argv[1] ), 1, 50 ) : 10;
+  own_log = ! ( argc > 2 && g_file_test ( argv[2], G_FILE_TEST_IS_REGULAR ) );
+  if ( own_log ) {
+    minutes = argc > 2 ? MAX ( atoi ( argv[2] ), 2 ) : minutes;
+    log = write_log ( hz, minutes );
+  } else
+    log = g_strdup ( argv[2] );
+  fixes = count_fixes ( log );
+
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_mapcache_init ();
+  a_background_init ();
+
+  gdk_threads_enter ();
+  vw = vik_window_new ();
+  gtk_window_resize ( GTK_WINDOW(vw), 1024, 768 );
+  gtk_widget_show_all ( GTK_WIDGET(vw) );
+  vvp = vik_window_viewport ( vw );
+  /* the whole circle on screen */
+  vik_viewport_set_drawmode ( vvp, VIK_VIEWPORT_DRAWMODE_MERCATOR );
+  vik_viewport_set_center_latlon ( vvp, &center );
+  vik_viewport_set_zoom ( vvp, 10.0 );
+
+  s.vgl = VIK_GPS_LAYER ( vik_layer_create ( VIK_LAYER_GPS, vvp, NULL, FALSE ) );
+  vik_layers_panel_add_layer ( vik_window_layers_panel ( vw ), VIK_LAYER(s.vgl) );
+  set_replay_rate ( s.vgl, hz, vvp );
+  while ( gtk_events_pending () )
+    gtk_main_iteration ();
+
+  printf ( "%lu fixes at %u fixes/s from %s\n", fixes, hz, own_log ? "a drive round and round" : log );
+  s.cpu = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+  s.timer = g_timer_new ();
+  s.wall = 0;
+  first = (gdouble) clock () / CLOCKS_PER_SEC;
+  g_array_append_val ( s.cpu, first );
+  vik_viewport_get_frames ( vvp, &full, &partial );
+  rss = rss_kb ();
+
+  if ( ! vik_gps_layer_replay ( s.vgl, log, &error ) ) {
+    fprintf ( stderr, "%s\n", error->message );
+    return EXIT_FAILURE;
+  }
+  g_timeout_add ( 1000, (GSourceFunc) sample, &s );
+  gtk_main ();
+
+  {
+    guint full_end, partial_end;
+    vik_viewport_get_frames ( vvp, &full_end, &partial_end );
+    full = full_end - full;
+    partial = partial_end - partial;
+  }
+  for ( children = vik_gps_layer_get_children ( s.vgl ); children; children = children->next )
+    g_hash_table_foreach ( vik_trw_layer_get_tracks ( VIK_TRW_LAYER(children->data) ), (GHFunc) count_points, &points );
+
+  /* the first and last whole minute, fixes coming at an even rate */
+  n = s.cpu->len;
+  first = n > 60 ? g_array_index ( s.cpu, gdouble, 60 ) - g_array_index ( s.cpu, gdouble, 0 ) : 0;
+  last = n > 61 ? g_array_index ( s.cpu, gdouble, n - 1 ) - g_array_index ( s.cpu, gdouble, n - 61 ) : 0;
+
+  printf ( "%lu points recorded in %.1f s\n", points, s.wall );
+  printf ( "CPU per fix: %.3f ms overall, first minute %.3f ms, last minute %.3f ms (%.1f ms between fixes)\n",
+           ( g_array_index ( s.cpu, gdouble, n - 1 ) - g_array_index ( s.cpu, gdouble, 0 ) ) * 1e3 / MAX ( fixes, 1 ),
+           first * 1e3 / ( hz * 60 ), last * 1e3 / ( hz * 60 ), 1000.0 / hz );
+  printf ( "frames: %u whole, %u partial\n", full, partial );
+  if ( rss >= 0 )
+    printf ( "grew by %ld kB\n", rss_kb () - rss );
+  else
+    printf ( "grew by n/a\n" );
+
+  gtk_widget_destroy ( GTK_WIDGET(vw) );
+  gdk_threads_leave ();
+  if ( own_log )
+    g_unlink ( log );
+  g_free ( log );
+  g_array_free ( s.cpu, TRUE );
+  g_timer_destroy ( s.timer );
+  a_background_uninit ();
+  a_mapcache_uninit ();
+  a_preferences_uninit ();
+  return EXIT_SUCCESS;
+}
+
+#else /* VIK_CONFIG_REALTIME_GPS_TRACKING */
+
+int main ( int argc, char *argv[] )
+{
+  printf ( "built without realtime GPS tracking, nothing to replay\n" );
+  return EXIT_SUCCESS;
+}
+
+#endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include <viking.h>
+#include "gpx.h"
+
+/* Times vik_track_simplify() by each method on a long track, checking
+ * that the ends stay and a point budget is met, then times gpsbabel's
+ * simplify filter on the same track when gpsbabel can be found. */
+
+#define N_POINTS 500000
+#define BUDGET 5000
+
+/* a wandering walk, a point every second about a metre apart */
+static VikTrack *make_track ( guint n )
+{
+  GRand *r = g_rand_new_with_seed ( 1 );
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 47.0, 8.0 };
+  gdouble heading = 0;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    heading += g_rand_double_range ( r, -0.2, 0.2 );
+    ll.lat += cos ( heading ) / 111120.0;
+    ll.lon += sin ( heading ) / 75800.0;
+    vik_coord_load_from_latlon ( &(tp->coord), VIK_COORD_LATLON, &ll );
+    tp->has_timestamp = TRUE;
+    tp->timestamp = 1199145600 + i;
+    tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tr->trackpoints );
+  g_rand_free ( r );
+  return tr;
+}
+
+static gint time_simplify ( const gchar *what, VikTrack *orig, VikTrackSimplify method, gdouble value )
+{
+  VikTrack *tr = vik_track_copy ( orig );
+  GTimer *timer = g_timer_new ();
+  gulong removed = vik_track_simplify ( tr, method, value );
+  gdouble secs = g_timer_elapsed ( timer, NULL );
+  guint left = g_list_length ( tr->trackpoints );
+  gint failures = 0;
+
+  printf ( "%-16s %8.3f s  %7d points left\n", what, secs, left );
+  if ( left + removed != N_POINTS ) {
+    fprintf ( stderr, "%s: %lu removed but %d left\n", what, removed, left );
+    failures++;
+  }
+  if ( vik_coord_diff ( &(VIK_TRACKPOINT(tr->trackpoints->data)->coord), &(VIK_TRACKPOINT(orig->trackpoints->data)->coord) ) > 0 ||
+       vik_coord_diff ( &(VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->coord),
+                        &(VIK_TRACKPOINT(g_list_last(orig->trackpoints)->data)->coord) ) > 0 ) {
+    fprintf ( stderr, "%s: lost an end of the track\n", what );
+    failures++;
+  }
+  if ( method == VIK_TRACK_SIMPLIFY_POINTS && left != value ) {
+    fprintf ( stderr, "%s: %d points left, asked for %d\n", what, left, (gint) value );
+    failures++;
+  }
+  g_timer_destroy ( timer );
+  vik_track_free ( tr );
+  return failures;
+}
+
+static void time_gpsbabel ( VikTrack *tr )
+{
+  gchar *in, *out, *cmd, *args[12];
+  GTimer *timer;
+  FILE *f;
+  gint fd, status, i = 0;
+
+  if ( ! (cmd = g_find_program_in_path ( "gpsbabel" )) ) {
+    printf ( "gpsbabel not found, not compared\n" );
+    return;
+  }
+
+  fd = g_file_open_tmp ( "vikbenchXXXXXX", &in, NULL );
+  f = fdopen ( fd, "w" );
+  fprintf ( f, "<?xml version=\"1.0\"?>\n<gpx version=\"1.0\" creator=\"Viking\">\n" );
+  a_gpx_write_track_file ( "bench", tr, f );
+  fprintf ( f, "</gpx>\n" );
+  fclose ( f );
+  out = g_strconcat ( in, ".out", NULL );
+
+  args[i++] = cmd;
+  args[i++] = "-i"; args[i++] = "gpx"; args[i++] = "-f"; args[i++] = in;
+  args[i++] = "-x"; args[i++] = g_strdup_printf ( "simplify,count=%d", BUDGET );
+  args[i++] = "-o"; args[i++] = "gpx"; args[i++] = "-F"; args[i++] = out;
+  args[i] = NULL;
+
+  /* gpsbabel has to read and write the file as well, which is part of
+   * what running it costs */
+  timer = g_timer_new ();
+  if ( g_spawn_sync ( NULL, args, NULL, G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL, NULL, NULL, &status, NULL ) && status == 0 )
+    printf ( "%-16s %8.3f s\n", "gpsbabel count", g_timer_elapsed ( timer, NULL ) );
+  else
+    printf ( "gpsbabel failed\n" );
+
+  g_timer_destroy ( timer );
+  g_remove ( in );
+  g_remove ( out );
+  g_free ( args[6] );
+  g_free ( in );
+  g_free ( out );
+  g_free ( cmd );
+}
+
+int main(int argc, char *argv[])
+{
+  VikTrack *tr = make_track ( N_POINTS );
+  gint failures = 0;
+
+  g_type_init ();
+
+  failures += time_simplify ( "douglas-peucker", tr, VIK_TRACK_SIMPLIFY_DOUGLAS_PEUCKER, 5 );
+  failures += time_simplify ( "visvalingam", tr, VIK_TRACK_SIMPLIFY_VISVALINGAM, 50 );
+  failures += time_simplify ( "point budget", tr, VIK_TRACK_SIMPLIFY_POINTS, BUDGET );
+  failures += time_simplify ( "every 10 s", tr, VIK_TRACK_SIMPLIFY_TIME, 10 );
+  failures += time_simplify ( "every 100 m", tr, VIK_TRACK_SIMPLIFY_DISTANCE, 100 );
+  time_gpsbabel ( tr );
+
+  vik_track_free ( tr );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <glib/gstdio.h>
+#include <viking.h>
+#include "babelcache.h"
+
+/* Checks that the babel cache keys on both input and arguments, finds
+ * what was stored, and that going over its size the least recently used
+ * output goes first. Runs in a HOME of its own. */
+
+#define ENTRY_SIZE (BABELCACHE_MAX_SIZE / 4)
+
+static gchar *store ( guint8 *data, gchar **args, time_t used )
+{
+  gchar *key = a_babelcache_key ( data, 16, args ), *fn;
+  struct utimbuf times;
+
+  a_babelcache_store ( key, data, ENTRY_SIZE );
+  if ( used && (fn = a_babelcache_lookup ( key )) ) {
+    times.actime = times.modtime = used;
+    utime ( fn, &times );
+    g_free ( fn );
+  }
+  return key;
+}
+
+/* empties and removes dir, which only holds files and directories */
+static void remove_dir ( const gchar *dir )
+{
+  GDir *d = g_dir_open ( dir, 0, NULL );
+  const gchar *name;
+
+  while ( d && (name = g_dir_read_name ( d )) ) {
+    gchar *fn = g_build_filename ( dir, name, NULL );
+    if ( g_file_test ( fn, G_FILE_TEST_IS_DIR ) )
+      remove_dir ( fn );
+    else
+      g_remove ( fn );
+    g_free ( fn );
+  }
+  if ( d )
+    g_dir_close ( d );
+  g_rmdir ( dir );
+}
+
+static gboolean cached ( const gchar *key )
+{
+  gchar *fn = a_babelcache_lookup ( key );
+  g_free ( fn );
+  return fn != NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  gchar *args1[] = { "gpsbabel", "-x", "simplify,count=100", NULL };
+  gchar *args2[] = { "gpsbabel", "-x", "simplify,count=200", NULL };
+  gchar *home = g_build_filename ( g_get_tmp_dir (), "test_babelcache.XXXXXX", NULL );
+  guint8 *data = g_malloc0 ( ENTRY_SIZE );
+  gchar *key1, *key2, *keys[5];
+  time_t now = time ( NULL );
+  gint failures = 0, i;
+
+  g_setenv ( "HOME", mkdtemp ( home ), TRUE );
+
+  strcpy ( (gchar *) data, "<gpx>one</gpx>" );
+  key1 = a_babelcache_key ( data, 16, args1 );
+  key2 = a_babelcache_key ( data, 16, args2 );
+  if ( strcmp ( key1, key2 ) == 0 ) {
+    fprintf ( stderr, "arguments not in the key\n" );
+    failures++;
+  }
+  g_free ( key2 );
+  strcpy ( (gchar *) data, "<gpx>two</gpx>" );
+  key2 = a_babelcache_key ( data, 16, args1 );
+  if ( strcmp ( key1, key2 ) == 0 ) {
+    fprintf ( stderr, "input not in the key\n" );
+    failures++;
+  }
+
+  if ( cached ( key1 ) ) {
+    fprintf ( stderr, "found before stored\n" );
+    failures++;
+  }
+  g_free ( key1 );
+  g_free ( key2 );
+
+  /* four fill the cache, oldest first; then the first is used again */
+  for ( i = 0; i < 4; i++ ) {
+    data[0] = i;
+    keys[i] = store ( data, args1, now - 400 + i * 100 );
+  }
+  if ( ! cached ( keys[0] ) ) {
+    fprintf ( stderr, "stored output not found\n" );
+    failures++;
+  }
+  data[0] = 4;
+  keys[4] = store ( data, args1, 0 );
+
+  for ( i = 0; i < 5; i++ ) {
+    if ( cached ( keys[i] ) != ( i != 1 ) ) {
+      fprintf ( stderr, "entry %d %s\n", i, i == 1 ? "kept" : "lost" );
+      failures++;
+    }
+    g_free ( keys[i] );
+  }
+
+  remove_dir ( home );
+  g_free ( data );
+  g_free ( home );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <viking.h>
+#include <preferences.h>
+#include <modules.h>
+#include "binfile.h"
+#include "mapcache.h"
+
+/* Checks that a project saved in the binary format and read back
+ * saves as the same text as the project it came from: the sample
+ * projects here, and one with random waypoints and tracks.
+ * Loading layers needs an X server, without one the test is skipped. */
+
+#define SKIP 77
+
+static gint failures = 0;
+
+#define CHECK(cond, ...) if ( !(cond) ) { failures++; fprintf ( stderr, __VA_ARGS__ ); fprintf ( stderr, "\n" ); }
+
+static void random_latlon ( GRand *r, VikCoord *coord, VikCoordMode mode )
+{
+  struct LatLon ll;
+  ll.lat = g_rand_double_range ( r, -79.0, 83.0 );
+  ll.lon = g_rand_double_range ( r, -180.0, 180.0 );
+  vik_coord_load_from_latlon ( coord, mode, &ll );
+}
+
+static VikLayer *random_layer ( GRand *r, VikViewport *vp )
+{
+  VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, vp, NULL, FALSE );
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vl);
+  VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+  gint i, j;
+  gchar *name;
+
+  vik_layer_rename ( vl, "random" );
+  for ( i = 0; i < 50; i++ )
+  {
+    VikWaypoint *wp = vik_waypoint_new ();
+    random_latlon ( r, &(wp->coord), mode );
+    wp->visible = g_rand_boolean ( r );
+    if ( g_rand_boolean ( r ) )
+      wp->altitude = g_rand_double_range ( r, -400.0, 9000.0 );
+    if ( g_rand_boolean ( r ) )
+      vik_waypoint_set_comment ( wp, "a comment" );
+    if ( g_rand_boolean ( r ) )
+      vik_waypoint_set_symbol ( wp, "flag" );
+    name = g_strdup_printf ( "wp%d", i );
+    vik_trw_layer_filein_add_waypoint ( vtl, name, wp );
+    g_free ( name );
+  }
+
+  for ( i = 0; i < 5; i++ )
+  {
+    VikTrack *tr = vik_track_new ();
+    tr->visible = g_rand_boolean ( r );
+    if ( g_rand_boolean ( r ) )
+      vik_track_set_comment ( tr, "a comment" );
+    for ( j = 0; j < 2000; j++ )
+    {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      random_latlon ( r, &(tp->coord), mode );
+      tp->newsegment = g_rand_int_range ( r, 0, 50 ) == 0;
+      if ( g_rand_boolean ( r ) )
+        tp->altitude = g_rand_double_range ( r, -400.0, 9000.0 );
+      if ( (tp->has_timestamp = g_rand_boolean ( r )) )
+        tp->timestamp = g_rand_int_range ( r, 0, G_MAXINT32 );
+      if ( g_rand_boolean ( r ) ) {
+        tp->speed = g_rand_double_range ( r, 0.0, 50.0 );
+        tp->course = g_rand_double_range ( r, 0.0, 360.0 );
+        tp->nsats = g_rand_int_range ( r, 1, 13 );
+        tp->fix_mode = g_rand_int_range ( r, 0, 4 );
+      }
+      tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+    }
+    tr->trackpoints = g_list_reverse ( tr->trackpoints );
+    name = g_strdup_printf ( "track%d", i );
+    vik_trw_layer_filein_add_track ( vtl, name, tr );
+    g_free ( name );
+  }
+  return vl;
+}
+
+static gint compare_lines ( const void *a, const void *b )
+{
+  return strcmp ( *(gchar * const *) a, *(gchar * const *) b );
+}
+
+/* waypoints and tracks come out in hash table order, so compare sorted lines */
+static gboolean same_lines ( const gchar *a, const gchar *b )
+{
+  gchar **la = g_strsplit ( a, "\n", -1 );
+  gchar **lb = g_strsplit ( b, "\n", -1 );
+  gint i, na = g_strv_length ( la ), nb = g_strv_length ( lb );
+  gboolean same = ( na == nb );
+  qsort ( la, na, sizeof(gchar *), compare_lines );
+  qsort ( lb, nb, sizeof(gchar *), compare_lines );
+  for ( i = 0; same && i < na; i++ )
+    same = strcmp ( la[i], lb[i] ) == 0;
+  g_strfreev ( la );
+  g_strfreev ( lb );
+  return same;
+}
+
+static gchar *temp_name ( const gchar *tmpl )
+{
+  gchar *fn;
+  gint fd = g_file_open_tmp ( tmpl, &fn, NULL );
+  if ( fd < 0 ) {
+    fprintf ( stderr, "cannot make a temporary file\n" );
+    exit ( EXIT_FAILURE );
+  }
+  close ( fd );
+  return fn;
+}
+
+/* what top saves as in the text format */
+static gchar *project_text ( VikAggregateLayer *top, VikViewport *vp )
+{
+  gchar *fn = temp_name ( "viking-XXXXXX.vik" ), *s = NULL;
+  if ( a_file_save ( top, vp, fn ) )
+    g_file_get_contents ( fn, &s, NULL, NULL );
+  g_unlink ( fn );
+  g_free ( fn );
+  return s;
+}
+
+/* saves top as binary, reads it back and compares the texts */
+static void check_round_trip ( VikAggregateLayer *top, VikViewport *vp, const gchar *what )
+{
+  gchar *bin = temp_name ( "viking-XXXXXX" BINFILE_EXT );
+  gchar *before = project_text ( top, vp ), *after = NULL;
+  VikAggregateLayer *top2 = vik_aggregate_layer_new ();
+
+  CHECK ( before, "%s: could not save as text", what );
+  CHECK ( a_file_save ( top, vp, bin ), "%s: could not save as binary", what );
+  CHECK ( a_file_load ( top2, vp, bin ) == 1, "%s: could not read the binary file back", what );
+  after = project_text ( top2, vp );
+  CHECK ( before && after && same_lines ( before, after ), "%s: changed going through the binary format", what );
+
+  g_unlink ( bin );
+  g_free ( bin );
+  g_free ( before );
+  g_free ( after );
+  g_object_unref ( G_OBJECT(top2) );
+}
+
+int main ( int argc, char *argv[] )
+{
+  static const gchar *samples[] = { "OpenStreetMap.vik", "sf_1952523.vik", "sf_1970257.vik" };
+  const gchar *srcdir = g_getenv ( "srcdir" );
+  VikViewport *vp;
+  VikAggregateLayer *top;
+  GRand *r;
+  guint i;
+
+  g_thread_init ( NULL );
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    fprintf ( stderr, "no X server, skipped\n" );
+    return SKIP;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  modules_init ();
+  a_mapcache_init ();
+
+  vp = vik_viewport_new_offscreen ( NULL, 1024, 768 );
+
+  for ( i = 0; i < G_N_ELEMENTS(samples); i++ ) {
+    gchar *fn = g_build_filename ( srcdir ? srcdir : ".", samples[i], NULL );
+    top = vik_aggregate_layer_new ();
+    if ( a_file_load ( top, vp, fn ) == 1 )
+      check_round_trip ( top, vp, samples[i] );
+    else
+      CHECK ( FALSE, "%s: could not load", fn );
+    g_object_unref ( G_OBJECT(top) );
+    g_free ( fn );
+  }
+
+  r = g_rand_new_with_seed ( 1 );
+  top = vik_aggregate_layer_new ();
+  vik_aggregate_layer_add_layer ( top, random_layer ( r, vp ) );
+  check_round_trip ( top, vp, "random tracks and waypoints" );
+  g_object_unref ( G_OBJECT(top) );
+  g_rand_free ( r );
+
+  vik_viewport_free_offscreen ( vp );
+  a_mapcache_uninit ();
+  a_preferences_uninit ();
+
+  if ( failures )
+    fprintf ( stderr, "%d failures\n", failures );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <viking.h>
+
+/* Checks the UTM <-> lat/lon conversions against the straightforward
+ * series evaluation they replaced, and the distances against a long
+ * double haversine, to within a millimetre; and times the old code, the
+ * new code and the batch forms. */
+
+#define N_POINTS 200000
+#define TOLERANCE 0.001   /* metres */
+#define METRES_PER_DEGREE 111320.0
+
+#define K0 0.9996
+#define EquatorialRadius 6378137
+#define EccentricitySquared 0.00669438
+
+static gdouble per_point ( GTimer *timer )
+{
+  return g_timer_elapsed ( timer, NULL ) * 1e9 / N_POINTS;
+}
+
+static void ref_latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm )
+{
+  double latitude = latlon->lat, longitude = latlon->lon;
+  double lat_rad, long_rad, long_origin_rad, eccPrimeSquared, N, T, C, A, M;
+  int zone;
+
+  if ( longitude < -180.0 )
+    longitude += 360.0;
+  if ( longitude > 180.0 )
+    longitude -= 360.0;
+  lat_rad = latitude * M_PI / 180.0;
+  long_rad = longitude * M_PI / 180.0;
+  zone = (int) ( ( longitude + 180 ) / 6 ) + 1;
+  if ( latitude >= 56.0 && latitude < 64.0 && longitude >= 3.0 && longitude < 12.0 )
+    zone = 32;
+  if ( latitude >= 72.0 && latitude < 84.0 )
+  {
+    if      ( longitude >= 0.0  && longitude <  9.0 ) zone = 31;
+    else if ( longitude >= 9.0  && longitude < 21.0 ) zone = 33;
+    else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
+    else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
+  }
+  long_origin_rad = ( ( zone - 1 ) * 6 - 180 + 3 ) * M_PI / 180.0;
+  eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
+  N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( lat_rad ) * sin( lat_rad ) );
+  T = tan( lat_rad ) * tan( lat_rad );
+  C = eccPrimeSquared * cos( lat_rad ) * cos( lat_rad );
+  A = cos( lat_rad ) * ( long_rad - long_origin_rad );
+  M = EquatorialRadius * ( ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) * lat_rad - ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 2 * lat_rad ) + ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 4 * lat_rad ) - ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 ) * sin( 6 * lat_rad ) );
+  utm->easting = K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * eccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
+  utm->northing = K0 * ( M + N * tan( lat_rad ) * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * eccPrimeSquared ) * A * A * A * A * A * A / 720 ) );
+  if ( latitude < 0.0 )
+    utm->northing += 10000000.0;
+  utm->zone = zone;
+}
+
+static void ref_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon )
+{
+  double x, y, eccPrimeSquared, e1, N1, T1, C1, R1, D, M, mu, phi1_rad;
+
+  x = utm->easting - 500000.0;
+  y = utm->northing;
+  if ( utm->letter < 'N' )
+    y -= 10000000.0;
+  eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
+  e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
+  M = y / K0;
+  mu = M / ( EquatorialRadius * ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) );
+  phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 )* sin( 2 * mu ) + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * sin( 4 * mu ) + ( 151 * e1 * e1 * e1 / 96 ) * sin( 6 *mu );
+  N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ) );
+  T1 = tan( phi1_rad ) * tan( phi1_rad );
+  C1 = eccPrimeSquared * cos( phi1_rad ) * cos( phi1_rad );
+  R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ), 1.5 );
+  D = x / ( N1 * K0 );
+  latlon->lat = ( phi1_rad - ( N1 * tan( phi1_rad ) / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * eccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * eccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 ) ) * 180.0 / M_PI;
+  latlon->lon = ( ( utm->zone - 1 ) * 6 - 180 + 3 ) + ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * eccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos( phi1_rad ) * 180.0 / M_PI;
+}
+
+/* the spherical law of cosines used before */
+static gdouble ref_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
+{
+  gdouble d = EquatorialRadius * acos ( sin ( ll1->lat * M_PI / 180 ) * sin ( ll2->lat * M_PI / 180 ) +
+                                       cos ( ll1->lat * M_PI / 180 ) * cos ( ll2->lat * M_PI / 180 ) * cos ( ( ll1->lon - ll2->lon ) * M_PI / 180 ) );
+  return isnan ( d ) ? 0 : d;
+}
+
+static long double exact_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
+{
+  long double lat1 = ll1->lat * M_PI / 180, lat2 = ll2->lat * M_PI / 180;
+  long double sl = sinl ( ( lat2 - lat1 ) / 2 ), sn = sinl ( ( ll2->lon - ll1->lon ) * M_PI / 360 );
+  return 2 * EquatorialRadius * asinl ( sqrtl ( sl * sl + cosl ( lat1 ) * cosl ( lat2 ) * sn * sn ) );
+}
+
+/* a walk of n points with steps of up to step degrees, around latitude lat */
+static void random_walk ( GRand *r, struct LatLon *lls, gint n, gdouble lat, gdouble step )
+{
+  gint i;
+  lls[0].lat = lat;
+  lls[0].lon = g_rand_double_range ( r, -180.0, 180.0 );
+  for ( i = 1; i < n; i++ ) {
+    lls[i].lat = CLAMP ( lls[i-1].lat + g_rand_double_range ( r, -step, step ), -90.0, 90.0 );
+    lls[i].lon = lls[i-1].lon + g_rand_double_range ( r, -step, step );
+  }
+}
+
+static gint test_distances ( GRand *r, struct LatLon *lls, gdouble *dists )
+{
+  static const gdouble lats[] = { 0.0, 30.0, -45.0, 60.0, -75.0, 85.0, 89.9 };
+  static const gdouble steps[] = { 0.00001, 0.001, 0.04, 0.06, 1.0, 30.0 };
+  GTimer *timer = g_timer_new ();
+  gdouble worst = 0.0, worst_batch = 0.0, err, sum = 0.0;
+  gint l, s, i, failures = 0;
+
+  for ( l = 0; l < G_N_ELEMENTS(lats); l++ )
+    for ( s = 0; s < G_N_ELEMENTS(steps); s++ ) {
+      random_walk ( r, lls, N_POINTS / 100, lats[l], steps[s] );
+      a_coords_latlons_diff ( lls, N_POINTS / 100, dists );
+      for ( i = 0; i + 1 < N_POINTS / 100; i++ ) {
+        long double exact = exact_latlon_diff ( lls + i, lls + i + 1 );
+        err = fabsl ( a_coords_latlon_diff ( lls + i, lls + i + 1 ) - exact );
+        worst = MAX ( worst, err );
+        if ( err > TOLERANCE ) {
+          fprintf ( stderr, "%f,%f to %f,%f: distance off by %g m\n", lls[i].lat, lls[i].lon, lls[i+1].lat, lls[i+1].lon, err );
+          failures++;
+        }
+        err = fabsl ( dists[i] - exact );
+        worst_batch = MAX ( worst_batch, err );
+        if ( err > TOLERANCE ) {
+          fprintf ( stderr, "%f,%f to %f,%f: batch distance off by %g m\n", lls[i].lat, lls[i].lon, lls[i+1].lat, lls[i+1].lon, err );
+          failures++;
+        }
+      }
+    }
+  printf ( "worst distance error: %g m, batch %g m\n", worst, worst_batch );
+
+  /* a track: points a few metres apart */
+  random_walk ( r, lls, N_POINTS, 47.0, 0.0001 );
+  g_timer_start ( timer );
+  for ( i = 0; i + 1 < N_POINTS; i++ )
+    sum += ref_latlon_diff ( lls + i, lls + i + 1 );
+  printf ( "distance    reference %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  for ( i = 0; i + 1 < N_POINTS; i++ )
+    sum += a_coords_latlon_diff ( lls + i, lls + i + 1 );
+  printf ( "  per point %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  a_coords_latlons_diff ( lls, N_POINTS, dists );
+  printf ( "  batch %6.1f ns\n", per_point ( timer ) );
+
+  g_timer_destroy ( timer );
+  return failures + ( sum < 0 );
+}
+
+static gdouble latlon_error ( const struct LatLon *a, const struct LatLon *b )
+{
+  gdouble dn = ( a->lat - b->lat ) * METRES_PER_DEGREE;
+  gdouble de = ( a->lon - b->lon ) * METRES_PER_DEGREE * cos ( a->lat * M_PI / 180.0 );
+  return sqrt ( dn * dn + de * de );
+}
+
+
+int main(int argc, char *argv[])
+{
+  struct LatLon *lls = g_new ( struct LatLon, N_POINTS ), *lls2 = g_new ( struct LatLon, N_POINTS );
+  struct UTM *utms = g_new ( struct UTM, N_POINTS ), *utms2 = g_new ( struct UTM, N_POINTS );
+  gdouble *dists = g_new ( gdouble, N_POINTS );
+  GRand *r = g_rand_new_with_seed ( argc > 1 ? atoi(argv[1]) : 1 );
+  GTimer *timer = g_timer_new ();
+  gdouble worst_utm = 0.0, worst_ll = 0.0, err;
+  gint i, failures = 0;
+
+  for ( i = 0; i < N_POINTS; i++ ) {
+    lls[i].lat = g_rand_double_range ( r, -80.0, 84.0 );
+    lls[i].lon = g_rand_double_range ( r, -180.0, 180.0 );
+  }
+
+  /* lat/lon -> UTM */
+  for ( i = 0; i < N_POINTS; i++ ) {
+    ref_latlon_to_utm ( lls + i, utms2 + i );
+    a_coords_latlon_to_utm ( lls + i, utms + i );
+    err = hypot ( utms[i].easting - utms2[i].easting, utms[i].northing - utms2[i].northing );
+    worst_utm = MAX ( worst_utm, err );
+    if ( err > TOLERANCE || utms[i].zone != utms2[i].zone ) {
+      fprintf ( stderr, "%f,%f: UTM off by %g m\n", lls[i].lat, lls[i].lon, err );
+      failures++;
+    }
+  }
+
+  /* UTM -> lat/lon */
+  for ( i = 0; i < N_POINTS; i++ ) {
+    struct LatLon ref;
+    ref_utm_to_latlon ( utms + i, &ref );
+    a_coords_utm_to_latlon ( utms + i, lls2 + i );
+    err = latlon_error ( &ref, lls2 + i );
+    worst_ll = MAX ( worst_ll, err );
+    if ( err > TOLERANCE ) {
+      fprintf ( stderr, "%c%d %f,%f: lat/lon off by %g m\n", utms[i].letter, utms[i].zone, utms[i].easting, utms[i].northing, err );
+      failures++;
+    }
+  }
+  printf ( "worst difference: to UTM %g m, to lat/lon %g m\n", worst_utm, worst_ll );
+
+  g_timer_start ( timer );
+  for ( i = 0; i < N_POINTS; i++ )
+    ref_latlon_to_utm ( lls + i, utms2 + i );
+  printf ( "to UTM      reference %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  for ( i = 0; i < N_POINTS; i++ )
+    a_coords_latlon_to_utm ( lls + i, utms2 + i );
+  printf ( "  per point %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  a_coords_latlons_to_utms ( lls, utms2, N_POINTS );
+  printf ( "  batch %6.1f ns\n", per_point ( timer ) );
+
+  g_timer_start ( timer );
+  for ( i = 0; i < N_POINTS; i++ )
+    ref_utm_to_latlon ( utms + i, lls2 + i );
+  printf ( "to lat/lon  reference %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  for ( i = 0; i < N_POINTS; i++ )
+    a_coords_utm_to_latlon ( utms + i, lls2 + i );
+  printf ( "  per point %6.1f ns", per_point ( timer ) );
+  g_timer_start ( timer );
+  a_coords_utms_to_latlons ( utms, lls2, N_POINTS );
+  printf ( "  batch %6.1f ns\n", per_point ( timer ) );
+
+  failures += test_distances ( r, lls, dists );
+
+  g_timer_destroy ( timer );
+  g_rand_free ( r );
+  g_free ( dists );
+  g_free ( lls ); g_free ( lls2 );
+  g_free ( utms ); g_free ( utms2 );
+  if ( failures )
+    fprintf ( stderr, "%d failures\n", failures );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <viking.h>
+
+/* Round trip and fuzz tests for the gpspoint reader:
+ * writing what was read must give the same lines as the original,
+ * and mangled input must never crash it. */
+
+#define ITERATIONS 200
+
+static gint failures = 0;
+
+#define CHECK(cond, ...) if ( !(cond) ) { failures++; fprintf ( stderr, __VA_ARGS__ ); fprintf ( stderr, "\n" ); }
+
+static gchar *random_text ( GRand *r, gboolean plain, gint len )
+{
+  static const gchar plain_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+  static const gchar nasty_chars[] = "ab 09=\"\\#~'\t";
+  gchar *s = g_malloc ( len + 1 );
+  gint i;
+  for ( i = 0; i < len; i++ )
+    if ( plain )
+      s[i] = plain_chars[g_rand_int_range ( r, 0, sizeof(plain_chars)-1 )];
+    else
+      s[i] = nasty_chars[g_rand_int_range ( r, 0, sizeof(nasty_chars)-1 )];
+  s[len] = '\0';
+  return s;
+}
+
+static void random_latlon ( GRand *r, VikCoord *coord )
+{
+  struct LatLon ll;
+  ll.lat = g_rand_double_range ( r, -89.0, 89.0 );
+  ll.lon = g_rand_double_range ( r, -180.0, 180.0 );
+  vik_coord_load_from_latlon ( coord, VIK_COORD_LATLON, &ll );
+}
+
+static VikTrwLayer *random_layer ( GRand *r )
+{
+  VikTrwLayer *vtl = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  gint i, j, n;
+  gchar *name, *tmp;
+
+  n = g_rand_int_range ( r, 0, 20 );
+  for ( i = 0; i < n; i++ )
+  {
+    VikWaypoint *wp = vik_waypoint_new ();
+    random_latlon ( r, &(wp->coord) );
+    wp->visible = g_rand_boolean ( r );
+    if ( g_rand_boolean ( r ) )
+      wp->altitude = g_rand_double_range ( r, -400.0, 9000.0 );
+    if ( g_rand_boolean ( r ) ) {
+      /* longer than the old 2048 byte line buffer, now and then */
+      tmp = random_text ( r, FALSE, i == 0 ? 5000 : g_rand_int_range ( r, 1, 40 ) );
+      vik_waypoint_set_comment ( wp, tmp );
+      g_free ( tmp );
+    }
+    if ( g_rand_boolean ( r ) ) {
+      tmp = random_text ( r, FALSE, g_rand_int_range ( r, 1, 40 ) );
+      vik_waypoint_set_image ( wp, tmp );
+      g_free ( tmp );
+    }
+    if ( g_rand_boolean ( r ) ) {
+      tmp = random_text ( r, TRUE, g_rand_int_range ( r, 1, 10 ) );
+      vik_waypoint_set_symbol ( wp, tmp );
+      g_free ( tmp );
+    }
+    name = g_strdup_printf ( "wp%d", i );
+    vik_trw_layer_filein_add_waypoint ( vtl, name, wp );
+    g_free ( name );
+  }
+
+  n = g_rand_int_range ( r, 0, 5 );
+  for ( i = 0; i < n; i++ )
+  {
+    VikTrack *tr = vik_track_new ();
+    gint n_points = g_rand_int_range ( r, 0, 3000 );
+    tr->visible = g_rand_boolean ( r );
+    if ( g_rand_boolean ( r ) ) {
+      tmp = random_text ( r, FALSE, g_rand_int_range ( r, 1, 40 ) );
+      vik_track_set_comment ( tr, tmp );
+      g_free ( tmp );
+    }
+    for ( j = 0; j < n_points; j++ )
+    {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      random_latlon ( r, &(tp->coord) );
+      tp->newsegment = g_rand_int_range ( r, 0, 50 ) == 0;
+      if ( g_rand_boolean ( r ) )
+        tp->altitude = g_rand_double_range ( r, -400.0, 9000.0 );
+      if ( (tp->has_timestamp = g_rand_boolean ( r )) )
+        tp->timestamp = g_rand_int_range ( r, 0, G_MAXINT32 );
+      if ( g_rand_boolean ( r ) ) {
+        tp->speed = g_rand_double_range ( r, 0.0, 50.0 );
+        tp->course = g_rand_double_range ( r, 0.0, 360.0 );
+        tp->nsats = g_rand_int_range ( r, 1, 13 );
+        tp->fix_mode = g_rand_int_range ( r, 0, 4 );
+      }
+      tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+    }
+    tr->trackpoints = g_list_reverse ( tr->trackpoints );
+    name = random_text ( r, TRUE, 8 );
+    vik_trw_layer_filein_add_track ( vtl, name, tr );
+    g_free ( name );
+  }
+  return vtl;
+}
+
+static gchar *layer_to_text ( VikTrwLayer *vtl, gsize *len )
+{
+  FILE *f = tmpfile ();
+  gchar *s;
+  a_gpspoint_write_file ( vtl, f );
+  *len = ftell ( f );
+  rewind ( f );
+  s = g_malloc ( *len + 1 );
+  *len = fread ( s, 1, *len, f );
+  s[*len] = '\0';
+  fclose ( f );
+  return s;
+}
+
+static gint compare_lines ( const void *a, const void *b )
+{
+  return strcmp ( *(gchar * const *) a, *(gchar * const *) b );
+}
+
+/* waypoints and tracks come out in hash table order, so compare sorted lines */
+static gboolean same_lines ( const gchar *a, const gchar *b )
+{
+  gchar **la = g_strsplit ( a, "\n", -1 );
+  gchar **lb = g_strsplit ( b, "\n", -1 );
+  gint i, na = g_strv_length ( la ), nb = g_strv_length ( lb );
+  gboolean same = ( na == nb );
+  qsort ( la, na, sizeof(gchar *), compare_lines );
+  qsort ( lb, nb, sizeof(gchar *), compare_lines );
+  for ( i = 0; same && i < na; i++ )
+    same = strcmp ( la[i], lb[i] ) == 0;
+  g_strfreev ( la );
+  g_strfreev ( lb );
+  return same;
+}
+
+static void check_track_lengths ( const gchar *name, VikTrack *tr, GHashTable *other )
+{
+  VikTrack *tr2 = g_hash_table_lookup ( other, name );
+  CHECK ( tr2 && g_list_length ( tr->trackpoints ) == g_list_length ( tr2->trackpoints ),
+          "track %s lost trackpoints", name );
+}
+
+static void test_round_trip ( GRand *r )
+{
+  VikTrwLayer *vtl = random_layer ( r );
+  VikTrwLayer *from_file = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  VikTrwLayer *from_buffer = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  gchar *text, *text2;
+  gsize len, len2;
+  FILE *f;
+
+  text = layer_to_text ( vtl, &len );
+
+  f = tmpfile ();
+  fwrite ( text, 1, len, f );
+  rewind ( f );
+  a_gpspoint_read_file ( from_file, f );
+  fclose ( f );
+  text2 = layer_to_text ( from_file, &len2 );
+  CHECK ( same_lines ( text, text2 ), "file round trip differs" );
+  g_hash_table_foreach ( vik_trw_layer_get_tracks ( vtl ), (GHFunc) check_track_lengths, vik_trw_layer_get_tracks ( from_file ) );
+  g_free ( text2 );
+
+  CHECK ( a_gpspoint_read_buffer ( from_buffer, text, len ) == len, "buffer not fully read" );
+  text2 = layer_to_text ( from_buffer, &len2 );
+  CHECK ( same_lines ( text, text2 ), "buffer round trip differs" );
+  g_free ( text2 );
+
+  g_free ( text );
+  g_object_unref ( vtl );
+  g_object_unref ( from_file );
+  g_object_unref ( from_buffer );
+}
+
+/* as embedded in a .vik file: reading must stop right after ~EndLayerData */
+static void test_embedded ()
+{
+  const gchar data[] = "type=\"waypoint\" latitude=\"1\" longitude=\"2\" name=\"a\"\n~EndLayerData\n~EndLayer\n";
+  gchar rest[32];
+  VikTrwLayer *vtl = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  FILE *f = tmpfile ();
+
+  CHECK ( a_gpspoint_read_buffer ( vtl, data, strlen(data) ) == strlen(data) - strlen("~EndLayer\n"),
+          "buffer read did not stop at ~EndLayerData" );
+
+  fputs ( data, f );
+  rewind ( f );
+  a_gpspoint_read_file ( vtl, f );
+  CHECK ( fgets ( rest, sizeof(rest), f ) && strcmp ( rest, "~EndLayer\n" ) == 0,
+          "file read did not stop at ~EndLayerData" );
+  fclose ( f );
+  g_object_unref ( vtl );
+}
+
+static void test_fuzz ( GRand *r )
+{
+  static const gchar specials[] = "\"\\= \n#~\r\t";
+  VikTrwLayer *vtl = random_layer ( r );
+  gsize len;
+  gchar *text = layer_to_text ( vtl, &len );
+  gint i, n = g_rand_int_range ( r, 1, 20 );
+  FILE *f;
+
+  for ( i = 0; i < n && len > 0; i++ )
+  {
+    gsize pos = g_rand_int_range ( r, 0, len );
+    switch ( g_rand_int_range ( r, 0, 4 ) ) {
+      case 0: text[pos] = specials[g_rand_int_range ( r, 0, sizeof(specials)-1 )]; break;
+      case 1: text[pos] = g_rand_int_range ( r, 1, 256 ); break;
+      case 2: memmove ( text+pos, text+pos+1, len-pos-1 ); len--; break;
+      case 3: len = pos; break;
+    }
+  }
+  g_object_unref ( vtl );
+
+  vtl = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  a_gpspoint_read_buffer ( vtl, text, len );
+  g_object_unref ( vtl );
+
+  vtl = vik_trw_layer_new_detached ( VIK_COORD_LATLON );
+  f = tmpfile ();
+  fwrite ( text, 1, len, f );
+  rewind ( f );
+  a_gpspoint_read_file ( vtl, f );
+  fclose ( f );
+  g_object_unref ( vtl );
+
+  g_free ( text );
+}
+
+int main(int argc, char *argv[])
+{
+  GRand *r = g_rand_new_with_seed ( argc > 1 ? atoi(argv[1]) : 1 );
+  gint i;
+
+  g_type_init ();
+
+  test_embedded ();
+  for ( i = 0; i < ITERATIONS; i++ )
+    test_round_trip ( r );
+  for ( i = 0; i < ITERATIONS; i++ )
+    test_fuzz ( r );
+
+  g_rand_free ( r );
+  if ( failures )
+    fprintf ( stderr, "%d failures\n", failures );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
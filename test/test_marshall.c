@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <viking.h>
+
+/* Checks that tracks and waypoints come back from the clipboard format
+ * as they went in, that cut short or foreign data is refused rather
+ * than read, and times a long track both ways. */
+
+#define N_POINTS 100000
+#define N_SMALL 100
+
+static VikTrack *make_track ( guint n, GRand *r )
+{
+  VikTrack *tr = vik_track_new ();
+  guint i;
+
+  vik_track_set_comment ( tr, "round trip" );
+  tr->visible = TRUE;
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    struct LatLon ll;
+    ll.lat = g_rand_double_range ( r, -80.0, 80.0 );
+    ll.lon = g_rand_double_range ( r, -180.0, 180.0 );
+    vik_coord_load_from_latlon ( &(tp->coord), i % 2 ? VIK_COORD_UTM : VIK_COORD_LATLON, &ll );
+    tp->newsegment = ( i % 1000 == 0 );
+    tp->has_timestamp = ( i % 3 != 0 );
+    tp->timestamp = 1200000000 + i;
+    tp->altitude = i % 5 ? g_rand_double_range ( r, -100.0, 5000.0 ) : VIK_DEFAULT_ALTITUDE;
+    tp->speed = i % 7 ? g_rand_double ( r ) * 50 : NAN;
+    tp->course = i % 7 ? g_rand_double ( r ) * 360 : NAN;
+    tp->nsats = i % 13;
+    tp->fix_mode = i % 4;
+    tp->hdop = g_rand_double ( r );
+    tp->vdop = g_rand_double ( r );
+    tp->pdop = g_rand_double ( r );
+    tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tr->trackpoints );
+  return tr;
+}
+
+/* NAN != NAN, so the doubles are compared as bytes */
+#define SAME(a,b) ( memcmp ( &(a), &(b), sizeof(a) ) == 0 )
+
+static gboolean same_string ( const gchar *a, const gchar *b )
+{
+  return a == b || ( a && b && strcmp ( a, b ) == 0 );
+}
+
+static gboolean same_coord ( const VikCoord *a, const VikCoord *b )
+{
+  return SAME(a->north_south, b->north_south) && SAME(a->east_west, b->east_west) &&
+         a->utm_zone == b->utm_zone && a->utm_letter == b->utm_letter && a->mode == b->mode;
+}
+
+static gboolean same_track ( const VikTrack *a, const VikTrack *b )
+{
+  GList *i, *j;
+
+  if ( a->visible != b->visible || ! same_string ( a->comment, b->comment ) )
+    return FALSE;
+  for ( i = a->trackpoints, j = b->trackpoints; i && j; i = i->next, j = j->next ) {
+    VikTrackpoint *p = i->data, *q = j->data;
+    if ( ! ( same_coord ( &(p->coord), &(q->coord) ) && p->newsegment == q->newsegment &&
+             p->has_timestamp == q->has_timestamp && p->timestamp == q->timestamp &&
+             SAME(p->altitude, q->altitude) && SAME(p->speed, q->speed) && SAME(p->course, q->course) &&
+             p->nsats == q->nsats && p->fix_mode == q->fix_mode &&
+             SAME(p->hdop, q->hdop) && SAME(p->vdop, q->vdop) && SAME(p->pdop, q->pdop) ) )
+      return FALSE;
+  }
+  return i == NULL && j == NULL;
+}
+
+static gint check_waypoints ( void )
+{
+  VikWaypoint *wp = vik_waypoint_new (), *wp2;
+  struct LatLon ll = { 47.5, 8.25 };
+  guint8 *data;
+  guint len, cut;
+  gint failures = 0;
+
+  vik_coord_load_from_latlon ( &(wp->coord), VIK_COORD_UTM, &ll );
+  wp->visible = TRUE;
+  wp->altitude = 432.1;
+  wp->image_width = wp->image_height = 0;
+  vik_waypoint_set_comment ( wp, "a comment" );
+  vik_waypoint_set_symbol ( wp, "flag" );
+
+  vik_waypoint_marshall ( wp, &data, &len );
+  wp2 = vik_waypoint_unmarshall ( data, len );
+  if ( ! wp2 || ! same_coord ( &(wp->coord), &(wp2->coord) ) || wp2->altitude != wp->altitude || wp2->visible != wp->visible ||
+       ! same_string ( wp2->comment, "a comment" ) || wp2->image != NULL || ! same_string ( wp2->symbol, "flag" ) ) {
+    fprintf ( stderr, "waypoint changed in a round trip\n" );
+    failures++;
+  }
+  if ( wp2 )
+    vik_waypoint_free ( wp2 );
+
+  for ( cut = 0; cut < len; cut++ )
+    if ( ( wp2 = vik_waypoint_unmarshall ( data, cut ) ) ) {
+      fprintf ( stderr, "waypoint read from %d of %d bytes\n", cut, len );
+      vik_waypoint_free ( wp2 );
+      failures++;
+    }
+
+  g_free ( data );
+  vik_waypoint_free ( wp );
+  return failures;
+}
+
+static gint check_tracks ( GRand *r )
+{
+  VikTrack *tr = make_track ( N_SMALL, r ), *tr2;
+  guint8 *data;
+  guint len, cut;
+  gint failures = 0;
+
+  vik_track_marshall ( tr, &data, &len );
+  tr2 = vik_track_unmarshall ( data, len );
+  if ( ! tr2 || ! same_track ( tr, tr2 ) ) {
+    fprintf ( stderr, "track changed in a round trip\n" );
+    failures++;
+  }
+  if ( tr2 )
+    vik_track_free ( tr2 );
+
+  for ( cut = 0; cut < len; cut++ )
+    if ( ( tr2 = vik_track_unmarshall ( data, cut ) ) ) {
+      fprintf ( stderr, "track read from %d of %d bytes\n", cut, len );
+      vik_track_free ( tr2 );
+      failures++;
+    }
+
+  /* a format this code doesn't know */
+  data[0]++;
+  if ( ( tr2 = vik_track_unmarshall ( data, len ) ) ) {
+    fprintf ( stderr, "track of another version read\n" );
+    vik_track_free ( tr2 );
+    failures++;
+  }
+
+  g_free ( data );
+  vik_track_free ( tr );
+  return failures;
+}
+
+static gint time_track ( GRand *r )
+{
+  VikTrack *tr = make_track ( N_POINTS, r ), *tr2;
+  GTimer *timer = g_timer_new ();
+  gdouble marshall, unmarshall;
+  guint8 *data;
+  guint len;
+  gint failures = 0;
+
+  vik_track_marshall ( tr, &data, &len );
+  marshall = g_timer_elapsed ( timer, NULL );
+  g_timer_start ( timer );
+  tr2 = vik_track_unmarshall ( data, len );
+  unmarshall = g_timer_elapsed ( timer, NULL );
+
+  if ( ! tr2 || ! same_track ( tr, tr2 ) ) {
+    fprintf ( stderr, "long track changed in a round trip\n" );
+    failures++;
+  }
+  printf ( "%d points, %.1f MB  marshall %6.1f ms (%.0f MB/s)  unmarshall %6.1f ms (%.0f MB/s)\n",
+           N_POINTS, len / 1e6, marshall * 1e3, len / 1e6 / marshall, unmarshall * 1e3, len / 1e6 / unmarshall );
+
+  if ( tr2 )
+    vik_track_free ( tr2 );
+  g_free ( data );
+  vik_track_free ( tr );
+  g_timer_destroy ( timer );
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  GRand *r = g_rand_new_with_seed ( 1 );
+  gint failures = 0;
+
+  failures += check_waypoints ();
+  failures += check_tracks ( r );
+  failures += time_track ( r );
+
+  g_rand_free ( r );
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
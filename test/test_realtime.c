@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <viking.h>
+#include "realtime.h"
+
+/* Checks reading NMEA and gpsd JSON logs, then replays a long drive
+ * through the recorder and checks its end of the list and totals
+ * against the track. */
+
+#define REPLAY_FIXES 50000
+
+static gint failures = 0;
+
+static void check ( gboolean ok, const gchar *what )
+{
+  if ( ! ok ) {
+    fprintf ( stderr, "%s\n", what );
+    failures++;
+  }
+}
+
+static void test_parse ( void )
+{
+  RealtimeFix fix;
+
+  memset ( &fix, 0, sizeof(fix) );
+  check ( ! a_realtime_parse_line ( &fix, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6B" ),
+          "NMEA: bad checksum taken" );
+  check ( a_realtime_parse_line ( &fix, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A" ),
+          "NMEA: RMC not taken" );
+  check ( fabs ( fix.latitude - 48.1173 ) < 1e-6 && fabs ( fix.longitude - 11.516667 ) < 1e-6, "NMEA: wrong position" );
+  check ( fix.time == 764426119, "NMEA: wrong time" );
+  check ( fabs ( fix.track - 84.4 ) < 1e-9 && fabs ( fix.speed - 22.4 * 0.514444 ) < 1e-3, "NMEA: wrong course" );
+  check ( fix.mode == VIK_GPS_MODE_2D, "NMEA: RMC is not a 2D fix" );
+
+  check ( ! a_realtime_parse_line ( &fix, "$GPGGA,123520,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*4D" ),
+          "NMEA: GGA completes a fix" );
+  check ( fix.satellites_used == 8 && fabs ( fix.altitude - 545.4 ) < 1e-9, "NMEA: GGA not read" );
+  a_realtime_parse_line ( &fix, "$GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39" );
+  check ( fix.mode == VIK_GPS_MODE_3D, "NMEA: GSA not read" );
+
+  memset ( &fix, 0, sizeof(fix) );
+  check ( ! a_realtime_parse_line ( &fix, "{\"class\":\"TPV\",\"mode\":1,\"time\":\"2010-04-30T11:48:20.10Z\"}" ),
+          "JSON: taken without a fix" );
+  check ( a_realtime_parse_line ( &fix, "{\"class\":\"TPV\",\"device\":\"/dev/ttyUSB0\",\"mode\":3,"
+                                        "\"time\":\"2010-04-30T11:48:20.10Z\",\"lat\":46.498204497,\"lon\":7.568061439,"
+                                        "\"alt\":1327.689,\"track\":10.3788,\"speed\":0.091}" ),
+          "JSON: TPV not taken" );
+  check ( fabs ( fix.latitude - 46.498204497 ) < 1e-9 && fabs ( fix.longitude - 7.568061439 ) < 1e-9 &&
+          fabs ( fix.altitude - 1327.689 ) < 1e-9 && fix.mode == VIK_GPS_MODE_3D, "JSON: wrong position" );
+  check ( fabs ( fix.time - 1272628100.1 ) < 1e-3, "JSON: wrong time" );
+  check ( ! a_realtime_parse_line ( &fix, "{\"class\":\"SKY\",\"satellites\":[]}" ), "JSON: SKY taken" );
+}
+
+/* a fix turning 5 degrees a second, so each one is kept */
+static void make_fix ( RealtimeFix *fix, guint i, gint mode )
+{
+  memset ( fix, 0, sizeof(RealtimeFix) );
+  fix->time = 1272628100 + i;
+  fix->latitude = 46.5 + i * 1e-4;
+  fix->longitude = 7.5 + ( i % 2 ) * 1e-4;
+  fix->altitude = NAN;
+  fix->track = ( i % 2 ) * 5;
+  fix->speed = 10;
+  fix->mode = mode;
+}
+
+static void test_replay ( void )
+{
+  RealtimeRecorder rec;
+  RealtimeFix fix;
+  VikTrack *tr = vik_track_new ();
+  gboolean replaced;
+  GList *before;
+  GTimer *timer;
+  guint i;
+
+  a_realtime_recorder_init ( &rec, tr, VIK_COORD_LATLON );
+
+  /* a 2D fix made good a second later takes its place */
+  make_fix ( &fix, 0, VIK_GPS_MODE_3D );
+  check ( a_realtime_recorder_add ( &rec, &fix, FALSE, &replaced ) && ! replaced, "first fix not recorded" );
+  make_fix ( &fix, 1, VIK_GPS_MODE_2D );
+  a_realtime_recorder_add ( &rec, &fix, FALSE, &replaced );
+  make_fix ( &fix, 2, VIK_GPS_MODE_3D );
+  fix.track = 0;
+  check ( a_realtime_recorder_add ( &rec, &fix, FALSE, &replaced ) && replaced, "2D fix not replaced" );
+  check ( rec.points == 2 && g_list_length ( tr->trackpoints ) == 2, "replacing added a point" );
+
+  /* same course, nothing new */
+  fix.time++;
+  check ( ! a_realtime_recorder_add ( &rec, &fix, FALSE, &replaced ), "a straight on fix was recorded" );
+
+  timer = g_timer_new ();
+  for ( i = 4; i < REPLAY_FIXES; i++ ) {
+    make_fix ( &fix, i, VIK_GPS_MODE_3D );
+    a_realtime_recorder_add ( &rec, &fix, FALSE, NULL );
+  }
+  printf ( "replayed %d fixes, %.2f us each\n", REPLAY_FIXES - 4, g_timer_elapsed ( timer, NULL ) * 1e6 / ( REPLAY_FIXES - 4 ) );
+  g_timer_destroy ( timer );
+
+  check ( rec.tail == g_list_last ( tr->trackpoints ), "tail is not the end of the track" );
+  check ( rec.points == g_list_length ( tr->trackpoints ), "point count is off" );
+  check ( fabs ( rec.length - vik_track_get_length ( tr ) ) < 1e-6 * rec.length, "length is off" );
+
+  /* the last point deleted by hand, as from the trackpoint window */
+  before = rec.tail->prev;
+  vik_trackpoint_free ( VIK_TRACKPOINT(rec.tail->data) );
+  tr->trackpoints = g_list_delete_link ( tr->trackpoints, rec.tail );
+  a_realtime_recorder_changed ( &rec );
+  make_fix ( &fix, i++, VIK_GPS_MODE_3D );
+  check ( a_realtime_recorder_add ( &rec, &fix, FALSE, NULL ) && rec.tail == g_list_last ( tr->trackpoints ),
+          "tail not found again after an edit" );
+  check ( rec.tail->prev == before, "recorded after an edit off the end" );
+
+  /* the last fix is kept when recording stops */
+  fix.time++;
+  a_realtime_recorder_add ( &rec, &fix, FALSE, NULL );
+  check ( a_realtime_recorder_flush ( &rec ) != NULL && rec.tail == g_list_last ( tr->trackpoints ), "last fix not flushed" );
+
+  a_realtime_recorder_clear ( &rec );
+  check ( tr->ref_count == 1, "track not released" );
+  vik_track_free ( tr );
+}
+
+int main ( int argc, char *argv[] )
+{
+  test_parse ();
+  test_replay ();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <viking.h>
+
+/* Checks where vik_track_split() cuts a track by each criterion and
+ * that the points are moved rather than copied, then times splitting
+ * a year of points logged every minute into days. */
+
+#define START 1199145600 /* 2008-01-01 00:00 UTC */
+#define YEAR_POINTS (366 * 24 * 60)
+
+/* n points 10 m apart going north, every step seconds from t0 */
+static VikTrack *make_track ( guint n, time_t t0, guint step )
+{
+  VikTrack *tr = vik_track_new ();
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    struct LatLon ll = { 47.0 + i * 10.0 / 111120.0, 8.0 };
+    vik_coord_load_from_latlon ( &(tp->coord), VIK_COORD_LATLON, &ll );
+    tp->has_timestamp = TRUE;
+    tp->timestamp = t0 + i * step;
+    tr->trackpoints = g_list_prepend ( tr->trackpoints, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tr->trackpoints );
+  return tr;
+}
+
+static void free_pieces ( VikTrack **pieces, guint n )
+{
+  guint i;
+  for ( i = 0; i < n; i++ )
+    vik_track_free ( pieces[i] );
+  g_free ( pieces );
+}
+
+/* splits tr and compares the piece lengths with expected, a 0 ended list */
+static gint check_split ( const gchar *what, VikTrack *tr, VikTrackSplit criterion, gdouble value, const guint *expected )
+{
+  gpointer first = tr->trackpoints ? tr->trackpoints->data : NULL;
+  guint n, i, want = 0;
+  VikTrack **pieces = vik_track_split ( tr, criterion, value, &n );
+  gint failures = 0;
+
+  while ( expected[want] )
+    want++;
+  if ( want < 2 ) {
+    if ( pieces || n ) {
+      fprintf ( stderr, "%s: cut where it shouldn't\n", what );
+      failures++;
+    }
+  } else if ( n != want ) {
+    fprintf ( stderr, "%s: %d pieces, expected %d\n", what, n, want );
+    failures++;
+  } else {
+    for ( i = 0; i < n; i++ )
+      if ( g_list_length ( pieces[i]->trackpoints ) != expected[i] ||
+           pieces[i]->trackpoints->prev || g_list_last ( pieces[i]->trackpoints )->next ) {
+        fprintf ( stderr, "%s: piece %d wrong\n", what, i );
+        failures++;
+      }
+    if ( pieces[0]->trackpoints->data != first || tr->trackpoints ) {
+      fprintf ( stderr, "%s: points were not moved\n", what );
+      failures++;
+    }
+  }
+  if ( pieces )
+    free_pieces ( pieces, n );
+  vik_track_free ( tr );
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  static const guint none[] = { 0 };
+  static const guint by_time[] = { 3, 4, 0 };
+  static const guint by_points[] = { 4, 4, 2, 0 };
+  static const guint by_day[] = { 3, 24, 21, 0 };
+  VikTrack *tr, **pieces;
+  GList *iter;
+  GTimer *timer;
+  guint n;
+  gint failures = 0;
+
+  g_setenv ( "TZ", "UTC", TRUE );
+  tzset ();
+
+  /* a 10 minute gap after the third point */
+  tr = make_track ( 7, START, 60 );
+  for ( iter = g_list_nth ( tr->trackpoints, 3 ); iter; iter = iter->next )
+    VIK_TRACKPOINT(iter->data)->timestamp += 600;
+  failures += check_split ( "time", tr, VIK_TRACK_SPLIT_TIME, 300, by_time );
+  failures += check_split ( "time, no gap", make_track ( 7, START, 60 ), VIK_TRACK_SPLIT_TIME, 300, none );
+
+  /* a 1 km jump after the third point */
+  tr = make_track ( 7, START, 60 );
+  for ( iter = g_list_nth ( tr->trackpoints, 3 ); iter; iter = iter->next )
+    VIK_TRACKPOINT(iter->data)->coord.north_south += 0.01;
+  failures += check_split ( "distance", tr, VIK_TRACK_SPLIT_DISTANCE, 500, by_time );
+  failures += check_split ( "distance, no gap", make_track ( 7, START, 60 ), VIK_TRACK_SPLIT_DISTANCE, 500, none );
+
+  failures += check_split ( "points", make_track ( 10, START, 60 ), VIK_TRACK_SPLIT_POINTS, 4, by_points );
+  failures += check_split ( "points, fewer", make_track ( 4, START, 60 ), VIK_TRACK_SPLIT_POINTS, 4, none );
+
+  /* hourly from 21:00 on one day to 20:00 two days later */
+  failures += check_split ( "day", make_track ( 48, START - 3 * 3600, 3600 ), VIK_TRACK_SPLIT_DAY, 0, by_day );
+  failures += check_split ( "day, within one", make_track ( 24, START, 3600 ), VIK_TRACK_SPLIT_DAY, 0, none );
+
+  tr = make_track ( YEAR_POINTS, START, 60 );
+  timer = g_timer_new ();
+  pieces = vik_track_split ( tr, VIK_TRACK_SPLIT_DAY, 0, &n );
+  printf ( "%d points into %d days in %.1f ms\n", YEAR_POINTS, n, g_timer_elapsed ( timer, NULL ) * 1e3 );
+  if ( n != 366 ) {
+    fprintf ( stderr, "a year cut into %d days\n", n );
+    failures++;
+  }
+  free_pieces ( pieces, n );
+  vik_track_free ( tr );
+  g_timer_destroy ( timer );
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}